@@ -0,0 +1,82 @@
+#include <batteryPolicy.h>
+
+// voltage under load below which a level is entered, none for normal
+static const float thresholds[BATTERY_LEVELS] = {
+    0, BATTERY_LOW_VOLTAGE, BATTERY_CRITICAL_VOLTAGE, BATTERY_SAFE_VOLTAGE};
+
+/*
+ * Recover one level at a time above the threshold plus hysteresis, drop
+ * right away below the threshold
+ */
+batteryLevel BatteryPolicy::update(float voltage) {
+    if (voltage < BATTERY_MIN_READING) { return this->health.level; }
+    float load = voltage - this->health.sag;
+    int level = this->health.level;
+    while (
+        level > BATTERY_NORMAL && load >= thresholds[level] + BATTERY_HYSTERESIS
+    ) {
+        level--;
+    }
+    while (level < BATTERY_SAFE && load < thresholds[level + 1]) { level++; }
+    this->health.level = (batteryLevel) level;
+    return this->health.level;
+}
+
+void BatteryPolicy::onLoad(float rest, float load) {
+    if (rest < BATTERY_MIN_READING || load < BATTERY_MIN_READING) { return; }
+    float sag = (rest > load) ? rest - load : 0;
+    if (this->health.samples < BATTERY_SAG_SAMPLES) { this->health.samples++; }
+    this->health.sag += (sag - this->health.sag) / this->health.samples;
+}
+
+batteryLevel BatteryPolicy::level() const {
+    return this->health.level;
+}
+
+uint32_t BatteryPolicy::interval(uint32_t interval) const {
+    switch (this->health.level) {
+        case BATTERY_LOW: return interval * BATTERY_LOW_FACTOR;
+        case BATTERY_CRITICAL:
+            return (interval > BATTERY_CRITICAL_INTERVAL) ?
+                interval : BATTERY_CRITICAL_INTERVAL;
+        case BATTERY_SAFE:
+            return (interval > BATTERY_SAFE_INTERVAL) ?
+                interval : BATTERY_SAFE_INTERVAL;
+        default: return interval;
+    }
+}
+
+uint16_t BatteryPolicy::gpsTimeout(uint16_t timeout) const {
+    uint16_t limit = timeout;
+    if (this->health.level == BATTERY_LOW) { limit = BATTERY_LOW_GPS_TIME_OUT; }
+    if (this->health.level >= BATTERY_CRITICAL) {
+        limit = BATTERY_CRITICAL_GPS_TIME_OUT;
+    }
+    return (timeout < limit) ? timeout : limit;
+}
+
+uint16_t BatteryPolicy::systemTimeout(uint16_t timeout) const {
+    if (this->health.level < BATTERY_CRITICAL) { return timeout; }
+    return (timeout < BATTERY_CRITICAL_SYSTEM_TIME_OUT) ?
+        timeout : BATTERY_CRITICAL_SYSTEM_TIME_OUT;
+}
+
+bool BatteryPolicy::retry() const {
+    return this->health.level < BATTERY_CRITICAL;
+}
+
+bool BatteryPolicy::extras() const {
+    return this->health.level == BATTERY_NORMAL;
+}
+
+bool BatteryPolicy::skipGps() const {
+    return this->health.level == BATTERY_SAFE;
+}
+
+batteryHealth BatteryPolicy::getHealth() const {
+    return this->health;
+}
+
+void BatteryPolicy::setHealth(const batteryHealth &health) {
+    this->health = health;
+}
@@ -0,0 +1,80 @@
+/*
+ * Reporting adapted to the battery. A buoy with a weak battery browns out
+ * during the current peak of an SBDIX session, so the policy judges the
+ * voltage expected under modem load, the voltage at rest minus the sag
+ * measured during past sessions. As it falls the policy
+ *
+ * - BATTERY_LOW: stretches the interval by BATTERY_LOW_FACTOR, caps the
+ *   GPS timeout and turns off extras (orbit refresh, GPS overlap, ring
+ *   listening, track wake ups)
+ * - BATTERY_CRITICAL: reports at most every BATTERY_CRITICAL_INTERVAL
+ *   without retries, shorter GPS and system timeouts
+ * - BATTERY_SAFE: skips the GPS and sends a minimal low battery message
+ *   every BATTERY_SAFE_INTERVAL
+ *
+ * A level is left once the voltage is BATTERY_HYSTERESIS above the
+ * threshold, so a recovering battery does not switch back and forth.
+ * Readings below BATTERY_MIN_READING (no battery, USB power) are ignored.
+ *
+ * The policy does not depend on hardware, voltages are passed by the caller.
+ */
+#ifndef __BATTERY_POLICY_H__
+#define __BATTERY_POLICY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stateType.h>
+
+// thresholds of the voltage under load, V
+#ifndef BATTERY_LOW_VOLTAGE
+#define BATTERY_LOW_VOLTAGE 3.5
+#endif
+#ifndef BATTERY_CRITICAL_VOLTAGE
+#define BATTERY_CRITICAL_VOLTAGE 3.4
+#endif
+#ifndef BATTERY_SAFE_VOLTAGE
+#define BATTERY_SAFE_VOLTAGE 3.3
+#endif
+#define BATTERY_HYSTERESIS 0.05
+#define BATTERY_MIN_READING 2.0
+// intervals, s, and timeouts, s
+#define BATTERY_LOW_FACTOR 2
+#define BATTERY_LOW_GPS_TIME_OUT 120
+#ifndef BATTERY_CRITICAL_INTERVAL
+#define BATTERY_CRITICAL_INTERVAL 21600
+#endif
+#define BATTERY_CRITICAL_GPS_TIME_OUT 60
+#define BATTERY_CRITICAL_SYSTEM_TIME_OUT 180
+#ifndef BATTERY_SAFE_INTERVAL
+#define BATTERY_SAFE_INTERVAL 86400
+#endif
+// the sag estimate averages the first BATTERY_SAG_SAMPLES sessions and
+// follows new ones exponentially after
+#define BATTERY_SAG_SAMPLES 8
+
+class BatteryPolicy {
+
+    private:
+        batteryHealth health;
+
+    public:
+        BatteryPolicy() {};
+        // update the level from the voltage at rest after wake up
+        batteryLevel update(float voltage);
+        // sag from the lowest voltage measured during an SBDIX session
+        void onLoad(float rest, float load);
+        batteryLevel level() const;
+        // reporting interval, s
+        uint32_t interval(uint32_t interval) const;
+        // GPS and system timeouts, s
+        uint16_t gpsTimeout(uint16_t timeout) const;
+        uint16_t systemTimeout(uint16_t timeout) const;
+        bool retry() const;
+        // GPS refresh and overlap, ring listening, track wake ups
+        bool extras() const;
+        bool skipGps() const;
+        batteryHealth getHealth() const;
+        void setHealth(const batteryHealth &health);
+};
+
+#endif
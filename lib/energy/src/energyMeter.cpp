@@ -0,0 +1,108 @@
+#include <energyMeter.h>
+
+// mAs per mAh and s per day
+#define SECS_IN_AN_HOUR 3600
+#define SECS_IN_A_DAY 86400
+
+float energyPerDay(const energyTotals &totals, size_t load) {
+    if (totals.seconds <= 0) { return 0; }
+    double charge = 0;
+    for (size_t i = 0; i < ENERGY_LOADS; i++) {
+        if (i == load || load == ENERGY_LOADS) { charge += totals.charge[i]; }
+    }
+    return charge / SECS_IN_AN_HOUR * SECS_IN_A_DAY / totals.seconds;
+}
+
+/*
+ * CPU awake and deep sleep don't overlap and make up the time
+ */
+void EnergyMeter::account(energyLoad load, double seconds) {
+    this->totals.charge[load] += seconds * this->current[load];
+    if (load == LOAD_CPU || load == LOAD_SLEEP) {
+        this->totals.seconds += seconds;
+    }
+}
+
+void EnergyMeter::set(energyLoad load, bool on, int64_t now) {
+    if (on == this->on[load]) { return; }
+    if (!on && now > this->since[load]) {
+        this->account(load, (now - this->since[load]) / 1E3);
+    }
+    this->on[load] = on;
+    this->since[load] = now;
+}
+
+bool EnergyMeter::isOn(energyLoad load) const {
+    return this->on[load];
+}
+
+void EnergyMeter::update(int64_t now) {
+    for (size_t i = 0; i < ENERGY_LOADS; i++) {
+        if (!this->on[i] || now <= this->since[i]) { continue; }
+        this->account((energyLoad) i, (now - this->since[i]) / 1E3);
+        this->since[i] = now;
+    }
+}
+
+/*
+ * The time the CPU was on so far is accounted at the former current
+ */
+void EnergyMeter::updateCpuCurrent(int64_t now) {
+    if (this->on[LOAD_CPU] && now > this->since[LOAD_CPU]) {
+        this->account(LOAD_CPU, (now - this->since[LOAD_CPU]) / 1E3);
+        this->since[LOAD_CPU] = now;
+    }
+    bool awake = !this->managed || this->locks > 0;
+    this->current[LOAD_CPU] = awake ? ENERGY_CPU_MA : ENERGY_LIGHT_SLEEP_MA;
+}
+
+void EnergyMeter::setPowerManaged(bool managed, int64_t now) {
+    this->managed = managed;
+    this->updateCpuCurrent(now);
+}
+
+void EnergyMeter::lock(bool hold, int64_t now) {
+    if (hold) {
+        this->locks++;
+    } else if (this->locks > 0) {
+        this->locks--;
+    }
+    this->updateCpuCurrent(now);
+}
+
+void EnergyMeter::startSleep(uint32_t seconds) {
+    this->totals.sleep = seconds;
+}
+
+/*
+ * The sleep is not part of the first phase awake
+ */
+void EnergyMeter::wake(bool timer) {
+    if (timer) {
+        this->account(LOAD_SLEEP, this->totals.sleep);
+        this->mark += this->totals.sleep * this->current[LOAD_SLEEP];
+    }
+    this->totals.sleep = 0;
+}
+
+float EnergyMeter::phase() {
+    double charge = 0;
+    for (size_t i = 0; i < ENERGY_LOADS; i++) {
+        charge += this->totals.charge[i];
+    }
+    float phase = (charge - this->mark) / SECS_IN_AN_HOUR;
+    this->mark = charge;
+    return phase;
+}
+
+energyTotals EnergyMeter::getTotals() const {
+    return this->totals;
+}
+
+void EnergyMeter::setTotals(const energyTotals &totals) {
+    this->totals = totals;
+    this->mark = 0;
+    for (size_t i = 0; i < ENERGY_LOADS; i++) {
+        this->mark += totals.charge[i];
+    }
+}
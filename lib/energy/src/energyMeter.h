@@ -0,0 +1,90 @@
+/*
+ * Energy accounting from the time each load is on. The battery voltage
+ * tells little about the charge drawn, so the firmware times its loads
+ * (CPU awake, GPS, Rockblock powered, SBDIX sessions, deep sleep) and
+ * multiplies the durations by a current profile. Totals are kept in RTC
+ * memory and give the mAh per day of each load to tune intervals and
+ * timeouts.
+ *
+ * Each load is switched by the task that owns it. The meter is not thread
+ * safe, callers in different tasks have to share a lock. It does not
+ * depend on hardware, times are passed by the caller in ms since wake up.
+ */
+#ifndef __ENERGY_METER_H__
+#define __ENERGY_METER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stateType.h>
+
+// current profile, mA at the supply. The CPU runs at 10 MHz, the SBDIX
+// current is the average over a session on top of the powered Rockblock.
+#ifndef ENERGY_CPU_MA
+#define ENERGY_CPU_MA 20
+#endif
+#ifndef ENERGY_GPS_MA
+#define ENERGY_GPS_MA 30
+#endif
+#ifndef ENERGY_ROCKBLOCK_MA
+#define ENERGY_ROCKBLOCK_MA 40
+#endif
+#ifndef ENERGY_SBDIX_MA
+#define ENERGY_SBDIX_MA 110
+#endif
+#ifndef ENERGY_SLEEP_MA
+#define ENERGY_SLEEP_MA 0.2
+#endif
+// CPU load with automatic light sleep while no power management lock is
+// held, the chip sleeps whenever all tasks wait
+#ifndef ENERGY_LIGHT_SLEEP_MA
+#define ENERGY_LIGHT_SLEEP_MA 1
+#endif
+// send the energy record with the first report after this time, s
+#ifndef ENERGY_REPORT_INTERVAL
+#define ENERGY_REPORT_INTERVAL 86400
+#endif
+
+// mAh per day of a load, ENERGY_LOADS for the sum, 0 before any time is
+// accounted
+float energyPerDay(const energyTotals &totals, size_t load);
+
+class EnergyMeter {
+
+    private:
+        energyTotals totals;
+        float current[ENERGY_LOADS] = {ENERGY_CPU_MA, ENERGY_GPS_MA,
+            ENERGY_ROCKBLOCK_MA, ENERGY_SBDIX_MA, ENERGY_SLEEP_MA};
+        bool on[ENERGY_LOADS] = {false};
+        int64_t since[ENERGY_LOADS] = {0};
+        // charge at the last phase mark, mAs
+        double mark = 0;
+        // automatic light sleep and power management locks held
+        bool managed = false;
+        uint8_t locks = 0;
+        void account(energyLoad load, double seconds);
+        void updateCpuCurrent(int64_t now);
+
+    public:
+        EnergyMeter() {};
+        // switch a load on or off, the time it was on is accounted
+        void set(energyLoad load, bool on, int64_t now);
+        bool isOn(energyLoad load) const;
+        // account loads that are on up to now, e.g. before storing
+        void update(int64_t now);
+        // with automatic light sleep the CPU draws ENERGY_CPU_MA only while
+        // a power management lock is held, ENERGY_LIGHT_SLEEP_MA otherwise
+        void setPowerManaged(bool managed, int64_t now);
+        // a power management lock was acquired or released
+        void lock(bool hold, int64_t now);
+        // keep the programmed deep sleep, accounted by wake()
+        void startSleep(uint32_t seconds);
+        // account the sleep after a timer wake up, a reset or power on
+        // ends it at an unknown time and drops it
+        void wake(bool timer);
+        // charge drawn since the last call, mAh, up to the last update
+        float phase();
+        energyTotals getTotals() const;
+        void setTotals(const energyTotals &totals);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include <math.h>
+#include <courseAverage.h>
+
+#define DEG_TO_RAD_FACTOR (M_PI / 180.0)
+
+
+void CourseAverage::reset() {
+    this->east = 0;
+    this->north = 0;
+    this->count = 0;
+    this->last_time = 0;
+}
+
+/*
+ * Gps reports the same fix until the next one arrived, the time tells them
+ * apart
+ */
+bool CourseAverage::add(time_t time, float speed, float course) {
+    if (this->count > 0 && time == this->last_time) { return false; }
+    this->east += speed * sin(course * DEG_TO_RAD_FACTOR);
+    this->north += speed * cos(course * DEG_TO_RAD_FACTOR);
+    this->count++;
+    this->last_time = time;
+    return true;
+}
+
+uint16_t CourseAverage::samples() const { return this->count; }
+
+float CourseAverage::speed() const {
+    if (this->count == 0) { return 0; }
+    return sqrt(this->east * this->east + this->north * this->north) /
+        this->count;
+}
+
+float CourseAverage::course() const {
+    if (this->count == 0) { return 0; }
+    float course = atan2(this->east, this->north) / DEG_TO_RAD_FACTOR;
+    return (course < 0) ? course + 360 : course;
+}
@@ -0,0 +1,38 @@
+/*
+ * Speed and course over ground averaged over successive fixes. A single
+ * fix reports the speed and heading of that moment, a buoy moved by waves
+ * swings around its drift. Velocities are averaged as east and north
+ * components, so headings around north do not cancel out and random
+ * movements average to zero while the drift remains.
+ *
+ * Does not depend on hardware, fixes are passed by the caller.
+ */
+#ifndef __COURSE_AVERAGE_H__
+#define __COURSE_AVERAGE_H__
+
+#include <stdint.h>
+#include <time.h>
+
+class CourseAverage {
+
+    private:
+        // sums of the velocity components, knots
+        float east = 0;
+        float north = 0;
+        uint16_t count = 0;
+        time_t last_time = 0;
+
+    public:
+        CourseAverage() {};
+        void reset();
+        // add the speed (knots) and course (degrees) of a fix, a fix with
+        // the time of the last one is ignored, returns whether it was added
+        bool add(time_t time, float speed, float course);
+        uint16_t samples() const;
+        // speed over ground, knots
+        float speed() const;
+        // course over ground, degrees from 0 to 360
+        float course() const;
+};
+
+#endif
@@ -1,6 +1,6 @@
 #include <gps.h>
 
-Gps::Gps(Expander &expander, HardwareSerial &serial, uint8_t enable_pin) {
+Gps::Gps(Expander &expander, AbstractSerial &serial, uint8_t enable_pin) {
     this->expander = &expander;
     this->serial = &serial;
     this->enable_pin = enable_pin;
@@ -11,11 +11,26 @@ Gps::Gps(Expander &expander, HardwareSerial &serial, uint8_t enable_pin) {
  */
 void Gps::enable() {
     // flush Serial buffer
-    if (this->serial->available()) this->serial->read();
+    while (this->serial->readBytes(
+        this->read_buffer, sizeof(this->read_buffer)) > 0) {}
     this->expander->pinMode(this->enable_pin, EXPANDER_OUTPUT);
     this->expander->digitalWrite(this->enable_pin, HIGH);
     this->enabled = true;
+    // don't pair sentences from before the GPS was off
+    this->gps_parser.reset();
+    // the receiver forgets its configuration when off
+    this->ubx_parser.reset();
+    this->configuring = false;
+    this->ubx_active = false;
+    this->ubx_fallback = false;
+    if (this->baud != GPS_SERIAL_SPEED) {
+        this->baud = GPS_SERIAL_SPEED;
+        this->serial->updateBaudRate(this->baud);
+    }
     this->start_time = esp_timer_get_time() / 1E6;
+    this->enable_time = esp_timer_get_time();
+    this->ttff = 0;
+    this->aided = false;
 }
 
 /*
@@ -26,27 +41,147 @@ void Gps::disable() {
     this->expander->digitalWrite(this->enable_pin, LOW);
 }
 
+void Gps::setConfig(const UbxSettings &settings) {
+    this->settings = settings;
+}
+
+void Gps::setAiding(float lat, float lng, uint32_t position_accuracy,
+    time_t time, uint16_t time_accuracy
+) {
+    this->aiding = true;
+    this->aid_lat = lround(lat * 1E7);
+    this->aid_lng = lround(lng * 1E7);
+    this->aid_position_accuracy = position_accuracy;
+    this->aid_time = time;
+    this->aid_time_accuracy = time_accuracy;
+    this->aid_set_time = esp_timer_get_time();
+}
+
+/*
+ * Time first, then position. Aiding is not acknowledged by default.
+ */
+void Gps::sendAiding() {
+    uint8_t frame[32];
+    time_t time = this->aid_time +
+        (esp_timer_get_time() - this->aid_set_time) / 1000000;
+    this->send(frame, ubxAidTime(frame, sizeof(frame), time,
+        this->aid_time_accuracy));
+    // accuracy in cm, capped at about 40000 km
+    uint32_t accuracy = (this->aid_position_accuracy < 40000000) ?
+        this->aid_position_accuracy * 100 : 4000000000;
+    this->send(frame, ubxAidPosition(frame, sizeof(frame), this->aid_lat,
+        this->aid_lng, accuracy));
+    this->aided = true;
+    Serial.println("GPS: aiding sent");
+}
+
+void Gps::send(const uint8_t *bfr, size_t len) {
+    if (len > 0) { this->serial->write(bfr, len); }
+}
+
+/*
+ * Returns true if a NAV-PVT with a fix arrived. The first NAV-PVT turns NMEA
+ * output off.
+ */
+bool Gps::feedUbx(const uint8_t *bfr, size_t len) {
+    bool fix = false;
+    size_t used = 0;
+    while (used < len) {
+        used += this->ubx_parser.feed(bfr + used, len - used);
+        this->config.onMessage(this->ubx_parser);
+        if (!this->ubx_parser.is(UBX_CLASS_NAV, UBX_NAV_PVT)) { continue; }
+        fix |= this->ubx_parser.navPvt(&this->fix);
+        if (!this->ubx_active) {
+            Serial.println("GPS: NAV-PVT received, NMEA off");
+            this->ubx_active = true;
+            this->config.setOutput(UBX_PROTOCOL_UBX);
+        }
+    }
+    return fix;
+}
+
 /*
- * Run t
+ * Start the configuration once the receiver is up, i.e. sends anything, and
+ * send the next message when the previous one is acknowledged. Stay on NMEA
+ * if the receiver rejected NAV-PVT or there is none after
+ * UBX_FALLBACK_TIMEOUT.
+ */
+void Gps::configure(bool received) {
+    char msg[64];
+    uint8_t frame[48];
+    int64_t now = esp_timer_get_time() / 1000;
+    if (!this->configuring) {
+        if (!received) { return; }
+        if (this->aiding) { this->sendAiding(); }
+        this->config.begin(this->settings, this->baud);
+        this->configuring = true;
+        this->config_time = 0;
+    }
+    this->send(frame, this->config.poll(now, frame, sizeof(frame)));
+    if (this->config.baud != this->baud) {
+        this->baud = this->config.baud;
+        this->serial->updateBaudRate(this->baud);
+    }
+    if (!this->config.done() || this->config_time) { return; }
+    this->config_time = now;
+    snprintf(msg, sizeof(msg), "GPS: configured at %lu baud, rejected %#x",
+        (unsigned long) this->baud, this->config.rejected);
+    Serial.println(msg);
+    if (
+        this->settings.nav_pvt && !this->ubx_active &&
+        !this->config.isAcked(UBX_STEP_NAV_PVT)
+    ) {
+        Serial.println("GPS: no NAV-PVT, staying with NMEA");
+        this->ubx_fallback = true;
+    }
+}
+
+/*
+ * Run the parsers over everything received since the last call, updated is
+ * set if a complete fix arrived: NAV-PVT, or RMC and GGA of the same second
  */
 void Gps::loop() {
-    char character;
-    while(this->serial->available()) {
-        character = this->serial->read();
-        this->gps_parser.encode(character);
+    size_t len;
+    bool fix = false;
+    bool received = false;
+    int64_t now = esp_timer_get_time() / 1000;
+    // acknowledgements or NAV-PVT to expect
+    bool use_ubx = !this->config.done() || !this->configuring || (
+        this->settings.nav_pvt && !this->ubx_fallback);
+    while ((len = this->serial->readBytes(
+        this->read_buffer, sizeof(this->read_buffer))) > 0) {
+        received = true;
+        if (use_ubx) {
+            fix |= this->feedUbx((const uint8_t*) this->read_buffer, len);
+        }
+        // NMEA until NAV-PVT arrives
+        if (this->ubx_active) { continue; }
+        if (this->gps_parser.feed(this->read_buffer, len)) {
+            this->fix = this->gps_parser.fix;
+            fix = true;
+        }
     }
+    this->configure(received);
     if (
-        this->gps_parser.time.isValid() && gps_parser.time.isUpdated() &&
-        this->gps_parser.date.isValid() && gps_parser.date.isUpdated() &&
-        this->gps_parser.location.isValid() && gps_parser.location.isUpdated()
+        this->settings.nav_pvt && !this->ubx_active && !this->ubx_fallback &&
+        this->config_time && now - this->config_time >= UBX_FALLBACK_TIMEOUT
     ) {
+        Serial.println("GPS: no NAV-PVT, staying with NMEA");
+        this->ubx_fallback = true;
+    }
+    if (fix) {
         this->gps_read_system_time = esp_timer_get_time();
-        this->epoch = this->time_to_epoch(
-            this->gps_parser.date, this->gps_parser.time);
-        this->lat = this->gps_parser.location.lat();
-        this->lng = this->gps_parser.location.lng();
-        this->speed = this->gps_parser.speed.knots();
-        this->heading = this->gps_parser.course.deg();
+        this->epoch = this->time_to_epoch(this->fix);
+        this->lat = this->fix.lat / 1E7;
+        this->lng = this->fix.lng / 1E7;
+        this->speed = this->fix.speed / 100.0;
+        this->heading = this->fix.course / 100.0;
+        this->hdop = this->fix.hdop ? this->fix.hdop : this->fix.pdop;
+        this->satellites = this->fix.satellites;
+        if (!this->ttff) {
+            this->ttff = (this->gps_read_system_time - this->enable_time) /
+                1000;
+        }
         this->updated = true;
     } else this->updated = false;
 }
@@ -61,13 +196,13 @@ time_t Gps::get_corrected_epoch() {
 };
 
 // assume that 1 second precision is enough for our purposes
-time_t Gps::time_to_epoch(TinyGPSDate date, TinyGPSTime time) {
+time_t Gps::time_to_epoch(const NmeaFix &fix) {
     struct tm t={0};
-    t.tm_year = date.year() - 1900;
-    t.tm_mon = date.month() - 1;
-    t.tm_mday = date.day();
-    t.tm_hour = time.hour();
-    t.tm_min = time.minute();
-    t.tm_sec = time.second();
+    t.tm_year = fix.year - 1900;
+    t.tm_mon = fix.month - 1;
+    t.tm_mday = fix.day;
+    t.tm_hour = fix.hour;
+    t.tm_min = fix.minute;
+    t.tm_sec = fix.second;
     return mktime(&t);
 }
@@ -1,23 +1,63 @@
 /*
- * Light weight GPS class relying non Arduino TinyGPS for parsing
+ * Light weight GPS class, NMEA is parsed by NmeaParser (nmea.h). Once the
+ * receiver talks after power on it is configured (UbxConfig in ubx.h):
+ * unused sentences off, constellations, power mode, UART rate. With NAV-PVT
+ * requested NMEA output is turned off once NAV-PVT arrives. Receivers
+ * without NAV-PVT stay on NMEA. An estimate of time and position set with
+ * setAiding() is sent before the configuration to shorten the time to first
+ * fix.
  */
 #ifndef __GPS_H__
 #define __GPS_H__
 #include <Arduino.h>
-#include <HardwareSerial.h>
-#include <TinyGPSPlus.h>
 // project
+#include <hal.h>
 #include <tca95xx.h>
+#include <nmea.h>
+#include <ubx.h>
 
+#ifndef GPS_SERIAL_SPEED
+#define GPS_SERIAL_SPEED 9600
+#endif
+// stay on NMEA if there is no NAV-PVT within this time after configuring, ms
+#define UBX_FALLBACK_TIMEOUT 5000
 
 class Gps {
 
 private:
+    // NMEA is read in bulk
     char read_buffer[255];
-    time_t time_to_epoch(TinyGPSDate date, TinyGPSTime time);
-    HardwareSerial* serial;
+    time_t time_to_epoch(const NmeaFix &fix);
+    AbstractSerial* serial;
     Expander* expander;
-    TinyGPSPlus gps_parser;
+    NmeaParser gps_parser;
+    UbxParser ubx_parser;
+    // latest fix of either parser
+    NmeaFix fix;
+    UbxSettings settings = {false, 0, 0, false};
+    UbxConfig config;
+    // configuration started, NAV-PVT received, NAV-PVT not supported
+    bool configuring = false;
+    bool ubx_active = false;
+    bool ubx_fallback = false;
+    // UART rate in use
+    uint32_t baud = GPS_SERIAL_SPEED;
+    // end of the configuration, ms
+    int64_t config_time = 0;
+    // estimate for the next enable(), time as of aid_set_time (us)
+    bool aiding = false;
+    int32_t aid_lat = 0;
+    int32_t aid_lng = 0;
+    uint32_t aid_position_accuracy = 0;
+    time_t aid_time = 0;
+    uint16_t aid_time_accuracy = 0;
+    int64_t aid_set_time = 0;
+    // enable(), us
+    int64_t enable_time = 0;
+    void sendAiding();
+    bool feedUbx(const uint8_t *bfr, size_t len);
+    void configure(bool received);
+    void send(const uint8_t *bfr, size_t len);
     uint8_t enable_pin;
     bool enabled = false;
     time_t start_time = 0;
@@ -33,11 +73,24 @@ public:
     // implement those mainly for compatibility
     float speed;
     float heading;
+    // HDOP in 1/100 (PDOP from UBX), 0 if unknown, and satellites used
+    uint16_t hdop = 0;
+    uint8_t satellites = 0;
+    // ms from enable() to the first fix, 0 until then
+    uint32_t ttff = 0;
+    // aiding was sent after the last enable()
+    bool aided = false;
     // Constructor
-    Gps(Expander &expander, HardwareSerial &seria, uint8_t enable_pin);
+    Gps(Expander &expander, AbstractSerial &serial, uint8_t enable_pin);
     // Methods
     // Return epoch corrected by the time passed since last GPS read.
     time_t get_corrected_epoch();
+    // receiver settings, take effect with the next enable()
+    void setConfig(const UbxSettings &settings);
+    // estimated position (m) and time (s) with their accuracy, sent after
+    // the next enable(). Needs a u-blox M8 or later, others ignore it.
+    void setAiding(float lat, float lng, uint32_t position_accuracy,
+        time_t time, uint16_t time_accuracy);
     void enable();
     void disable();
     void loop();
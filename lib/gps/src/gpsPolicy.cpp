@@ -0,0 +1,120 @@
+#include <gpsPolicy.h>
+
+// Upper bounds of the time to first fix buckets in seconds, the last one
+// takes everything above
+static const uint16_t ttffBuckets[GPS_TTFF_BUCKETS] = {
+    10, 20, 30, 45, 60, 90, 150, GPS_TIME_OUT};
+
+
+GpsPolicy::GpsPolicy() {}
+
+uint16_t GpsPolicy::fixes() {
+    uint16_t fixes = 0;
+    for (size_t i = 0; i < GPS_TTFF_BUCKETS; i++) {
+        fixes += this->history.ttff[i];
+    }
+    return fixes;
+}
+
+/*
+ * Halve the counts at the limit, the totals with them to keep the averages
+ */
+void GpsPolicy::age() {
+    if (this->fixes() + this->history.timeouts < GPS_HISTORY_LIMIT) { return; }
+    for (size_t i = 0; i < GPS_TTFF_BUCKETS; i++) {
+        this->history.ttff[i] /= 2;
+    }
+    this->history.timeouts /= 2;
+    for (size_t i = 0; i < 2; i++) {
+        this->history.fixes[i] /= 2;
+        this->history.ttff_total[i] /= 2;
+    }
+}
+
+/*
+ * Success rate from history, smoothed with a prior of all fixes
+ */
+float GpsPolicy::successRate() {
+    float fixes = this->fixes() + GPS_PRIOR_WEIGHT;
+    return fixes / (fixes + this->history.timeouts);
+}
+
+/*
+ * Margin over the time to first fix of GPS_TTFF_QUANTILE of the wake ups.
+ * The prior counts as fixes at GPS_TIME_OUT.
+ */
+uint16_t GpsPolicy::timeout() {
+    uint8_t misses = this->history.misses;
+    if (misses == 1 || (misses > 1 && misses % GPS_FULL_ATTEMPT_EVERY == 0)) {
+        return GPS_TIME_OUT;
+    }
+    if (misses > 1) { return GPS_MISS_TIME_OUT; }
+    if (this->successRate() < GPS_MIN_SUCCESS_RATE) { return GPS_TIME_OUT; }
+    float target = (this->fixes() + GPS_PRIOR_WEIGHT) * GPS_TTFF_QUANTILE;
+    uint16_t count = 0;
+    uint16_t bound = GPS_TIME_OUT;
+    for (size_t i = 0; i < GPS_TTFF_BUCKETS; i++) {
+        count += this->history.ttff[i];
+        if (count >= target) {
+            bound = ttffBuckets[i];
+            break;
+        }
+    }
+    uint32_t timeout = bound * GPS_TIME_OUT_MARGIN;
+    if (timeout < GPS_MIN_TIME_OUT) { return GPS_MIN_TIME_OUT; }
+    return (timeout < GPS_TIME_OUT) ? timeout : GPS_TIME_OUT;
+}
+
+uint16_t GpsPolicy::acceptHdop() {
+    uint16_t hdop = this->history.hdop + this->history.hdop / 4;
+    return (hdop > GPS_ACCEPT_HDOP) ? hdop : GPS_ACCEPT_HDOP;
+}
+
+bool GpsPolicy::acceptable(uint16_t hdop, uint8_t satellites) {
+    if (satellites < GPS_MIN_SATELLITES) { return false; }
+    return hdop == 0 || hdop <= this->acceptHdop();
+}
+
+/*
+ * HDOP and satellites are averaged with a weight of 1/4 for the new fix
+ */
+void GpsPolicy::onFix(uint32_t ttff, uint16_t hdop, uint8_t satellites,
+    bool aided
+) {
+    size_t bucket = 0;
+    while (
+        bucket < GPS_TTFF_BUCKETS - 1 && ttff > ttffBuckets[bucket] * 1000U
+    ) {
+        bucket++;
+    }
+    this->age();
+    this->history.ttff[bucket]++;
+    this->history.fixes[aided]++;
+    this->history.ttff_total[aided] += ttff;
+    this->history.misses = 0;
+    if (hdop) {
+        this->history.hdop = this->history.hdop ?
+            (3 * this->history.hdop + hdop) / 4 : hdop;
+    }
+    this->history.satellites = this->history.satellites ?
+        (3 * this->history.satellites + satellites) / 4 : satellites;
+}
+
+uint32_t GpsPolicy::averageTtff(bool aided) {
+    uint16_t fixes = this->history.fixes[aided];
+    return fixes ? this->history.ttff_total[aided] / fixes : 0;
+}
+
+void GpsPolicy::onTimeout() {
+    this->age();
+    this->history.timeouts++;
+    if (this->history.misses < UINT8_MAX) { this->history.misses++; }
+}
+
+gpsHistory GpsPolicy::getHistory() {
+    return this->history;
+}
+
+void GpsPolicy::setHistory(const gpsHistory &history) {
+    this->history = history;
+}
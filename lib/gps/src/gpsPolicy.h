@@ -0,0 +1,73 @@
+/*
+ * GPS timeout and fix acceptance learned from past wake ups. The GPS is the
+ * largest part of the awake time, hence the policy decides
+ *
+ * - how long to wait for a fix: a margin over the time to first fix most
+ *   wake ups needed, at most GPS_TIME_OUT. After a timeout the next wake up
+ *   waits GPS_TIME_OUT to tell a short timeout from a buoy that cannot see
+ *   the sky (underwater, upside down). Further timeouts only wait
+ *   GPS_MISS_TIME_OUT, except for every GPS_FULL_ATTEMPT_EVERY one.
+ * - which fix is good enough to be accepted right away: HDOP close to that
+ *   of past fixes and enough satellites. Other fixes are kept as candidate
+ *   for up to GPS_QUALITY_WAIT seconds while waiting for a better one.
+ *
+ * The policy does not depend on hardware, times are passed by the caller.
+ */
+#ifndef __GPS_POLICY_H__
+#define __GPS_POLICY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stateType.h>
+
+// longest time to wait for a fix, s
+#ifndef GPS_TIME_OUT
+#define GPS_TIME_OUT 240
+#endif
+// shortest learned timeout and timeout after repeated misses, s
+#define GPS_MIN_TIME_OUT 60
+#define GPS_MISS_TIME_OUT 30
+#define GPS_FULL_ATTEMPT_EVERY 4
+// timeout is a margin over this share of past times to first fix
+#define GPS_TTFF_QUANTILE 0.9
+#define GPS_TIME_OUT_MARGIN 2
+// weight of the prior (all fixes at GPS_TIME_OUT) in wake ups
+#define GPS_PRIOR_WEIGHT 2
+// below this success rate the history does not shorten the timeout
+#define GPS_MIN_SUCCESS_RATE 0.5
+// counts are halved when reaching the limit, recent wake ups count more
+#define GPS_HISTORY_LIMIT 100
+// fix quality accepted right away: satellites and HDOP (1/100), at least
+// GPS_ACCEPT_HDOP or a quarter above the average of past fixes
+#define GPS_MIN_SATELLITES 5
+#define GPS_ACCEPT_HDOP 200
+// time to wait for a better fix after the first one, s
+#define GPS_QUALITY_WAIT 20
+
+class GpsPolicy {
+
+    private:
+        gpsHistory history;
+        uint16_t fixes();
+        void age();
+
+    public:
+        GpsPolicy();
+        // timeout for this wake up, s
+        uint16_t timeout();
+        float successRate();
+        // HDOP (1/100) accepted right away
+        uint16_t acceptHdop();
+        // good enough to be accepted without waiting, hdop 0 if unknown
+        bool acceptable(uint16_t hdop, uint8_t satellites);
+        // record the accepted fix of a wake up, ttff in ms
+        void onFix(uint32_t ttff, uint16_t hdop, uint8_t satellites,
+            bool aided);
+        // average time to first fix with or without aiding, ms
+        uint32_t averageTtff(bool aided);
+        void onTimeout();
+        gpsHistory getHistory();
+        void setHistory(const gpsHistory &history);
+};
+
+#endif
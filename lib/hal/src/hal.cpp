@@ -23,20 +23,194 @@
  */
 HardwareSerial hws(2);
 
-RockblockSerial::RockblockSerial() {
-    this->serial = &hws;
-};
+EventSerial::EventSerial(HardwareSerial &serial, size_t rx_buffer_size,
+    bool only_on_timeout
+) {
+    this->serial = &serial;
+    this->rx_buffer_size = rx_buffer_size;
+    this->only_on_timeout = only_on_timeout;
+}
 
-void RockblockSerial::begin(uint16_t serialSpeed, int serial8N1, uint8_t rxPin,
+/*
+ * The RX buffer size has to be set before the UART driver is installed
+ */
+void EventSerial::begin(uint32_t serialSpeed, int serial8N1, uint8_t rxPin,
     uint8_t txPin) {
+        this->serial->setRxBufferSize(this->rx_buffer_size);
         this->serial->begin(serialSpeed, serial8N1, rxPin, txPin);
-        // Serial.println("ROCKBLOCK SERIAL BEGIN SUCCESS");
+        // runs in the UART event task, not in an interrupt
+        this->serial->onReceive([this]() {
+            portENTER_CRITICAL(&this->task_lock);
+            if (this->task != NULL) { xTaskNotifyGive(this->task); }
+            portEXIT_CRITICAL(&this->task_lock);
+        }, this->only_on_timeout);
+        this->serial->onReceiveError([this](hardwareSerial_error_t error) {
+            if (
+                error == UART_BUFFER_FULL_ERROR ||
+                error == UART_FIFO_OVF_ERROR
+            ) { this->overflows++; }
+        });
+    }
+
+void EventSerial::print(const char *bfr) { this->serial->print(bfr); }
+
+size_t EventSerial::write(const uint8_t *bfr, size_t len) {
+    return this->serial->write(bfr, len);
+}
+
+char EventSerial::read() { return this->serial->read(); }
+
+bool EventSerial::available() { return this->serial->available(); }
+
+size_t EventSerial::readBytes(char *bfr, size_t len) {
+    size_t available = this->serial->available();
+    if (available == 0) { return 0; }
+    return this->serial->read(
+        (uint8_t*) bfr, (available < len) ? available : len);
+}
+
+/*
+ * Notifications that arrived while the task was busy wake it right away,
+ * data is read in bulk anyway
+ */
+bool EventSerial::waitForData(uint32_t timeout) {
+    if (this->serial->available()) { return true; }
+    this->task = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout));
+    this->detach();
+    return this->serial->available();
+}
+
+/*
+ * The UART keeps receiving after the waiting task has been deleted, it must
+ * not be notified anymore
+ */
+void EventSerial::detach() {
+    portENTER_CRITICAL(&this->task_lock);
+    this->task = NULL;
+    portEXIT_CRITICAL(&this->task_lock);
+}
+
+void EventSerial::updateBaudRate(uint32_t serialSpeed) {
+    this->serial->flush();
+    this->serial->updateBaudRate(serialSpeed);
+}
+
+RockblockSerial::RockblockSerial() :
+    EventSerial(hws, ROCKBLOCK_SERIAL_RX_BUFFER) {}
+
+bool enablePowerManagement(int max_mhz, int min_mhz) {
+    esp_pm_config_esp32_t config = {};
+    config.max_freq_mhz = max_mhz;
+    config.min_freq_mhz = min_mhz;
+    config.light_sleep_enable = true;
+    return esp_pm_configure(&config) == ESP_OK;
+}
+
+PowerLock::PowerLock(esp_pm_lock_type_t type, const char *name) {
+    this->type = type;
+    this->name = name;
+}
+
+void PowerLock::begin() {
+    if (this->handle != NULL) { return; }
+    esp_err_t err = esp_pm_lock_create(
+        this->type, 0, this->name, &this->handle);
+    if (err != ESP_OK) { this->handle = NULL; }
+}
+
+/*
+ * The flag is set before acquiring and cleared after releasing. A task
+ * deleted in between leaves it set, releasing an unacquired lock again only
+ * returns an error.
+ */
+void PowerLock::hold(bool hold) {
+    if (this->handle == NULL || hold == this->held) { return; }
+    if (hold) {
+        this->held = true;
+        esp_pm_lock_acquire(this->handle);
+    } else {
+        esp_pm_lock_release(this->handle);
+        this->held = false;
     }
+}
+
+uint32_t deviceSeed() {
+    uint64_t mac = ESP.getEfuseMac();
+    return (uint32_t) mac ^ (uint32_t) (mac >> 32);
+}
+
+#endif
+
+#ifdef NATIVE
+#include <stdio.h>
+#include <string.h>
+
+NativeSerial Serial;
+
+void NativeSerial::print(const char *bfr) {
+    if (this->echo) { printf("%s", bfr); }
+}
+
+void NativeSerial::print(long val) {
+    if (this->echo) { printf("%ld", val); }
+}
+
+void NativeSerial::println(const char *bfr) {
+    if (this->echo) { printf("%s\n", bfr); }
+}
 
-void RockblockSerial::print(const char *bfr) { this->serial->print(bfr); }
+void NativeSerial::println(long val) {
+    if (this->echo) { printf("%ld\n", val); }
+}
 
-char RockblockSerial::read() { return this->serial->read(); }
+static int64_t nativeTime = 0;
 
-bool RockblockSerial::available() { return this->serial->available(); }
+uint32_t deviceSeed() { return 0x2545f491; }
 
-#endif
\ No newline at end of file
+int64_t esp_timer_get_time() { return nativeTime; }
+
+void advanceNativeTime(int64_t us) { nativeTime += us; }
+
+void setNativeTime(int64_t us) { nativeTime = us; }
+
+void LoopbackSerial::print(const char *bfr) {
+    this->write((const uint8_t*) bfr, strlen(bfr));
+}
+
+size_t LoopbackSerial::write(const uint8_t *bfr, size_t len) {
+    size_t space = LOOPBACK_BUFFER_SIZE - this->tx_len;
+    len = (len < space) ? len : space;
+    memcpy(this->tx + this->tx_len, bfr, len);
+    this->tx_len += len;
+    return len;
+}
+
+char LoopbackSerial::read() {
+    char c = 0;
+    this->readBytes(&c, 1);
+    return c;
+}
+
+bool LoopbackSerial::available() { return this->rx_len > 0; }
+
+size_t LoopbackSerial::readBytes(char *bfr, size_t len) {
+    len = (len < this->rx_len) ? len : this->rx_len;
+    memcpy(bfr, this->rx + this->rx_head, len);
+    this->rx_head += len;
+    this->rx_len -= len;
+    return len;
+}
+
+size_t LoopbackSerial::inject(const char *bfr, size_t len) {
+    // move unread bytes to the front
+    memmove(this->rx, this->rx + this->rx_head, this->rx_len);
+    this->rx_head = 0;
+    size_t space = LOOPBACK_BUFFER_SIZE - this->rx_len;
+    len = (len < space) ? len : space;
+    memcpy(this->rx + this->rx_len, bfr, len);
+    this->rx_len += len;
+    return len;
+}
+
+#endif
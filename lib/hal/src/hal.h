@@ -1,18 +1,20 @@
 /*
  * Abstract hardware dependencies for native development
  *
- * TODO: Native development has not been fully implemented because
- * of time consuming difficulties. All tests need to run on the 
- * LilyGO board used in the project, however just the board (peripherials 
- * not required) should be sufficient for testing.
+ * With NATIVE defined the Rockblock driver builds on the development machine
+ * and runs against an emulated modem, see test/test_native. Other tests need
+ * to run on the LilyGO board used in the project, however just the board
+ * (peripherials not required) should be sufficient for testing.
  * 
  * TODO: further abstract to any ESP32 board
  */
 #ifndef __HAL_H__
 #define __HAL_H__
 #include <stdint.h>
+#include <stddef.h>
 #ifndef NATIVE
 #include <Arduino.h>
+#include <esp_pm.h>
 #endif
 
 /*
@@ -22,28 +24,164 @@
 class AbstractSerial {
     public:
         // AbstractSerial() {};
-        virtual void begin(uint16_t serialSpeed, int serial8N1,
+        virtual void begin(uint32_t serialSpeed, int serial8N1,
             uint8_t rxPin, uint8_t txPin) = 0;
         virtual void print(const char *bfr) = 0;
+        virtual size_t write(const uint8_t *bfr, size_t len) = 0;
         virtual char read() = 0;
         virtual bool available() = 0;
+        // Copy up to len available bytes without blocking, returns the
+        // number of bytes copied. Falls back to reading byte by byte.
+        virtual size_t readBytes(char *bfr, size_t len) {
+            size_t count = 0;
+            while (count < len && this->available()) {
+                bfr[count++] = this->read();
+            }
+            return count;
+        };
+        // Block the calling task until data arrives or timeout (ms) passed,
+        // returns whether data is available. Does not block by default.
+        virtual bool waitForData(uint32_t timeout) {
+            return this->available();
+        };
+        // Change the rate once everything written is sent. Does nothing by
+        // default.
+        virtual void updateBaudRate(uint32_t serialSpeed) {};
 };
 
+/*
+ * Differs between devices, e.g. to seed random delays. Folded from the MAC
+ * in the eFuse, a constant on native.
+ */
+uint32_t deviceSeed();
+
 // Don't compile if we run on native
 #ifndef NATIVE
+#ifndef ROCKBLOCK_SERIAL_RX_BUFFER
+#define ROCKBLOCK_SERIAL_RX_BUFFER 512
+#endif
+
 /*
- * Implements the AbstractSerial class for Scout devices
+ * Event driven UART. The driver buffers received bytes in a RX buffer of the
+ * given size, readers take them in bulk. waitForData() blocks the calling
+ * task until the UART reports data. By default the report comes when the RX
+ * line goes idle, i.e. at the end of an NMEA sentence or AT response, instead
+ * of for every few bytes. The RX buffer has to fit such a burst.
  */
-class RockblockSerial : public AbstractSerial {
+class EventSerial : public AbstractSerial {
     private:
         HardwareSerial* serial=0;
+        size_t rx_buffer_size;
+        bool only_on_timeout;
+        // task waiting for data, the lock keeps it from being deleted
+        // while notified
+        TaskHandle_t task = NULL;
+        portMUX_TYPE task_lock = portMUX_INITIALIZER_UNLOCKED;
     public:
-        RockblockSerial();
-        virtual void begin(uint16_t serialSpeed, int serial8N1,
+        EventSerial(HardwareSerial &serial, size_t rx_buffer_size,
+            bool only_on_timeout=true);
+        virtual void begin(uint32_t serialSpeed, int serial8N1,
             uint8_t rxPin, uint8_t txPin);
         void print(const char *bfr) override;
+        size_t write(const uint8_t *bfr, size_t len) override;
+        char read() override;
+        bool available() override;
+        size_t readBytes(char *bfr, size_t len) override;
+        bool waitForData(uint32_t timeout) override;
+        // forget the waiting task, before deleting it
+        void detach();
+        void updateBaudRate(uint32_t serialSpeed) override;
+        // received data lost because the RX buffer or FIFO were full
+        uint32_t overflows = 0;
+};
+
+/*
+ * Implements the AbstractSerial class for the Rockblock of Scout devices
+ */
+class RockblockSerial : public EventSerial {
+    public:
+        RockblockSerial();
+};
+
+/*
+ * Power management while awake. With automatic light sleep the chip sleeps
+ * whenever all tasks block, otherwise the CPU runs between the minimum and
+ * maximum frequency. Needs an ESP-IDF built with CONFIG_PM_ENABLE and
+ * CONFIG_FREERTOS_USE_TICKLESS_IDLE, returns false if not supported.
+ *
+ * UARTs don't receive during light sleep. The driver clocks them from
+ * REF_TICK, so the rate does not change with the frequency. I2C is set up
+ * at the maximum APB frequency and runs slower, never faster, below.
+ */
+bool enablePowerManagement(int max_mhz, int min_mhz);
+
+/*
+ * Lock held by a single task while it needs the chip awake, e.g. a UART
+ * expecting data (ESP_PM_NO_LIGHT_SLEEP), or at the maximum frequency for
+ * parsing (ESP_PM_CPU_FREQ_MAX). Does nothing without power management.
+ */
+class PowerLock {
+    private:
+        esp_pm_lock_type_t type;
+        const char *name;
+        esp_pm_lock_handle_t handle = NULL;
+        bool held = false;
+    public:
+        PowerLock(esp_pm_lock_type_t type, const char *name);
+        // create the lock after enablePowerManagement()
+        void begin();
+        // acquire or release, repeating the last call does nothing. Release
+        // the lock of a deleted task from the deleting one.
+        void hold(bool hold);
+        // whether it is held, always false without power management
+        bool isHeld() const { return this->held; }
+};
+#else
+/*
+ * Stand-ins for the Arduino and ESP-IDF functions used by the libraries on the
+ * development machine. Debug output is muted unless echo is set.
+ */
+class NativeSerial {
+    public:
+        bool echo = false;
+        void print(const char *bfr);
+        void print(long val);
+        void println(const char *bfr="");
+        void println(long val);
+};
+extern NativeSerial Serial;
+
+/*
+ * Simulated time, it only advances when the caller says so. This allows to
+ * run the Rockblock state machine and an emulated modem faster than real time.
+ */
+int64_t esp_timer_get_time();
+void advanceNativeTime(int64_t us);
+void setNativeTime(int64_t us);
+
+#define LOOPBACK_BUFFER_SIZE 1024
+
+/*
+ * Serial for tests, received bytes are injected by the test and written
+ * bytes are kept
+ */
+class LoopbackSerial : public AbstractSerial {
+    private:
+        char rx[LOOPBACK_BUFFER_SIZE] = {0};
+        size_t rx_head = 0;
+        size_t rx_len = 0;
+    public:
+        char tx[LOOPBACK_BUFFER_SIZE] = {0};
+        size_t tx_len = 0;
+        void begin(uint32_t serialSpeed, int serial8N1,
+            uint8_t rxPin, uint8_t txPin) override {};
+        void print(const char *bfr) override;
+        size_t write(const uint8_t *bfr, size_t len) override;
         char read() override;
         bool available() override;
+        size_t readBytes(char *bfr, size_t len) override;
+        // add bytes to receive, returns the number of bytes that fit
+        size_t inject(const char *bfr, size_t len);
 };
 #endif
 
@@ -32,17 +32,24 @@ void helpers::printTime(const time_t time) {
  * corrected to NORMAL if we there is no time for retry.
  */
 uint32_t helpers::getSleepDifference(systemState &state, const time_t now) {
+  // a weak battery stretches the interval and stops retries
+  BatteryPolicy battery;
+  battery.setHealth(state.battery);
+  uint32_t interval = battery.interval(state.interval);
   // Make sure that the new time is not the same as the old time, we substract
   // 1 from the alternative time to account for state.gps_read_time being
   // exactly on the time
   time_t reference = (state.gps_read_time > state.expected_wakeup) ?
-    state.gps_read_time : state.gps_read_time + state.interval - 1;
+    state.gps_read_time : state.gps_read_time + interval - 1;
   // Calculate times for wakeup, and retry
-  time_t regularWakeup = getNextWakeupTime(reference, state.interval);
+  time_t regularWakeup = getNextWakeupTime(reference, interval);
   time_t retryWakeup = getNextWakeupTime(reference, RETRY_INTERVAL);
   time_t wakeUp = 0;
   // Use retry time if earlier than next normal time if retries left
-  if ( state.retry && retryWakeup + SYSTEM_TIME_OUT < regularWakeup) {
+  if (
+    state.retry && battery.retry() &&
+    retryWakeup + SYSTEM_TIME_OUT < regularWakeup
+  ) {
     wakeUp = retryWakeup;
   } else {
     wakeUp = regularWakeup;
@@ -60,11 +67,88 @@ uint32_t helpers::getSleepDifference(systemState &state, const time_t now) {
   difference = ( difference < MINIMUM_SLEEP ) ? MINIMUM_SLEEP : difference;
   // Sleep time is 3 days maximum
   difference = ( difference > MAXIMUM_SLEEP ) ? MAXIMUM_SLEEP : difference;
-  // store expected wakeup to account for clock drift later (not implemented)
+  // store expected wakeup, the RTC sleep is derived from it and the wake up
+  // compared with it, see getRtcSleep
   state.expected_wakeup = now + difference;
   return difference;
 }
 
+/*
+ * Track wake ups only take a fix for the track and sleep again, see
+ * processGpsFix. They are pegged to track_interval like reports, a track
+ * wake up too close to the report is skipped. Reports waiting for
+ * feedback or sleep commands don't have track wake ups.
+ */
+bool helpers::scheduleTrack(
+  systemState &state, time_t now, uint32_t track_interval
+) {
+  state.track_wakeup = false;
+  if (
+    track_interval == 0 || state.sleep != 0 || state.config_change_requested
+  ) { return false; }
+  time_t track = getNextWakeupTime(now, track_interval);
+  if (track < now + MINIMUM_SLEEP) {
+    track = getNextWakeupTime(now + MINIMUM_SLEEP, track_interval);
+  }
+  if (track + GPS_TIME_OUT > state.expected_wakeup) { return false; }
+  state.expected_wakeup = track;
+  state.track_wakeup = true;
+  return true;
+}
+
+/*
+ * The ESP32 RTC drifts by up to 30 min a day through deep sleep. The sleep
+ * to the absolute state.expected_wakeup is scaled by the drift estimate,
+ * a slow RTC sleeps fewer of its seconds. The start is kept to measure the
+ * drift after wake up if the clock is known to be right.
+ */
+uint32_t helpers::getRtcSleep(systemState &state, time_t now, bool synced) {
+  int32_t difference = state.expected_wakeup - now;
+  difference = (difference < MINIMUM_SLEEP) ? MINIMUM_SLEEP : difference;
+  double sleep = difference * (1 + state.rtc_drift.ppm / 1E6);
+  state.rtc_drift.sleep_rtc = round(sleep);
+  state.rtc_drift.sleep_start = synced ? now : 0;
+  return state.rtc_drift.sleep_rtc;
+}
+
+/*
+ * The RTC counted the time since the sleep started at its drifting rate
+ */
+time_t helpers::correctRtcTime(const systemState &state, time_t now) {
+  const rtcDrift &drift = state.rtc_drift;
+  if (drift.sleep_start == 0 || now <= drift.sleep_start) { return now; }
+  double elapsed = (now - drift.sleep_start) / (1 + drift.ppm / 1E6);
+  return drift.sleep_start + (time_t) round(elapsed);
+}
+
+/*
+ * Compare the programmed sleep with the time it actually took. Each sleep
+ * is measured once.
+ */
+bool helpers::updateRtcDrift(systemState &state, time_t wake_time) {
+  rtcDrift &drift = state.rtc_drift;
+  if (drift.sleep_start == 0) { return false; }
+  state.wakeup_error = wake_time - state.expected_wakeup;
+  int32_t elapsed = wake_time - drift.sleep_start;
+  drift.sleep_start = 0;
+  if (drift.sleep_rtc < RTC_DRIFT_MIN_SLEEP || elapsed <= 0) { return false; }
+  double ppm = ((double) drift.sleep_rtc / elapsed - 1) * 1E6;
+  if (fabs(ppm) > RTC_DRIFT_MAX_PPM) { return false; }
+  if (drift.samples < RTC_DRIFT_SAMPLES) { drift.samples++; }
+  drift.ppm += (ppm - drift.ppm) / drift.samples;
+  return true;
+}
+
+/*
+ * Counted from the first fix after power on until the first record was sent
+ */
+bool helpers::energyReportDue(const systemState &state, time_t now) {
+  time_t reference = state.energy_report_time ?
+    state.energy_report_time : state.start_time;
+  if (reference == 0 || state.energy.seconds <= 0) { return false; }
+  return now - reference >= ENERGY_REPORT_INTERVAL;
+}
+
 /*
  * Update state after send success and from incoming message bfr (or timeout)
  * :param systemState state pointer: A pointer to the system state object
@@ -76,11 +160,36 @@ uint32_t helpers::getSleepDifference(systemState &state, const time_t now) {
  */
 mainFSM helpers::processRockblockMessage(
   systemState &state, char *bfr, bool success=false, bool busy=true
+) {
+  char* messages[] = {bfr};
+  size_t lengths[] = {strlen(bfr)};
+  return processRockblockMessage(
+    state, messages, lengths, (bfr[0] != '\0') ? 1 : 0, success, busy);
+}
+
+/*
+ * Same as above for all incoming messages of a session, applied in order
+ * :param char* messages[]: Incoming messages, oldest first
+ * :param size_t lengths[]: Their lengths as received
+ * :param size_t count: Number of incoming messages
+ */
+mainFSM helpers::processRockblockMessage(
+  systemState &state, char* messages[], const size_t lengths[],
+  size_t count, bool success, bool busy
 ) {
   if (!busy) {
     // RB send success
     if (success) {
       state.mode = NORMAL;
+      // queued fixes packed into the message have been delivered
+      state.queue.pop(state.queue_sent);
+      state.queue_sent = 0;
+      state.track.pop(state.track_sent);
+      state.track_sent = 0;
+      if (state.energy_sent) {
+        state.energy_report_time = state.gps_read_time;
+        state.energy_sent = false;
+      }
       // Apply new interval AFTER config message sent successfully
       if (state.new_interval != 0) {
         state.interval = state.new_interval;
@@ -92,9 +201,9 @@ mainFSM helpers::processRockblockMessage(
         state.new_sleep = 0;
         state.mode = WAKE_UP;
       }
-      // process incoming message, when available
-      if (bfr[0] != '\0') {
-        if (scoutMessages::parseIncoming(state, bfr)) {
+      // process incoming messages, when available
+      if (count > 0) {
+        if (scoutMessages::parseIncoming(state, messages, lengths, count)) {
           state.mode = CONFIG;
           state.interval = 600;
         } else {
@@ -112,34 +221,181 @@ mainFSM helpers::processRockblockMessage(
 }
 
 /*
- * Update from GPS (side effect) and return next state
+ * Lower HDOP, or more satellites if HDOP is the same or unknown
+ */
+static bool betterFix(const systemState &state, const Gps &gps) {
+    if (gps.hdop && state.hdop && gps.hdop != state.hdop) {
+      return gps.hdop < state.hdop;
+    }
+    return gps.satellites > state.satellites;
+}
+
+/*
+ * The report only tells that the battery is low, pending config feedback
+ * keeps its status. A track wake up just sleeps again.
+ * :param systemState state: A pointer to the system state
+ * :param time_t time: RTC time
+ */
+mainFSM helpers::skipGps(systemState &state, time_t time) {
+    state.lat = 999;
+    state.lng = 999;
+    state.heading = 0;
+    state.speed = 0;
+    state.gps_read_time = time;
+    state.ttff = 0;
+    state.gps_done = true;
+    if (state.track_wakeup) { return SLEEP_READY; }
+    if (state.mode != CONFIG && state.mode != ERROR) {
+      state.mode = LOW_BATTERY;
+    }
+    state.sequence++;
+    return WAIT_FOR_RB;
+}
+
+/*
+ * Update from GPS (side effect) and return next state. A fix is accepted
+ * right away if the policy finds it good enough, otherwise the best fix is
+ * taken after GPS_QUALITY_WAIT or at the timeout.
  * :param systemState state: A pointer to the system state
  * :param Gps gps: A pointer to the gps class
+ * :param GpsPolicy policy: Learns timeout and quality from the outcome
  * :param time_t time: Time when function called
  * :param bool timeout: Whether to timeout the GPS
  * :return type mainFSM:
  */
 mainFSM helpers::processGpsFix(
-  systemState &state, Gps &gps, time_t time, bool timeout=false
+  systemState &state, Gps &gps, GpsPolicy &policy, time_t time,
+  bool timeout=false
 ) {
-    if (!gps.updated && !timeout) { return WAIT_FOR_GPS; }
-    if (gps.updated) {
+    bool candidate = state.gps_first_fix != 0;
+    if (gps.updated && (!candidate || betterFix(state, gps))) {
       state.lat = gps.lat;
       state.lng = gps.lng;
       state.heading = gps.heading;
       state.speed = gps.speed;
+      state.hdop = gps.hdop;
+      state.satellites = gps.satellites;
       state.gps_read_time = gps.get_corrected_epoch();
+      state.last_lat = gps.lat;
+      state.last_lng = gps.lng;
+      state.last_speed = gps.speed;
+      state.last_fix_time = state.gps_read_time;
+      if (!candidate) {
+        state.gps_first_fix = state.gps_read_time;
+        state.ttff = gps.ttff;
+      }
       if (state.start_time == 0) {
         state.start_time = gps.get_corrected_epoch() - time;
       }
+      candidate = true;
     }
-    if (timeout) {
+    bool accept = candidate && (
+      timeout || policy.acceptable(state.hdop, state.satellites) ||
+      gps.get_corrected_epoch() - state.gps_first_fix >= GPS_QUALITY_WAIT);
+    if (!accept && !timeout) { return WAIT_FOR_GPS; }
+    if (accept) {
+      policy.onFix(state.ttff, state.hdop, state.satellites, gps.aided);
+    } else {
       state.lat = 999;
       state.lng = 999;
       state.heading = 0;
       state.speed = 0;
       state.gps_read_time = time;
+      state.ttff = 0;
+      policy.onTimeout();
     }
+    state.gps_history = policy.getHistory();
+    state.gps_aided = gps.aided;
     state.gps_done = true;
+    // a track wake up only keeps the fix, the report is sent later
+    if (state.track_wakeup) {
+      if (accept) {
+        trackFix fix;
+        fix.time = state.gps_read_time;
+        fix.lat = round(state.lat * 1E5);
+        fix.lng = round(state.lng * 1E5);
+        state.track.push(fix);
+      }
+      return SLEEP_READY;
+    }
+    // every report gets a new sequence number
+    state.sequence++;
     return WAIT_FOR_RB;
 }
+
+/*
+ * The buoy drifts at the speed of the last fix (at least AIDING_MIN_DRIFT m/s)
+ * and the RTC drifts since the last fix set it. The drift is the one measured
+ * in past sleeps, RTC_DRIFT_PPM until then.
+ * :param systemState state: A pointer to the system state
+ * :param time_t now: RTC time
+ */
+bool helpers::estimateAiding(const systemState &state, time_t now,
+  uint32_t *position_accuracy, uint16_t *time_accuracy
+) {
+    if (state.last_lat == 999 || state.last_fix_time == 0) { return false; }
+    if (now < state.last_fix_time) { return false; }
+    uint32_t elapsed = now - state.last_fix_time;
+    // knots to m/s
+    float drift = state.last_speed * 0.5144;
+    drift = (drift > AIDING_MIN_DRIFT) ? drift : AIDING_MIN_DRIFT;
+    float accuracy = AIDING_FIX_ACCURACY + drift * elapsed;
+    if (accuracy > AIDING_MAX_ACCURACY) { return false; }
+    *position_accuracy = accuracy;
+    float ppm = state.rtc_drift.samples ?
+      fabs(state.rtc_drift.ppm) : RTC_DRIFT_PPM;
+    uint64_t drift_s = (uint64_t) (elapsed * (double) ppm / 1E6) + 1;
+    *time_accuracy = (drift_s < UINT16_MAX) ? drift_s : UINT16_MAX;
+    return true;
+}
+
+/*
+ * Refresh if a fix was found this wake up, the battery allows it and the
+ * orbital data is old or the fix took long
+ * :param systemState state: A pointer to the system state
+ * :param time_t now: RTC time
+ */
+bool helpers::startGpsRefresh(systemState &state, time_t now) {
+    state.gps_refreshing = false;
+    if (!state.ttff || state.bat < GPS_REFRESH_MIN_BATTERY) { return false; }
+    bool old = now - state.gps_refresh_time >= GPS_REFRESH_INTERVAL;
+    // resume a refresh that did not complete before
+    bool started = state.gps_refresh_progress > 0;
+    if (!old && !started && state.ttff <= GPS_REFRESH_TTFF) { return false; }
+    if (!started) { state.gps_refresh_ttff = state.ttff; }
+    state.gps_refreshing = true;
+    return true;
+}
+
+/*
+ * :param systemState state: A pointer to the system state
+ * :param time_t now: RTC time
+ * :param uint32_t seconds: time the GPS was kept on after the fix
+ */
+bool helpers::endGpsRefresh(systemState &state, time_t now, uint32_t seconds) {
+    if (!state.gps_refreshing) { return false; }
+    state.gps_refreshing = false;
+    state.gps_refresh_progress += seconds;
+    if (state.gps_refresh_progress < GPS_REFRESH_DURATION) { return false; }
+    state.gps_refresh_time = now;
+    state.gps_refresh_progress = 0;
+    return true;
+}
+
+/*
+ * Queue the current fix after sending failed, it will be packed into the
+ * next successful message. Reports without fix are not queued.
+ * :param systemState state: A pointer to the system state
+ */
+void helpers::queueUnsentFix(systemState &state) {
+    state.queue_sent = 0;
+    state.track_sent = 0;
+    state.energy_sent = false;
+    if (state.lat == 999 && state.lng == 999) { return; }
+    queuedFix fix;
+    fix.seq = state.sequence;
+    fix.time = state.gps_read_time;
+    fix.lat = state.lat;
+    fix.lng = state.lng;
+    state.queue.push(fix);
+}
@@ -9,6 +9,9 @@
 #include <stateType.h>
 #include <scoutMessages.h>
 #include <gps.h>
+#include <gpsPolicy.h>
+#include <energyMeter.h>
+#include <batteryPolicy.h>
 
 #ifndef MINIMUM_SLEEP
 #define MINIMUM_SLEEP 20
@@ -22,20 +25,84 @@
 #ifndef SYSTEM_TIME_OUT
   #define SYSTEM_TIME_OUT 360
 #endif
+// drift of the RTC through deep sleep, see setTime() in main.cpp
+#ifndef RTC_DRIFT_PPM
+#define RTC_DRIFT_PPM 20000
+#endif
+// RTC drift estimate, see updateRtcDrift: sleeps shorter than
+// RTC_DRIFT_MIN_SLEEP (s) do not tell the drift from the resolution of one
+// second, measurements beyond RTC_DRIFT_MAX_PPM are discarded, the estimate
+// averages the first RTC_DRIFT_SAMPLES measurements and follows new ones
+// exponentially after
+#define RTC_DRIFT_MIN_SLEEP 300
+#define RTC_DRIFT_MAX_PPM 50000
+#define RTC_DRIFT_SAMPLES 8
+// accuracy of a fix and the slowest drift assumed for the buoy
+#define AIDING_FIX_ACCURACY 100
+#define AIDING_MIN_DRIFT 0.5
+// positions less accurate than this (m) don't help the receiver
+#define AIDING_MAX_ACCURACY 300000
+// Keep the GPS on after the fix while the Rockblock sends to refresh the
+// orbital data: every GPS_REFRESH_INTERVAL (s), or if the time to first fix
+// exceeded GPS_REFRESH_TTFF (ms), and only above GPS_REFRESH_MIN_BATTERY (V).
+// A refresh is complete after GPS_REFRESH_DURATION (s, one almanac cycle),
+// summed over wake ups.
+#ifndef GPS_REFRESH_INTERVAL
+#define GPS_REFRESH_INTERVAL 259200
+#endif
+#ifndef GPS_REFRESH_TTFF
+#define GPS_REFRESH_TTFF 60000
+#endif
+#ifndef GPS_REFRESH_MIN_BATTERY
+#define GPS_REFRESH_MIN_BATTERY 3.7
+#endif
+#define GPS_REFRESH_DURATION 750
 
 namespace helpers {
   // Calculate wake up time, pegging it to actual time starting at 00:00:00.
   time_t getNextWakeupTime(time_t now, unsigned int delay);
   // Print epoch as time.
   void printTime(const time_t time);
-  // Get sleep time and retries from state
+  // Get sleep time and retries from state, the interval and retries
+  // adapted to the battery
   uint32_t getSleepDifference(systemState &state, const time_t now);
+  // Wake up for a track fix before the report at state.expected_wakeup if
+  // track_interval (s) is set, returns whether it does
+  bool scheduleTrack(systemState &state, time_t now, uint32_t track_interval);
+  // Sleep until state.expected_wakeup in seconds of the RTC, corrected by
+  // the drift estimate. synced if the GPS set the clock this wake up.
+  uint32_t getRtcSleep(systemState &state, time_t now, bool synced);
+  // Time after a timer wake up corrected by the drift estimate
+  time_t correctRtcTime(const systemState &state, time_t now);
+  // Update the drift estimate at the first fix, wake_time from the GPS.
+  // Returns false if the last sleep tells nothing.
+  bool updateRtcDrift(systemState &state, time_t wake_time);
+  // Whether the next report carries the energy estimate, once per
+  // ENERGY_REPORT_INTERVAL
+  bool energyReportDue(const systemState &state, time_t now);
   // Update state from incoming message
   mainFSM processRockblockMessage(
     systemState &state, char *bfr, bool success, bool busy);
+  // Update state from all incoming messages of a session
+  mainFSM processRockblockMessage(
+    systemState &state, char* messages[], const size_t lengths[],
+    size_t count, bool success, bool busy);
+  // Keep the current fix for the next message after sending failed
+  void queueUnsentFix(systemState &state);
+  // Report without GPS fix to save the battery
+  mainFSM skipGps(systemState &state, time_t time);
   // Update state from GPS
   mainFSM processGpsFix(
-    systemState &state, Gps &gps, time_t time, bool timeout);
+    systemState &state, Gps &gps, GpsPolicy &policy, time_t time,
+    bool timeout);
+  // Accuracy of the last fix as position estimate (m) and of the RTC (s),
+  // false if there is no useful estimate
+  bool estimateAiding(const systemState &state, time_t now,
+    uint32_t *position_accuracy, uint16_t *time_accuracy);
+  // Whether to keep the GPS on after the fix, sets gps_refreshing
+  bool startGpsRefresh(systemState &state, time_t now);
+  // Account the seconds the GPS was kept on, true if the refresh is complete
+  bool endGpsRefresh(systemState &state, time_t now, uint32_t seconds);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,381 @@
+#include <nmea.h>
+#include <string.h>
+
+// value of hex digits, -1 for anything else. Also used for decimal digits.
+static const int8_t HEX_VALUES[128] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static inline int8_t hexValue(char c) {
+    return ((uint8_t) c < 128) ? HEX_VALUES[(uint8_t) c] : -1;
+}
+
+static inline int8_t digitValue(char c) {
+    int8_t value = hexValue(c);
+    return (value >= 0 && value < 10) ? value : -1;
+}
+
+// fields present in an RMC or GGA sentence
+#define HAS_TIME 0x01
+#define HAS_DATE 0x02
+#define HAS_LAT 0x04
+#define HAS_LNG 0x08
+#define HAS_POSITION (HAS_LAT | HAS_LNG)
+
+/*
+ * Read count decimal digits, -1 if any of them is missing
+ */
+static int32_t parseDigits(const char *bfr, uint8_t count) {
+    int32_t value = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        int8_t digit = digitValue(bfr[i]);
+        if (digit < 0) { return -1; }
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+/*
+ * Decimal number as integer with the given number of decimals, e.g. "1.5"
+ * with 2 decimals is 150. Further decimals are cut off.
+ */
+static bool parseFixed(const char *bfr, uint8_t len, uint8_t decimals,
+    uint32_t *value
+) {
+    uint32_t result = 0;
+    uint8_t idx = 0;
+    if (len == 0) { return false; }
+    for (; idx < len && bfr[idx] != '.'; idx++) {
+        int8_t digit = digitValue(bfr[idx]);
+        if (digit < 0) { return false; }
+        result = result * 10 + digit;
+    }
+    // skip the decimal point
+    idx++;
+    for (uint8_t i = 0; i < decimals; i++, idx++) {
+        int8_t digit = (idx < len) ? digitValue(bfr[idx]) : 0;
+        if (digit < 0) { return false; }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return true;
+}
+
+/*
+ * ddmm.mmmm (latitude) or dddmm.mmmm (longitude) to 1e-7 degrees
+ */
+static bool parseCoordinate(const char *bfr, uint8_t len,
+    uint8_t degree_digits, int32_t *value
+) {
+    if (len < degree_digits + 2) { return false; }
+    int32_t degrees = parseDigits(bfr, degree_digits);
+    uint32_t minutes = 0;
+    if (
+        degrees < 0 ||
+        !parseFixed(bfr + degree_digits, len - degree_digits, 7, &minutes)
+    ) {
+        return false;
+    }
+    // minutes in 1e-7, rounded to the nearest 1e-7 degree
+    *value = degrees * 10000000 + (int32_t) ((minutes + 30) / 60);
+    return true;
+}
+
+/*
+ * hhmmss(.ss), returns centiseconds of the day or -1
+ */
+static int32_t parseTime(const char *bfr, uint8_t len, NmeaFix *fix) {
+    uint32_t fraction = 0;
+    if (len < 6) { return -1; }
+    int32_t hour = parseDigits(bfr, 2);
+    int32_t minute = parseDigits(bfr + 2, 2);
+    int32_t second = parseDigits(bfr + 4, 2);
+    if (hour < 0 || minute < 0 || second < 0) { return -1; }
+    if (len > 7 && !parseFixed(bfr + 6, len - 6, 2, &fraction)) { return -1; }
+    fix->hour = hour;
+    fix->minute = minute;
+    fix->second = second;
+    return ((hour * 60 + minute) * 60 + second) * 100 + fraction;
+}
+
+void NmeaParser::reset() {
+    this->state = NMEA_WAIT;
+    this->rmc_time = -1;
+    this->gga_time = -1;
+    this->hdop = 0;
+    this->pdop = 0;
+    this->vdop = 0;
+}
+
+void NmeaParser::startSentence() {
+    this->state = NMEA_BODY;
+    this->type = NMEA_OTHER;
+    this->field_len = 0;
+    this->field_idx = 0;
+    this->checksum = 0;
+    this->received_checksum = 0;
+    this->checksum_digits = 0;
+    this->sentence = NmeaFix();
+    this->sentence_time = -1;
+    this->sentence_valid = false;
+    this->seen = 0;
+}
+
+/*
+ * Decode the field just completed, its position tells its meaning
+ */
+void NmeaParser::endField() {
+    const char *bfr = this->field;
+    uint8_t len = this->field_len;
+    uint8_t idx = this->field_idx++;
+    this->field_len = 0;
+    uint32_t value = 0;
+
+    if (idx == 0) {
+        // talker (GP, GN, ...) and sentence type
+        if (len != 5) { this->type = NMEA_OTHER; }
+        else if (memcmp(bfr + 2, "RMC", 3) == 0) { this->type = NMEA_RMC; }
+        else if (memcmp(bfr + 2, "GGA", 3) == 0) { this->type = NMEA_GGA; }
+        else if (memcmp(bfr + 2, "GSA", 3) == 0) { this->type = NMEA_GSA; }
+        // sentences we don't use are skipped up to the next $
+        if (this->type == NMEA_OTHER) { this->state = NMEA_WAIT; }
+        return;
+    }
+    if (len == 0) { return; }
+
+    switch (this->type) {
+
+        case NMEA_RMC:
+            switch (idx) {
+                case 1:
+                    this->sentence_time = parseTime(bfr, len, &this->sentence);
+                    if (this->sentence_time >= 0) { this->seen |= HAS_TIME; }
+                    break;
+                case 2: this->sentence_valid = bfr[0] == 'A'; break;
+                case 3:
+                    if (parseCoordinate(bfr, len, 2, &this->sentence.lat)) {
+                        this->seen |= HAS_LAT;
+                    }
+                    break;
+                case 4: if (bfr[0] == 'S') { this->sentence.lat *= -1; } break;
+                case 5:
+                    if (parseCoordinate(bfr, len, 3, &this->sentence.lng)) {
+                        this->seen |= HAS_LNG;
+                    }
+                    break;
+                case 6: if (bfr[0] == 'W') { this->sentence.lng *= -1; } break;
+                case 7:
+                    parseFixed(bfr, len, 2, &this->sentence.speed);
+                    break;
+                case 8:
+                    parseFixed(bfr, len, 2, &this->sentence.course);
+                    break;
+                case 9: {
+                    int32_t day = (len == 6) ? parseDigits(bfr, 2) : -1;
+                    int32_t month = (len == 6) ? parseDigits(bfr + 2, 2) : -1;
+                    int32_t year = (len == 6) ? parseDigits(bfr + 4, 2) : -1;
+                    if (day < 0 || month < 0 || year < 0) { break; }
+                    this->sentence.day = day;
+                    this->sentence.month = month;
+                    this->sentence.year = 2000 + year;
+                    this->seen |= HAS_DATE;
+                    break;
+                }
+                // mode indicator (NMEA 2.3), N is no fix
+                case 12:
+                    if (bfr[0] == 'N') { this->sentence_valid = false; }
+                    break;
+                default: break;
+            }
+            break;
+
+        case NMEA_GGA:
+            switch (idx) {
+                case 1:
+                    this->sentence_time = parseTime(bfr, len, &this->sentence);
+                    if (this->sentence_time >= 0) { this->seen |= HAS_TIME; }
+                    break;
+                case 2:
+                    if (parseCoordinate(bfr, len, 2, &this->sentence.lat)) {
+                        this->seen |= HAS_LAT;
+                    }
+                    break;
+                case 3: if (bfr[0] == 'S') { this->sentence.lat *= -1; } break;
+                case 4:
+                    if (parseCoordinate(bfr, len, 3, &this->sentence.lng)) {
+                        this->seen |= HAS_LNG;
+                    }
+                    break;
+                case 5: if (bfr[0] == 'W') { this->sentence.lng *= -1; } break;
+                case 6:
+                    if (parseFixed(bfr, len, 0, &value)) {
+                        this->sentence.quality = value;
+                    }
+                    break;
+                case 7:
+                    if (parseFixed(bfr, len, 0, &value)) {
+                        this->sentence.satellites = value;
+                    }
+                    break;
+                case 8:
+                    if (parseFixed(bfr, len, 2, &value)) {
+                        this->sentence.hdop = value;
+                    }
+                    break;
+                default: break;
+            }
+            break;
+
+        case NMEA_GSA:
+            if (idx >= 15 && idx <= 17 && parseFixed(bfr, len, 2, &value)) {
+                if (idx == 15) { this->sentence.pdop = value; }
+                else if (idx == 16) { this->sentence.hdop = value; }
+                else { this->sentence.vdop = value; }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+ * RMC and GGA of the same epoch with matching positions make a fix
+ */
+bool NmeaParser::matchFix() {
+    if (this->rmc_time < 0 || this->rmc_time != this->gga_time) {
+        return false;
+    }
+    int32_t lat_diff = this->rmc.lat - this->gga.lat;
+    int32_t lng_diff = this->rmc.lng - this->gga.lng;
+    if (
+        lat_diff > NMEA_POSITION_TOLERANCE ||
+        lat_diff < -NMEA_POSITION_TOLERANCE ||
+        lng_diff > NMEA_POSITION_TOLERANCE ||
+        lng_diff < -NMEA_POSITION_TOLERANCE
+    ) {
+        return false;
+    }
+    this->fix = this->rmc;
+    this->fix.quality = this->gga.quality;
+    this->fix.satellites = this->gga.satellites;
+    this->fix.hdop = this->gga.hdop ? this->gga.hdop : this->hdop;
+    this->fix.pdop = this->pdop;
+    this->fix.vdop = this->vdop;
+    this->rmc_time = -1;
+    this->gga_time = -1;
+    return true;
+}
+
+/*
+ * The checksum matched, keep the values of the sentence
+ */
+bool NmeaParser::endSentence() {
+    this->sentences++;
+    switch (this->type) {
+        case NMEA_RMC:
+            if (
+                !this->sentence_valid ||
+                this->seen != (HAS_TIME | HAS_DATE | HAS_POSITION)
+            ) {
+                return false;
+            }
+            this->rmc = this->sentence;
+            this->rmc_time = this->sentence_time;
+            return this->matchFix();
+        case NMEA_GGA:
+            if (
+                this->sentence.quality == 0 ||
+                this->seen != (HAS_TIME | HAS_POSITION)
+            ) {
+                return false;
+            }
+            this->gga = this->sentence;
+            this->gga_time = this->sentence_time;
+            return this->matchFix();
+        case NMEA_GSA:
+            this->hdop = this->sentence.hdop;
+            this->pdop = this->sentence.pdop;
+            this->vdop = this->sentence.vdop;
+            return false;
+        default:
+            return false;
+    }
+}
+
+bool NmeaParser::feed(char c) {
+    // a new sentence starts anywhere, an incomplete one is dropped
+    if (c == '$') {
+        this->startSentence();
+        return false;
+    }
+    switch (this->state) {
+        case NMEA_BODY:
+            if (c == '*') {
+                this->endField();
+                this->state = NMEA_CHECKSUM;
+            } else if (c == '\r' || c == '\n') {
+                // no checksum
+                this->state = NMEA_WAIT;
+            } else {
+                this->checksum ^= c;
+                if (c == ',') {
+                    this->endField();
+                } else if (this->field_len < NMEA_FIELD_SIZE - 1) {
+                    this->field[this->field_len++] = c;
+                }
+            }
+            return false;
+        case NMEA_CHECKSUM: {
+            int8_t value = hexValue(c);
+            if (value < 0) {
+                this->state = NMEA_WAIT;
+                return false;
+            }
+            this->received_checksum = (this->received_checksum << 4) | value;
+            if (++this->checksum_digits < 2) { return false; }
+            this->state = NMEA_WAIT;
+            if (this->received_checksum != this->checksum) {
+                this->checksum_errors++;
+                return false;
+            }
+            return this->endSentence();
+        }
+        default:
+            return false;
+    }
+}
+
+bool NmeaParser::feed(const char *bfr, size_t len) {
+    bool result = false;
+    for (size_t i = 0; i < len; i++) {
+        if (this->state == NMEA_WAIT) {
+            const char *start = (const char*) memchr(bfr + i, '$', len - i);
+            if (!start) { break; }
+            i = start - bfr;
+        }
+        // copy the rest of the field at once, delimiters go through feed()
+        while (this->state == NMEA_BODY && i < len) {
+            char c = bfr[i];
+            if (
+                c == ',' || c == '*' || c == '$' || c == '\r' || c == '\n'
+            ) {
+                break;
+            }
+            this->checksum ^= c;
+            if (this->field_len < NMEA_FIELD_SIZE - 1) {
+                this->field[this->field_len++] = c;
+            }
+            i++;
+        }
+        if (i < len) { result |= this->feed(bfr[i]); }
+    }
+    return result;
+}
@@ -0,0 +1,98 @@
+/*
+ * Streaming NMEA 0183 parser limited to what a position report needs: RMC
+ * (time, date, position, speed, course), GGA (fix quality, satellites) and
+ * GSA (dilution of precision). Other sentences are skipped without
+ * decoding.
+ *
+ * Bytes are decoded field by field while they arrive, nothing is buffered
+ * beyond the current field and no memory is allocated. Values of a sentence
+ * only count once its checksum matches. Coordinates are integers in 1e-7
+ * degrees, speed and course in hundredths.
+ *
+ * A fix is signalled as soon as a valid RMC and a GGA with a fix for the
+ * same UTC time have arrived, in any order.
+ */
+#ifndef __NMEA_H__
+#define __NMEA_H__
+#include <stdint.h>
+#include <stddef.h>
+
+// longest field kept, e.g. a coordinate with 7 decimals
+#define NMEA_FIELD_SIZE 16
+// coordinates of RMC and GGA of the same epoch may differ in the last digits
+#define NMEA_POSITION_TOLERANCE 100
+
+struct NmeaFix {
+    uint16_t year = 0;
+    uint8_t month = 0;
+    uint8_t day = 0;
+    uint8_t hour = 0;
+    uint8_t minute = 0;
+    uint8_t second = 0;
+    // 1e-7 degrees, north and east positive
+    int32_t lat = 0;
+    int32_t lng = 0;
+    // 1/100 knots and 1/100 degrees
+    uint32_t speed = 0;
+    uint32_t course = 0;
+    // GGA fix quality, 0 without fix
+    uint8_t quality = 0;
+    uint8_t satellites = 0;
+    // 1/100, 0 if unknown
+    uint16_t hdop = 0;
+    uint16_t pdop = 0;
+    uint16_t vdop = 0;
+    // horizontal accuracy estimate in mm, only from UBX (see ubx.h), 0 if
+    // unknown
+    uint32_t h_acc = 0;
+};
+
+class NmeaParser {
+
+    private:
+        enum SentenceType { NMEA_OTHER, NMEA_RMC, NMEA_GGA, NMEA_GSA };
+        enum ParserState { NMEA_WAIT, NMEA_BODY, NMEA_CHECKSUM };
+        ParserState state = NMEA_WAIT;
+        SentenceType type = NMEA_OTHER;
+        char field[NMEA_FIELD_SIZE] = {0};
+        uint8_t field_len = 0;
+        uint8_t field_idx = 0;
+        uint8_t checksum = 0;
+        uint8_t received_checksum = 0;
+        uint8_t checksum_digits = 0;
+        // values of the sentence being decoded
+        NmeaFix sentence;
+        // UTC time of day in centiseconds, -1 if not set
+        int32_t sentence_time = -1;
+        bool sentence_valid = false;
+        // fields of the sentence decoded successfully, see nmea.cpp
+        uint8_t seen = 0;
+        // last complete RMC and GGA waiting for their counterpart
+        NmeaFix rmc;
+        int32_t rmc_time = -1;
+        NmeaFix gga;
+        int32_t gga_time = -1;
+        // latest GSA
+        uint16_t hdop = 0;
+        uint16_t pdop = 0;
+        uint16_t vdop = 0;
+        void startSentence();
+        void endField();
+        bool endSentence();
+        bool matchFix();
+
+    public:
+        NmeaParser() {};
+        // latest fix, valid once feed() returned true
+        NmeaFix fix;
+        // sentences with a matching checksum, with a wrong one
+        uint32_t sentences = 0;
+        uint32_t checksum_errors = 0;
+        void reset();
+        // feed a single byte, returns true if it completed a fix
+        bool feed(char c);
+        // feed bytes, returns true if any of them completed a fix
+        bool feed(const char *bfr, size_t len);
+};
+
+#endif /* __NMEA_H__ */
@@ -0,0 +1,108 @@
+#include <ringBuffer.h>
+#include <string.h>
+
+/*
+ * Return character at idx of the view without linearizing it.
+ */
+char FrameView::at(size_t idx) const {
+    if (idx < this->first_len) { return this->first[idx]; }
+    return this->second[idx - this->first_len];
+}
+
+/*
+ * Return character at idx counted from the read position.
+ */
+char RingBuffer::at(size_t idx) const {
+    return this->data[this->index(idx)];
+}
+
+/*
+ * Append a single byte. Returns false and counts the byte as dropped if the
+ * buffer is full.
+ */
+bool RingBuffer::push(char c) {
+    if (this->count == RING_BUFFER_SIZE) {
+        this->drop(1);
+        return false;
+    }
+    this->data[this->index(this->count)] = c;
+    this->count++;
+    this->dropping = false;
+    return true;
+}
+
+/*
+ * Count dropped bytes, an overflow only once until data is accepted again.
+ */
+void RingBuffer::drop(size_t len) {
+    this->dropped_bytes += len;
+    if (!this->dropping) { this->overflows++; }
+    this->dropping = true;
+}
+
+/*
+ * Append len bytes, returns the number of bytes actually written.
+ */
+size_t RingBuffer::write(const char* bfr, size_t len) {
+    size_t written = 0;
+    char* ptr = nullptr;
+    while (written < len) {
+        size_t span = this->writeSpan(&ptr);
+        if (span == 0) { break; }
+        if (span > len - written) { span = len - written; }
+        memcpy(ptr, bfr + written, span);
+        this->commit(span);
+        written += span;
+    }
+    if (written < len) { this->drop(len - written); }
+    return written;
+}
+
+/*
+ * Get the largest contiguous free region. Allows a reader to fill the buffer
+ * without an intermediate copy. Call commit() with the number of bytes
+ * written afterwards.
+ */
+size_t RingBuffer::writeSpan(char** ptr) {
+    size_t head = this->index(this->count);
+    *ptr = this->data + head;
+    if (this->count == RING_BUFFER_SIZE) { return 0; }
+    if (head >= this->tail) { return RING_BUFFER_SIZE - head; }
+    return this->tail - head;
+}
+
+void RingBuffer::commit(size_t len) {
+    if (len > 0) { this->dropping = false; }
+    this->count += len;
+    if (this->count > RING_BUFFER_SIZE) { this->count = RING_BUFFER_SIZE; }
+}
+
+/*
+ * Create a view of len bytes starting at offset from the read position.
+ */
+FrameView RingBuffer::view(size_t offset, size_t len) const {
+    FrameView view;
+    view.first = this->data;
+    view.second = this->data;
+    if (offset + len > this->count) { return view; }
+    size_t start = this->index(offset);
+    view.first = this->data + start;
+    if (start + len <= RING_BUFFER_SIZE) {
+        view.first_len = len;
+    } else {
+        view.first_len = RING_BUFFER_SIZE - start;
+        view.second_len = len - view.first_len;
+    }
+    return view;
+}
+
+/*
+ * Release len bytes from the read position.
+ */
+void RingBuffer::consume(size_t len) {
+    if (len > this->count) { len = this->count; }
+    this->tail = this->index(len);
+    this->count -= len;
+}
+
+void RingBuffer::clear() { this->consume(this->count); }
@@ -0,0 +1,73 @@
+/*
+ * Fixed capacity ring buffer for serial streams.
+ *
+ * Bytes are never moved once written. Consumers get views pointing into the
+ * buffer instead of copies. A view is valid until the bytes it points to are
+ * consumed.
+ *
+ * The buffer does not overwrite unconsumed data. Bytes arriving while the
+ * buffer is full are dropped and counted, so that data loss is visible.
+ */
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RING_BUFFER_SIZE
+#define RING_BUFFER_SIZE 1024
+#endif
+
+/*
+ * A view into the ring buffer. Data might wrap around the end of the buffer,
+ * therefore a view consists of up to two segments.
+ */
+struct FrameView {
+    const char* first = nullptr;
+    size_t first_len = 0;
+    const char* second = nullptr;
+    size_t second_len = 0;
+    size_t length() const { return first_len + second_len; };
+    char at(size_t idx) const;
+};
+
+class RingBuffer {
+
+    private:
+        char data[RING_BUFFER_SIZE] = {0};
+        // read position
+        size_t tail = 0;
+        // number of unconsumed bytes
+        size_t count = 0;
+        // the last byte offered was dropped, the overflow is counted already
+        bool dropping = false;
+        // position of offset from the read position, wraps without a
+        // division since offsets never exceed the capacity
+        size_t index(size_t offset) const {
+            size_t idx = this->tail + offset;
+            return (idx < RING_BUFFER_SIZE) ? idx : idx - RING_BUFFER_SIZE;
+        };
+        void drop(size_t len);
+
+    public:
+        RingBuffer() {};
+        // Bytes dropped because the buffer was full
+        uint32_t dropped_bytes = 0;
+        // Number of times the buffer ran full, consecutive dropped bytes
+        // count once
+        uint32_t overflows = 0;
+        size_t capacity() const { return RING_BUFFER_SIZE; };
+        size_t size() const { return this->count; };
+        size_t space() const { return RING_BUFFER_SIZE - this->count; };
+        char at(size_t idx) const;
+        bool push(char c);
+        size_t write(const char* bfr, size_t len);
+        // Contiguous free space to write into directly, use with commit()
+        size_t writeSpan(char** ptr);
+        void commit(size_t len);
+        // View of len bytes starting at offset from the read position
+        FrameView view(size_t offset, size_t len) const;
+        void consume(size_t len);
+        void clear();
+};
+
+#endif /* __RING_BUFFER_H__ */
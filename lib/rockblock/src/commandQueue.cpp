@@ -0,0 +1,138 @@
+#include <commandQueue.h>
+#include <string.h>
+#include <stdio.h>
+
+
+CommandQueue::CommandQueue() {}
+
+/*
+ * Keep the queue ordered by priority, same priorities in order of insertion
+ */
+bool CommandQueue::insert(const AtCommand &command) {
+    if (this->count == COMMAND_QUEUE_SIZE) { return false; }
+    size_t idx = this->count;
+    while (idx > 0 && this->items[idx - 1].priority < command.priority) {
+        this->items[idx] = this->items[idx - 1];
+        idx--;
+    }
+    this->items[idx] = command;
+    this->count++;
+    return true;
+}
+
+bool CommandQueue::push(const char *text, CommandCallback callback,
+    RockblockStatus expected, uint32_t timeout, uint8_t priority, bool binary,
+    bool info
+) {
+    AtCommand command;
+    strncpy(command.text, text, COMMAND_TEXT_SIZE - 1);
+    command.callback = callback;
+    command.expected = expected;
+    command.timeout = timeout;
+    command.priority = priority;
+    command.binary = binary;
+    command.info = info;
+    return this->insert(command);
+}
+
+bool CommandQueue::pushRaw(const uint8_t *data, size_t len,
+    CommandCallback callback, uint32_t timeout, uint8_t priority
+) {
+    AtCommand command;
+    command.data = data;
+    command.len = len;
+    command.callback = callback;
+    command.timeout = timeout;
+    command.priority = priority;
+    command.info = true;
+    return this->insert(command);
+}
+
+const AtCommand* CommandQueue::start(AbstractSerial *serial, uint32_t now) {
+    if (this->in_flight || this->count == 0) { return nullptr; }
+    this->current = this->items[0];
+    for (size_t i = 1; i < this->count; i++) {
+        this->items[i - 1] = this->items[i];
+    }
+    this->count--;
+    // release the callback of the moved out slot
+    this->items[this->count] = AtCommand();
+    this->in_flight = true;
+    this->sent_at = now;
+    if (this->current.data != nullptr) {
+        serial->write(this->current.data, this->current.len);
+    } else {
+        char bfr[COMMAND_TEXT_SIZE + 8] = {0};
+        snprintf(bfr, sizeof(bfr), "AT%s\r\n", this->current.text);
+        serial->print(bfr);
+    }
+    return &this->current;
+}
+
+/*
+ * The command is done before calling back, the callback may queue the next
+ * command.
+ */
+void CommandQueue::finish(CommandResult result) {
+    CommandCallback callback = this->current.callback;
+    this->current.callback = nullptr;
+    this->in_flight = false;
+    if (callback) { callback(result); }
+}
+
+/*
+ * Text commands are matched by their echo. Without echo the name of the
+ * response has to be the beginning of the command, +SBDIXA answers with
+ * +SBDIX: for example.
+ */
+bool CommandQueue::matches(const FrameParser &parser) {
+    if (strncmp(parser.command, "AT", 2) == 0) {
+        return strcmp(parser.command + 2, this->current.text) == 0;
+    }
+    if (parser.response[0] != '+') { return true; }
+    const char *end = strchr(parser.response, ':');
+    size_t len = end ? end - parser.response : strlen(parser.response);
+    return strncmp(parser.response, this->current.text, len) == 0;
+}
+
+/*
+ * Responses to raw commands have no echo, e.g. 0 followed by OK after +SBDWB.
+ */
+bool CommandQueue::complete(const FrameParser &parser) {
+    if (!this->in_flight || !parser.complete) { return false; }
+    if (this->current.data == nullptr && !this->matches(parser)) {
+        return false;
+    }
+    this->finish(
+        (parser.status == this->current.expected) ?
+        COMMAND_OK : COMMAND_ERROR);
+    return true;
+}
+
+bool CommandQueue::checkTimeout(uint32_t now) {
+    if (!this->in_flight) { return false; }
+    if ((int32_t) (now - this->sent_at) < (int32_t) this->current.timeout) {
+        return false;
+    }
+    this->finish(COMMAND_TIMEOUT);
+    return true;
+}
+
+bool CommandQueue::busy() {
+    return this->in_flight;
+}
+
+bool CommandQueue::idle() {
+    return !this->in_flight && this->count == 0;
+}
+
+void CommandQueue::clear() {
+    for (size_t i = 0; i < this->count; i++) { this->items[i] = AtCommand(); }
+    this->count = 0;
+    this->current = AtCommand();
+    this->in_flight = false;
+}
+
+const char* CommandQueue::currentText() {
+    return this->current.text;
+}
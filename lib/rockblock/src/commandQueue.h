@@ -0,0 +1,98 @@
+/*
+ * Queue of AT commands for the Rockblock. One command is in flight at a time
+ * and the next one is sent as soon as the previous one completed. Every
+ * command has
+ *
+ * - the status it expects, OK or READY (+SBDWT and +SBDWB),
+ * - a timeout, a command without response completes with COMMAND_TIMEOUT
+ *   instead of blocking the driver until the system times out,
+ * - a priority, higher priorities are sent first, otherwise in order,
+ * - a callback, called once when the command completes.
+ *
+ * Raw commands are sent as they are, e.g. the message after READY. The queue
+ * only keeps a pointer to their data.
+ *
+ * Without echo (ATE0) frames cannot be matched by their echo, they complete
+ * the command in flight if their response (e.g. +CSQ:) fits the command.
+ */
+#ifndef __COMMAND_QUEUE_H__
+#define __COMMAND_QUEUE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <hal.h>
+#include <frameParser.h>
+
+#define COMMAND_QUEUE_SIZE 4
+// fits +SBDIX with location
+#define COMMAND_TEXT_SIZE 72
+// default timeout in ms
+#define DEFAULT_COMMAND_TIMEOUT 5000
+
+#define PRIORITY_NORMAL 0
+// data following READY has to be sent before anything else
+#define PRIORITY_HIGH 1
+
+enum CommandResult { COMMAND_OK, COMMAND_ERROR, COMMAND_TIMEOUT };
+
+typedef std::function<void(CommandResult)> CommandCallback;
+
+struct AtCommand {
+    // without AT prefix and line end, e.g. +CSQ
+    char text[COMMAND_TEXT_SIZE] = {0};
+    // raw commands only
+    const uint8_t *data = nullptr;
+    size_t len = 0;
+    RockblockStatus expected = OK_STATUS;
+    uint32_t timeout = DEFAULT_COMMAND_TIMEOUT;
+    uint8_t priority = PRIORITY_NORMAL;
+    // the response is binary, see FrameParser::expectBinary()
+    bool binary = false;
+    // the response starts with a numeric information line, always true for
+    // raw commands, see FrameParser::expectInfo()
+    bool info = false;
+    CommandCallback callback = nullptr;
+};
+
+class CommandQueue {
+
+    private:
+        AtCommand items[COMMAND_QUEUE_SIZE];
+        size_t count = 0;
+        AtCommand current;
+        bool in_flight = false;
+        uint32_t sent_at = 0;
+        bool insert(const AtCommand &command);
+        bool matches(const FrameParser &parser);
+        void finish(CommandResult result);
+
+    public:
+        CommandQueue();
+        // returns false if the queue is full
+        bool push(const char *text, CommandCallback callback,
+            RockblockStatus expected=OK_STATUS,
+            uint32_t timeout=DEFAULT_COMMAND_TIMEOUT,
+            uint8_t priority=PRIORITY_NORMAL, bool binary=false,
+            bool info=false);
+        bool pushRaw(const uint8_t *data, size_t len, CommandCallback callback,
+            uint32_t timeout=DEFAULT_COMMAND_TIMEOUT,
+            uint8_t priority=PRIORITY_HIGH);
+        // send the next command if none is in flight, returns the command sent
+        const AtCommand* start(AbstractSerial *serial, uint32_t now);
+        // complete the command in flight with a complete frame, returns false
+        // if the frame does not belong to it (e.g. a late response)
+        bool complete(const FrameParser &parser);
+        // returns true if the command in flight timed out
+        bool checkTimeout(uint32_t now);
+        // a command is in flight
+        bool busy();
+        // nothing in flight or queued
+        bool idle();
+        // drop all commands without calling back, e.g. when powered off
+        void clear();
+        // text of the command in flight, empty for raw commands
+        const char* currentText();
+};
+
+#endif
@@ -0,0 +1,379 @@
+#include <frameParser.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define OK_TOKEN "OK"
+#define ERROR_TOKEN "ERROR"
+#define READY_TOKEN "READY"
+// unsolicited ring alert, might arrive at any time
+#define RING_TOKEN "SBDRING"
+// numeric result codes (ATV0), other codes are errors
+#define OK_CODE 0
+#define RING_CODE 126
+#define MAX_CODE_LEN 3
+#define LINE_SEP "\r\n"
+#define SEP_LEN 2
+
+/*
+ * Least significant two bytes of the sum of all message bytes.
+ */
+uint16_t sbdChecksum(const uint8_t *bfr, size_t len) {
+    uint16_t sum = 0;
+    for (size_t i = 0; i < len; i++) { sum += bfr[i]; }
+    return sum;
+}
+
+bool ResponseValues::push_back(int16_t value) {
+    if (this->count == MAX_RESPONSE_VALUES) { return false; }
+    this->data[this->count++] = value;
+    return true;
+}
+
+/*
+ * Reset all results, call before parsing the next frame.
+ */
+void FrameParser::reset() {
+    this->line_type = COMMAND_LINE;
+    this->line_idx = 0;
+    this->line_len = 0;
+    this->line_started = false;
+    this->pending_cr = false;
+    this->line_payload_start = 0;
+    this->command_len = 0;
+    this->response_len = 0;
+    this->payload_len = 0;
+    this->in_values = false;
+    this->binary_idx = 0;
+    this->binary_len = 0;
+    this->binary_checksum = 0;
+    this->endValue();
+    this->command[0] = '\0';
+    this->response[0] = '\0';
+    this->payload[0] = '\0';
+    this->values.clear();
+    this->status = WAIT_STATUS;
+    this->complete = false;
+    this->binary = NO_BINARY;
+    this->binary_valid = false;
+    this->line_digits = false;
+    this->info_expected = false;
+}
+
+void FrameParser::expectBinary() {
+    this->reset();
+    this->binary = BINARY_EXPECTED;
+}
+
+void FrameParser::expectInfo() {
+    this->reset();
+    this->info_expected = true;
+}
+
+void FrameParser::setTerse(bool terse) {
+    this->terse = terse;
+}
+
+/*
+ * Parse the binary part of a frame, returns false if the byte has not been
+ * used. The modem sends two bytes length, message, and two bytes checksum
+ * right after the echo of the command. The echo might end without \n, since
+ * the length is at most 340 the first byte is never \n.
+ */
+bool FrameParser::feedBinary(char c) {
+    uint8_t byte = (uint8_t) c;
+    switch (this->binary) {
+        case BINARY_EXPECTED:
+            // without echo the length comes first, its first byte is never
+            // the A of an echo
+            if (this->terse && this->command_len == 0 && c != 'A') {
+                this->line_idx = 1;
+                this->binary = BINARY_LENGTH;
+                return this->feedBinary(c);
+            }
+            // end of command echo starts binary
+            if (c != '\r' || this->command_len == 0) { return false; }
+            this->line_idx = 1;
+            this->line_len = 0;
+            this->line_started = false;
+            this->binary = BINARY_LF;
+            return true;
+        case BINARY_LF:
+            this->binary = BINARY_LENGTH;
+            if (c == '\n') { return true; }
+            return this->feedBinary(c);
+        case BINARY_LENGTH:
+            this->binary_len = (this->binary_len << 8) | byte;
+            if (++this->binary_idx < 2) { return true; }
+            this->binary_idx = 0;
+            this->binary = (this->binary_len > 0) ?
+                BINARY_DATA : BINARY_CHECKSUM;
+            return true;
+        case BINARY_DATA:
+            if (this->payload_len < MAX_MESSAGE_SIZE - 1) {
+                this->payload[this->payload_len++] = c;
+                this->payload[this->payload_len] = '\0';
+            }
+            if (++this->binary_idx == this->binary_len) {
+                this->binary_idx = 0;
+                this->binary = BINARY_CHECKSUM;
+            }
+            return true;
+        case BINARY_CHECKSUM:
+            this->binary_checksum = (this->binary_checksum << 8) | byte;
+            if (++this->binary_idx < 2) { return true; }
+            this->binary_valid = (
+                this->binary_len == this->payload_len &&
+                this->binary_checksum == sbdChecksum(
+                    (const uint8_t*) this->payload, this->payload_len));
+            // status lines follow, payload is complete
+            this->line_idx = 2;
+            this->binary = NO_BINARY;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Finish a response value, values are separated by commas.
+ */
+void FrameParser::endValue() {
+    if (this->value_digits) {
+        this->values.push_back(
+            this->value_negative ? -this->value : this->value);
+    }
+    this->value = 0;
+    this->value_digits = false;
+    this->value_negative = false;
+}
+
+/*
+ * Decide what to do with a line on its first byte (or at its end if empty).
+ * The rules follow the position of the line within the frame:
+ *
+ * - command will be always the first valid line
+ * - response will be always the second valid line and start with +
+ * - payload will always (!) start (!) on the third valid line, will not start
+ *   with an empty line, and should be tolerant to any content after that
+ */
+void FrameParser::startLine(char c) {
+    this->line_started = true;
+    this->line_digits = true;
+    // no echo, the frame starts with the response
+    if (
+        this->terse && this->line_idx == 0 && c != '\0' && c != 'A' &&
+        !this->info_expected
+    ) {
+        this->line_idx = 1;
+    }
+    if (this->line_idx == 0) {
+        this->line_type = (c != '\0') ? COMMAND_LINE : OTHER_LINE;
+    } else if (this->line_idx == 1) {
+        this->line_type = (c == '+') ? RESPONSE_LINE : OTHER_LINE;
+    } else if (this->binary_len > 0) {
+        // lines after a binary message are never payload
+        this->line_type = OTHER_LINE;
+    } else if (
+        (this->line_idx == 2 && c != '\0') ||
+        (this->line_idx > 2 && this->payload_len > 0)
+    ) {
+        this->line_type = PAYLOAD_LINE;
+        this->line_payload_start = this->payload_len;
+        if (this->payload_len > 0 &&
+            this->payload_len + SEP_LEN < MAX_MESSAGE_SIZE
+        ) {
+            memcpy(this->payload + this->payload_len, LINE_SEP, SEP_LEN);
+            this->payload_len += SEP_LEN;
+            this->payload[this->payload_len] = '\0';
+        }
+    } else {
+        this->line_type = OTHER_LINE;
+    }
+}
+
+void FrameParser::appendToLine(char c) {
+    if (!this->line_started) { this->startLine(c); }
+    this->line_digits &= (c >= '0' && c <= '9');
+    if (this->line_len < sizeof(this->token) - 1) {
+        this->token[this->line_len] = c;
+    }
+    this->line_len++;
+    switch (this->line_type) {
+        case COMMAND_LINE:
+            if (this->command_len < MAX_COMMAND_SIZE - 1) {
+                this->command[this->command_len++] = c;
+                this->command[this->command_len] = '\0';
+            }
+            break;
+        case RESPONSE_LINE:
+            if (this->response_len < MAX_RESPONSE_SIZE - 1) {
+                this->response[this->response_len++] = c;
+                this->response[this->response_len] = '\0';
+            }
+            if (!this->in_values) {
+                this->in_values = (c == ':');
+            } else if (c >= '0' && c <= '9') {
+                this->value = this->value * 10 + (c - '0');
+                this->value_digits = true;
+            } else if (c == '-' && !this->value_digits) {
+                this->value_negative = true;
+            } else if (c == ',') {
+                this->endValue();
+            }
+            break;
+        case PAYLOAD_LINE:
+            if (this->payload_len < MAX_MESSAGE_SIZE - 1) {
+                this->payload[this->payload_len++] = c;
+                this->payload[this->payload_len] = '\0';
+            }
+            break;
+        case OTHER_LINE:
+            break;
+    }
+}
+
+/*
+ * Remove an unsolicited line from the frame, it does not count as a line.
+ */
+void FrameParser::dropLine() {
+    switch (this->line_type) {
+        case COMMAND_LINE:
+            this->command_len = 0;
+            this->command[0] = '\0';
+            break;
+        case RESPONSE_LINE:
+            this->response_len = 0;
+            this->response[0] = '\0';
+            this->in_values = false;
+            this->values.clear();
+            break;
+        case PAYLOAD_LINE:
+            this->payload_len = this->line_payload_start;
+            this->payload[this->payload_len] = '\0';
+            break;
+        case OTHER_LINE:
+            break;
+    }
+    this->line_len = 0;
+    this->line_started = false;
+}
+
+/*
+ * A number ending with a single \r is a result code unless an information
+ * line is expected
+ */
+bool FrameParser::isResultCode() {
+    return (
+        this->terse && this->line_started && this->line_digits &&
+        this->line_len <= MAX_CODE_LEN && !this->info_expected);
+}
+
+/*
+ * Finish a line, detect status lines. A status line ends the frame and is
+ * removed from the payload. Ring alerts are removed from the frame.
+ */
+void FrameParser::endLine(bool result_code) {
+    if (!this->line_started) { this->startLine('\0'); }
+    if (this->line_type == RESPONSE_LINE) { this->endValue(); }
+    this->token[
+        (this->line_len < sizeof(this->token)) ?
+        this->line_len : sizeof(this->token) - 1] = '\0';
+    if (
+        (result_code && atoi(this->token) == RING_CODE) || (
+        this->line_len < sizeof(this->token) &&
+        strcmp(this->token, RING_TOKEN) == 0)
+    ) {
+        this->ring = true;
+        this->dropLine();
+        return;
+    }
+    // anything but an echo satisfies an expected information line
+    if (this->line_len > 0 && this->token[0] != 'A') {
+        this->info_expected = false;
+    }
+    if (result_code) {
+        this->status = (atoi(this->token) == OK_CODE) ?
+            OK_STATUS : ERROR_STATUS;
+    // Parse status, occurs the last line but on the second at the earliest
+    } else if (this->line_idx > 0 && this->line_len < sizeof(this->token)) {
+        // in terse mode only the response to ATE0 has status words
+        bool words = !this->terse || this->command[0] == 'A';
+        if (words && strcmp(this->token, OK_TOKEN) == 0) {
+            this->status = OK_STATUS;
+        } else if (words && strcmp(this->token, ERROR_TOKEN) == 0) {
+            this->status = ERROR_STATUS;
+        } else if (strcmp(this->token, READY_TOKEN) == 0) {
+            this->status = READY_STATUS;
+        }
+    }
+    if (this->status != WAIT_STATUS) {
+        if (this->line_type == PAYLOAD_LINE) {
+            // remove the status line and its separator
+            this->payload_len = (this->line_payload_start > 0) ?
+                this->line_payload_start : 0;
+            this->payload[this->payload_len] = '\0';
+        }
+        this->complete = true;
+    } else if (this->line_len > 0) {
+        // skip empty lines, increase index unless line is empty
+        this->line_idx++;
+    }
+    this->line_len = 0;
+    this->line_started = false;
+}
+
+/*
+ * Feed a single byte. Lines are separated by \r\n, a single \r or \n is
+ * treated as content, except for the \r ending a result code in terse mode.
+ * Returns true once the frame is complete, feeding more bytes after that
+ * starts a new frame.
+ */
+bool FrameParser::feed(char c) {
+    if (this->complete) { this->reset(); }
+    if (this->binary != NO_BINARY && this->feedBinary(c)) {
+        return this->complete;
+    }
+    if (this->pending_cr) {
+        this->pending_cr = false;
+        if (c == '\n') {
+            this->endLine();
+            return this->complete;
+        }
+        this->appendToLine('\r');
+    }
+    if (c == '\r' && this->isResultCode()) {
+        this->endLine(true);
+    } else if (c == '\r') {
+        this->pending_cr = true;
+    } else if (c == '\n' && this->terse && !this->line_started) {
+        // stray line feed, e.g. a result code with \r\n
+    } else {
+        this->appendToLine(c);
+    }
+    return this->complete;
+}
+
+size_t FrameParser::feed(const char *bfr, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (this->feed(bfr[i])) { return i + 1; }
+    }
+    return len;
+}
+
+/*
+ * Feed a view from the serial stream without copying it.
+ */
+size_t FrameParser::feed(const FrameView &view) {
+    size_t used = this->feed(view.first, view.first_len);
+    if (this->complete || used < view.first_len) { return used; }
+    return used + this->feed(view.second, view.second_len);
+}
+
+/*
+ * Parse a Rockblock Serial frame at once. Kept for testing and for frames
+ * that have been assembled elsewhere.
+ */
+void FrameParser::parse(const char *frame) {
+    this->reset();
+    this->feed(frame, strlen(frame));
+}
@@ -0,0 +1,136 @@
+/*
+ * Streaming parser for Rockblock AT frames. Bytes are fed as they arrive, the
+ * parser keeps its state between calls and signals when a frame is complete.
+ *
+ * A frame consists of lines separated by \r\n:
+ *
+ *  - command, the first non-empty line (echo of the command sent)
+ *  - response, the second line if it starts with +, e.g. +CSQ:4
+ *  - payload, all lines between response and status, e.g. for +SBDRT
+ *  - status, a line that is exactly OK, ERROR, or READY; ends the frame
+ *
+ * Binary responses (+SBDRB) are announced with expectBinary() before the
+ * command is sent. The binary message, length prefixed and followed by a
+ * checksum, replaces the payload lines.
+ *
+ * In terse mode (ATE0, ATV0) the modem does not echo commands and ends frames
+ * with a numeric result code followed by a single \r, e.g. 0 for OK. Frames
+ * without echo start with the response. Information lines that consist of a
+ * number like result codes (+SBDD, message written) end with \r\n and are
+ * announced with expectInfo(), they take the place of the command. The
+ * verbose format is still understood, i.e. before the modem is switched.
+ *
+ * The parser does not allocate memory, all results are kept in fixed size
+ * buffers and truncated if too long.
+ */
+#ifndef __FRAME_PARSER_H__
+#define __FRAME_PARSER_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <ringBuffer.h>
+
+// TODO: Determine actual maximum sizes, there is plenty of memory, we can be
+// generous for now.
+#define MAX_COMMAND_SIZE 256
+#define MAX_RESPONSE_SIZE 128
+// This number is from the Rockblock documentation
+#define MAX_MESSAGE_SIZE 340
+#define MAX_FRAME_SIZE 512
+// +SBDIX returns the most values with 6
+#define MAX_RESPONSE_VALUES 8
+
+// Rockblock status type
+enum RockblockStatus { WAIT_STATUS, OK_STATUS, READY_STATUS, ERROR_STATUS };
+
+// Two byte checksum used by +SBDWB and +SBDRB
+uint16_t sbdChecksum(const uint8_t *bfr, size_t len);
+
+/*
+ * Fixed capacity list of numeric response values. Mimics the parts of
+ * std::vector used by Rockblock. Reading out of range returns 0.
+ */
+class ResponseValues {
+    private:
+        int16_t data[MAX_RESPONSE_VALUES] = {0};
+        size_t count = 0;
+    public:
+        size_t size() const { return this->count; };
+        int16_t operator[](size_t idx) const {
+            return (idx < this->count) ? this->data[idx] : 0; };
+        void clear() { this->count = 0; };
+        bool push_back(int16_t value);
+};
+
+// Parse Serial frames
+class FrameParser {
+    private:
+        // role of the current line
+        enum LineType { COMMAND_LINE, RESPONSE_LINE, PAYLOAD_LINE, OTHER_LINE };
+        LineType line_type = COMMAND_LINE;
+        // number of non-empty, non-status lines so far
+        size_t line_idx = 0;
+        size_t line_len = 0;
+        bool line_started = false;
+        bool pending_cr = false;
+        // start of the current line in payload, used to remove status lines
+        size_t line_payload_start = 0;
+        size_t command_len = 0;
+        size_t response_len = 0;
+        size_t payload_len = 0;
+        // beginning of every line to recognize status lines
+        char token[8] = {0};
+        // numeric result codes, see setTerse()
+        bool terse = false;
+        bool line_digits = false;
+        bool info_expected = false;
+        bool isResultCode();
+        // binary message parsing
+        enum BinaryState {
+            NO_BINARY, BINARY_EXPECTED, BINARY_LF, BINARY_LENGTH, BINARY_DATA,
+            BINARY_CHECKSUM };
+        BinaryState binary = NO_BINARY;
+        size_t binary_idx = 0;
+        size_t binary_len = 0;
+        uint16_t binary_checksum = 0;
+        bool feedBinary(char c);
+        // incremental response value parsing
+        bool in_values = false;
+        bool value_digits = false;
+        bool value_negative = false;
+        int32_t value = 0;
+        void startLine(char c);
+        void appendToLine(char c);
+        void endLine(bool result_code=false);
+        void dropLine();
+        void endValue();
+    public:
+        FrameParser() {};
+        char command[MAX_COMMAND_SIZE] = {0};
+        char response[MAX_RESPONSE_SIZE] = {0};
+        RockblockStatus status = WAIT_STATUS;
+        ResponseValues values;
+        char payload[MAX_MESSAGE_SIZE] = {0};
+        // true once a status line has been parsed
+        bool complete = false;
+        // binary payload received with a valid checksum
+        bool binary_valid = false;
+        // unsolicited SBDRING received, kept until cleared by the caller
+        bool ring = false;
+        size_t payloadLength() const { return this->payload_len; };
+        void reset();
+        // the next frame contains a binary message after the command line
+        void expectBinary();
+        // the next frame starts with a numeric information line, terse only
+        void expectInfo();
+        // the modem sends numeric result codes and no echo, kept on reset
+        void setTerse(bool terse);
+        // feed a single byte, returns true if the frame is complete
+        bool feed(char c);
+        // feed bytes until a frame is complete, returns bytes used
+        size_t feed(const char *bfr, size_t len);
+        size_t feed(const FrameView &view);
+        // parse a complete frame at once
+        void parse(const char *frame);
+};
+
+#endif /* __FRAME_PARSER_H__ */
@@ -0,0 +1,196 @@
+#include <retryPolicy.h>
+#include <string.h>
+
+// Success rates assumed without history, signal strength 0 to 5
+static const float priorSuccessRate[SIGNAL_LEVELS] = {
+    0, 0.05, 0.15, 0.6, 0.8, 0.9};
+
+// Backoff after failed sessions in seconds, the last value repeats. Short
+// delays first while the satellite might still be in view.
+static const uint16_t backoffSchedule[] = {5, 10, 20, 40, 80, 160, 300};
+#define BACKOFF_STEPS (sizeof(backoffSchedule) / sizeof(backoffSchedule[0]))
+
+
+RetryPolicy::RetryPolicy() {}
+
+/*
+ * Pseudo random numbers for backoff jitter (xorshift32), does not have to be
+ * good but has to differ between devices, see setSeed().
+ */
+uint32_t RetryPolicy::random() {
+    this->seed ^= this->seed << 13;
+    this->seed ^= this->seed >> 17;
+    this->seed ^= this->seed << 5;
+    return this->seed;
+}
+
+/*
+ * Prepare for a new message, keeps the signal history
+ */
+void RetryPolicy::reset(uint32_t now) {
+    this->next_attempt = now;
+    this->waiting_since = now;
+    this->polled_once = false;
+    this->failures = 0;
+    this->reading_count = 0;
+}
+
+void RetryPolicy::setSeed(uint32_t seed) {
+    this->seed = seed ? seed : 1;
+}
+
+void RetryPolicy::setDeadline(uint32_t deadline) {
+    this->deadline = deadline;
+}
+
+/*
+ * Poll at most every CSQ_POLL_INTERVAL and not while backing off
+ */
+bool RetryPolicy::readyToPoll(uint32_t now) {
+    if ((int32_t) (now - this->next_attempt) < 0) { return false; }
+    if (!this->polled_once) { return true; }
+    return now - this->last_poll >= CSQ_POLL_INTERVAL;
+}
+
+void RetryPolicy::polled(uint32_t now) {
+    this->last_poll = now;
+    this->polled_once = true;
+}
+
+/*
+ * Average of the last SIGNAL_AVERAGE readings since the last attempt, fewer
+ * right after it. Rounded down, a bar more has to show in most readings.
+ */
+uint8_t RetryPolicy::addReading(uint8_t signal) {
+    if (signal >= SIGNAL_LEVELS) { signal = SIGNAL_LEVELS - 1; }
+    if (this->reading_count == SIGNAL_AVERAGE) {
+        memmove(this->readings, this->readings + 1, SIGNAL_AVERAGE - 1);
+        this->reading_count--;
+    }
+    this->readings[this->reading_count++] = signal;
+    uint16_t sum = 0;
+    for (uint8_t i = 0; i < this->reading_count; i++) {
+        sum += this->readings[i];
+    }
+    return sum / this->reading_count;
+}
+
+/*
+ * Success rate from history, smoothed with the prior success rate
+ */
+float RetryPolicy::successRate(uint8_t signal) {
+    if (signal >= SIGNAL_LEVELS) { signal = SIGNAL_LEVELS - 1; }
+    return (
+        (this->history.successes[signal] +
+            PRIOR_WEIGHT * priorSuccessRate[signal]) /
+        (this->history.attempts[signal] + PRIOR_WEIGHT));
+}
+
+/*
+ * Lowest signal strength with a sufficient success rate. After waiting for a
+ * long time one bar less is accepted if sessions still succeed regularly,
+ * close to the deadline any signal.
+ */
+uint8_t RetryPolicy::threshold(uint32_t now) {
+    float needed = MIN_SUCCESS_RATE;
+    if (this->deadline != 0) {
+        float left = (int32_t) (this->deadline - now) - DEADLINE_MARGIN;
+        if (left < DEADLINE_WINDOW) {
+            float share = (left > 0) ? left / DEADLINE_WINDOW : 0;
+            needed = DEADLINE_SUCCESS_RATE +
+                (needed - DEADLINE_SUCCESS_RATE) * share;
+        }
+    }
+    uint8_t threshold = SIGNAL_LEVELS - 1;
+    for (uint8_t i = 1; i < SIGNAL_LEVELS; i++) {
+        if (this->successRate(i) >= needed) {
+            threshold = i;
+            break;
+        }
+    }
+    if (
+        (int32_t) (now - this->waiting_since) >= THRESHOLD_RELAX_AFTER &&
+        threshold > 1 &&
+        this->successRate(threshold - 1) >= RELAXED_SUCCESS_RATE
+    ) {
+        threshold--;
+    }
+    return threshold;
+}
+
+bool RetryPolicy::shouldAttempt(uint8_t signal, uint32_t now) {
+    if ((int32_t) (now - this->next_attempt) < 0) { return false; }
+    return signal >= this->threshold(now);
+}
+
+void RetryPolicy::record(uint8_t signal, bool success) {
+    if (signal >= SIGNAL_LEVELS) { signal = SIGNAL_LEVELS - 1; }
+    if (this->history.attempts[signal] >= HISTORY_LIMIT) {
+        this->history.attempts[signal] /= 2;
+        this->history.successes[signal] /= 2;
+    }
+    this->history.attempts[signal]++;
+    if (success) { this->history.successes[signal]++; }
+}
+
+/*
+ * Update history and schedule the next attempt. Only results of an actual
+ * transmission count towards the signal history, see MO status codes in the
+ * ISU AT command reference.
+ */
+uint32_t RetryPolicy::onResult(uint8_t signal, uint8_t code, uint32_t now) {
+    uint32_t backoff = 0;
+    switch (code) {
+        case 0: case 1: case 2: case 3: case 4:
+            this->record(signal, true);
+            this->failures = 0;
+            break;
+        // call did not complete, session timeout, RF drop or link failure
+        case 10: case 13: case 17: case 18: case 19: {
+            this->record(signal, false);
+            uint8_t step = (this->failures < BACKOFF_STEPS) ?
+                this->failures : BACKOFF_STEPS - 1;
+            backoff = backoffSchedule[step] * 1000;
+            // +-25% jitter
+            backoff += (this->random() % (backoff / 2)) - backoff / 4;
+            this->failures++;
+            break;
+        }
+        // no network service, antenna fault, radio disabled or busy, nothing
+        // has been transmitted
+        case 32: case 33: case 34: case 35:
+            backoff = NO_SERVICE_BACKOFF;
+            break;
+        // registration failed, has to wait for 3 minutes
+        case 36:
+            backoff = REGISTRATION_BACKOFF;
+            break;
+        // gateway rejected the message or traffic management
+        default:
+            backoff = GATEWAY_BACKOFF;
+            break;
+    }
+    // keep time for more attempts before the deadline
+    if (this->deadline != 0) {
+        int32_t left = (int32_t) (this->deadline - now) - LAST_ATTEMPT_MARGIN;
+        uint32_t limit = (left > 0) ? left / BACKOFF_SHARE : 0;
+        if (backoff > limit) { backoff = limit; }
+    }
+    this->next_attempt = now + backoff;
+    this->waiting_since = this->next_attempt;
+    // readings from before the session are outdated
+    this->reading_count = 0;
+    return backoff;
+}
+
+uint8_t RetryPolicy::consecutiveFailures() {
+    return this->failures;
+}
+
+signalHistory RetryPolicy::getHistory() {
+    return this->history;
+}
+
+void RetryPolicy::setHistory(const signalHistory &history) {
+    this->history = history;
+}
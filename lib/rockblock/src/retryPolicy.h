@@ -0,0 +1,107 @@
+/*
+ * Retry policy for SBD sessions. Every +SBDIX attempt transmits at high
+ * current, hence the policy decides
+ *
+ * - how often signal strength is polled (+CSQF returns the last known value
+ *   without waiting for a new measurement). The last few readings are
+ *   averaged, a single reading is often one bar off,
+ * - which signal strength is good enough to attempt a session. The threshold
+ *   is learned from past attempts and successes per signal strength and
+ *   starts at 3 bars. Close to the deadline of the wake up any signal that
+ *   still succeeds sometimes is good enough, a late attempt is better than
+ *   no report,
+ * - how long to back off after a failed session. Iridium recommends
+ *   randomized, increasing delays between attempts, and fixed delays for
+ *   some error codes, e.g. 3 minutes after a failed registration (36).
+ *
+ * The policy does not depend on hardware and uses times in milliseconds
+ * passed by the caller.
+ */
+#ifndef __RETRY_POLICY_H__
+#define __RETRY_POLICY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stateType.h>
+
+// minimal time between signal polls
+#define CSQ_POLL_INTERVAL 2000
+// signal polls averaged, single readings are often one bar off
+#define SIGNAL_AVERAGE 4
+// estimated success rate needed to attempt a session
+#define MIN_SUCCESS_RATE 0.2
+// accept one bar less after waiting for a better signal for a while
+#define THRESHOLD_RELAX_AFTER 60000
+#define RELAXED_SUCCESS_RATE 0.1
+// accept any signal that still succeeds sometimes once the deadline is this
+// close, ms, about two sessions, the needed success rate drops linearly over
+// the window before that
+#ifndef DEADLINE_MARGIN
+#define DEADLINE_MARGIN 60000
+#endif
+#ifndef DEADLINE_WINDOW
+#define DEADLINE_WINDOW 180000
+#endif
+#ifndef DEADLINE_SUCCESS_RATE
+#define DEADLINE_SUCCESS_RATE 0.02
+#endif
+// a backoff takes at most this share of the time left before the deadline,
+// minus the time for one more session, ms
+#ifndef BACKOFF_SHARE
+#define BACKOFF_SHARE 40
+#endif
+#ifndef LAST_ATTEMPT_MARGIN
+#define LAST_ATTEMPT_MARGIN 20000
+#endif
+// weight of the prior success rates in attempts
+#define PRIOR_WEIGHT 4
+// attempts and successes are halved when reaching the limit, this way
+// recent attempts count more
+#define HISTORY_LIMIT 200
+// backoff in ms for results not depending on signal strength
+#define NO_SERVICE_BACKOFF 10000
+#define REGISTRATION_BACKOFF 180000
+#define GATEWAY_BACKOFF 300000
+
+class RetryPolicy {
+
+    private:
+        signalHistory history;
+        uint32_t next_attempt = 0;
+        uint32_t last_poll = 0;
+        bool polled_once = false;
+        uint32_t waiting_since = 0;
+        uint8_t failures = 0;
+        uint8_t readings[SIGNAL_AVERAGE] = {0};
+        uint8_t reading_count = 0;
+        uint32_t seed = 1;
+        // 0 without deadline
+        uint32_t deadline = 0;
+        uint32_t random();
+        void record(uint8_t signal, bool success);
+
+    public:
+        RetryPolicy();
+        // a new message is queued, history is kept
+        void reset(uint32_t now);
+        // backoff jitter, has to differ between devices, e.g. the MAC
+        void setSeed(uint32_t seed);
+        // time the message has to be sent by, ms
+        void setDeadline(uint32_t deadline);
+        bool readyToPoll(uint32_t now);
+        void polled(uint32_t now);
+        // add a polled signal strength, returns the average of the recent
+        // readings to decide on and report
+        uint8_t addReading(uint8_t signal);
+        // estimated success rate of a session at the given signal strength
+        float successRate(uint8_t signal);
+        uint8_t threshold(uint32_t now);
+        bool shouldAttempt(uint8_t signal, uint32_t now);
+        // update with the +SBDIX MO status, returns backoff in ms
+        uint32_t onResult(uint8_t signal, uint8_t code, uint32_t now);
+        uint8_t consecutiveFailures();
+        signalHistory getHistory();
+        void setHistory(const signalHistory &history);
+};
+
+#endif
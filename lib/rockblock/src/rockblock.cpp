@@ -1,13 +1,8 @@
 #include <rockblock.h>
 #include <cstring>
-#include <vector>
-
-#define OK_TOKEN "OK"
-#define ERROR_TOKEN "ERROR"
-#define READY_TOKEN "READY"
-#define SEND_THRESHOLD 3
-#define LINE_SEP "\r\n"
-#define SEP_LEN 2
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 
 /*
  * Implemented Rockblock commands, see
@@ -19,21 +14,49 @@
 #define AT_COMMAND ""
 // Create a prompt to store text message
 #define SBDWT_COMMAND "+SBDWT"
-// We could extent on the SBDIX command since it would take a location as
-// argument which might save on payload size.
+// Create a prompt to store binary message, followed by =<length>
+#define SBDWB_COMMAND "+SBDWB"
+// Start a session, optionally followed by =<lat>,<lon> which moves the
+// location into the session header instead of the payload
 #define SBDIX_COMMAND "+SBDIX"
-// signal strength command
+// Same as +SBDIX but answers a ring alert
+#define SBDIXA_COMMAND "+SBDIXA"
+// enable ring alerts
+#define SBDMTA_COMMAND "+SBDMTA=1"
+// signal strength command, waits for a new measurement
 #define CSQ_COMMAND "+CSQ"
+// last known signal strength, returns immediately
+#define CSQF_COMMAND "+CSQF"
 // clear MO and MT buffer command
 #define SBDD_COMMAND "+SBDD2"
+// clear MO buffer command
+#define SBDD_MO_COMMAND "+SBDD0"
 // retrieve incoming message
 #define SBDRT_COMMAND "+SBDRT"
+// retrieve incoming binary message
+#define SBDRB_COMMAND "+SBDRB"
+// terse dialect, no echo and numeric result codes
+#define ECHO_OFF_COMMAND "E0"
+#define NUMERIC_COMMAND "V0"
+
+// +CSQ waits for a new measurement
+#define CSQ_TIMEOUT 20000
+// a session takes about 20 s, up to a minute
+#define SBDIX_TIMEOUT 90000
+// MO status used for a session without response, call did not complete
+#define SBDIX_TIMEOUT_CODE 10
+// +SBDWB result codes, no response or an unknown answer counts as timeout
+#define SBDWB_OK 0
+#define SBDWB_TIMEOUT 1
+#define SBDWB_CHECKSUM 2
+#define SBDWB_SIZE 3
 
 #define RB_SUCCESS_TEMPLATE "Rockblock send success!\nTime: %.0f seconds\nRetries: %d\nTrigger signal strength: %d\n"
 
-// This unfortunately requires the Arduino String class in order to be
-// printable.
-std::map<RockblockStatus, String> statusLabels = {
+// Labels for debug output
+const char* writeResultLabels[] = {"ok", "timeout", "checksum", "size"};
+
+std::map<RockblockStatus, const char*> statusLabels = {
   {WAIT_STATUS, "WAIT"}, {OK_STATUS, "OK"}, {READY_STATUS, "READY"},
   {ERROR_STATUS, "ERROR"}
 };
@@ -61,16 +84,16 @@ char* strsep_multi(char** stringp, const char* delim) {
 
 /*
  * Convert float to a NMEA formatted string. Could be reused in ScoutMessages
+ *
+ * Rounds once to thousandths of minutes so that e.g. 23.9999999 results in
+ * 2400.000 instead of 2360.000.
  */
 size_t float2NmeaNumber(char* bfr, float val, int digits=3) {
-    float whole;
-    float mins = abs(std::modf(val, &whole)) * 60;
+    uint32_t mins = (uint32_t) lround(fabs((double) val) * 60000);
     char sign = (val < 0) ? '-' : '+';
-    if (digits == 2) {
-        return snprintf(bfr, 32, "%c%02.0f%06.3f", sign, abs(whole), mins);
-    } else {
-        return snprintf(bfr, 32, "%c%03.0f%06.3f", sign, abs(whole), mins);
-    }
+    return snprintf(bfr, 32, "%c%0*lu%02lu.%03lu", sign, digits,
+        (unsigned long) mins / 60000, (unsigned long) (mins / 1000) % 60,
+        (unsigned long) mins % 1000);
 }
 
 /*
@@ -78,130 +101,39 @@ size_t float2NmeaNumber(char* bfr, float val, int digits=3) {
  * to float2Nmea in Scout messages but the format is also different hence
  * a single function instead of reusing part of it and creating three functions
  * that had to be combined in different manners. 
+ *
+ * Format: +SBDIX=[+|-]DDMM.MMM,[+|-]dddMM.MMM
  */
 size_t getSbdixWithLocation(char* bfr, float lat, float lon) {
     char latBfr[32] = {0};
     char lonBfr[32] = {0};
     float2NmeaNumber(latBfr, lat, 2);
     float2NmeaNumber(lonBfr, lon, 3);
-    return sniprintf(bfr, 64, "%s=%s,%s", SBDIX_COMMAND, latBfr, lonBfr);
+    return snprintf(bfr, SBDIX_COMMAND_SIZE, "%s=%s,%s", SBDIX_COMMAND,
+        latBfr, lonBfr);
 }
 
 /*
- * Extract a frame by token and remove it from the incoming serialBuffer.
- * bfr[0] will be 0 if no frame extracted. TODO: We could make this slightly
- * more sophisticated in a way that we could not send messages that break the
- * frame parser. E.g. if the message itself contains characters that are
- * status tokens. Leave that for later.
+ * Inverse of getSbdixWithLocation, i.e. what the ground station receives in
+ * the session header. Accepts the command with or without AT prefix.
  */
-void extractFrame(char* bfr, char* serialBuffer) {
-    const char* stringConstants[] = {OK_TOKEN, ERROR_TOKEN, READY_TOKEN};
-    const char* pos = nullptr;
-    size_t len = 0;
-    size_t idx = 0;
-    for (idx = 0; idx < 3; idx++) {
-        pos = strstr(serialBuffer, stringConstants[idx]);
-        if (pos != nullptr) { break; }
-    }
-    if (pos == nullptr) {
-        bfr[0] = '\0';
-        return;
-    }
-    len = pos + strlen(stringConstants[idx]) + 2 - serialBuffer;
-    // copy frame
-    memcpy(bfr, serialBuffer, len);
-    // remove frame from the head of the Serial buffer
-    strcpy(serialBuffer, pos + strlen(stringConstants[idx]) + 2);
-}
-
-/*
- * Parses a response line from the Rockblock device and extracts integer values.
- */
-void FrameParser::parseResponse(const char* line) {
-    char* rest_ptr = nullptr;
-    char copy_of_line[MAX_FRAME_SIZE] = {0};
-    std::strncpy(copy_of_line, line, MAX_FRAME_SIZE-1);
-    char* token = strtok_r(copy_of_line, ":", &rest_ptr);
-    token = strtok_r(nullptr, ",", &rest_ptr);
-    this->values.clear();
-    while (token != nullptr) {
-        this->values.push_back(std::stoi(token));
-        token = strtok_r(nullptr, ",", &rest_ptr);
-    }
-}
-
-/*
- * Parse a Rockblock Serial frame. strtok does unfortunately not work with
- * empty tokens.
- */
-void FrameParser::parse(const char* frame) {
-    // strsep_multi will consume the buffer, use a copy to allow for const
-    char* rest = strdup(frame);
-    char* token = nullptr;
-    // payload can stretch multiple lines
-    size_t pld_idx = 0;
-    // identify on what line we are on
-    size_t idx = 0;
-    // re-setting default values
-    memset(this->command, 0, MAX_COMMAND_SIZE);
-    memset(this->response, 0, MAX_RESPONSE_SIZE);
-    memset(this->payload, 0, MAX_MESSAGE_SIZE);
-    // we need this local vars since they might change during the parse process
-    // assign final values at the end
-    char pld[MAX_MESSAGE_SIZE] = {0};
-    this->status = WAIT_STATUS;
-    // iterate over tokens
-    while ( (token = strsep_multi(&rest, LINE_SEP)) != NULL ) {
-        // get command. Command will be always the first valid line.
-        if (idx==0) {
-            strncpy(this->command, token, MAX_COMMAND_SIZE);
-        }
-        // parse response. Response will be always the second valid line.
-        if (idx==1) {
-            if  (token[0] == '+') {
-                memset(this->response, 0, MAX_RESPONSE_SIZE);
-                strncpy(this->response, token, MAX_RESPONSE_SIZE);
-                this->parseResponse(token);
-            } else {
-                this->response[0] = '\0';
-            }
-        }
-
-        // Parse status, occurs the last line but on the second at the earliest
-        if (idx > 0) {
-            if (strstr(token, OK_TOKEN) != nullptr) {
-                this->status = OK_STATUS;
-                continue;
-            } else if (strstr(token, ERROR_TOKEN) != nullptr) {
-                this->status = ERROR_STATUS;
-                continue;
-            } else if (strstr(token, READY_TOKEN) != nullptr) {
-                this->status = READY_STATUS;
-                continue;
-            }
-        }
-
-        // Parse payload:
-        // - Will always (!) start (!) on third valid line
-        // - Will not start with /r/n
-        // - After that it should be tolerant to any content
-        if ( (idx == 2 && token[0] != '\0') || (idx > 2 && pld_idx > 0) ) {
-            if (pld_idx > 0) {
-                strncpy(pld + pld_idx, LINE_SEP, SEP_LEN);
-                pld_idx += SEP_LEN;
-            }
-            strncpy(pld + pld_idx, token, MAX_MESSAGE_SIZE - pld_idx);
-            pld_idx += strlen(token);
-        }
-
-        // skip empty lines, increase index unless token is empty
-        if (token[0] != 0) { idx++; }
+bool parseSbdixLocation(const char* bfr, float* lat, float* lon) {
+    const char* start = strstr(bfr, SBDIX_COMMAND "=");
+    if (start == nullptr) { return false; }
+    char latSign, lonSign;
+    unsigned int latDeg, latMin, latFrac, lonDeg, lonMin, lonFrac;
+    int parsed = sscanf(start + sizeof(SBDIX_COMMAND),
+        "%c%2u%2u.%3u,%c%3u%2u.%3u", &latSign, &latDeg, &latMin, &latFrac,
+        &lonSign, &lonDeg, &lonMin, &lonFrac);
+    if (parsed != 8) { return false; }
+    if (latMin > 59 || lonMin > 59 || latDeg > 90 || lonDeg > 180) {
+        return false;
     }
-    // Our current parse method will generate trailing SEP
-    if (pld_idx > SEP_LEN) { strncpy(this->payload, pld, pld_idx-SEP_LEN); }
-    // avoid memory leak from strdup
-    // https://en.cppreference.com/w/c/experimental/dynamic/strdup
-    free(rest);
+    *lat = latDeg + (latMin + latFrac / 1000.0) / 60;
+    *lon = lonDeg + (lonMin + lonFrac / 1000.0) / 60;
+    if (latSign == '-') { *lat = -*lat; }
+    if (lonSign == '-') { *lon = -*lon; }
+    return true;
 }
 
 /*
@@ -214,56 +146,284 @@ Rockblock::Rockblock(AbstractExpander &expander,
     this->expander = &expander;
     this->serial = &serial;
     this->enable_pin = enable_pin;
+    this->policy.setSeed(deviceSeed());
 }
 
 /*
- * Send command and wait for response or (timeout)
+ * Queue a command, see CommandQueue
  */
-void Rockblock::sendCommand(const char* command) {
-    char commandBfr[32] = {0};
-    snprintf(commandBfr, 32, "AT%s\r\n", command);
-    if (!this->commandWaiting) {
-        this->commandWaiting = true;
-        this->serial->print(commandBfr);
-    } else {
-        Serial.println("Failure. Command in process.");
+void Rockblock::sendCommand(const char* command, CommandCallback callback,
+    RockblockStatus expected, uint32_t timeout, bool binary, bool info
+) {
+    if (!this->commands.push(
+        command, callback, expected, timeout, PRIORITY_NORMAL, binary, info)
+    ) {
+        Serial.print("Command queue full, dropped: "); Serial.println(command);
     }
 }
 
 /*
- * Queue a message to send
+ * Reset message related state before queueing a new message
  */
-void Rockblock::sendMessage(char* bfr, size_t len) {
+void Rockblock::resetMessage() {
     Serial.println("Queue message and delete incoming");
     memset(this->message, 0, MAX_MESSAGE_SIZE);
-    memset(this->incoming, 0, MAX_MESSAGE_SIZE);
-    memset(this->sbidxCommand, 0, 64);
+    memset(this->sbidxCommand, 0, SBDIX_COMMAND_SIZE);
+    this->inbox_count = 0;
+    this->mt_queued = 0;
+    this->mo_sent = false;
     this->start_time = esp_timer_get_time() / 1E6;
     this->retries = 0;
+    this->write_failures = 0;
     this->queued = true;
     this->sendSuccess = false;
     this->locationAvailable = false;
+    this->mailbox_check = false;
+    this->fresh_signal = false;
+    this->policy.reset(esp_timer_get_time() / 1000);
     strncpy(this->sbidxCommand, SBDIX_COMMAND, sizeof(SBDIX_COMMAND));
-    snprintf(this->message, 340, "%s\r", bfr);
+}
+
+/*
+ * Whether the message is already in the MO buffer of the modem. Text
+ * messages are stored with a trailing \r.
+ */
+bool Rockblock::isLoaded(const char *bfr, size_t len, bool binary) {
+    if (!this->mo_loaded || this->binary != binary) { return false; }
+    size_t stored_len = binary ? len : len + 1;
+    if (stored_len != this->message_len) { return false; }
+    return memcmp(this->message, bfr, len) == 0;
+}
+
+/*
+ * Queue a message to send. The MO buffer is not rewritten if a retry reuses
+ * the same payload.
+ */
+void Rockblock::sendMessage(char* bfr, size_t len) {
+    bool loaded = this->isLoaded(bfr, strnlen(bfr, len), false);
+    this->resetMessage();
+    this->binary = false;
+    this->message_len = snprintf(
+        this->message, MAX_MESSAGE_SIZE, "%s\r", bfr);
+    this->mo_loaded = loaded;
 };
 
 /*
- * Queue a message to send with location
+ * Queue a binary message to send, the checksum is added when sending
+ */
+void Rockblock::sendMessage(const uint8_t *bfr, size_t len) {
+    len = (len < MAX_MESSAGE_SIZE) ? len : MAX_MESSAGE_SIZE;
+    bool loaded = this->isLoaded((const char*) bfr, len, true);
+    this->resetMessage();
+    this->binary = true;
+    this->message_len = len;
+    memcpy(this->message, bfr, this->message_len);
+    this->mo_loaded = loaded;
+};
+
+/*
+ * Queue a message to send with location. The location is transmitted in the
+ * SBDIX session header, the message should not repeat it.
  */
 void Rockblock::sendMessage(char *bfr, float lat, float lon, size_t len) {
     this->sendMessage(bfr, len);
     this->locationAvailable = true;
-    getSbdixWithLocation(this->sbidxCommand, lat, lat);
-}; 
+    getSbdixWithLocation(this->sbidxCommand, lat, lon);
+};
+
+/*
+ * Queue a binary message to send with location in the session header
+ */
+void Rockblock::sendMessage(
+    const uint8_t *bfr, size_t len, float lat, float lon
+) {
+    this->sendMessage(bfr, len);
+    this->locationAvailable = true;
+    getSbdixWithLocation(this->sbidxCommand, lat, lon);
+};
+
+/*
+ * The payload can be replaced until it is written to the MO buffer for the
+ * session. A message written already is written again before +SBDIX.
+ */
+bool Rockblock::updatable() {
+    return this->queued && !this->mailbox_check && (
+        this->state == OFFLINE || this->state == IDLE ||
+        this->state == COM_CHECK);
+}
+
+/*
+ * Replace the payload of the queued text message
+ */
+bool Rockblock::updateMessage(char *bfr, size_t len) {
+    if (!this->updatable()) { return false; }
+    if (this->isLoaded(bfr, strnlen(bfr, len), false)) { return true; }
+    this->binary = false;
+    this->message_len = snprintf(
+        this->message, MAX_MESSAGE_SIZE, "%s\r", bfr);
+    this->mo_loaded = false;
+    return true;
+}
+
+/*
+ * Replace the payload of the queued binary message
+ */
+bool Rockblock::updateMessage(const uint8_t *bfr, size_t len) {
+    if (!this->updatable()) { return false; }
+    len = (len < MAX_MESSAGE_SIZE) ? len : MAX_MESSAGE_SIZE;
+    if (this->isLoaded((const char*) bfr, len, true)) { return true; }
+    this->binary = true;
+    this->message_len = len;
+    memcpy(this->message, bfr, this->message_len);
+    this->mo_loaded = false;
+    return true;
+}
 
 /*
  * Get an incoming message. Incoming message is only available until 
- * .sendMessage() is called.
+ * .sendMessage() is called. The copy is \0 terminated.
  */
-void Rockblock::getLastIncoming(char *bfr, size_t len) {
-    strncpy(bfr, this->incoming, MAX_MESSAGE_SIZE-1);
+size_t Rockblock::getIncoming(size_t idx, char *bfr, size_t len) {
+    if (len == 0) { return 0; }
+    size_t copy_len = 0;
+    if (idx < this->inbox_count) {
+        copy_len = (this->inbox_len[idx] < len - 1) ?
+            this->inbox_len[idx] : len - 1;
+        memcpy(bfr, this->inbox[idx], copy_len);
+    }
+    bfr[copy_len] = '\0';
+    return copy_len;
 };
 
+size_t Rockblock::getLastIncoming(char *bfr, size_t len) {
+    return this->getIncoming(this->inbox_count - 1, bfr, len);
+};
+
+size_t Rockblock::getIncomingSize() {
+    return this->inbox_count;
+}
+
+/*
+ * Keep an MT message, the inbox is only full if the gateway queued more
+ * messages than we could retrieve
+ */
+void Rockblock::storeIncoming(const char *bfr, size_t len) {
+    if (this->inbox_count == INBOX_SIZE) { return; }
+    len = (len < MAX_MESSAGE_SIZE - 1) ? len : MAX_MESSAGE_SIZE - 1;
+    memcpy(this->inbox[this->inbox_count], bfr, len);
+    this->inbox[this->inbox_count][len] = '\0';
+    this->inbox_len[this->inbox_count] = len;
+    this->inbox_count++;
+    this->incoming_count++;
+}
+
+/*
+ * Whether another session has to check the mailbox
+ */
+bool Rockblock::mailboxPending() {
+    return (
+        this->ring_pending ||
+        (this->mt_queued > 0 && this->inbox_count < INBOX_SIZE));
+}
+
+/*
+ * A session and the optional MT retrieval are done. Our message counts as
+ * sent once all queued MT messages are retrieved, this way all config
+ * changes are applied together.
+ */
+void Rockblock::finishSession() {
+    this->state = IDLE;
+    if (this->mailboxPending()) { return; }
+    if (this->mt_queued > 0) {
+        Serial.print("Inbox full, messages left at gateway: ");
+        Serial.println(this->mt_queued);
+    }
+    this->sendSuccess |= this->mo_sent;
+}
+
+/*
+ * Signal history used by the retry policy, stored by the caller
+ */
+signalHistory Rockblock::getSignalHistory() {
+    return this->policy.getHistory();
+}
+
+void Rockblock::setSignalHistory(const signalHistory &history) {
+    this->policy.setHistory(history);
+}
+
+/*
+ * Any signal is good enough close to the deadline, see RetryPolicy
+ */
+void Rockblock::setDeadline(uint32_t deadline) {
+    this->policy.setDeadline(deadline);
+}
+
+/*
+ * Number of MT messages received, allows to detect messages received while
+ * listening for ring alerts.
+ */
+uint16_t Rockblock::getIncomingCount() {
+    return this->incoming_count;
+}
+
+void Rockblock::setRingAlerts(bool enable) {
+    this->ring_alerts = enable;
+}
+
+/*
+ * Pass the level of the ring indicator pin, it is read by the caller since
+ * the IO expander is shared.
+ */
+void Rockblock::ringIndicator(bool level) {
+    if (this->on && this->ring_enabled && level == RING_ACTIVE_LEVEL) {
+        this->ring_pending = true;
+    }
+}
+
+/*
+ * Use the terse dialect (ATE0, ATV0), set before turning the Rockblock on.
+ * Halves the traffic per command and status words cannot be confused with
+ * payload anymore.
+ */
+void Rockblock::setTerse(bool terse) {
+    this->terse = terse;
+    this->parser.setTerse(terse);
+}
+
+/*
+ * MT messages are read with +SBDRB
+ */
+bool Rockblock::readsBinary() {
+    return this->binary || this->terse;
+}
+
+/*
+ * RTS/CTS on the IO expander. RTS is asserted while the Rockblock is on, no
+ * command is sent while CTS is not asserted. The modem has to be configured
+ * for flow control (AT&K3, its default).
+ */
+void Rockblock::setFlowControl(uint8_t rts_pin) {
+    this->flow_control = true;
+    this->rts_pin = rts_pin;
+}
+
+/*
+ * Pass the level of the CTS pin, it is read by the caller like the ring
+ * indicator
+ */
+void Rockblock::clearToSend(bool level) {
+    this->clear_to_send = level == FLOW_CONTROL_ACTIVE_LEVEL;
+}
+
+/*
+ * A command is queued or waiting for its response, the caller should run the
+ * loop more often
+ */
+bool Rockblock::commandPending() {
+    return !this->commands.idle();
+}
+
 /*
  * Public getter for signal strength
  */
@@ -277,161 +437,382 @@ uint8_t Rockblock::getSignalStrength() {
 void Rockblock::toggle(bool on) {
     this->expander->pinMode(this->enable_pin, EXPANDER_OUTPUT);
     this->expander->digitalWrite(this->enable_pin, !on);
+    if (this->flow_control) {
+        this->expander->pinMode(this->rts_pin, EXPANDER_OUTPUT);
+        this->expander->digitalWrite(this->rts_pin,
+            on ? FLOW_CONTROL_ACTIVE_LEVEL : !FLOW_CONTROL_ACTIVE_LEVEL);
+    }
     this->on = on;
+    // commands in flight and the modem state are lost when powered off
+    if (!on) {
+        this->commands.clear();
+        this->state = OFFLINE;
+        this->terse_active = false;
+    }
 }
 
 /*
- * Read the serial and add to this->stream
+ * Read the serial directly into this->stream, in bulk as far as the free space
+ * is contiguous.
  */
 void Rockblock::readAndAppendResponse() {
-    char bfr[255] = {0};
-    size_t idx = 0;
-    size_t remainingSpace = sizeof(this->stream) - strlen(this->stream) - 1;
-    while(this->serial->available()) {
-        bfr[idx] = this->serial->read();
-        if (idx > 253) { break; }
-        else idx++;
+    char* ptr = nullptr;
+    while (this->serial->available()) {
+        size_t span = this->stream.writeSpan(&ptr);
+        // push() will count the byte as dropped if there is no space left
+        if (span == 0) {
+            this->stream.push(this->serial->read());
+            continue;
+        }
+        size_t len = this->serial->readBytes(ptr, span);
+        this->stream.commit(len);
+        if (len == 0) { break; }
     }
-    strncat(this->stream, bfr, remainingSpace);
 }
 
 /*
  * We are using a state machine to parse the incoming serial data.
  * There are two levels of tokenizition: line breaks and two or three lines
- * forming a command response (frame).
+ * forming a command response (frame). Complete frames finish the command in
+ * flight and the next command is sent right away, several frames can be
+ * handled in one run.
  */
 void Rockblock::run() {
-
-    // Assume WAIT_STATUS if parser does not return other
-    RockblockStatus status = WAIT_STATUS;
-    char frame[MAX_FRAME_SIZE] = {0};
-    // for debug output
-    char bfr[255] = {0};
-
-    // copy latest incoming serial data to this->stream
+    this->now = esp_timer_get_time() / 1000;
+    // read latest incoming serial data into this->stream
     this->readAndAppendResponse();
-    // extract a frame from this->stream
-    extractFrame(frame, this->stream);
-    // parse the frame
-    this->parser.parse(frame);
 
-    // clear command waiting if OK, READY, or ERROR status
-    if (
-        parser.status == OK_STATUS || parser.status == READY_STATUS ||
-        parser.status == ERROR_STATUS)
-    {
-        this->commandWaiting = false;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        // the last frame has been handled
+        if (this->parser.complete) { this->parser.reset(); }
+        // feed new bytes to the parser until a frame is complete, nothing to
+        // do if there are no new bytes
+        if (this->stream.size() > 0) {
+            this->stream.consume(
+                this->parser.feed(this->stream.view(0, this->stream.size())));
+        }
+        if (this->parser.ring) {
+            this->parser.ring = false;
+            if (!this->ring_pending) { Serial.println("Ring alert"); }
+            this->ring_pending = true;
+        }
+        if (this->stream.overflows != this->reported_overflows) {
+            this->reported_overflows = this->stream.overflows;
+            Serial.print("Rockblock stream overflow, dropped bytes: ");
+            Serial.println(this->stream.dropped_bytes);
+        }
+        if (this->parser.complete) {
+            // some debug output
+            Serial.print("\nLast command: "); Serial.println(this->parser.command);
+            Serial.print("Last response: "); Serial.println(this->parser.response);
+            Serial.print("Status: ");
+            Serial.println(statusLabels[this->parser.status]);
+            // ERROR indicates a syntax or value error, i.e. our code would be
+            // responsible. The callback decides.
+            if (!this->commands.complete(this->parser)) {
+                Serial.println("Unexpected response, ignored");
+            }
+            progress = true;
+        }
+        this->step();
+        // the modem is not ready to receive, keep the command queued
+        if (this->flow_control && !this->clear_to_send) { continue; }
+        const AtCommand* started = this->commands.start(
+            this->serial, this->now);
+        if (started != nullptr) {
+            if (started->binary) { this->parser.expectBinary(); }
+            else if (started->info) { this->parser.expectInfo(); }
+            progress = true;
+        }
     }
 
-    // Add more error handling, however there is not much to do, error
-    // indicates that a command was not issus correctly in the sense of
-    // a syntax or value error. Our code would be solely reponsible for this.
-    if (parser.status == ERROR_STATUS) {
-        Serial.println("Rockblock error");
-        return;
+    // the modem did not answer, drop the partial frame and let the callback
+    // decide
+    if (this->commands.busy()) {
+        char command[COMMAND_TEXT_SIZE] = {0};
+        strncpy(command, this->commands.currentText(), sizeof(command) - 1);
+        if (this->commands.checkTimeout(this->now)) {
+            Serial.print("Command timed out: "); Serial.println(command);
+            this->parser.reset();
+        }
     }
+}
 
-    // some debug output
-    if (frame[0] != 0) {
-        Serial.print("\nLast command: "); Serial.println(this->parser.command);
-        Serial.print("Last response: "); Serial.println(this->parser.response);
-        Serial.print("Status: ");
-        Serial.println(statusLabels[this->parser.status]);
+/*
+ * Queue commands for the current state. Commands are only queued while the
+ * queue is idle, responses are handled by the callbacks.
+ */
+void Rockblock::step() {
+    char bfr[COMMAND_TEXT_SIZE] = {0};
+    if (!this->on || !this->commands.idle()) { return; }
+    // the message has been updated after writing it, write it again
+    if (
+        this->queued && !this->mo_loaded && !this->mailbox_check &&
+        (this->state == COM_CHECK || this->state == SENDING)
+    ) {
+        Serial.println("Message updated, write again");
+        this->state = IDLE;
     }
 
-    // This is a combination of device status and user workflow
-    bool readyForCommand = (
-        parser.status == WAIT_STATUS && !this->commandWaiting);
-
-    // Update state
     switch(this->state) {
 
         case OFFLINE:
-            if (this->on) {
-                if (readyForCommand) {
-                    // Check whether Rockblock is available and clear MO and MT
-                    // buffers
-                    sendCommand(SBDD_COMMAND);
-                } else if (parser.status == OK_STATUS) {
-                    this->state = IDLE;
-                }
+            // Switch to the terse dialect first, V0 is answered with a
+            // numeric result code already
+            if (this->terse && !this->terse_active) {
+                this->sendCommand(ECHO_OFF_COMMAND,
+                    [this](CommandResult result) {
+                        if (result != COMMAND_OK) { return; }
+                        this->sendCommand(NUMERIC_COMMAND,
+                            [this](CommandResult result) {
+                                this->terse_active = result == COMMAND_OK;
+                            });
+                    });
+                break;
+            }
+            // Check whether Rockblock is available and clear MO and MT
+            // buffers, enable ring alerts right after
+            this->mo_loaded = false;
+            this->ring_enabled = false;
+            this->sendCommand(SBDD_COMMAND, [this](CommandResult result) {
+                if (result == COMMAND_OK) { this->state = IDLE; }
+            }, OK_STATUS, DEFAULT_COMMAND_TIMEOUT, false, true);
+            if (this->ring_alerts) {
+                this->sendCommand(SBDMTA_COMMAND, [this](CommandResult result) {
+                    this->ring_enabled = result == COMMAND_OK;
+                    if (this->ring_enabled) {
+                        Serial.println("Ring alerts enabled");
+                    }
+                });
             }
             break;
 
         case IDLE:
-            if (readyForCommand && this->queued) {
-                sendCommand(SBDWT_COMMAND);
+            if (this->queued && this->mo_loaded) {
+                Serial.println("Message already in MO buffer");
+                this->state = COM_CHECK;
+            } else if (this->queued) {
+                if (this->binary) {
+                    snprintf(bfr, sizeof(bfr), "%s=%d", SBDWB_COMMAND,
+                        (int) this->message_len);
+                } else {
+                    strcpy(bfr, SBDWT_COMMAND);
+                }
+                this->sendCommand(bfr, [this](CommandResult result) {
+                    this->onWriteReady(result);
+                }, READY_STATUS);
                 this->state = MESSAGE_WAITING;
+            } else if (this->mailboxPending() && this->mo_loaded) {
+                // +SBDIX would send the last message again
+                this->sendCommand(SBDD_MO_COMMAND, [this](CommandResult result) {
+                    if (result == COMMAND_OK) { this->mo_loaded = false; }
+                }, OK_STATUS, DEFAULT_COMMAND_TIMEOUT, false, true);
+            } else if (this->mailboxPending()) {
+                this->mailbox_check = true;
+                if (this->sbidxCommand[0] == '\0') {
+                    strcpy(this->sbidxCommand, SBDIX_COMMAND);
+                }
+                if (this->ring_pending) {
+                    Serial.println("Answer ring alert");
+                    this->policy.reset(this->now);
+                    this->fresh_signal = false;
+                    this->state = COM_CHECK;
+                } else {
+                    // the last session just succeeded, no need to wait
+                    Serial.print("Retrieve queued messages: ");
+                    Serial.println(this->mt_queued);
+                    this->state = SENDING;
+                }
             };
             break;
 
         case MESSAGE_WAITING:
-            if (parser.status == READY_STATUS) {
-                Serial.println("Rockblock ready for text input: ");
-                this->serial->print(this->message);
-            } else if (parser.status == OK_STATUS) {
-                this->state = COM_CHECK;
-            }
+            // READY and the write are handled by callbacks, the write got
+            // lost if nothing is queued anymore
+            this->writeFailed("lost", false);
             break;
 
         case COM_CHECK:
-            if (readyForCommand) { sendCommand(CSQ_COMMAND); }
-            else if (
-                parser.status == OK_STATUS &&
-                strstr(this->parser.command, CSQ_COMMAND) != nullptr
-            ) {
-                this->signal = this->parser.values[0];
-                Serial.print("Signal strength: "); Serial.print(this->signal);
-                if (this->parser.values[0] >= SEND_THRESHOLD) {
-                    Serial.println(" -> attempt sending");
-                    this->state = SENDING;
-                } else {
-                    Serial.println(" -> too low to send");
-                }
+            // poll a new measurement after backing off, the last known value
+            // otherwise
+            if (this->policy.readyToPoll(this->now)) {
+                this->sendCommand(
+                    this->fresh_signal ? CSQF_COMMAND : CSQ_COMMAND,
+                    [this](CommandResult result) { this->onSignal(result); },
+                    OK_STATUS, CSQ_TIMEOUT);
+                this->policy.polled(this->now);
+                this->fresh_signal = true;
             }
             break;
 
         case SENDING:
-            if (readyForCommand) {
-                sendCommand(this->sbidxCommand);
-                this->retries += 1;
-            }
-            else if (
-                parser.status == OK_STATUS &&
-                strstr(this->parser.command, SBDIX_COMMAND) != nullptr
-            ) {
-                if (this->parser.values[0] < 5) {
-                    this->queued = false;
-                    // check for incoming message
-                    if (this->parser.values[2] == 1) {
-                        Serial.println("Message waiting");
-                        this->state = INCOMING;
-                    } else {
-                        this->state = IDLE;
-                        this->sendSuccess = true;
-                    }
-                } else {
-                    Serial.println("Send failed.");
-                    this->state = COM_CHECK;
-                }
+            if (this->ring_pending) {
+                // answer the ring alert, keeps the location arguments
+                snprintf(bfr, sizeof(bfr), "%s%s", SBDIXA_COMMAND,
+                    this->sbidxCommand + strlen(SBDIX_COMMAND));
+            } else {
+                strcpy(bfr, this->sbidxCommand);
             }
+            this->sendCommand(bfr, [this](CommandResult result) {
+                this->onSession(result);
+            }, OK_STATUS, SBDIX_TIMEOUT);
+            this->retries += 1;
             break;
 
         case INCOMING:
-            if (readyForCommand) { sendCommand(SBDRT_COMMAND); }
-            else if (
-                parser.status == OK_STATUS &&
-                strstr(this->parser.command, SBDRT_COMMAND) != nullptr
-            ) {
-                strncpy(this->incoming, parser.payload, MAX_MESSAGE_SIZE);
-                this->state = IDLE;
-                this->sendSuccess = true;
-            }
+            // text payloads are ambiguous without status words, the terse
+            // dialect reads text messages as binary
+            this->sendCommand(
+                this->readsBinary() ? SBDRB_COMMAND : SBDRT_COMMAND,
+                [this](CommandResult result) { this->onIncoming(result); },
+                OK_STATUS, DEFAULT_COMMAND_TIMEOUT, this->readsBinary());
+            break;
+
+        default:
             break;
     }
 }
 
+/*
+ * +SBDWT or +SBDWB answered, send the message
+ */
+void Rockblock::onWriteReady(CommandResult result) {
+    if (result != COMMAND_OK) {
+        this->writeFailed("not ready", false);
+        return;
+    }
+    size_t len = this->message_len;
+    if (this->binary) {
+        Serial.println("Rockblock ready for binary input");
+        // the checksum follows the message
+        uint16_t checksum = sbdChecksum(
+            (const uint8_t*) this->message, this->message_len);
+        this->message[len++] = checksum >> 8;
+        this->message[len++] = checksum & 0xff;
+    } else {
+        Serial.println("Rockblock ready for text input: ");
+    }
+    this->commands.pushRaw((const uint8_t*) this->message, len,
+        [this](CommandResult result) { this->onWritten(result); });
+}
+
+/*
+ * +SBDWB reports 0 on success, 1 timeout, 2 checksum, 3 size. A failed write
+ * counts as failed attempt and is repeated up to WRITE_ATTEMPTS times, a
+ * message of the wrong size is dropped right away.
+ */
+void Rockblock::onWritten(CommandResult result) {
+    uint8_t code = SBDWB_OK;
+    if (result != COMMAND_OK) {
+        code = SBDWB_TIMEOUT;
+    } else if (this->binary) {
+        char *end = nullptr;
+        long value = strtol(this->parser.command, &end, 10);
+        code = (
+            end == this->parser.command || *end != '\0' || value < 0 ||
+            value > SBDWB_SIZE
+        ) ? SBDWB_TIMEOUT : value;
+    }
+    if (code == SBDWB_OK) {
+        this->mo_loaded = true;
+        this->state = COM_CHECK;
+        return;
+    }
+    this->writeFailed(writeResultLabels[code], code == SBDWB_SIZE);
+}
+
+/*
+ * Count a failed write as failed attempt, the message is written again from
+ * IDLE until WRITE_ATTEMPTS is reached. A dropped message is not sent, the
+ * caller times out.
+ */
+void Rockblock::writeFailed(const char *reason, bool drop) {
+    char bfr[64] = {0};
+    this->retries += 1;
+    this->write_failures += 1;
+    this->state = IDLE;
+    if (drop || this->write_failures >= WRITE_ATTEMPTS) {
+        this->queued = false;
+        snprintf(bfr, sizeof(bfr), "Write failed (%s), message dropped",
+            reason);
+    } else {
+        snprintf(bfr, sizeof(bfr), "Write failed (%s), attempt %d of %d",
+            reason, this->write_failures, WRITE_ATTEMPTS);
+    }
+    Serial.println(bfr);
+}
+
+void Rockblock::onSignal(CommandResult result) {
+    // poll again
+    if (result != COMMAND_OK) { return; }
+    this->signal = this->policy.addReading(this->parser.values[0]);
+    Serial.print("Signal strength: "); Serial.print(this->signal);
+    if (this->policy.shouldAttempt(this->signal, this->now)) {
+        Serial.println(" -> attempt sending");
+        this->state = SENDING;
+    } else {
+        Serial.print(" -> too low to send, threshold ");
+        Serial.println(this->policy.threshold(this->now));
+    }
+}
+
+/*
+ * Result of +SBDIX, a session without response counts as failed session
+ */
+void Rockblock::onSession(CommandResult result) {
+    char bfr[64] = {0};
+    uint8_t code = (result == COMMAND_OK) ?
+        this->parser.values[0] : SBDIX_TIMEOUT_CODE;
+    uint32_t backoff = this->policy.onResult(this->signal, code, this->now);
+    if (code < 5) {
+        this->queued = false;
+        this->mo_sent |= !this->mailbox_check;
+        // the mailbox has been checked
+        this->ring_pending = false;
+        // messages left at the gateway after this one
+        this->mt_queued = this->parser.values[5];
+        // check for incoming message
+        if (this->parser.values[2] == 1) {
+            Serial.println("Message waiting");
+            this->state = INCOMING;
+        } else {
+            this->finishSession();
+        }
+    } else if (this->mailbox_check && !this->ring_pending) {
+        // leave remaining messages for the next wake up
+        Serial.println("Retrieving queued messages failed");
+        this->mt_queued = 0;
+        this->finishSession();
+    } else {
+        snprintf(bfr, sizeof(bfr), "Send failed (%d), retry in %d s",
+            code, (int) (backoff / 1000));
+        Serial.println(bfr);
+        this->fresh_signal = false;
+        this->state = COM_CHECK;
+    }
+}
+
+/*
+ * Result of +SBDRT or +SBDRB, a corrupted or lost message is dropped, our
+ * message has been sent anyway
+ */
+void Rockblock::onIncoming(CommandResult result) {
+    if (result != COMMAND_OK) {
+        Serial.println("Reading incoming message failed");
+    } else if (this->readsBinary() && !this->parser.binary_valid) {
+        Serial.println("Incoming binary checksum failed");
+    } else if (this->readsBinary()) {
+        this->storeIncoming(
+            this->parser.payload, this->parser.payloadLength());
+    } else {
+        this->storeIncoming(this->parser.payload, strlen(this->parser.payload));
+    }
+    this->finishSession();
+}
+
 
 void Rockblock::loop() {
     if (this->on) { this->run(); }
-}
\ No newline at end of file
+}
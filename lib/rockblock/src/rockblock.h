@@ -5,43 +5,46 @@
  */
 #ifndef __ROCKBLOCK_H__
 #define __ROCKBLOCK_H__
+#ifndef NATIVE
 #include <Arduino.h>
+#endif
 #include <tca95xx.h>
 #include <hal.h>
-#include <vector>
+#include <ringBuffer.h>
+#include <frameParser.h>
+#include <retryPolicy.h>
+#include <commandQueue.h>
 #include <map>
 
-// TODO: Determine actual maximum sizes, there is plenty of memory, we can be
-// generous for now.
-#define MAX_COMMAND_SIZE 256
-#define MAX_RESPONSE_SIZE 128
-// This number is from the Rockblock documentation
-#define MAX_MESSAGE_SIZE 340
-#define MAX_FRAME_SIZE 512
+// +SBDIX=+DDMM.MMM,+dddMM.MMM and some headroom
+#define SBDIX_COMMAND_SIZE 64
+
+// The 9603 ring indicator output is active low
+#ifndef RING_ACTIVE_LEVEL
+#define RING_ACTIVE_LEVEL 0
+#endif
+// RTS and CTS are active low like the ring indicator
+#ifndef FLOW_CONTROL_ACTIVE_LEVEL
+#define FLOW_CONTROL_ACTIVE_LEVEL 0
+#endif
+
+// MT messages kept from one wake up, more messages stay queued at the
+// gateway until the next time
+#ifndef INBOX_SIZE
+#define INBOX_SIZE 4
+#endif
+
+// writes of a message to the MO buffer before it is dropped
+#ifndef WRITE_ATTEMPTS
+#define WRITE_ATTEMPTS 3
+#endif
 
-// Rockblock status type
-enum RockblockStatus { WAIT_STATUS, OK_STATUS, READY_STATUS, ERROR_STATUS };
 // State machine type
 enum StateMachine {
     OFFLINE, IDLE, MESSAGE_WAITING, MESSAGE_IN_RB, COM_CHECK, SENDING,
     INCOMING
 };
 
-// Parse Serial frames
-class FrameParser {
-    private:
-        void parseResponse(const char *line);
-    public:
-        FrameParser() {};
-        char command[MAX_COMMAND_SIZE] = {0};
-        char response[MAX_RESPONSE_SIZE] = {0};
-        RockblockStatus status = WAIT_STATUS;
-        std::vector<int16_t> values;
-        // 270 is the maxim
-        char payload[MAX_MESSAGE_SIZE] = {0};
-        void parse(const char *frame);
-};
-
 // Rockblock state machine
 class Rockblock {
 
@@ -50,20 +53,74 @@ class Rockblock {
         AbstractExpander* expander;
         uint8_t enable_pin;
         FrameParser parser = FrameParser();
-        char message[MAX_MESSAGE_SIZE] = {0};
-        char incoming[MAX_MESSAGE_SIZE] = {0};
+        // fits the checksum of binary messages
+        char message[MAX_MESSAGE_SIZE + 2] = {0};
+        size_t message_len = 0;
+        // MT messages in order of arrival
+        char inbox[INBOX_SIZE][MAX_MESSAGE_SIZE] = {{0}};
+        size_t inbox_len[INBOX_SIZE] = {0};
+        size_t inbox_count = 0;
+        // MT messages still queued at the gateway, reported by +SBDIX
+        uint16_t mt_queued = 0;
+        // our message has been transmitted
+        bool mo_sent = false;
+        // binary messages use +SBDWB and +SBDRB instead of +SBDWT and +SBDRT
+        bool binary = false;
         time_t start_time;
         uint8_t retries = 3;
+        // +SBDWB rejected or unanswered for the current message
+        uint8_t write_failures = 0;
         uint8_t signal = 0;
+        // decides when to poll signal, send and retry
+        RetryPolicy policy = RetryPolicy();
+        // whether the last poll returned a fresh (+CSQ) or cached (+CSQF)
+        // signal strength, fresh after a backoff
+        bool fresh_signal = false;
+        // message already written to the MO buffer of the modem
+        bool mo_loaded = false;
+        // ring alerts, see +SBDMTA
+        bool ring_alerts = true;
+        bool ring_enabled = false;
+        bool ring_pending = false;
+        // RTS/CTS, see setFlowControl()
+        bool flow_control = false;
+        uint8_t rts_pin = 0;
+        bool clear_to_send = true;
+        // terse dialect requested and set up, see setTerse()
+        bool terse = false;
+        bool terse_active = false;
+        // session answering a ring alert without a message of our own
+        bool mailbox_check = false;
+        uint16_t incoming_count = 0;
         // buffer for unhandled serial data
-        char stream[1024] = {0};
+        RingBuffer stream = RingBuffer();
+        uint32_t reported_overflows = 0;
         bool on = false;
         bool queued = false;
-        bool commandWaiting = false;
+        // commands sent back to back, responses handled by callbacks
+        CommandQueue commands = CommandQueue();
+        // time of the current run in ms
+        uint32_t now = 0;
         bool locationAvailable = false;
-        char sbidxCommand[64] = {0};
+        char sbidxCommand[SBDIX_COMMAND_SIZE] = {0};
         void readAndAppendResponse();
-        void sendCommand(const char *command);
+        void resetMessage();
+        bool isLoaded(const char *bfr, size_t len, bool binary);
+        bool updatable();
+        void storeIncoming(const char *bfr, size_t len);
+        void finishSession();
+        void sendCommand(const char *command, CommandCallback callback,
+            RockblockStatus expected=OK_STATUS,
+            uint32_t timeout=DEFAULT_COMMAND_TIMEOUT, bool binary=false,
+            bool info=false);
+        void onWriteReady(CommandResult result);
+        void onWritten(CommandResult result);
+        void writeFailed(const char *reason, bool drop);
+        void onSignal(CommandResult result);
+        void onSession(CommandResult result);
+        void onIncoming(CommandResult result);
+        void step();
+        bool readsBinary();
         void run();
 
     public:
@@ -71,10 +128,43 @@ class Rockblock {
             uint8_t enable_pin);
         StateMachine state = OFFLINE;
         bool sendSuccess = false;
-        void sendMessage(char *bfr, size_t len=255); 
-        void sendMessage(char *bfr, float lat, float lon, size_t len=255); 
-        void getLastIncoming(char *bfr, size_t len=MAX_MESSAGE_SIZE);
+        void sendMessage(char *bfr, size_t len=MAX_MESSAGE_SIZE);
+        void sendMessage(char *bfr, float lat, float lon,
+            size_t len=MAX_MESSAGE_SIZE);
+        void sendMessage(const uint8_t *bfr, size_t len);
+        // location is sent in the session header instead of the payload
+        void sendMessage(const uint8_t *bfr, size_t len, float lat, float lon);
+        // replace the payload of the queued message before it is sent, keeps
+        // the location and the retry state, false if it is too late
+        bool updateMessage(char *bfr, size_t len=MAX_MESSAGE_SIZE);
+        bool updateMessage(const uint8_t *bfr, size_t len);
+        // returns length, binary messages might contain \0
+        size_t getLastIncoming(char *bfr, size_t len=MAX_MESSAGE_SIZE);
+        // all MT messages received since the last message has been queued
+        size_t getIncomingSize();
+        size_t getIncoming(size_t idx, char *bfr, size_t len=MAX_MESSAGE_SIZE);
+        // ring alert or MT messages left at the gateway
+        bool mailboxPending();
         uint8_t getSignalStrength();
+        // a command is queued or in flight
+        bool commandPending();
+        // increases with every MT message received
+        uint16_t getIncomingCount();
+        // enable ring alerts when (re-)starting, enabled by default
+        void setRingAlerts(bool enable);
+        // level of the ring indicator pin (ird_ri)
+        void ringIndicator(bool level);
+        // no echo and numeric result codes
+        void setTerse(bool terse);
+        // use RTS/CTS, the RTS pin is on the IO expander
+        void setFlowControl(uint8_t rts_pin);
+        // level of the CTS pin (ird_cts)
+        void clearToSend(bool level);
+        // signal history is kept by the caller while sleeping
+        signalHistory getSignalHistory();
+        void setSignalHistory(const signalHistory &history);
+        // the message has to be sent by then, ms since boot
+        void setDeadline(uint32_t deadline);
         void toggle(bool on=false);
         // process loop
         void loop();
@@ -0,0 +1,222 @@
+#include <jspr.h>
+#include <string.h>
+#include <stdio.h>
+
+#define LINE_END '\r'
+
+static const char base64Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+size_t base64Encode(const uint8_t *src, size_t len, char *dst, size_t dst_len) {
+    size_t out_len = BASE64_SIZE(len);
+    if (dst_len < out_len + 1) { return 0; }
+    size_t idx = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t triple = src[i] << 16;
+        if (i + 1 < len) { triple |= src[i + 1] << 8; }
+        if (i + 2 < len) { triple |= src[i + 2]; }
+        dst[idx++] = base64Alphabet[(triple >> 18) & 0x3f];
+        dst[idx++] = base64Alphabet[(triple >> 12) & 0x3f];
+        dst[idx++] = (i + 1 < len) ? base64Alphabet[(triple >> 6) & 0x3f] : '=';
+        dst[idx++] = (i + 2 < len) ? base64Alphabet[triple & 0x3f] : '=';
+    }
+    dst[idx] = '\0';
+    return idx;
+}
+
+static int8_t base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') { return c - 'A'; }
+    if (c >= 'a' && c <= 'z') { return c - 'a' + 26; }
+    if (c >= '0' && c <= '9') { return c - '0' + 52; }
+    if (c == '+') { return 62; }
+    if (c == '/') { return 63; }
+    return -1;
+}
+
+/*
+ * Padding is optional, anything else outside the alphabet is invalid
+ */
+bool base64Decode(const char *src, size_t len, uint8_t *dst, size_t dst_len,
+    size_t *out_len
+) {
+    while (len > 0 && src[len - 1] == '=') { len--; }
+    if (len % 4 == 1) { return false; }
+    size_t needed = len / 4 * 3 + ((len % 4) ? len % 4 - 1 : 0);
+    if (needed > dst_len) { return false; }
+    uint32_t bits = 0;
+    uint8_t count = 0;
+    size_t idx = 0;
+    for (size_t i = 0; i < len; i++) {
+        int8_t value = base64Value(src[i]);
+        if (value < 0) { return false; }
+        bits = (bits << 6) | value;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            dst[idx++] = (bits >> count) & 0xff;
+        }
+    }
+    *out_len = idx;
+    return true;
+}
+
+size_t jsprRequest(char *bfr, size_t len, const char *method,
+    const char *target, const char *json
+) {
+    int written = snprintf(bfr, len, "%s %s %s%c", method, target,
+        (json && json[0]) ? json : "{}", LINE_END);
+    if (written < 0 || (size_t) written >= len) { return 0; }
+    return written;
+}
+
+void JsprParser::reset() {
+    this->line_len = 0;
+    this->line[0] = '\0';
+    this->overflow = false;
+    this->body_start = 0;
+    this->code = 0;
+    this->method[0] = '\0';
+    this->target[0] = '\0';
+    this->complete = false;
+}
+
+/*
+ * Split the line into code or method, target and body
+ */
+void JsprParser::parseLine() {
+    const char *first_end = strchr(this->line, ' ');
+    size_t first_len = first_end ? first_end - this->line : this->line_len;
+    bool numeric = first_len == 3;
+    for (size_t i = 0; i < first_len && numeric; i++) {
+        numeric = this->line[i] >= '0' && this->line[i] <= '9';
+    }
+    if (numeric) {
+        this->code = (this->line[0] - '0') * 100 +
+            (this->line[1] - '0') * 10 + (this->line[2] - '0');
+    } else if (first_len < JSPR_METHOD_SIZE) {
+        memcpy(this->method, this->line, first_len);
+        this->method[first_len] = '\0';
+    }
+    this->body_start = this->line_len;
+    if (!first_end) { return; }
+    const char *target = first_end + 1;
+    const char *target_end = strchr(target, ' ');
+    size_t target_len = target_end ?
+        target_end - target : strlen(target);
+    if (target_len >= JSPR_TARGET_SIZE) { target_len = JSPR_TARGET_SIZE - 1; }
+    memcpy(this->target, target, target_len);
+    this->target[target_len] = '\0';
+    if (target_end) { this->body_start = target_end + 1 - this->line; }
+}
+
+/*
+ * Feed a single byte. Returns true once a line is complete, feeding more
+ * bytes after that starts the next line. Empty lines and \n are skipped.
+ */
+bool JsprParser::feed(char c) {
+    if (this->complete) { this->reset(); }
+    if (c == '\n') { return false; }
+    if (c != LINE_END) {
+        if (this->line_len < JSPR_MAX_LINE_SIZE - 1) {
+            this->line[this->line_len++] = c;
+        } else {
+            this->overflow = true;
+        }
+        return false;
+    }
+    if (this->overflow) {
+        this->dropped++;
+        this->reset();
+        return false;
+    }
+    if (this->line_len == 0) { return false; }
+    this->line[this->line_len] = '\0';
+    this->parseLine();
+    this->complete = true;
+    return true;
+}
+
+size_t JsprParser::feed(const char *bfr, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (this->feed(bfr[i])) { return i + 1; }
+    }
+    return len;
+}
+
+void JsprParser::parse(const char *line) {
+    this->reset();
+    this->feed(line, strlen(line));
+    if (!this->complete) { this->feed(LINE_END); }
+}
+
+const char* JsprParser::body() const {
+    return this->line + this->body_start;
+}
+
+/*
+ * Only matches keys, i.e. a quoted string followed by a colon
+ */
+const char* JsprParser::find(const char *key) const {
+    size_t key_len = strlen(key);
+    const char *ptr = this->body();
+    while ((ptr = strchr(ptr, '"')) != nullptr) {
+        ptr++;
+        if (
+            strncmp(ptr, key, key_len) != 0 || ptr[key_len] != '"'
+        ) {
+            // skip the rest of this string
+            const char *end = strchr(ptr, '"');
+            if (!end) { return nullptr; }
+            ptr = end + 1;
+            continue;
+        }
+        ptr += key_len + 1;
+        while (*ptr == ' ') { ptr++; }
+        if (*ptr != ':') { continue; }
+        ptr++;
+        while (*ptr == ' ') { ptr++; }
+        return ptr;
+    }
+    return nullptr;
+}
+
+bool JsprParser::getInt(const char *key, int32_t *value) const {
+    const char *ptr = this->find(key);
+    if (!ptr) { return false; }
+    bool negative = *ptr == '-';
+    if (negative) { ptr++; }
+    if (*ptr < '0' || *ptr > '9') { return false; }
+    int32_t result = 0;
+    while (*ptr >= '0' && *ptr <= '9') {
+        result = result * 10 + (*ptr++ - '0');
+    }
+    *value = negative ? -result : result;
+    return true;
+}
+
+bool JsprParser::getBool(const char *key, bool *value) const {
+    const char *ptr = this->find(key);
+    if (!ptr) { return false; }
+    if (strncmp(ptr, "true", 4) == 0) { *value = true; return true; }
+    if (strncmp(ptr, "false", 5) == 0) { *value = false; return true; }
+    return false;
+}
+
+const char* JsprParser::getRaw(const char *key, size_t *len) const {
+    const char *ptr = this->find(key);
+    if (!ptr || *ptr != '"') { return nullptr; }
+    ptr++;
+    const char *end = strchr(ptr, '"');
+    if (!end) { return nullptr; }
+    *len = end - ptr;
+    return ptr;
+}
+
+bool JsprParser::getString(const char *key, char *bfr, size_t len) const {
+    size_t value_len = 0;
+    const char *value = this->getRaw(key, &value_len);
+    if (!value || value_len >= len) { return false; }
+    memcpy(bfr, value, value_len);
+    bfr[value_len] = '\0';
+    return true;
+}
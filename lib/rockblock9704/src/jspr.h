@@ -0,0 +1,86 @@
+/*
+ * JSPR, the serial protocol of the RockBLOCK 9704 (Iridium Messaging
+ * Transport). Every message is a single line ending with \r:
+ *
+ *  - request from the host: <method> <target> <json>, e.g.
+ *    GET constellationState {}
+ *  - response or unsolicited message from the modem: <code> <target> <json>,
+ *    e.g. 200 constellationState {"signal_bars":3}. Responses have codes
+ *    2xx (4xx or 5xx on errors), unsolicited messages 299.
+ *
+ * Message data is base64 encoded within the JSON body. The JSON bodies used
+ * are flat apart from version objects, fields are looked up by their key
+ * without building a document.
+ *
+ * The parser does not allocate memory, lines are kept in a fixed size buffer
+ * and dropped if too long.
+ *
+ * See https://docs.groundcontrol.com/iot/rockblock-9704
+ */
+#ifndef __JSPR_H__
+#define __JSPR_H__
+#include <stdint.h>
+#include <stddef.h>
+
+// fits a message segment of IMT_MAX_SEGMENT_SIZE bytes in base64
+#ifndef JSPR_MAX_LINE_SIZE
+#define JSPR_MAX_LINE_SIZE 2048
+#endif
+#define JSPR_TARGET_SIZE 32
+#define JSPR_METHOD_SIZE 8
+// unsolicited messages from the modem
+#define JSPR_UNSOLICITED 299
+
+// Characters needed to encode len bytes, without \0
+#define BASE64_SIZE(len) ((((len) + 2) / 3) * 4)
+
+// Encode into a \0 terminated string, returns its length, 0 if it does not fit
+size_t base64Encode(const uint8_t *src, size_t len, char *dst, size_t dst_len);
+// Decode, returns false on invalid input or if the result does not fit
+bool base64Decode(const char *src, size_t len, uint8_t *dst, size_t dst_len,
+    size_t *out_len);
+
+// Write a request line including \r, returns its length, 0 if it does not fit
+size_t jsprRequest(char *bfr, size_t len, const char *method,
+    const char *target, const char *json);
+
+class JsprParser {
+    private:
+        char line[JSPR_MAX_LINE_SIZE] = {0};
+        size_t line_len = 0;
+        // the current line is too long and will be dropped
+        bool overflow = false;
+        size_t body_start = 0;
+        void parseLine();
+        // start of the value of key within the body, nullptr if missing
+        const char* find(const char *key) const;
+
+    public:
+        JsprParser() {};
+        // status code of a response, 0 for requests
+        uint16_t code = 0;
+        // GET or PUT for requests, empty for responses
+        char method[JSPR_METHOD_SIZE] = {0};
+        char target[JSPR_TARGET_SIZE] = {0};
+        // true once a line has been parsed
+        bool complete = false;
+        // lines dropped since they did not fit
+        uint32_t dropped = 0;
+        void reset();
+        // feed a single byte, returns true if a line is complete
+        bool feed(char c);
+        // feed bytes until a line is complete, returns bytes used
+        size_t feed(const char *bfr, size_t len);
+        // parse a complete line at once, with or without \r
+        void parse(const char *line);
+        // JSON body of the current line
+        const char* body() const;
+        bool getInt(const char *key, int32_t *value) const;
+        bool getBool(const char *key, bool *value) const;
+        // copy a string value, false if missing or too long
+        bool getString(const char *key, char *bfr, size_t len) const;
+        // string value without copying, e.g. base64 data
+        const char* getRaw(const char *key, size_t *len) const;
+};
+
+#endif /* __JSPR_H__ */
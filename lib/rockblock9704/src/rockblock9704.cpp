@@ -0,0 +1,508 @@
+/*
+ * RockBLOCK 9704 driver, see rockblock9704.h
+ *
+ * A message is sent in three steps:
+ *
+ * 1. PUT messageOriginate announces topic and length, the modem answers with
+ *    a message id
+ * 2. the modem asks for the message in segments (299 messageOriginateSegment)
+ *    and we answer with PUT messageOriginateSegment and the data in base64
+ * 3. the modem reports the final status (299 messageOriginateStatus) once the
+ *    message has been acknowledged or it gave up
+ *
+ * MT messages arrive the same way in the other direction, announced with 299
+ * messageTerminate, followed by their segments and final status.
+ */
+#include <rockblock9704.h>
+#include <stdio.h>
+#include <string.h>
+
+#define GET_METHOD "GET"
+#define PUT_METHOD "PUT"
+#define API_VERSION_TARGET "apiVersion"
+#define SIM_CONFIG_TARGET "simConfig"
+#define OPERATIONAL_STATE_TARGET "operationalState"
+#define CONSTELLATION_TARGET "constellationState"
+#define MO_TARGET "messageOriginate"
+#define MO_SEGMENT_TARGET "messageOriginateSegment"
+#define MO_STATUS_TARGET "messageOriginateStatus"
+#define MT_TARGET "messageTerminate"
+#define MT_SEGMENT_TARGET "messageTerminateSegment"
+#define MT_STATUS_TARGET "messageTerminateStatus"
+#define MO_ACKNOWLEDGED "mo_ack_received"
+#define MO_ACCEPTED "message_accepted"
+#define MT_COMPLETE "complete"
+// number of setup requests after power on
+#define SETUP_STEPS 3
+// codes passed to the retry policy, see RetryPolicy::onResult()
+#define MO_FAILED_CODE 18
+#define NO_SERVICE_CODE 32
+// bytes read from the serial at once
+#define READ_CHUNK_SIZE 128
+
+Rockblock9704::Rockblock9704(AbstractExpander &expander,
+    AbstractSerial &serial, uint8_t enable_pin
+) {
+    this->expander = &expander;
+    this->serial = &serial;
+    this->enable_pin = enable_pin;
+    this->policy.setSeed(deviceSeed());
+}
+
+/*
+ * Send a request, one request waits for its response at a time
+ */
+bool Rockblock9704::request(const char *method, const char *target,
+    const char *json
+) {
+    size_t len = jsprRequest(this->line, sizeof(this->line), method, target,
+        json);
+    if (len == 0) {
+        Serial.print("Request too long: "); Serial.println(target);
+        return false;
+    }
+    this->serial->print(this->line);
+    strncpy(this->pending, target, sizeof(this->pending) - 1);
+    this->pending_since = this->now;
+    return true;
+}
+
+/*
+ * Reset message related state before queueing a new message
+ */
+void Rockblock9704::resetMessage() {
+    Serial.println("Queue message and delete incoming");
+    this->inbox_count = 0;
+    this->mo_sent = false;
+    this->mo_id = -1;
+    this->start_time = esp_timer_get_time() / 1E6;
+    this->retries = 0;
+    this->queued = true;
+    this->sendSuccess = false;
+    this->policy.reset(esp_timer_get_time() / 1000);
+}
+
+/*
+ * Queue a text message to send
+ */
+void Rockblock9704::sendMessage(char *bfr, size_t len) {
+    len = (len < IMT_MAX_MESSAGE_SIZE) ? len : IMT_MAX_MESSAGE_SIZE;
+    this->sendMessage((const uint8_t*) bfr, strnlen(bfr, len));
+}
+
+/*
+ * Queue a binary message to send
+ */
+void Rockblock9704::sendMessage(const uint8_t *bfr, size_t len) {
+    this->resetMessage();
+    this->message_len = (len < IMT_MAX_MESSAGE_SIZE) ?
+        len : IMT_MAX_MESSAGE_SIZE;
+    memcpy(this->message, bfr, this->message_len);
+}
+
+void Rockblock9704::sendMessage(char *bfr, float lat, float lon, size_t len) {
+    this->sendMessage(bfr, len);
+}
+
+void Rockblock9704::sendMessage(
+    const uint8_t *bfr, size_t len, float lat, float lon
+) {
+    this->sendMessage(bfr, len);
+}
+
+/*
+ * Replace the payload of the queued text message
+ */
+bool Rockblock9704::updateMessage(char *bfr, size_t len) {
+    len = (len < IMT_MAX_MESSAGE_SIZE) ? len : IMT_MAX_MESSAGE_SIZE;
+    return this->updateMessage((const uint8_t*) bfr, strnlen(bfr, len));
+}
+
+/*
+ * Replace the payload of the queued binary message. The payload is read
+ * once the modem accepted the message, until then it can change.
+ */
+bool Rockblock9704::updateMessage(const uint8_t *bfr, size_t len) {
+    if (!this->queued || this->state == SENDING || this->mo_id >= 0) {
+        return false;
+    }
+    this->message_len = (len < IMT_MAX_MESSAGE_SIZE) ?
+        len : IMT_MAX_MESSAGE_SIZE;
+    memcpy(this->message, bfr, this->message_len);
+    return true;
+}
+
+/*
+ * Get an incoming message. Incoming message is only available until
+ * .sendMessage() is called. The copy is \0 terminated.
+ */
+size_t Rockblock9704::getIncoming(size_t idx, char *bfr, size_t len) {
+    if (len == 0) { return 0; }
+    size_t copy_len = 0;
+    if (idx < this->inbox_count) {
+        copy_len = (this->inbox_len[idx] < len - 1) ?
+            this->inbox_len[idx] : len - 1;
+        memcpy(bfr, this->inbox[idx], copy_len);
+    }
+    bfr[copy_len] = '\0';
+    return copy_len;
+}
+
+size_t Rockblock9704::getLastIncoming(char *bfr, size_t len) {
+    return this->getIncoming(this->inbox_count - 1, bfr, len);
+}
+
+size_t Rockblock9704::getIncomingSize() {
+    return this->inbox_count;
+}
+
+uint16_t Rockblock9704::getIncomingCount() {
+    return this->incoming_count;
+}
+
+/*
+ * Config messages are short, longer MT messages are truncated
+ */
+void Rockblock9704::storeIncoming(const uint8_t *bfr, size_t len) {
+    if (this->inbox_count == INBOX_SIZE) {
+        Serial.println("Inbox full, message dropped");
+        return;
+    }
+    len = (len < MAX_MESSAGE_SIZE - 1) ? len : MAX_MESSAGE_SIZE - 1;
+    memcpy(this->inbox[this->inbox_count], bfr, len);
+    this->inbox[this->inbox_count][len] = '\0';
+    this->inbox_len[this->inbox_count] = len;
+    this->inbox_count++;
+    this->incoming_count++;
+}
+
+bool Rockblock9704::mailboxPending() {
+    return this->mt_active;
+}
+
+bool Rockblock9704::commandPending() {
+    return this->pending[0] != '\0';
+}
+
+uint8_t Rockblock9704::getSignalStrength() {
+    return this->signal;
+}
+
+signalHistory Rockblock9704::getSignalHistory() {
+    return this->policy.getHistory();
+}
+
+void Rockblock9704::setSignalHistory(const signalHistory &history) {
+    this->policy.setHistory(history);
+}
+
+/*
+ * Any signal is good enough close to the deadline, see RetryPolicy
+ */
+void Rockblock9704::setDeadline(uint32_t deadline) {
+    this->policy.setDeadline(deadline);
+}
+
+/*
+ * Our message counts as sent once an MT message in progress is complete,
+ * this way config changes received in the meantime are applied together.
+ */
+void Rockblock9704::finishSession() {
+    this->state = this->mt_active ? INCOMING : IDLE;
+    this->sendSuccess |= this->mo_sent && !this->mt_active;
+}
+
+/*
+ * The modem gave up on the message or rejected it, try again after backing
+ * off
+ */
+void Rockblock9704::moFailed(const char *reason) {
+    char bfr[96] = {0};
+    uint32_t backoff = this->policy.onResult(this->signal,
+        this->signal > 0 ? MO_FAILED_CODE : NO_SERVICE_CODE, this->now);
+    snprintf(bfr, sizeof(bfr), "Send failed (%s), retry in %d s",
+        reason, (int) (backoff / 1000));
+    Serial.println(bfr);
+    this->mo_id = -1;
+    this->state = COM_CHECK;
+}
+
+/*
+ * Turn Rockblock on before sending and turn off before sleeping
+ */
+void Rockblock9704::toggle(bool on) {
+    this->expander->pinMode(this->enable_pin, EXPANDER_OUTPUT);
+    this->expander->digitalWrite(this->enable_pin, !on);
+    this->on = on;
+    // requests and messages in progress are lost when powered off
+    if (!on) {
+        this->state = OFFLINE;
+        this->setup_step = 0;
+        this->pending[0] = '\0';
+        this->mo_id = -1;
+        this->mt_active = false;
+        this->parser.reset();
+    }
+}
+
+/*
+ * Response to our request
+ */
+void Rockblock9704::onResponse() {
+    if (strcmp(this->parser.target, this->pending) != 0) {
+        Serial.print("Unexpected response, ignored: ");
+        Serial.println(this->parser.target);
+        return;
+    }
+    const char *target = this->parser.target;
+    if (this->parser.code >= 300) {
+        Serial.print("Request failed: ");
+        Serial.print((long) this->parser.code);
+        Serial.print(" "); Serial.println(target);
+        // other requests are sent again once they time out
+        if (strcmp(target, MO_TARGET) == 0) {
+            this->pending[0] = '\0';
+            this->moFailed("rejected");
+        }
+        return;
+    }
+    this->pending[0] = '\0';
+    if (
+        strcmp(target, API_VERSION_TARGET) == 0 ||
+        strcmp(target, SIM_CONFIG_TARGET) == 0 ||
+        strcmp(target, OPERATIONAL_STATE_TARGET) == 0
+    ) {
+        if (++this->setup_step == SETUP_STEPS) {
+            Serial.println("Rockblock 9704 active");
+            this->state = IDLE;
+        }
+    } else if (strcmp(target, CONSTELLATION_TARGET) == 0) {
+        int32_t bars = 0;
+        this->parser.getInt("signal_bars", &bars);
+        this->signal = this->policy.addReading(
+            (bars < SIGNAL_LEVELS) ? bars : SIGNAL_LEVELS - 1);
+        Serial.print("Signal strength: "); Serial.print(this->signal);
+        if (this->policy.shouldAttempt(this->signal, this->now)) {
+            Serial.println(" -> attempt sending");
+            this->state = SENDING;
+        } else {
+            Serial.print(" -> too low to send, threshold ");
+            Serial.println(this->policy.threshold(this->now));
+        }
+    } else if (strcmp(target, MO_TARGET) == 0) {
+        char response[32] = {0};
+        int32_t id = -1;
+        this->parser.getString("message_response", response, sizeof(response));
+        if (
+            strcmp(response, MO_ACCEPTED) != 0 ||
+            !this->parser.getInt("message_id", &id)
+        ) {
+            this->moFailed(response);
+            return;
+        }
+        this->mo_id = id;
+        this->mo_since = this->now;
+    }
+}
+
+/*
+ * The modem asks for the next part of our message
+ */
+void Rockblock9704::onOriginateSegment() {
+    int32_t id = -1;
+    int32_t start = 0;
+    int32_t len = 0;
+    this->parser.getInt("message_id", &id);
+    this->parser.getInt("segment_start", &start);
+    this->parser.getInt("segment_length", &len);
+    if (
+        id != this->mo_id || start < 0 || len <= 0 ||
+        len > IMT_MAX_SEGMENT_SIZE ||
+        (size_t) (start + len) > this->message_len
+    ) {
+        Serial.println("Invalid segment request, ignored");
+        return;
+    }
+    int offset = snprintf(this->line, sizeof(this->line),
+        "%s %s {\"topic_id\":%d,\"message_id\":%d,\"segment_length\":%d,"
+        "\"segment_start\":%d,\"data\":\"", PUT_METHOD, MO_SEGMENT_TARGET,
+        IMT_TOPIC, (int) id, (int) len, (int) start);
+    size_t encoded = base64Encode(this->message + start, len,
+        this->line + offset, sizeof(this->line) - offset);
+    snprintf(this->line + offset + encoded,
+        sizeof(this->line) - offset - encoded, "\"}\r");
+    this->serial->print(this->line);
+    strncpy(this->pending, MO_SEGMENT_TARGET, sizeof(this->pending) - 1);
+    this->pending_since = this->now;
+}
+
+void Rockblock9704::onOriginateStatus() {
+    char status[32] = {0};
+    int32_t id = -1;
+    this->parser.getInt("message_id", &id);
+    if (id != this->mo_id) { return; }
+    this->parser.getString("final_mo_status", status, sizeof(status));
+    if (strcmp(status, MO_ACKNOWLEDGED) != 0) {
+        this->moFailed(status);
+        return;
+    }
+    this->policy.onResult(this->signal, 0, this->now);
+    Serial.println("Message acknowledged");
+    this->mo_id = -1;
+    this->queued = false;
+    this->mo_sent = true;
+    this->finishSession();
+}
+
+/*
+ * An MT message is announced, its segments follow
+ */
+void Rockblock9704::onTerminate() {
+    int32_t id = -1;
+    this->parser.getInt("message_id", &id);
+    this->mt_id = id;
+    this->mt_len = 0;
+    this->mt_active = true;
+    if (this->state == IDLE) { this->state = INCOMING; }
+}
+
+void Rockblock9704::onTerminateSegment() {
+    int32_t id = -1;
+    int32_t start = 0;
+    size_t data_len = 0;
+    size_t decoded = 0;
+    this->parser.getInt("message_id", &id);
+    this->parser.getInt("segment_start", &start);
+    const char *data = this->parser.getRaw("data", &data_len);
+    if (
+        id != this->mt_id || !data || start < 0 ||
+        start >= IMT_MAX_MESSAGE_SIZE ||
+        !base64Decode(data, data_len, this->mt + start,
+            IMT_MAX_MESSAGE_SIZE - start, &decoded)
+    ) {
+        Serial.println("Invalid MT segment, ignored");
+        return;
+    }
+    if (start + decoded > this->mt_len) { this->mt_len = start + decoded; }
+}
+
+void Rockblock9704::onTerminateStatus() {
+    char status[32] = {0};
+    int32_t id = -1;
+    this->parser.getInt("message_id", &id);
+    if (id != this->mt_id) { return; }
+    this->parser.getString("final_mt_status", status, sizeof(status));
+    if (strcmp(status, MT_COMPLETE) == 0) {
+        Serial.print("Incoming message: "); Serial.println((long) this->mt_len);
+        this->storeIncoming(this->mt, this->mt_len);
+    } else {
+        Serial.print("Incoming message failed: "); Serial.println(status);
+    }
+    this->mt_id = -1;
+    this->mt_active = false;
+    // a message of our own in progress finishes the session
+    if (this->state == INCOMING) { this->finishSession(); }
+}
+
+void Rockblock9704::handleLine() {
+    const char *target = this->parser.target;
+    if (this->parser.code != JSPR_UNSOLICITED) {
+        this->onResponse();
+    } else if (strcmp(target, MO_SEGMENT_TARGET) == 0) {
+        this->onOriginateSegment();
+    } else if (strcmp(target, MO_STATUS_TARGET) == 0) {
+        this->onOriginateStatus();
+    } else if (strcmp(target, MT_TARGET) == 0) {
+        this->onTerminate();
+    } else if (strcmp(target, MT_SEGMENT_TARGET) == 0) {
+        this->onTerminateSegment();
+    } else if (strcmp(target, MT_STATUS_TARGET) == 0) {
+        this->onTerminateStatus();
+    }
+}
+
+/*
+ * Send the request for the current state, nothing is sent while a request
+ * waits for its response
+ */
+void Rockblock9704::step() {
+    char json[96] = {0};
+    if (!this->on || this->pending[0] != '\0') { return; }
+
+    switch (this->state) {
+
+        case OFFLINE:
+            if (this->setup_step == 0) {
+                snprintf(json, sizeof(json),
+                    "{\"active_version\":{\"major\":%d,\"minor\":%d,"
+                    "\"patch\":0}}", IMT_API_MAJOR, IMT_API_MINOR);
+                this->request(PUT_METHOD, API_VERSION_TARGET, json);
+            } else if (this->setup_step == 1) {
+                this->request(PUT_METHOD, SIM_CONFIG_TARGET,
+                    "{\"interface\":\"internal\"}");
+            } else {
+                this->request(PUT_METHOD, OPERATIONAL_STATE_TARGET,
+                    "{\"state\":\"active\"}");
+            }
+            break;
+
+        case IDLE:
+            if (this->queued) { this->state = COM_CHECK; }
+            break;
+
+        case COM_CHECK:
+            if (this->policy.readyToPoll(this->now)) {
+                this->request(GET_METHOD, CONSTELLATION_TARGET, "{}");
+                this->policy.polled(this->now);
+            }
+            break;
+
+        case SENDING:
+            // the modem handles the message once accepted
+            if (this->mo_id >= 0) { break; }
+            snprintf(json, sizeof(json),
+                "{\"topic_id\":%d,\"message_length\":%d,"
+                "\"request_reference\":%d}", IMT_TOPIC,
+                (int) this->message_len, (int) ++this->request_reference);
+            this->request(PUT_METHOD, MO_TARGET, json);
+            this->retries += 1;
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Rockblock9704::run() {
+    char chunk[READ_CHUNK_SIZE];
+    size_t len = 0;
+    uint32_t dropped = this->parser.dropped;
+    this->now = esp_timer_get_time() / 1000;
+
+    while ((len = this->serial->readBytes(chunk, sizeof(chunk))) > 0) {
+        size_t used = 0;
+        while (used < len) {
+            used += this->parser.feed(chunk + used, len - used);
+            if (this->parser.complete) { this->handleLine(); }
+        }
+    }
+    if (this->parser.dropped != dropped) {
+        Serial.println("JSPR line too long, dropped");
+    }
+    // requests are sent again by step()
+    if (
+        this->pending[0] != '\0' &&
+        this->now - this->pending_since >= JSPR_REQUEST_TIMEOUT
+    ) {
+        Serial.print("Request timed out: "); Serial.println(this->pending);
+        this->pending[0] = '\0';
+    }
+    if (this->mo_id >= 0 && this->now - this->mo_since >= IMT_MO_TIMEOUT) {
+        this->moFailed("timeout");
+    }
+    this->step();
+}
+
+void Rockblock9704::loop() {
+    if (this->on) { this->run(); }
+}
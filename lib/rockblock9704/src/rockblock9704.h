@@ -0,0 +1,134 @@
+/*
+ * Driver for the RockBLOCK 9704 using Iridium Messaging Transport (IMT) over
+ * JSPR, see jspr.h. It has the same public surface as Rockblock (9603, SBD)
+ * and is selected at build time with ROCKBLOCK_9704.
+ *
+ * Differences to the 9603:
+ *
+ * - messages up to IMT_MAX_MESSAGE_SIZE bytes, transferred in segments the
+ *   modem asks for,
+ * - the modem retries a message by itself until it reports a final status,
+ * - MT messages are pushed by the modem whenever it is on, no ring alerts or
+ *   mailbox checks,
+ * - no location in a session header, the location has to be in the payload.
+ */
+#ifndef __ROCKBLOCK_9704_H__
+#define __ROCKBLOCK_9704_H__
+#ifndef NATIVE
+#include <Arduino.h>
+#endif
+#include <tca95xx.h>
+#include <hal.h>
+// StateMachine, INBOX_SIZE and signal history are shared with the 9603
+#include <rockblock.h>
+#include <jspr.h>
+
+#ifndef IMT_MAX_MESSAGE_SIZE
+#define IMT_MAX_MESSAGE_SIZE 2048
+#endif
+// largest segment that fits a request line in base64
+#define IMT_MAX_SEGMENT_SIZE ((JSPR_MAX_LINE_SIZE - 160) / 4 * 3)
+// topic of RockBLOCK messages without cloudloop configuration
+#ifndef IMT_TOPIC
+#define IMT_TOPIC 244
+#endif
+#define IMT_API_MAJOR 1
+#define IMT_API_MINOR 0
+// response to a request, in ms
+#define JSPR_REQUEST_TIMEOUT 5000
+// final status of a message, the modem retries by itself in the meantime
+#define IMT_MO_TIMEOUT 180000
+
+class Rockblock9704 {
+
+    private:
+        AbstractSerial* serial;
+        AbstractExpander* expander;
+        uint8_t enable_pin;
+        JsprParser parser = JsprParser();
+        char line[JSPR_MAX_LINE_SIZE] = {0};
+        uint8_t message[IMT_MAX_MESSAGE_SIZE] = {0};
+        size_t message_len = 0;
+        // MT messages in order of arrival
+        char inbox[INBOX_SIZE][MAX_MESSAGE_SIZE] = {{0}};
+        size_t inbox_len[INBOX_SIZE] = {0};
+        size_t inbox_count = 0;
+        uint16_t incoming_count = 0;
+        // MT message being received
+        uint8_t mt[IMT_MAX_MESSAGE_SIZE] = {0};
+        int32_t mt_id = -1;
+        size_t mt_len = 0;
+        bool mt_active = false;
+        // setup requests sent after power on
+        uint8_t setup_step = 0;
+        // request waiting for its response, empty if none
+        char pending[JSPR_TARGET_SIZE] = {0};
+        uint32_t pending_since = 0;
+        int32_t request_reference = 0;
+        int32_t mo_id = -1;
+        uint32_t mo_since = 0;
+        bool mo_sent = false;
+        bool queued = false;
+        bool on = false;
+        time_t start_time;
+        uint8_t retries = 0;
+        uint8_t signal = 0;
+        RetryPolicy policy = RetryPolicy();
+        // time of the current run in ms
+        uint32_t now = 0;
+        bool request(const char *method, const char *target,
+            const char *json);
+        void resetMessage();
+        void storeIncoming(const uint8_t *bfr, size_t len);
+        void finishSession();
+        void moFailed(const char *reason);
+        void handleLine();
+        void onResponse();
+        void onOriginateSegment();
+        void onOriginateStatus();
+        void onTerminate();
+        void onTerminateSegment();
+        void onTerminateStatus();
+        void step();
+        void run();
+
+    public:
+        Rockblock9704(AbstractExpander &expander, AbstractSerial &serial,
+            uint8_t enable_pin);
+        StateMachine state = OFFLINE;
+        bool sendSuccess = false;
+        void sendMessage(char *bfr, size_t len=IMT_MAX_MESSAGE_SIZE);
+        void sendMessage(const uint8_t *bfr, size_t len);
+        // IMT has no session header, the location is not sent
+        void sendMessage(char *bfr, float lat, float lon,
+            size_t len=IMT_MAX_MESSAGE_SIZE);
+        void sendMessage(const uint8_t *bfr, size_t len, float lat, float lon);
+        // replace the payload before the modem asks for it, false if it is
+        // too late
+        bool updateMessage(char *bfr, size_t len=IMT_MAX_MESSAGE_SIZE);
+        bool updateMessage(const uint8_t *bfr, size_t len);
+        size_t getLastIncoming(char *bfr, size_t len=MAX_MESSAGE_SIZE);
+        size_t getIncomingSize();
+        size_t getIncoming(size_t idx, char *bfr, size_t len=MAX_MESSAGE_SIZE);
+        // an MT message is being received
+        bool mailboxPending();
+        uint8_t getSignalStrength();
+        // a request is waiting for its response
+        bool commandPending();
+        uint16_t getIncomingCount();
+        // compatibility with Rockblock, the 9704 needs none of these
+        void setRingAlerts(bool enable) {};
+        void ringIndicator(bool level) {};
+        void setTerse(bool terse) {};
+        void setFlowControl(uint8_t rts_pin) {};
+        void clearToSend(bool level) {};
+        signalHistory getSignalHistory();
+        void setSignalHistory(const signalHistory &history);
+        // the message has to be sent by then, ms since boot
+        void setDeadline(uint32_t deadline);
+        void toggle(bool on=false);
+        // process loop
+        void loop();
+};
+
+#endif
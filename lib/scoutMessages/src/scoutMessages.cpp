@@ -41,7 +41,7 @@ size_t scoutMessages::epoch2utcSimple(char* bfr, time_t val) {
  *
  * Example: PK001;lat:3658.56558,NS:N,lon:12200.87904,EW:W,utc:195257.00,sog:2.371,cog:0,sta:00,batt:3.44
  */
-size_t scoutMessages::createPK001(char* bfr, const systemState state) {
+size_t scoutMessages::createPK001(char* bfr, const systemState &state) {
     // wasting some memory here
     char latBfr[32] = {0};
     char lonBfr[32] = {0};
@@ -59,7 +59,9 @@ size_t scoutMessages::createPK001(char* bfr, const systemState state) {
  *
  * Example: PK001;lat:3658.56558,NS:N,lon:12200.87904,EW:W,utc:195257.00,sog:2.371,cog:0,sta:00,batt:3.44,int:10,st:5
  */
-size_t scoutMessages::createPK001_extended(char* bfr, const systemState state) {
+size_t scoutMessages::createPK001_extended(
+    char* bfr, const systemState &state
+) {
     size_t len = createPK001(bfr, state);
     uint16_t interval = (
         state.new_interval == 0) ? state.interval : state.new_interval;
@@ -76,7 +78,7 @@ size_t scoutMessages::createPK001_extended(char* bfr, const systemState state) {
  * - int, added, interval in minutes
  * - st, added, status 0, 1, 2, 3, 4
  */
-size_t scoutMessages::createPK101(char* bfr, const systemState state) {
+size_t scoutMessages::createPK101(char* bfr, const systemState &state) {
     // wasting some memory here
     char latBfr[32] = {0};
     char lonBfr[32] = {0};
@@ -95,21 +97,131 @@ size_t scoutMessages::createPK101(char* bfr, const systemState state) {
         (uint32_t) sleep/60, state.mode);
 }
 
+/*
+ * PK101 without coordinates, the location is part of the SBDIX session
+ * header instead. This saves about 40 bytes per message.
+ */
+size_t scoutMessages::createPK102(char* bfr, const systemState &state) {
+    char timeBfr[16] = {0};
+    epoch2utcSimple(timeBfr, state.gps_read_time);
+    uint32_t interval = (
+        state.new_interval == 0) ? state.interval : state.new_interval;
+    uint32_t sleep = (
+        state.new_sleep == 0) ? state.sleep : state.new_sleep;
+    return snprintf(
+        bfr, 128, "PK102;%s,batt:%.1f,int:%d,sl:%d,st:%d",
+        timeBfr, state.bat, (uint32_t) interval/60, (uint32_t) sleep/60,
+        state.mode);
+}
+
+/*
+ * Lat and lng are set to 999 if the GPS timed out
+ */
+bool scoutMessages::hasPosition(const systemState &state) {
+    return !(state.lat == 999 && state.lng == 999);
+}
+
+/*
+ * Append the sequence number of the current report and fixes that could not
+ * be sent before, e.g. ";seq:12;Q:10,1726686049,35.50000,-122.00000". Fixes
+ * are added until size is reached, the rest stays queued.
+ */
+size_t scoutMessages::appendBacklog(
+    char* bfr, size_t size, const systemState &state, uint8_t* sent
+) {
+    char entry[64] = {0};
+    size_t len = snprintf(entry, sizeof(entry), ";seq:%d", state.sequence);
+    *sent = 0;
+    if (len >= size) { return 0; }
+    memcpy(bfr, entry, len + 1);
+    for (size_t i = 0; i < state.queue.size(); i++) {
+        const queuedFix &fix = state.queue[i];
+        size_t entry_len = snprintf(entry, sizeof(entry), ";Q:%d,%lu,%.5f,%.5f",
+            fix.seq, (unsigned long) fix.time, fix.lat, fix.lng);
+        if (len + entry_len >= size) { break; }
+        memcpy(bfr + len, entry, entry_len + 1);
+        len += entry_len;
+        *sent += 1;
+    }
+    return len;
+}
+
+/*
+ * Append track fixes, e.g. ";T:1726686049,3550000,-12200000,600,12,-40".
+ * Fixes are added until size is reached, the rest stays in the track.
+ */
+size_t scoutMessages::appendTrack(
+    char* bfr, size_t size, const systemState &state, uint8_t* sent
+) {
+    char entry[48] = {0};
+    size_t len = 0;
+    *sent = 0;
+    for (size_t i = 0; i < state.track.size(); i++) {
+        const trackFix &fix = state.track[i];
+        size_t entry_len = 0;
+        if (i == 0) {
+            entry_len = snprintf(entry, sizeof(entry), ";T:%lu,%ld,%ld",
+                (unsigned long) fix.time, (long) fix.lat, (long) fix.lng);
+        } else {
+            const trackFix &last = state.track[i - 1];
+            // the RTC stepped back, the fix starts the track of the next
+            // message
+            if (fix.time < last.time) { break; }
+            entry_len = snprintf(entry, sizeof(entry), ",%lu,%ld,%ld",
+                (unsigned long) (fix.time - last.time),
+                (long) (fix.lat - last.lat), (long) (fix.lng - last.lng));
+        }
+        if (len + entry_len >= size) { break; }
+        memcpy(bfr + len, entry, entry_len + 1);
+        len += entry_len;
+        *sent += 1;
+    }
+    return len;
+}
+
+/*
+ * Append the energy estimate in mAh per day, e.g.
+ * ";E:48,55.2,10.1,8.0,20.3,12.5,4.3" for hours accounted, total, CPU, GPS,
+ * Rockblock, SBDIX sessions and deep sleep.
+ */
+size_t scoutMessages::appendEnergy(
+    char* bfr, size_t size, const systemState &state
+) {
+    const energyTotals &energy = state.energy;
+    char entry[80] = {0};
+    size_t len = snprintf(entry, sizeof(entry),
+        ";E:%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f",
+        (unsigned long) (energy.seconds / 3600),
+        energyPerDay(energy, ENERGY_LOADS), energyPerDay(energy, LOAD_CPU),
+        energyPerDay(energy, LOAD_GPS), energyPerDay(energy, LOAD_ROCKBLOCK),
+        energyPerDay(energy, LOAD_SBDIX), energyPerDay(energy, LOAD_SLEEP));
+    if (len >= size) { return 0; }
+    memcpy(bfr, entry, len + 1);
+    return len;
+}
+
 /*
  * Parse an incoming message. The data format is rather inconsistent,
  * but we are taking it from the legacy version of the firmware by Matt Arcady.
  * Example: +DATA:PK006,60 (minutes) BUT +DATA:PK007:86400 (seconds)
+ *
+ * PK008 selects the uplink format, 0 text and 1 binary. Binary config
+ * messages are recognized by their header byte and rejected if shorter than
+ * a config message, text messages end at the first \0.
  */
-bool scoutMessages::parseIncoming(systemState &state, char* bfr) {
+bool scoutMessages::parseIncoming(systemState &state, char* bfr, size_t len) {
     // with more tokens we should use enum but keep it simple for now
-    uint8_t message_type = 0; // 1 PK001, 2 PK002
+    uint8_t message_type = 0; // 1 PK006, 2 PK007, 3 PK008
     int32_t parsed = 0;
-    const char* tokens[] = {"+DATA:PK006,", "+DATA:PK007,"};
+    const char* tokens[] = {"+DATA:PK006,", "+DATA:PK007,", "+DATA:PK008,"};
+    if (len > 0 && ((uint8_t) bfr[0] >> 4) == BINARY_VERSION) {
+        return parseIncomingBinary(state, (const uint8_t*) bfr, len);
+    }
     // initialize values
     state.new_interval = 0;
     state.new_sleep = 0;
     // check tokens
-    for (int i=0; i<2; i++) {
+    for (int i=0; i<3; i++) {
       char* substr = strstr(bfr, tokens[i]);
       if (substr == NULL) { continue; }
       if (substr != bfr) { continue; }
@@ -126,11 +238,307 @@ bool scoutMessages::parseIncoming(systemState &state, char* bfr) {
     if (message_type == 1 && parsed > 1440 ) { return false; }
     // this is in seconds
     if (message_type == 2 && parsed > 259200 ) { return false; }
+    // text or binary
+    if (message_type == 3 && parsed > BINARY_FORMAT ) { return false; }
     // finally set times
     if (message_type == 1) { state.new_interval = parsed * 60; }
     if (message_type == 2) {
         state.new_interval = 600;
         state.new_sleep = parsed;
     }
+    // format applies immediately, the confirmation uses the new format
+    if (message_type == 3) { state.message_format = (messageFormat) parsed; }
     return true;
+}
+
+bool scoutMessages::parseIncoming(systemState &state, char* bfr) {
+    return parseIncoming(state, bfr, strlen(bfr));
+}
+
+/*
+ * Parse several incoming messages, e.g. all MT messages queued at the
+ * gateway. Every message resets the new values, hence they are collected
+ * here. Valid messages are applied even if another one is invalid.
+ */
+bool scoutMessages::parseIncoming(
+    systemState &state, char* messages[], const size_t lengths[],
+    size_t count
+) {
+    bool valid = true;
+    uint32_t new_interval = 0;
+    uint32_t new_sleep = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!parseIncoming(state, messages[i], lengths[i])) {
+            valid = false;
+            continue;
+        }
+        if (state.new_interval != 0) { new_interval = state.new_interval; }
+        if (state.new_sleep != 0) { new_sleep = state.new_sleep; }
+    }
+    state.new_interval = new_interval;
+    state.new_sleep = new_sleep;
+    return valid;
+}
+
+/*
+ * Write big-endian integers to a byte buffer.
+ */
+static size_t putUint16(uint8_t* bfr, uint16_t val) {
+    bfr[0] = val >> 8;
+    bfr[1] = val & 0xff;
+    return 2;
+}
+
+static size_t putUint32(uint8_t* bfr, uint32_t val) {
+    putUint16(bfr, val >> 16);
+    putUint16(bfr + 2, val & 0xffff);
+    return 4;
+}
+
+static uint32_t getUint32(const uint8_t* bfr) {
+    return (uint32_t) bfr[0] << 24 | (uint32_t) bfr[1] << 16 |
+        (uint32_t) bfr[2] << 8 | bfr[3];
+}
+
+static size_t putVarint(uint8_t* bfr, uint32_t val) {
+    size_t idx = 0;
+    while (val >= 0x80) {
+        bfr[idx++] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    bfr[idx++] = val;
+    return idx;
+}
+
+// small differences of either sign become small unsigned values
+static uint32_t zigzag(int32_t val) {
+    return ((uint32_t) val << 1) ^ (uint32_t) (val >> 31);
+}
+
+// Limit a value to the range of a message field
+static uint32_t clamp(float val, float max) {
+    if (val < 0) { return 0; }
+    return (val > max) ? max : round(val);
+}
+
+/*
+ * Create a binary position message, see scoutMessages.h for the layout.
+ */
+size_t scoutMessages::createBinaryPosition(
+    uint8_t* bfr, const systemState &state
+) {
+    size_t idx = 0;
+    uint32_t interval = (
+        state.new_interval == 0) ? state.interval : state.new_interval;
+    uint32_t sleep = (
+        state.new_sleep == 0) ? state.sleep : state.new_sleep;
+    bfr[idx++] = BINARY_VERSION << 4 | BINARY_POSITION;
+    idx += putUint32(bfr + idx, state.gps_read_time);
+    idx += putUint32(bfr + idx, (int32_t) round(state.lat * 1E6));
+    idx += putUint32(bfr + idx, (int32_t) round(state.lng * 1E6));
+    bfr[idx++] = clamp(state.bat * 50, 255);
+    idx += putUint16(bfr + idx, clamp(interval / 60, 0xffff));
+    idx += putUint16(bfr + idx, clamp(sleep / 60, 0xffff));
+    bfr[idx++] = state.mode;
+    bfr[idx++] = clamp(state.speed * 10, 255);
+    bfr[idx++] = clamp(state.heading / 2, 179);
+    return idx;
+}
+
+/*
+ * Create a binary position message without coordinates, these are sent in
+ * the SBDIX session header.
+ */
+size_t scoutMessages::createBinaryHeaderPosition(
+    uint8_t* bfr, const systemState &state
+) {
+    size_t idx = 0;
+    uint32_t interval = (
+        state.new_interval == 0) ? state.interval : state.new_interval;
+    uint32_t sleep = (
+        state.new_sleep == 0) ? state.sleep : state.new_sleep;
+    bfr[idx++] = BINARY_VERSION << 4 | BINARY_HEADER_POSITION;
+    idx += putUint32(bfr + idx, state.gps_read_time);
+    bfr[idx++] = clamp(state.bat * 50, 255);
+    idx += putUint16(bfr + idx, clamp(interval / 60, 0xffff));
+    idx += putUint16(bfr + idx, clamp(sleep / 60, 0xffff));
+    bfr[idx++] = state.mode;
+    bfr[idx++] = clamp(state.speed * 10, 255);
+    bfr[idx++] = clamp(state.heading / 2, 179);
+    return idx;
+}
+
+/*
+ * Create a binary status message, used if there is no position to report.
+ */
+size_t scoutMessages::createBinaryStatus(
+    uint8_t* bfr, const systemState &state
+) {
+    size_t idx = 0;
+    uint32_t interval = (
+        state.new_interval == 0) ? state.interval : state.new_interval;
+    uint32_t sleep = (
+        state.new_sleep == 0) ? state.sleep : state.new_sleep;
+    bfr[idx++] = BINARY_VERSION << 4 | BINARY_STATUS;
+    idx += putUint32(bfr + idx, state.gps_read_time);
+    bfr[idx++] = clamp(state.bat * 50, 255);
+    bfr[idx++] = state.signal;
+    bfr[idx++] = 3 - state.retries;
+    bfr[idx++] = state.mode;
+    idx += putUint16(bfr + idx, clamp(interval / 60, 0xffff));
+    idx += putUint16(bfr + idx, clamp(sleep / 60, 0xffff));
+    return idx;
+}
+
+/*
+ * Create a config acknowledgement, confirming the settings that will apply
+ * after this message has been sent.
+ */
+size_t scoutMessages::createBinaryConfigAck(
+    uint8_t* bfr, const systemState &state
+) {
+    size_t idx = 0;
+    uint32_t interval = (
+        state.new_interval == 0) ? state.interval : state.new_interval;
+    uint32_t sleep = (
+        state.new_sleep == 0) ? state.sleep : state.new_sleep;
+    bfr[idx++] = BINARY_VERSION << 4 | BINARY_CONFIG_ACK;
+    bfr[idx++] = state.mode != ERROR;
+    idx += putUint16(bfr + idx, clamp(interval / 60, 0xffff));
+    idx += putUint32(bfr + idx, sleep);
+    return idx;
+}
+
+/*
+ * Create the binary report sent on every wake up. Status replaces position
+ * if there was no GPS fix. The config acknowledgement is appended after a
+ * config message has been received.
+ */
+size_t scoutMessages::createBinaryReport(
+    uint8_t* bfr, const systemState &state, bool locationInHeader
+) {
+    size_t len = 0;
+    if (!hasPosition(state)) {
+        len = createBinaryStatus(bfr, state);
+    } else if (locationInHeader) {
+        len = createBinaryHeaderPosition(bfr, state);
+    } else {
+        len = createBinaryPosition(bfr, state);
+    }
+    if (state.mode == CONFIG || state.mode == ERROR) {
+        len += createBinaryConfigAck(bfr + len, state);
+    }
+    return len;
+}
+
+/*
+ * Binary version of appendBacklog, the record is omitted if there is not
+ * even space for the sequence number.
+ */
+size_t scoutMessages::createBinaryBacklog(
+    uint8_t* bfr, size_t size, const systemState &state, uint8_t* sent
+) {
+    size_t idx = 0;
+    *sent = 0;
+    if (size < BINARY_BACKLOG_SIZE) { return 0; }
+    bfr[idx++] = BINARY_VERSION << 4 | BINARY_BACKLOG;
+    idx += putUint16(bfr + idx, state.sequence);
+    // count is set below
+    idx++;
+    for (size_t i = 0; i < state.queue.size(); i++) {
+        if (idx + BINARY_BACKLOG_FIX_SIZE > size) { break; }
+        const queuedFix &fix = state.queue[i];
+        idx += putUint16(bfr + idx, fix.seq);
+        idx += putUint32(bfr + idx, fix.time);
+        idx += putUint32(bfr + idx, (int32_t) round(fix.lat * 1E6));
+        idx += putUint32(bfr + idx, (int32_t) round(fix.lng * 1E6));
+        *sent += 1;
+    }
+    bfr[3] = *sent;
+    return idx;
+}
+
+/*
+ * Binary version of appendTrack, see scoutMessages.h for the encoding.
+ * Fixes are added as long as they fit into size.
+ */
+size_t scoutMessages::createBinaryTrack(
+    uint8_t* bfr, size_t size, const systemState &state, uint8_t* sent
+) {
+    size_t idx = 0;
+    *sent = 0;
+    if (state.track.size() == 0 || size < BINARY_TRACK_SIZE) { return 0; }
+    const trackFix &first = state.track[0];
+    bfr[idx++] = BINARY_VERSION << 4 | BINARY_TRACK;
+    // count is set below
+    idx++;
+    idx += putUint32(bfr + idx, first.time);
+    idx += putUint32(bfr + idx, first.lat);
+    idx += putUint32(bfr + idx, first.lng);
+    *sent = 1;
+    uint8_t delta[15] = {0};
+    for (size_t i = 1; i < state.track.size(); i++) {
+        const trackFix &fix = state.track[i];
+        const trackFix &last = state.track[i - 1];
+        // time deltas are unsigned, see appendTrack
+        if (fix.time < last.time) { break; }
+        size_t len = putVarint(delta, fix.time - last.time);
+        len += putVarint(delta + len, zigzag(fix.lat - last.lat));
+        len += putVarint(delta + len, zigzag(fix.lng - last.lng));
+        if (idx + len > size) { break; }
+        memcpy(bfr + idx, delta, len);
+        idx += len;
+        *sent += 1;
+    }
+    bfr[1] = *sent;
+    return idx;
+}
+
+/*
+ * Binary version of appendEnergy, see scoutMessages.h for the layout.
+ */
+size_t scoutMessages::createBinaryEnergy(
+    uint8_t* bfr, size_t size, const systemState &state
+) {
+    if (size < BINARY_ENERGY_SIZE) { return 0; }
+    size_t idx = 0;
+    bfr[idx++] = BINARY_VERSION << 4 | BINARY_ENERGY;
+    idx += putUint16(bfr + idx, clamp(state.energy.seconds / 3600, 65535));
+    for (size_t i = 0; i < ENERGY_LOADS; i++) {
+        idx += putUint16(
+            bfr + idx, clamp(energyPerDay(state.energy, i) * 10, 65535));
+    }
+    return idx;
+}
+
+/*
+ * Parse a binary config message. Same bounds as the text messages apply.
+ */
+bool scoutMessages::parseIncomingBinary(
+    systemState &state, const uint8_t* bfr, size_t len
+) {
+    // initialize values
+    state.new_interval = 0;
+    state.new_sleep = 0;
+    if (len < BINARY_CONFIG_SIZE) { return false; }
+    if (bfr[0] != (BINARY_VERSION << 4 | BINARY_CONFIG)) { return false; }
+    uint32_t parsed = getUint32(bfr + 2);
+    switch (bfr[1]) {
+        case CONFIG_INTERVAL:
+            // this is in minutes
+            if (parsed > 1440) { return false; }
+            state.new_interval = parsed * 60;
+            return true;
+        case CONFIG_SLEEP:
+            // this is in seconds
+            if (parsed > 259200) { return false; }
+            state.new_interval = 600;
+            state.new_sleep = parsed;
+            return true;
+        case CONFIG_FORMAT:
+            if (parsed > BINARY_FORMAT) { return false; }
+            state.message_format = (messageFormat) parsed;
+            return true;
+    }
+    return false;
 }
\ No newline at end of file
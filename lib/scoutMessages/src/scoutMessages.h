@@ -14,6 +14,82 @@
 #include <Arduino.h>
 #include <time.h>
 #include <stateType.h>
+#include <energyMeter.h>
+
+/*
+ * Binary message family. All messages start with a header byte holding the
+ * format version (high nibble) and message type (low nibble). Multi-byte
+ * values are big-endian. A position report with config acknowledgement stays
+ * well below a single 50 byte Iridium credit.
+ *
+ * Position (21 bytes):
+ *   header, utc (uint32, epoch), lat and lon (int32, degrees * 1E6),
+ *   batt (uint8, 20mV steps), int (uint16, minutes), sl (uint16, minutes),
+ *   st (uint8), sog (uint8, 0.1 knots), cog (uint8, 2 degree steps)
+ *
+ * Position without coordinates (13 bytes), used when the location is sent
+ * in the SBDIX session header:
+ *   header, utc (uint32, epoch), batt (uint8), int (uint16), sl (uint16),
+ *   st (uint8), sog (uint8), cog (uint8), same units as position
+ *
+ * Status (13 bytes), sent instead of position without GPS fix:
+ *   header, utc (uint32), batt (uint8), signal (uint8), retries (uint8),
+ *   st (uint8), int (uint16, minutes), sl (uint16, minutes)
+ *
+ * Config acknowledgement (8 bytes), appended to position or status after a
+ * config message has been received:
+ *   header, accepted (uint8, 0 or 1), int (uint16, minutes),
+ *   sl (uint32, seconds)
+ *
+ * Backlog (4 bytes + 14 bytes per fix), appended to every report:
+ *   header, seq (uint16, sequence number of this report), count (uint8),
+ *   count times: seq (uint16), utc (uint32), lat and lon (int32)
+ *
+ * Track (14 bytes + 3 to 15 bytes per further fix), appended after the
+ * backlog if there are fixes of track wake ups, oldest first:
+ *   header, count (uint8), first fix: utc (uint32), lat and lon (int32,
+ *   degrees * 1E5), further fixes as difference to the one before: utc
+ *   (varint, s), lat and lon (zigzag varint, degrees * 1E5). A varint holds
+ *   7 bits per byte, least significant first, the high bit is set if
+ *   another byte follows. Zigzag maps signed to unsigned values, 0, -1, 1,
+ *   -2 to 0, 1, 2, 3.
+ *
+ * Energy (13 bytes), appended once per ENERGY_REPORT_INTERVAL, see
+ * energyMeter.h:
+ *   header, hours accounted (uint16), mAh per day (uint16, 0.1 mAh) of CPU,
+ *   GPS, Rockblock, SBDIX sessions and deep sleep
+ *
+ * Config (downlink, 6 bytes):
+ *   header, setting (uint8, see binaryConfigSetting), value (uint32)
+ */
+#define BINARY_VERSION 1
+#define BINARY_POSITION_SIZE 21
+#define BINARY_HEADER_POSITION_SIZE 13
+#define BINARY_STATUS_SIZE 13
+#define BINARY_CONFIG_ACK_SIZE 8
+#define BINARY_CONFIG_SIZE 6
+#define BINARY_BACKLOG_SIZE 4
+#define BINARY_BACKLOG_FIX_SIZE 14
+#define BINARY_TRACK_SIZE 14
+#define BINARY_ENERGY_SIZE 13
+
+enum binaryMessageType {
+  BINARY_POSITION = 1,
+  BINARY_STATUS = 2,
+  BINARY_CONFIG_ACK = 3,
+  BINARY_HEADER_POSITION = 4,
+  BINARY_BACKLOG = 5,
+  BINARY_TRACK = 6,
+  BINARY_ENERGY = 7,
+  BINARY_CONFIG = 8
+};
+
+// Settings changed by a binary config message, same as PK006, PK007, PK008
+enum binaryConfigSetting {
+  CONFIG_INTERVAL = 1, // minutes
+  CONFIG_SLEEP = 2, // seconds
+  CONFIG_FORMAT = 3 // messageFormat
+};
 
 namespace scoutMessages {
   size_t epoch2utc(char* bfr, time_t val);
@@ -21,13 +97,54 @@ namespace scoutMessages {
   // every message
   size_t epoch2utcSimple(char* bfr, time_t val);
   size_t float2Nmea(char* bfr, float val, bool latFlag=true);
-  size_t createPK001(char* bfr, const systemState state);
+  size_t createPK001(char* bfr, const systemState &state);
   // TODO: reimplement original PK001 if needed
   // PK001_extended adds extra fields to PK001, for development only 
-  size_t createPK001_extended(char* bfr, const systemState state);
+  size_t createPK001_extended(char* bfr, const systemState &state);
   // Modified version of PK101 as used in v3
-  size_t createPK101(char* bfr, const systemState state);
+  size_t createPK101(char* bfr, const systemState &state);
+  // PK101 without coordinates, location is sent in the SBDIX session header
+  size_t createPK102(char* bfr, const systemState &state);
+  // whether state holds a GPS fix that can be reported
+  bool hasPosition(const systemState &state);
+  // Parse a message of len bytes as received, binary ones may contain \0
+  bool parseIncoming(systemState &state, char* bfr, size_t len);
+  // Same for a NUL terminated text message
   bool parseIncoming(systemState &state, char* bfr);
+  // Parse all messages of a session in order, the last one setting a value
+  // wins. Returns false if any message is invalid.
+  bool parseIncoming(
+    systemState &state, char* messages[], const size_t lengths[],
+    size_t count);
+  // Append sequence number and queued fixes (oldest first) as long as they
+  // fit into size, sent returns the number of fixes added
+  size_t appendBacklog(
+    char* bfr, size_t size, const systemState &state, uint8_t* sent);
+  // Append fixes of track wake ups, the first one absolute, the others as
+  // difference to the one before, as long as they fit into size and the
+  // time does not go backwards
+  size_t appendTrack(
+    char* bfr, size_t size, const systemState &state, uint8_t* sent);
+  // Append the energy estimate, 0 if it does not fit into size
+  size_t appendEnergy(char* bfr, size_t size, const systemState &state);
+  // Binary messages, return size in bytes
+  size_t createBinaryPosition(uint8_t* bfr, const systemState &state);
+  size_t createBinaryHeaderPosition(uint8_t* bfr, const systemState &state);
+  size_t createBinaryStatus(uint8_t* bfr, const systemState &state);
+  size_t createBinaryConfigAck(uint8_t* bfr, const systemState &state);
+  // Position (or status without fix) and config acknowledgement if needed,
+  // coordinates are left out if locationInHeader is set
+  size_t createBinaryReport(
+    uint8_t* bfr, const systemState &state, bool locationInHeader=false);
+  bool parseIncomingBinary(systemState &state, const uint8_t* bfr, size_t len);
+  size_t createBinaryBacklog(
+    uint8_t* bfr, size_t size, const systemState &state, uint8_t* sent);
+  // empty if there are no track fixes
+  size_t createBinaryTrack(
+    uint8_t* bfr, size_t size, const systemState &state, uint8_t* sent);
+  // 0 if it does not fit into size
+  size_t createBinaryEnergy(
+    uint8_t* bfr, size_t size, const systemState &state);
 };
 
 #endif
@@ -5,7 +5,11 @@
 #define __STATE_TYPE_H__
 
 #include <map>
+#include <stdint.h>
+#include <time.h>
+#ifndef NATIVE
 #include <Arduino.h>
+#endif
 
 #ifndef DEFAULT_INTERVAL
 #define DEFAULT_INTERVAL 600
@@ -20,9 +24,159 @@ enum messageType {
   FIRST,
   WAKE_UP,
   CONFIG,
-  ERROR // a retry message could be a config message at the same time
+  ERROR, // a retry message could be a config message at the same time
+  LOW_BATTERY // GPS skipped to save the battery, see batteryPolicy.h
+};
+
+/*
+ * Uplink message format, text (PK101) or binary, see scoutMessages.h
+ */
+enum messageFormat {
+  TEXT_FORMAT,
+  BINARY_FORMAT
+};
+
+#ifndef DEFAULT_MESSAGE_FORMAT
+#define DEFAULT_MESSAGE_FORMAT TEXT_FORMAT
+#endif
+
+/*
+ * Iridium sessions (+SBDIX) attempted and succeeded per signal strength
+ * (CSQ 0 to 5), used to learn the send threshold, see retryPolicy.h
+ */
+#define SIGNAL_LEVELS 6
+
+typedef struct {
+  uint8_t attempts[SIGNAL_LEVELS] = {0};
+  uint8_t successes[SIGNAL_LEVELS] = {0};
+} signalHistory;
+
+/*
+ * Ring buffer kept in RTC memory, the oldest item is dropped when full
+ */
+template <typename T, size_t N>
+struct ringQueue {
+  T items[N];
+  uint8_t start = 0;
+  uint8_t count = 0;
+  size_t size() const { return this->count; }
+  // oldest first
+  const T& operator[](size_t idx) const {
+    return this->items[(this->start + idx) % N]; }
+  void push(const T &item) {
+    if (this->count == N) { this->pop(1); }
+    this->items[(this->start + this->count) % N] = item;
+    this->count++;
+  }
+  // remove the n oldest items
+  void pop(size_t n) {
+    if (n > this->count) { n = this->count; }
+    this->start = (this->start + n) % N;
+    this->count -= n;
+  }
+};
+
+/*
+ * Fixes that could not be sent, they are packed into the next successful
+ * message. The oldest fix is dropped when the queue is full.
+ */
+#ifndef FIX_QUEUE_SIZE
+#define FIX_QUEUE_SIZE 16
+#endif
+
+typedef struct {
+  uint16_t seq = 0;
+  uint32_t time = 0;
+  float lat = 999;
+  float lng = 999;
+} queuedFix;
+
+typedef ringQueue<queuedFix, FIX_QUEUE_SIZE> fixQueue;
+
+/*
+ * Fixes taken by track wake ups between reports, see
+ * helpers::scheduleTrack. They are sent delta encoded with the next
+ * successful message, the oldest fix is dropped when the track is full.
+ */
+#ifndef TRACK_SIZE
+#define TRACK_SIZE 48
+#endif
+
+typedef struct {
+  uint32_t time = 0;
+  // degrees * 1E5
+  int32_t lat = 0;
+  int32_t lng = 0;
+} trackFix;
+
+typedef ringQueue<trackFix, TRACK_SIZE> fixTrack;
+
+/*
+ * Time to first fix, timeouts and fix quality of past wake ups, see
+ * gpsPolicy.h
+ */
+#define GPS_TTFF_BUCKETS 8
+
+typedef struct {
+  // wake ups with fix by time to first fix, buckets see gpsPolicy.cpp
+  uint8_t ttff[GPS_TTFF_BUCKETS] = {0};
+  uint8_t timeouts = 0;
+  // timeouts in a row
+  uint8_t misses = 0;
+  // average HDOP (1/100) and satellites of accepted fixes, 0 if unknown
+  uint16_t hdop = 0;
+  uint8_t satellites = 0;
+  // wake ups with fix and their time to first fix (ms) summed up, index 0
+  // without and 1 with aiding, see Gps::setAiding
+  uint16_t fixes[2] = {0};
+  uint32_t ttff_total[2] = {0};
+} gpsHistory;
+
+/*
+ * Drift of the RTC through deep sleep, measured against the GPS, see
+ * helpers::updateRtcDrift
+ */
+typedef struct {
+  // filtered rate error in ppm, negative if the RTC runs slow
+  float ppm = 0;
+  uint8_t samples = 0;
+  // time the last sleep started, 0 if the clock was not set by the GPS
+  time_t sleep_start = 0;
+  // sleep as programmed, s of the RTC
+  uint32_t sleep_rtc = 0;
+} rtcDrift;
+
+/*
+ * Charge drawn by each load since power on, see energyMeter.h. The Rockblock
+ * load is the modem powered, the SBDIX load the extra current of sessions.
+ */
+enum energyLoad {
+  LOAD_CPU, LOAD_GPS, LOAD_ROCKBLOCK, LOAD_SBDIX, LOAD_SLEEP, ENERGY_LOADS
 };
 
+typedef struct {
+  // mAs per load
+  double charge[ENERGY_LOADS] = {0};
+  // time awake and asleep, s
+  double seconds = 0;
+  // deep sleep programmed before the last sleep, s
+  uint32_t sleep = 0;
+} energyTotals;
+
+/*
+ * Battery level and the voltage sag under modem load, see batteryPolicy.h
+ */
+enum batteryLevel {
+  BATTERY_NORMAL, BATTERY_LOW, BATTERY_CRITICAL, BATTERY_SAFE, BATTERY_LEVELS
+};
+
+typedef struct {
+  batteryLevel level = BATTERY_NORMAL;
+  // filtered sag during SBDIX sessions, V
+  float sag = 0;
+  uint8_t samples = 0;
+} batteryHealth;
+
 /*
  * Define states for Main FSM
  */
@@ -31,6 +185,7 @@ enum mainFSM {
   WAIT_FOR_GPS,
   WAIT_FOR_RB,
   RB_DONE,
+  WAIT_FOR_RING,
   SLEEP_READY,
   ERROR_SLEEP
 };
@@ -40,10 +195,14 @@ typedef struct {
   time_t start_time = 0; // time when buoy firts powered on (inlcudes sleep times)
   time_t gps_read_time = 0; // time when GPS was read
   time_t expected_wakeup = 0;
+  rtcDrift rtc_drift;
+  // wake up minus expected_wakeup (s), measured at the first fix
+  int32_t wakeup_error = 0;
   uint32_t interval = DEFAULT_INTERVAL; // reporting interval
   uint32_t sleep = 0;
   uint8_t retries = 3; // maximal number of retries
   messageType mode = NORMAL;
+  messageFormat message_format = DEFAULT_MESSAGE_FORMAT;
   // state
   bool gps_done = 0;
   bool rockblock_done = 0;
@@ -53,8 +212,46 @@ typedef struct {
   float lng=999;
   float heading=0;
   float speed=0; // speed in knots
+  // quality of the fix, HDOP in 1/100 (0 if unknown)
+  uint16_t hdop = 0;
+  uint8_t satellites = 0;
+  // RTC time of the first fix of this wake up, 0 until then
+  time_t gps_first_fix = 0;
+  gpsHistory gps_history;
+  // last fix, kept through GPS timeouts to aid the next start
+  float last_lat = 999;
+  float last_lng = 999;
+  float last_speed = 0;
+  time_t last_fix_time = 0;
+  // time to first fix (ms) of this wake up, 0 without fix
+  uint32_t ttff = 0;
+  bool gps_aided = false;
+  // orbital data refresh, see startGpsRefresh in helpers.h: GPS kept on
+  // after the fix, last completed, seconds done since, time to first fix
+  // (ms) before the refresh started
+  bool gps_refreshing = false;
+  time_t gps_refresh_time = 0;
+  uint16_t gps_refresh_progress = 0;
+  uint32_t gps_refresh_ttff = 0;
   float bat=0;
+  batteryHealth battery;
   uint8_t signal = 0;
+  signalHistory signal_history;
+  // sequence number of the current fix, increases with every GPS read
+  uint16_t sequence = 0;
+  fixQueue queue;
+  // number of queued fixes packed into the current message
+  uint8_t queue_sent = 0;
+  // fixes of track wake ups and the number of them packed into the current
+  // message, the next wake up only takes a fix for the track if set
+  fixTrack track;
+  uint8_t track_sent = 0;
+  bool track_wakeup = false;
+  // energy accounting, whether it has been packed into the current message
+  // and time of the last sent report with it, 0 if none
+  energyTotals energy;
+  bool energy_sent = false;
+  time_t energy_report_time = 0;
   // message
   char message[255] = {0};
   // requested configuration change
@@ -3,12 +3,30 @@
 // treat RTC storage as local vars
 RTC_DATA_ATTR time_t rtc_start = 0;
 RTC_DATA_ATTR time_t rtc_expected_wakeup = 0;
+RTC_DATA_ATTR rtcDrift rtc_drift;
 RTC_DATA_ATTR unsigned int rtc_interval = 600;
 RTC_DATA_ATTR bool rtc_first_run = true;
 RTC_DATA_ATTR unsigned int rtc_retries = 3;
 RTC_DATA_ATTR unsigned int rtc_new_interval = 0;
 RTC_DATA_ATTR unsigned int rtc_sleep = 0;
 RTC_DATA_ATTR messageType rtc_mode = NORMAL;
+RTC_DATA_ATTR messageFormat rtc_message_format = DEFAULT_MESSAGE_FORMAT;
+RTC_DATA_ATTR signalHistory rtc_signal_history;
+RTC_DATA_ATTR uint16_t rtc_sequence = 0;
+RTC_DATA_ATTR fixQueue rtc_queue;
+RTC_DATA_ATTR fixTrack rtc_track;
+RTC_DATA_ATTR bool rtc_track_wakeup = false;
+RTC_DATA_ATTR energyTotals rtc_energy;
+RTC_DATA_ATTR time_t rtc_energy_report_time = 0;
+RTC_DATA_ATTR float rtc_last_lat = 999;
+RTC_DATA_ATTR float rtc_last_lng = 999;
+RTC_DATA_ATTR float rtc_last_speed = 0;
+RTC_DATA_ATTR time_t rtc_last_fix_time = 0;
+RTC_DATA_ATTR gpsHistory rtc_gps_history;
+RTC_DATA_ATTR batteryHealth rtc_battery;
+RTC_DATA_ATTR time_t rtc_gps_refresh_time = 0;
+RTC_DATA_ATTR uint16_t rtc_gps_refresh_progress = 0;
+RTC_DATA_ATTR uint32_t rtc_gps_refresh_ttff = 0;
 
 
 ScoutStorage::ScoutStorage() {}
@@ -26,11 +44,29 @@ void ScoutStorage::restore(systemState &state) {
         state.first_run = false;
         state.start_time = rtc_start;
         state.expected_wakeup = rtc_expected_wakeup;
+        state.rtc_drift = rtc_drift;
         state.interval = rtc_interval;
         state.new_interval = rtc_new_interval;
         state.retries = rtc_retries;
         state.new_sleep = rtc_sleep;
         state.mode = rtc_mode;
+        state.message_format = rtc_message_format;
+        state.signal_history = rtc_signal_history;
+        state.sequence = rtc_sequence;
+        state.queue = rtc_queue;
+        state.track = rtc_track;
+        state.track_wakeup = rtc_track_wakeup;
+        state.energy = rtc_energy;
+        state.energy_report_time = rtc_energy_report_time;
+        state.last_lat = rtc_last_lat;
+        state.last_lng = rtc_last_lng;
+        state.last_speed = rtc_last_speed;
+        state.last_fix_time = rtc_last_fix_time;
+        state.gps_history = rtc_gps_history;
+        state.battery = rtc_battery;
+        state.gps_refresh_time = rtc_gps_refresh_time;
+        state.gps_refresh_progress = rtc_gps_refresh_progress;
+        state.gps_refresh_ttff = rtc_gps_refresh_ttff;
     }
 }
 
@@ -40,11 +76,29 @@ void ScoutStorage::store(systemState &state) {
     rtc_first_run = false;
     if (rtc_start == 0) { rtc_start = state.start_time; }
     rtc_expected_wakeup = state.expected_wakeup;
+    rtc_drift = state.rtc_drift;
     rtc_interval = state.interval;
     rtc_new_interval = state.new_interval;
     rtc_sleep = state.new_sleep;
     rtc_retries = state.retries;
     rtc_mode = state.mode;
+    rtc_message_format = state.message_format;
+    rtc_signal_history = state.signal_history;
+    rtc_sequence = state.sequence;
+    rtc_queue = state.queue;
+    rtc_track = state.track;
+    rtc_track_wakeup = state.track_wakeup;
+    rtc_energy = state.energy;
+    rtc_energy_report_time = state.energy_report_time;
+    rtc_last_lat = state.last_lat;
+    rtc_last_lng = state.last_lng;
+    rtc_last_speed = state.last_speed;
+    rtc_last_fix_time = state.last_fix_time;
+    rtc_gps_history = state.gps_history;
+    rtc_battery = state.battery;
+    rtc_gps_refresh_time = state.gps_refresh_time;
+    rtc_gps_refresh_progress = state.gps_refresh_progress;
+    rtc_gps_refresh_ttff = state.gps_refresh_ttff;
     // store variables that should persisted even after power down
     preferences.begin("scout", false);
     preferences.end();
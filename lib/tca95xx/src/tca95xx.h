@@ -3,10 +3,12 @@
  */
 #ifndef __TCA95XX_H__
 #define __TCA95XX_H__
-#include <Arduino.h>
 #include <stdint.h>
-#include <Wire.h>
 #include <tuple>
+#ifndef NATIVE
+#include <Arduino.h>
+#include <Wire.h>
+#endif
 
 
 #define EXPANDER_OUTPUT 0
@@ -36,7 +38,7 @@ class AbstractExpander {
 public:
     AbstractExpander() {};
     virtual void init() = 0;
-    virtual bool check();
+    virtual bool check() { return true; };
     virtual void pinMode(uint8_t pin, bool mode) = 0;
     virtual void pinMode(uint8_t port, uint8_t bit, bool mode) = 0;
     virtual void digitalWrite(uint8_t pin, bool value) = 0;
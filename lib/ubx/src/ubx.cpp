@@ -0,0 +1,428 @@
+#include <ubx.h>
+#include <string.h>
+
+// NAV-PVT fields used, offsets into the payload
+#define PVT_YEAR 4
+#define PVT_MONTH 6
+#define PVT_DAY 7
+#define PVT_HOUR 8
+#define PVT_MINUTE 9
+#define PVT_SECOND 10
+#define PVT_VALID 11
+#define PVT_FIX_TYPE 20
+#define PVT_FLAGS 21
+#define PVT_NUM_SV 23
+#define PVT_LON 24
+#define PVT_LAT 28
+#define PVT_H_ACC 40
+#define PVT_G_SPEED 60
+#define PVT_HEAD_MOT 64
+#define PVT_P_DOP 76
+// valid: date and time, flags: gnssFixOK
+#define PVT_VALID_DATE_TIME 0x03
+#define PVT_FIX_OK 0x01
+// 2D, 3D and GNSS with dead reckoning
+#define PVT_MIN_FIX 2
+#define PVT_MAX_FIX 4
+
+static inline void putLe32(uint8_t *bfr, uint32_t value) {
+    bfr[0] = value & 0xff;
+    bfr[1] = (value >> 8) & 0xff;
+    bfr[2] = (value >> 16) & 0xff;
+    bfr[3] = value >> 24;
+}
+
+static inline uint16_t le16(const uint8_t *bfr) {
+    return bfr[0] | (bfr[1] << 8);
+}
+
+static inline uint32_t le32(const uint8_t *bfr) {
+    return (uint32_t) bfr[0] | ((uint32_t) bfr[1] << 8) |
+        ((uint32_t) bfr[2] << 16) | ((uint32_t) bfr[3] << 24);
+}
+
+size_t ubxFrame(uint8_t *bfr, size_t len, uint8_t msg_class, uint8_t msg_id,
+    const uint8_t *payload, uint16_t payload_len
+) {
+    size_t frame_len = payload_len + UBX_OVERHEAD;
+    if (len < frame_len) { return 0; }
+    bfr[0] = UBX_SYNC_1;
+    bfr[1] = UBX_SYNC_2;
+    bfr[2] = msg_class;
+    bfr[3] = msg_id;
+    bfr[4] = payload_len & 0xff;
+    bfr[5] = payload_len >> 8;
+    if (payload_len > 0) { memcpy(bfr + 6, payload, payload_len); }
+    uint8_t a = 0;
+    uint8_t b = 0;
+    for (size_t i = 2; i < frame_len - 2; i++) {
+        a += bfr[i];
+        b += a;
+    }
+    bfr[frame_len - 2] = a;
+    bfr[frame_len - 1] = b;
+    return frame_len;
+}
+
+size_t ubxSetRate(uint8_t *bfr, size_t len, uint8_t msg_class,
+    uint8_t msg_id, uint8_t rate
+) {
+    const uint8_t payload[3] = {msg_class, msg_id, rate};
+    return ubxFrame(bfr, len, UBX_CLASS_CFG, UBX_CFG_MSG, payload, 3);
+}
+
+size_t ubxSetPort(uint8_t *bfr, size_t len, uint32_t baud,
+    uint16_t out_protocols
+) {
+    uint8_t payload[20] = {0};
+    // UART1, 8 bits, no parity, 1 stop bit
+    payload[0] = 1;
+    payload[4] = 0xd0;
+    payload[5] = 0x08;
+    payload[8] = baud & 0xff;
+    payload[9] = (baud >> 8) & 0xff;
+    payload[10] = (baud >> 16) & 0xff;
+    payload[11] = baud >> 24;
+    payload[12] = UBX_PROTOCOL_UBX | UBX_PROTOCOL_NMEA;
+    payload[14] = out_protocols & 0xff;
+    payload[15] = out_protocols >> 8;
+    return ubxFrame(bfr, len, UBX_CLASS_CFG, UBX_CFG_PRT, payload, 20);
+}
+
+size_t ubxSetGnss(uint8_t *bfr, size_t len, uint8_t gnss) {
+    // gnssId, reserved and maximum tracking channels
+    const uint8_t systems[4][4] = {
+        {UBX_GNSS_GPS, 0, 8, 16}, {UBX_GNSS_GALILEO, 2, 4, 8},
+        {UBX_GNSS_BEIDOU, 3, 8, 16}, {UBX_GNSS_GLONASS, 6, 8, 14}};
+    uint8_t payload[4 + 4 * 8] = {0};
+    // numTrkChUse: all, numConfigBlocks
+    payload[2] = 0xff;
+    payload[3] = 4;
+    for (int i = 0; i < 4; i++) {
+        uint8_t *block = payload + 4 + i * 8;
+        block[0] = systems[i][1];
+        block[1] = systems[i][2];
+        block[2] = systems[i][3];
+        // enable, L1 signal
+        block[4] = (gnss & systems[i][0]) ? 0x01 : 0x00;
+        block[6] = 0x01;
+    }
+    return ubxFrame(bfr, len, UBX_CLASS_CFG, UBX_CFG_GNSS, payload,
+        sizeof(payload));
+}
+
+size_t ubxSetPowerMode(uint8_t *bfr, size_t len, bool power_save) {
+    // reserved (8), lpMode: 0 continuous, 1 power save
+    const uint8_t payload[2] = {8, power_save ? (uint8_t) 1 : (uint8_t) 0};
+    return ubxFrame(bfr, len, UBX_CLASS_CFG, UBX_CFG_RXM, payload, 2);
+}
+
+size_t ubxAidTime(uint8_t *bfr, size_t len, time_t time, uint16_t accuracy) {
+    struct tm t = {0};
+    gmtime_r(&time, &t);
+    uint8_t payload[24] = {0};
+    // type, version, reference: on receipt of the message
+    payload[0] = 0x10;
+    // leap seconds unknown
+    payload[3] = 0x80;
+    payload[4] = (t.tm_year + 1900) & 0xff;
+    payload[5] = (t.tm_year + 1900) >> 8;
+    payload[6] = t.tm_mon + 1;
+    payload[7] = t.tm_mday;
+    payload[8] = t.tm_hour;
+    payload[9] = t.tm_min;
+    payload[10] = t.tm_sec;
+    payload[16] = accuracy & 0xff;
+    payload[17] = accuracy >> 8;
+    return ubxFrame(bfr, len, UBX_CLASS_MGA, UBX_MGA_INI, payload,
+        sizeof(payload));
+}
+
+size_t ubxAidPosition(uint8_t *bfr, size_t len, int32_t lat, int32_t lng,
+    uint32_t accuracy
+) {
+    uint8_t payload[20] = {0};
+    // type, version, altitude (cm) left at 0, the buoy is at sea level
+    payload[0] = 0x01;
+    putLe32(payload + 4, lat);
+    putLe32(payload + 8, lng);
+    putLe32(payload + 16, accuracy);
+    return ubxFrame(bfr, len, UBX_CLASS_MGA, UBX_MGA_INI, payload,
+        sizeof(payload));
+}
+
+void UbxParser::reset() {
+    this->state = UBX_WAIT;
+    this->complete = false;
+}
+
+void UbxParser::add(uint8_t c) {
+    this->checksum_a += c;
+    this->checksum_b += this->checksum_a;
+}
+
+bool UbxParser::feed(uint8_t c) {
+    this->complete = false;
+    switch (this->state) {
+        case UBX_WAIT:
+            if (c == UBX_SYNC_1) { this->state = UBX_SYNC; }
+            break;
+        case UBX_SYNC:
+            if (c == UBX_SYNC_2) {
+                this->state = UBX_CLASS;
+                this->checksum_a = 0;
+                this->checksum_b = 0;
+            } else if (c != UBX_SYNC_1) {
+                this->state = UBX_WAIT;
+            }
+            break;
+        case UBX_CLASS:
+            this->msg_class = c;
+            this->add(c);
+            this->state = UBX_ID;
+            break;
+        case UBX_ID:
+            this->msg_id = c;
+            this->add(c);
+            this->state = UBX_LENGTH_1;
+            break;
+        case UBX_LENGTH_1:
+            this->length = c;
+            this->add(c);
+            this->state = UBX_LENGTH_2;
+            break;
+        case UBX_LENGTH_2:
+            this->length |= c << 8;
+            this->add(c);
+            this->payload_idx = 0;
+            this->state = this->length ? UBX_PAYLOAD : UBX_CHECKSUM_A;
+            break;
+        case UBX_PAYLOAD:
+            if (this->payload_idx < UBX_MAX_PAYLOAD) {
+                this->payload[this->payload_idx] = c;
+            }
+            this->add(c);
+            if (++this->payload_idx == this->length) {
+                this->state = UBX_CHECKSUM_A;
+            }
+            break;
+        case UBX_CHECKSUM_A:
+            this->state = (c == this->checksum_a) ?
+                UBX_CHECKSUM_B : UBX_WAIT;
+            if (this->state == UBX_WAIT) { this->checksum_errors++; }
+            break;
+        case UBX_CHECKSUM_B:
+            this->state = UBX_WAIT;
+            if (c != this->checksum_b) {
+                this->checksum_errors++;
+                break;
+            }
+            this->messages++;
+            this->complete = true;
+            break;
+    }
+    return this->complete;
+}
+
+size_t UbxParser::feed(const uint8_t *bfr, size_t len) {
+    this->complete = false;
+    for (size_t i = 0; i < len; i++) {
+        if (this->state == UBX_WAIT) {
+            // skip NMEA and anything else up to the next frame
+            const uint8_t *start = (const uint8_t*) memchr(
+                bfr + i, UBX_SYNC_1, len - i);
+            if (!start) { break; }
+            i = start - bfr;
+        } else if (this->state == UBX_PAYLOAD) {
+            // copy the payload at once
+            size_t count = this->length - this->payload_idx - 1;
+            count = (count < len - i) ? count : len - i;
+            for (size_t j = 0; j < count; j++, i++) {
+                if (this->payload_idx < UBX_MAX_PAYLOAD) {
+                    this->payload[this->payload_idx] = bfr[i];
+                }
+                this->payload_idx++;
+                this->add(bfr[i]);
+            }
+            if (i == len) { break; }
+        }
+        if (this->feed(bfr[i])) { return i + 1; }
+    }
+    return len;
+}
+
+bool UbxParser::is(uint8_t msg_class, uint8_t msg_id) const {
+    return this->complete && this->msg_class == msg_class &&
+        this->msg_id == msg_id;
+}
+
+bool UbxParser::navPvt(NmeaFix *fix) const {
+    const uint8_t *p = this->payload;
+    if (
+        !this->is(UBX_CLASS_NAV, UBX_NAV_PVT) ||
+        this->length != UBX_NAV_PVT_LENGTH ||
+        (p[PVT_VALID] & PVT_VALID_DATE_TIME) != PVT_VALID_DATE_TIME ||
+        !(p[PVT_FLAGS] & PVT_FIX_OK) ||
+        p[PVT_FIX_TYPE] < PVT_MIN_FIX || p[PVT_FIX_TYPE] > PVT_MAX_FIX
+    ) {
+        return false;
+    }
+    fix->year = le16(p + PVT_YEAR);
+    fix->month = p[PVT_MONTH];
+    fix->day = p[PVT_DAY];
+    fix->hour = p[PVT_HOUR];
+    fix->minute = p[PVT_MINUTE];
+    fix->second = p[PVT_SECOND];
+    fix->lat = (int32_t) le32(p + PVT_LAT);
+    fix->lng = (int32_t) le32(p + PVT_LON);
+    // mm/s to 1/100 knots
+    int32_t speed = (int32_t) le32(p + PVT_G_SPEED);
+    fix->speed = (speed > 0) ? ((int64_t) speed * 1944 + 5000) / 10000 : 0;
+    // 1e-5 to 1/100 degrees
+    int32_t heading = (int32_t) le32(p + PVT_HEAD_MOT);
+    fix->course = (heading > 0) ? heading / 1000 : 0;
+    fix->quality = p[PVT_FIX_TYPE];
+    fix->satellites = p[PVT_NUM_SV];
+    fix->hdop = 0;
+    fix->pdop = le16(p + PVT_P_DOP);
+    fix->vdop = 0;
+    fix->h_acc = le32(p + PVT_H_ACC);
+    return true;
+}
+
+/*
+ * Steps needed for the settings
+ */
+uint16_t UbxConfig::steps() {
+    uint16_t steps = (1 << UBX_STEP_GSV) | (1 << UBX_STEP_GLL) |
+        (1 << UBX_STEP_VTG) | (1 << UBX_STEP_POWER);
+    if (this->settings.gnss) { steps |= 1 << UBX_STEP_GNSS; }
+    if (this->settings.nav_pvt) { steps |= 1 << UBX_STEP_NAV_PVT; }
+    if (this->settings.baud) { steps |= 1 << UBX_STEP_PORT; }
+    return steps;
+}
+
+void UbxConfig::begin(const UbxSettings &settings, uint32_t baud) {
+    this->settings = settings;
+    this->baud = baud;
+    this->previous_baud = baud;
+    this->output = UBX_PROTOCOL_UBX | UBX_PROTOCOL_NMEA;
+    this->pending = this->steps();
+    this->step = UBX_STEPS;
+    this->acked = 0;
+    this->rejected = 0;
+    this->replied = false;
+    this->probed = false;
+}
+
+void UbxConfig::setOutput(uint16_t protocols) {
+    if (protocols == this->output) { return; }
+    this->output = protocols;
+    this->pending |= 1 << UBX_STEP_PORT;
+    this->acked &= ~(1 << UBX_STEP_PORT);
+}
+
+size_t UbxConfig::frame(uint8_t *bfr, size_t len) {
+    switch (this->step) {
+        case UBX_STEP_GSV:
+            return ubxSetRate(bfr, len, UBX_CLASS_NMEA, UBX_NMEA_GSV, 0);
+        case UBX_STEP_GLL:
+            return ubxSetRate(bfr, len, UBX_CLASS_NMEA, UBX_NMEA_GLL, 0);
+        case UBX_STEP_VTG:
+            return ubxSetRate(bfr, len, UBX_CLASS_NMEA, UBX_NMEA_VTG, 0);
+        case UBX_STEP_GNSS:
+            return ubxSetGnss(bfr, len, this->settings.gnss);
+        case UBX_STEP_POWER:
+            return ubxSetPowerMode(bfr, len, this->settings.power_save);
+        case UBX_STEP_NAV_PVT:
+            return ubxSetRate(bfr, len, UBX_CLASS_NAV, UBX_NAV_PVT, 1);
+        case UBX_STEP_PORT: {
+            uint32_t baud = this->settings.baud ?
+                this->settings.baud : this->baud;
+            return ubxSetPort(bfr, len, baud, this->output);
+        }
+        default:
+            return 0;
+    }
+}
+
+/*
+ * No reply after the last attempt
+ */
+void UbxConfig::fail() {
+    if (!this->replied && !this->probed && this->settings.baud &&
+        this->settings.baud != this->baud) {
+        // try again at the rate the receiver may still use
+        this->probed = true;
+        this->baud = this->settings.baud;
+        this->previous_baud = this->baud;
+        this->pending |= this->steps();
+        this->rejected = 0;
+    } else {
+        this->rejected |= 1 << this->step;
+        this->pending &= ~(1 << this->step);
+        // the receiver did not follow
+        if (this->step == UBX_STEP_PORT) {
+            this->baud = this->previous_baud;
+        }
+    }
+    this->step = UBX_STEPS;
+}
+
+size_t UbxConfig::poll(int64_t now, uint8_t *bfr, size_t len) {
+    if (this->step != UBX_STEPS) {
+        if (now - this->sent_time < UBX_ACK_TIMEOUT) { return 0; }
+        if (this->attempts >= UBX_CONFIG_ATTEMPTS) { this->fail(); }
+    }
+    if (this->step == UBX_STEPS) {
+        if (!this->pending) { return 0; }
+        // lowest pending step first
+        uint8_t step = 0;
+        while (!(this->pending & (1 << step))) { step++; }
+        this->step = (UbxConfigStep) step;
+        this->attempts = 0;
+    }
+    size_t frame_len = this->frame(bfr, len);
+    if (!frame_len) { return 0; }
+    this->msg_class = bfr[2];
+    this->msg_id = bfr[3];
+    this->attempts++;
+    this->sent_time = now;
+    // the local UART follows right after the message is sent
+    if (this->step == UBX_STEP_PORT && this->settings.baud &&
+        this->baud != this->settings.baud) {
+        this->previous_baud = this->baud;
+        this->baud = this->settings.baud;
+    }
+    return frame_len;
+}
+
+void UbxConfig::onMessage(const UbxParser &parser) {
+    if (
+        !parser.complete || parser.msg_class != UBX_CLASS_ACK ||
+        parser.length != 2 || this->step == UBX_STEPS
+    ) {
+        return;
+    }
+    // ACK and NAK carry class and id of the message they answer
+    if (parser.payload[0] != this->msg_class ||
+        parser.payload[1] != this->msg_id) {
+        return;
+    }
+    this->replied = true;
+    if (parser.msg_id == UBX_ACK_ACK) {
+        this->acked |= 1 << this->step;
+    } else {
+        this->rejected |= 1 << this->step;
+    }
+    this->pending &= ~(1 << this->step);
+    this->step = UBX_STEPS;
+}
+
+bool UbxConfig::done() const {
+    return !this->pending && this->step == UBX_STEPS;
+}
+
+bool UbxConfig::isAcked(UbxConfigStep step) const {
+    return this->acked & (1 << step);
+}
@@ -0,0 +1,185 @@
+/*
+ * u-blox UBX binary protocol, limited to what Gps needs: NAV-PVT (time,
+ * fix, position, speed, heading and accuracy in one 100 byte message
+ * instead of about 400 bytes of NMEA per second) and the configuration
+ * messages to enable it.
+ *
+ * Frame: 0xB5 0x62, class, id, length (2 bytes, little endian), payload,
+ * Fletcher checksum (2 bytes) over class to payload.
+ *
+ * NAV-PVT needs protocol version 14 or later, e.g. u-blox M8. Older
+ * receivers ignore the configuration and keep sending NMEA.
+ */
+#ifndef __UBX_H__
+#define __UBX_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+// NmeaFix is used for both protocols
+#include <nmea.h>
+
+// larger messages are skipped
+#define UBX_MAX_PAYLOAD 100
+// sync, class, id, length and checksum
+#define UBX_OVERHEAD 8
+#define UBX_SYNC_1 0xB5
+#define UBX_SYNC_2 0x62
+#define UBX_CLASS_NAV 0x01
+#define UBX_CLASS_ACK 0x05
+#define UBX_CLASS_CFG 0x06
+#define UBX_CLASS_MGA 0x13
+#define UBX_NAV_PVT 0x07
+#define UBX_NAV_PVT_LENGTH 92
+#define UBX_ACK_NAK 0x00
+#define UBX_ACK_ACK 0x01
+#define UBX_CFG_PRT 0x00
+#define UBX_CFG_MSG 0x01
+#define UBX_CFG_RXM 0x11
+#define UBX_CFG_GNSS 0x3E
+#define UBX_MGA_INI 0x40
+#define UBX_CLASS_NMEA 0xF0
+#define UBX_NMEA_GLL 0x01
+#define UBX_NMEA_GSV 0x03
+#define UBX_NMEA_VTG 0x05
+
+// Write a frame, returns its length, 0 if it does not fit
+size_t ubxFrame(uint8_t *bfr, size_t len, uint8_t msg_class, uint8_t msg_id,
+    const uint8_t *payload, uint16_t payload_len);
+// CFG-MSG: output rate of a message on the current port, 0 disables it
+size_t ubxSetRate(uint8_t *bfr, size_t len, uint8_t msg_class,
+    uint8_t msg_id, uint8_t rate);
+// CFG-PRT: UART1 at baud with the given output protocols, 8N1, UBX and NMEA
+// input
+#define UBX_PROTOCOL_UBX 0x01
+#define UBX_PROTOCOL_NMEA 0x02
+size_t ubxSetPort(uint8_t *bfr, size_t len, uint32_t baud,
+    uint16_t out_protocols);
+// CFG-GNSS: enable the UBX_GNSS_* systems, disable the others of them
+#define UBX_GNSS_GPS 0x01
+#define UBX_GNSS_GALILEO 0x02
+#define UBX_GNSS_BEIDOU 0x04
+#define UBX_GNSS_GLONASS 0x08
+size_t ubxSetGnss(uint8_t *bfr, size_t len, uint8_t gnss);
+// CFG-RXM: power save mode or continuous tracking
+size_t ubxSetPowerMode(uint8_t *bfr, size_t len, bool power_save);
+// MGA-INI-TIME_UTC: estimated time with its accuracy (s), valid on receipt
+size_t ubxAidTime(uint8_t *bfr, size_t len, time_t time, uint16_t accuracy);
+// MGA-INI-POS_LLH: estimated position (1e-7 degrees) with its accuracy (cm)
+size_t ubxAidPosition(uint8_t *bfr, size_t len, int32_t lat, int32_t lng,
+    uint32_t accuracy);
+
+class UbxParser {
+
+    private:
+        enum ParserState {
+            UBX_WAIT, UBX_SYNC, UBX_CLASS, UBX_ID, UBX_LENGTH_1,
+            UBX_LENGTH_2, UBX_PAYLOAD, UBX_CHECKSUM_A, UBX_CHECKSUM_B
+        };
+        ParserState state = UBX_WAIT;
+        uint16_t payload_idx = 0;
+        uint8_t checksum_a = 0;
+        uint8_t checksum_b = 0;
+        void add(uint8_t c);
+
+    public:
+        UbxParser() {};
+        uint8_t msg_class = 0;
+        uint8_t msg_id = 0;
+        uint16_t length = 0;
+        // payload of the current message, only complete if length fits
+        uint8_t payload[UBX_MAX_PAYLOAD] = {0};
+        // true once a message passed its checksum
+        bool complete = false;
+        uint32_t messages = 0;
+        uint32_t checksum_errors = 0;
+        void reset();
+        // feed a single byte, returns true if a message is complete
+        bool feed(uint8_t c);
+        // feed bytes until a message is complete, returns bytes used
+        size_t feed(const uint8_t *bfr, size_t len);
+        bool is(uint8_t msg_class, uint8_t msg_id) const;
+        // decode the current NAV-PVT, false if it is none or has no valid
+        // fix with date and time
+        bool navPvt(NmeaFix *fix) const;
+};
+
+// wait for ACK-ACK or ACK-NAK, ms
+#define UBX_ACK_TIMEOUT 1000
+// attempts per message without reply
+#define UBX_CONFIG_ATTEMPTS 3
+
+/*
+ * Receiver settings, applied by UbxConfig
+ */
+struct UbxSettings {
+    // request NAV-PVT
+    bool nav_pvt;
+    // UART rate to switch to, 0 keeps the current
+    uint32_t baud;
+    // UBX_GNSS_* to use, 0 keeps the receiver default
+    uint8_t gnss;
+    // power save mode instead of continuous tracking
+    bool power_save;
+};
+
+// configuration messages, in the order they are sent
+enum UbxConfigStep {
+    UBX_STEP_GSV, UBX_STEP_GLL, UBX_STEP_VTG, UBX_STEP_GNSS, UBX_STEP_POWER,
+    UBX_STEP_NAV_PVT, UBX_STEP_PORT, UBX_STEPS
+};
+
+/*
+ * Configuration of a receiver with factory defaults after power on. One
+ * message is sent at a time and has to be acknowledged before the next, a
+ * message without reply is repeated, a rejected one (ACK-NAK) is skipped.
+ * Settings are not saved in the receiver, so the same messages are sent
+ * after every power on and sending them again does no harm.
+ *
+ * A new UART rate is set last. The local UART follows right after sending,
+ * the message is then repeated at the new rate until acknowledged. If the
+ * receiver does not answer at all it may still run at the new rate from
+ * before, the configuration is repeated once at that rate.
+ */
+class UbxConfig {
+
+    private:
+        UbxSettings settings = {false, 0, 0, false};
+        // steps left to send, bit per UbxConfigStep
+        uint16_t pending = 0;
+        // step waiting for its acknowledgement, UBX_STEPS if none
+        UbxConfigStep step = UBX_STEPS;
+        // class and id of the message sent for it
+        uint8_t msg_class = 0;
+        uint8_t msg_id = 0;
+        uint8_t attempts = 0;
+        int64_t sent_time = 0;
+        // any ACK or NAK since begin()
+        bool replied = false;
+        bool probed = false;
+        // rate to return to if the receiver does not follow
+        uint32_t previous_baud = 0;
+        uint16_t output = UBX_PROTOCOL_UBX | UBX_PROTOCOL_NMEA;
+        uint16_t steps();
+        size_t frame(uint8_t *bfr, size_t len);
+        void fail();
+
+    public:
+        UbxConfig() {};
+        // UART rate the local side has to use
+        uint32_t baud = 0;
+        // acknowledged and rejected or unanswered steps, bit per step
+        uint16_t acked = 0;
+        uint16_t rejected = 0;
+        // start over after power on, the receiver listens at baud
+        void begin(const UbxSettings &settings, uint32_t baud);
+        // output protocols of the UART, sent again if configured already
+        void setOutput(uint16_t protocols);
+        // frame to send now, returns its length, 0 if none
+        size_t poll(int64_t now, uint8_t *bfr, size_t len);
+        // pass every complete message, picks up the acknowledgements
+        void onMessage(const UbxParser &parser);
+        bool done() const;
+        bool isAcked(UbxConfigStep step) const;
+};
+
+#endif /* __UBX_H__ */
@@ -17,11 +17,7 @@
  * - we still relay heavily on third party libraries, sometimes only marginally
  * we might replace some of them
  * - we still use Matt Arcady's message types even though in slight variations
- * - since sending takes quite some time we could keep reading GPS and get cog
- * and sog
- * - binary message for shorter and cheaper messages
  * - fully implement hardware abstraction
- * - correction factor for known time drift
  * -----------------------------------------------------------------------------
  */
 // debug flags
@@ -40,12 +36,18 @@
 // project
 #include <tca95xx.h>
 #include <gps.h>
+#include <courseAverage.h>
 #include <display.h>
 #include <rockblock.h>
+#if ROCKBLOCK_9704
+#include <rockblock9704.h>
+#endif
 #include <stateType.h>
 #include <scoutMessages.h>
 #include <storage.h>
 #include <helpers.h>
+#include <energyMeter.h>
+#include <batteryPolicy.h>
 
 
 // printf templates
@@ -53,11 +55,62 @@
   \n - difference: %ds\n - retries: %d\n - message status: %s\n"
 #define ERROR_SLEEP_TEMPLATE ("Going to sleep because of a system error.\n" \
   "Retry in %d seconds.")
-#define GPS_MESSAGE_TEMPLATE "GPS updated: %.05f, %.05f after %d seconds\n"
+#define GPS_MESSAGE_TEMPLATE "GPS updated: %.05f, %.05f, HDOP %.2f, %d "\
+  "satellites after %d seconds\n"
+#define GPS_TIMEOUT_TEMPLATE "GPS: timeout %d s, success rate %.0f%%, "\
+  "accept HDOP %.2f"
+#define TTFF_MESSAGE_TEMPLATE "GPS: first fix after %lu ms%s, average %lu "\
+  "ms aided (%u), %lu ms unaided (%u), orbital data refreshed %ld h ago"
+#define REFRESH_MESSAGE_TEMPLATE "GPS: refreshing orbital data, %u of %d s "\
+  "done, last refresh %ld h ago"
+#define REFRESHED_MESSAGE_TEMPLATE "GPS: orbital data refreshed, first fix "\
+  "took %lu ms before"
+#define RTC_DRIFT_TEMPLATE "RTC: woke up %ld s after the expected time, "\
+  "drift %.0f ppm (%u samples)"
+#define RTC_SLEEP_TEMPLATE "RTC: sleep %lu s, drift %.0f ppm (%u samples)"
+#define COURSE_MESSAGE_TEMPLATE "GPS: %u fixes averaged, SOG %.2f kn, COG "\
+  "%.0f deg, message %s"
+#define ENERGY_PHASE_TEMPLATE "Energy: %s done after %lu ms, %.3f mAh"
+#define ENERGY_TEMPLATE "Energy: %.1f mAh/day over %.1f days, CPU %.1f, "\
+  "GPS %.1f, Rockblock %.1f, SBDIX %.1f, sleep %.1f"
+#define BATTERY_TEMPLATE "battery: %.2f V, level %s, sag %.2f V under "\
+  "modem load (%u sessions)"
+#define BATTERY_SAG_TEMPLATE "Battery: %.2f V under modem load, sag %.2f V "\
+  "(%u sessions)"
+#define TRACK_MESSAGE_TEMPLATE "GPS: track wake up, %u fixes waiting for "\
+  "the next report"
+#define TRACK_SLEEP_TEMPLATE "Next wake up for the track, %u fixes waiting"
+#define OVERLAP_MESSAGE_TEMPLATE "GPS: on for %u s while sending, CPU GPS "\
+  "%lu ms, Rockblock %lu ms, I2C wait %lu ms (%u missed), UART overflows "\
+  "GPS %lu, Rockblock %lu"
+
+// Both modems have the same interface. The 9704 sends larger messages but has
+// no session header, the location goes into the payload.
+#if ROCKBLOCK_9704
+typedef Rockblock9704 Radio;
+#define RADIO_MESSAGE_SIZE IMT_MAX_MESSAGE_SIZE
+#define LOCATION_IN_HEADER 0
+#else
+typedef Rockblock Radio;
+#define RADIO_MESSAGE_SIZE MAX_MESSAGE_SIZE
+#define LOCATION_IN_HEADER 1
+#endif
 
 std::map<messageType, String> scoutMessageTypeLabels = {
   {NORMAL, "NORMAL"}, {FIRST, "FIRST"}, {WAKE_UP, "SLEEP WAKE UP"},
-  {CONFIG, "CONFIG"}, {ERROR, "ERROR"}
+  {CONFIG, "CONFIG"}, {ERROR, "ERROR"}, {LOW_BATTERY, "LOW BATTERY"}
+};
+
+std::map<batteryLevel, const char*> batteryLevelLabels = {
+  {BATTERY_NORMAL, "NORMAL"}, {BATTERY_LOW, "LOW"},
+  {BATTERY_CRITICAL, "CRITICAL"}, {BATTERY_SAFE, "SAFE"}
+};
+
+std::map<mainFSM, const char*> mainFSMLabels = {
+  {AWAKE, "AWAKE"}, {WAIT_FOR_GPS, "WAIT_FOR_GPS"},
+  {WAIT_FOR_RB, "WAIT_FOR_RB"}, {RB_DONE, "RB_DONE"},
+  {WAIT_FOR_RING, "WAIT_FOR_RING"}, {SLEEP_READY, "SLEEP_READY"},
+  {ERROR_SLEEP, "ERROR_SLEEP"}
 };
 
 /*
@@ -68,15 +121,65 @@ static SemaphoreHandle_t mutex_i2c;
 // Use to protect state object if variable update is not atomic, e.g. buffers or
 // long types
 static SemaphoreHandle_t mutex_state;
+// Use to protect the Rockblock object while the main task queues or updates
+// the message
+static SemaphoreHandle_t mutex_rockblock;
+// Use to protect the energy meter, loads are switched by the main, GPS and
+// Rockblock tasks
+static SemaphoreHandle_t mutex_energy;
 // Create TaskhHandles, only needed if the task is referenced outside the task
 static TaskHandle_t rockblockTaskHandle = NULL;
 static TaskHandle_t gpsTaskHandle = NULL;
 static TaskHandle_t blinkTaskHandle = NULL;
+// the clock has been set by the GPS during this wake up
+static bool clockSynced = false;
+// run time when the GPS was kept on after the fix, see startGpsRefresh
+static uint16_t gpsRefreshStart = 0;
+// GPS timeout and fix quality learned across wake ups
+GpsPolicy gpsPolicy;
+// GPS kept on while the Rockblock sends, fixes are averaged into speed and
+// course over ground, see GPS_OVERLAP
+static bool gpsOverlap = false;
+static uint16_t gpsOverlapStart = 0;
+static uint16_t gpsOverlapUpdate = 0;
+CourseAverage courseAverage;
+// Contention of GPS and Rockblock running at the same time, counted by the
+// tasks while gpsOverlap is set. CPU time in the loops and time waiting for
+// the I2C bus in us.
+struct overlapLoad {
+  uint32_t gps_cpu = 0;
+  uint32_t rockblock_cpu = 0;
+  uint32_t i2c_wait = 0;
+  uint16_t i2c_missed = 0;
+  uint32_t gps_overflows = 0;
+  uint32_t rockblock_overflows = 0;
+};
+static overlapLoad overlap;
+// Charge drawn by CPU, GPS, Rockblock and deep sleep, kept in state.energy
+EnergyMeter energyMeter;
+// Interval, timeouts and extras adapted to the battery, kept in
+// state.battery. Lowest voltage during SBDIX sessions of this wake up, 0 if
+// not measured.
+BatteryPolicy batteryPolicy;
+static float batteryUnderLoad = 0;
+// Automatic light sleep, see POWER_MANAGEMENT. The GPS and Rockblock tasks
+// keep the chip awake while their UART has to receive and boost the CPU
+// while parsing. The GPS is not listened to once it only stays on for a
+// refresh.
+static bool powerManaged = false;
+static bool gpsListening = true;
+PowerLock gpsListen = PowerLock(ESP_PM_NO_LIGHT_SLEEP, "gps");
+PowerLock gpsBoost = PowerLock(ESP_PM_CPU_FREQ_MAX, "gps boost");
+PowerLock rockblockListen = PowerLock(ESP_PM_NO_LIGHT_SLEEP, "rockblock");
+PowerLock rockblockBoost = PowerLock(ESP_PM_CPU_FREQ_MAX, "rockblock boost");
+PowerLock i2cSetup = PowerLock(ESP_PM_APB_FREQ_MAX, "i2c setup");
 
 /*
  * Hardware and peripheral objects
  */
-HardwareSerial gps_serial(1);
+HardwareSerial gps_hws(1);
+// Defined in hal.h, wakes Task_gps when NMEA data arrived
+EventSerial gps_serial = EventSerial(gps_hws, GPS_SERIAL_RX_BUFFER);
 // Defined in hal.h
 RockblockSerial rockblock_serial = RockblockSerial();
 // Port Expander using i2c
@@ -85,8 +188,8 @@ Expander expander = Expander(Wire, PORT_EXPANDER_I2C_ADDRESS);
 Gps gps = Gps(expander, gps_serial, PORT_EXPANDER_GPS_ENABLE_PIN);
 // Display using i2c, for development only.
 LilyGoDisplay display = LilyGoDisplay(Wire);
-// Rockblock or Lora Simulation
-Rockblock rockblock = Rockblock(
+// Rockblock 9603 or 9704, see ROCKBLOCK_9704
+Radio rockblock = Radio(
   expander, rockblock_serial, PORT_EXPANDER_ROCKBLOCK_ENABLE_PIN);
 // State object
 systemState state;
@@ -95,6 +198,10 @@ ScoutStorage storage = ScoutStorage();
 #ifdef DEBUG
 Preferences preferences;
 #endif
+// Copies of the MT messages retrieved in one wake up
+char incoming[INBOX_SIZE][MAX_MESSAGE_SIZE + 1] = {{0}};
+char* incomingMessages[INBOX_SIZE] = {0};
+size_t incomingLengths[INBOX_SIZE] = {0};
 
 /*
  * Keep functions that interact with ESP in main.cpp for now
@@ -125,6 +232,70 @@ void setTime(time_t time) {
  */
 uint16_t getRunTime() { return round(esp_timer_get_time() / 1E6); }
 
+/*
+ * Run time in ms for energy accounting
+ */
+int64_t getRunTimeMs() { return esp_timer_get_time() / 1000; }
+
+/*
+ * Switch a load of the energy meter, from any task
+ */
+void setEnergyLoad(energyLoad load, bool on) {
+  xSemaphoreTake(mutex_energy, portMAX_DELAY);
+  energyMeter.set(load, on, getRunTimeMs());
+  xSemaphoreGive(mutex_energy);
+}
+
+/*
+ * Acquire or release a power management lock, from any task. With
+ * automatic light sleep the CPU is charged while any lock is held.
+ */
+void holdLock(PowerLock &lock, bool hold) {
+  if (!powerManaged || lock.isHeld() == hold) { return; }
+  xSemaphoreTake(mutex_energy, portMAX_DELAY);
+  lock.hold(hold);
+  // not counted if the lock could not be created
+  if (lock.isHeld() == hold) { energyMeter.lock(hold, getRunTimeMs()); }
+  xSemaphoreGive(mutex_energy);
+}
+
+/*
+ * Delete a task that might be switching a load or lock, not while it holds
+ * the energy meter. The UART it waits on must not notify it afterwards.
+ */
+void deleteTask(TaskHandle_t task, EventSerial &serial) {
+  xSemaphoreTake(mutex_energy, portMAX_DELAY);
+  serial.detach();
+  vTaskDelete(task);
+  xSemaphoreGive(mutex_energy);
+}
+
+/*
+ * Account the loads up to now and return the totals
+ */
+energyTotals updateEnergy() {
+  xSemaphoreTake(mutex_energy, portMAX_DELAY);
+  energyMeter.update(getRunTimeMs());
+  energyTotals totals = energyMeter.getTotals();
+  xSemaphoreGive(mutex_energy);
+  return totals;
+}
+
+/*
+ * Copy all incoming messages from the rockblock inbox, returns their number
+ */
+size_t readIncoming() {
+  size_t count = rockblock.getIncomingSize();
+  for (size_t i = 0; i < count; i++) {
+    incomingLengths[i] = rockblock.getIncoming(
+      i, incoming[i], sizeof(incoming[i]));
+    incomingMessages[i] = incoming[i];
+    Serial.print("RB: Incoming message - ");
+    Serial.println(incoming[i]);
+  }
+  return count;
+}
+
 /*
  * Read battery voltage (on wakeup, no reason to get fancy here)
  */
@@ -139,6 +310,178 @@ float readBatteryVoltage() {
   return readings * (BATT_R_UPPER + BATT_R_LOWER)/BATT_R_LOWER;
 }
 
+/*
+ * Single reading during an SBDIX session to catch the sag, keeps the lowest
+ */
+void sampleBatteryLoad() {
+  float voltage = analogReadMilliVolts(BATT_ADC) / 1000.0 *
+    (BATT_R_UPPER + BATT_R_LOWER) / BATT_R_LOWER;
+  if (batteryUnderLoad == 0 || voltage < batteryUnderLoad) {
+    batteryUnderLoad = voltage;
+  }
+}
+
+/*
+ * Stop the GPS task and turn the GPS off, does nothing if stopped already
+ */
+void stopGps() {
+  if (gpsTaskHandle == NULL) { return; }
+  deleteTask(gpsTaskHandle, gps_serial);
+  gpsTaskHandle = NULL;
+  holdLock(gpsListen, false);
+  holdLock(gpsBoost, false);
+  if (xSemaphoreTake(mutex_i2c, 100) == pdTRUE) {
+    gps.disable();
+    xSemaphoreGive(mutex_i2c);
+  }
+  setEnergyLoad(LOAD_GPS, false);
+}
+
+/*
+ * Account the time the GPS was kept on after the fix, returns true if the
+ * refresh is complete. Does nothing without refresh.
+ */
+bool endGpsRefresh() {
+  if (!state.gps_refreshing) { return false; }
+  bool complete = helpers::endGpsRefresh(
+    state, getTime(), getRunTime() - gpsRefreshStart);
+  if (complete) {
+    char bfr[80] = {0};
+    snprintf(bfr, 80, REFRESHED_MESSAGE_TEMPLATE,
+      (unsigned long) state.gps_refresh_ttff);
+    Serial.println(bfr);
+  }
+  return true;
+}
+
+/*
+ * Write the report and the fixes that could not be sent before, as long as
+ * they fit into the MO buffer, and queue it. A valid fix is sent in the
+ * SBDIX session header instead of the payload if the modem has one. A low
+ * battery report is sent alone, the fixes stay queued.
+ *
+ * With update the payload of the queued message is replaced instead, returns
+ * false if the Rockblock is sending it already.
+ */
+bool queueMessage(char *bfr, bool update=false) {
+  bool fix = scoutMessages::hasPosition(state) && LOCATION_IN_HEADER;
+  bool binary = state.message_format == BINARY_FORMAT;
+  bool minimal = batteryPolicy.skipGps();
+  // the estimate is sent once a day
+  bool energy = !minimal && (
+    state.energy_sent || helpers::energyReportDue(state, getTime()));
+  if (energy) { state.energy = updateEnergy(); }
+  size_t len = 0;
+  if (binary) {
+    len = scoutMessages::createBinaryReport((uint8_t*) bfr, state, fix);
+    if (!minimal) {
+      len += scoutMessages::createBinaryBacklog(
+        (uint8_t*) bfr + len, RADIO_MESSAGE_SIZE - len, state,
+        &state.queue_sent);
+      len += scoutMessages::createBinaryTrack(
+        (uint8_t*) bfr + len, RADIO_MESSAGE_SIZE - len, state,
+        &state.track_sent);
+    }
+    if (energy) {
+      size_t energy_len = scoutMessages::createBinaryEnergy(
+        (uint8_t*) bfr + len, RADIO_MESSAGE_SIZE - len, state);
+      state.energy_sent = energy_len > 0;
+      len += energy_len;
+    }
+  } else {
+    // leave space for \r and \0
+    len = fix ? scoutMessages::createPK102(bfr, state) :
+      scoutMessages::createPK101(bfr, state);
+    if (!minimal) {
+      len += scoutMessages::appendBacklog(
+        bfr + len, RADIO_MESSAGE_SIZE - 1 - len, state, &state.queue_sent);
+      len += scoutMessages::appendTrack(
+        bfr + len, RADIO_MESSAGE_SIZE - 1 - len, state, &state.track_sent);
+    }
+    if (energy) {
+      state.energy_sent = scoutMessages::appendEnergy(
+        bfr + len, RADIO_MESSAGE_SIZE - 1 - len, state) > 0;
+    }
+  }
+  // the Rockblock task only holds it for one loop
+  if (xSemaphoreTake(mutex_rockblock, update ? 100 : portMAX_DELAY) != pdTRUE) {
+    return false;
+  }
+  bool queued = true;
+  // close to the timeout the Rockblock tries with any signal
+  if (!update) {
+    rockblock.setDeadline(batteryPolicy.systemTimeout(SYSTEM_TIME_OUT) * 1000);
+  }
+  if (update && binary) {
+    queued = rockblock.updateMessage((const uint8_t*) bfr, len);
+  } else if (update) {
+    queued = rockblock.updateMessage(bfr);
+  } else if (binary && fix) {
+    rockblock.sendMessage((const uint8_t*) bfr, len, state.lat, state.lng);
+  } else if (binary) {
+    rockblock.sendMessage((const uint8_t*) bfr, len);
+  } else if (fix) {
+    rockblock.sendMessage(bfr, state.lat, state.lng);
+  } else {
+    rockblock.sendMessage(bfr);
+  }
+  xSemaphoreGive(mutex_rockblock);
+  return queued;
+}
+
+/*
+ * Keep the GPS on while the Rockblock sends, starting with the accepted fix
+ */
+void startGpsOverlap() {
+  gpsOverlap = true;
+  gpsOverlapStart = getRunTime();
+  gpsOverlapUpdate = gpsOverlapStart;
+  courseAverage.reset();
+  courseAverage.add(gps.epoch, state.speed, state.heading);
+  overlap = overlapLoad();
+  overlap.gps_overflows = gps_serial.overflows;
+  overlap.rockblock_overflows = rockblock_serial.overflows;
+}
+
+/*
+ * Average new fixes and update the queued message every
+ * GPS_OVERLAP_INTERVAL seconds
+ */
+void updateGpsOverlap(char *bfr) {
+  if (gps.updated) { courseAverage.add(gps.epoch, gps.speed, gps.heading); }
+  if (
+    getRunTime() - gpsOverlapUpdate < GPS_OVERLAP_INTERVAL ||
+    courseAverage.samples() < 2
+  ) { return; }
+  gpsOverlapUpdate = getRunTime();
+  state.speed = courseAverage.speed();
+  state.heading = courseAverage.course();
+  bool updated = queueMessage(bfr, true);
+  snprintf(bfr, 255, COURSE_MESSAGE_TEMPLATE, courseAverage.samples(),
+    state.speed, state.heading, updated ? "updated" : "sent already");
+  Serial.println(bfr);
+}
+
+/*
+ * Report the load of running GPS and Rockblock at the same time, the GPS is
+ * left on for a refresh
+ */
+void endGpsOverlap() {
+  if (!gpsOverlap) { return; }
+  gpsOverlap = false;
+  gpsListening = false;
+  char bfr[200] = {0};
+  snprintf(bfr, 200, OVERLAP_MESSAGE_TEMPLATE,
+    getRunTime() - gpsOverlapStart,
+    (unsigned long) overlap.gps_cpu / 1000,
+    (unsigned long) overlap.rockblock_cpu / 1000,
+    (unsigned long) overlap.i2c_wait / 1000, overlap.i2c_missed,
+    (unsigned long) (gps_serial.overflows - overlap.gps_overflows),
+    (unsigned long) (
+      rockblock_serial.overflows - overlap.rockblock_overflows));
+  Serial.println(bfr);
+}
+
 /*
  * Go to sleep. If error is true, we treat this as a reaction to a systen error.
  *
@@ -148,14 +491,52 @@ float readBatteryVoltage() {
 void goToSleep(bool error=false) {
   char bfr[128] = {0};
   uint32_t difference = ERROR_SLEEP_DIFFERENCE;
-  // Store data needed on wakeup
+  // GPS kept on for a refresh or while sending, turned off with the
+  // expander below
+  endGpsOverlap();
+  endGpsRefresh();
+  if (gpsTaskHandle != NULL) {
+    deleteTask(gpsTaskHandle, gps_serial);
+    gpsTaskHandle = NULL;
+  }
+  // Sleep until the expected wake up, the RTC drift is compensated
+  uint32_t rtc_sleep = difference;
+  if (error) {
+    state.rtc_drift.sleep_start = 0;
+  } else {
+    // the sag of this session is taken into account from the next wake up
+    if (batteryUnderLoad > 0) {
+      batteryPolicy.onLoad(state.bat, batteryUnderLoad);
+      state.battery = batteryPolicy.getHealth();
+      snprintf(bfr, 128, BATTERY_SAG_TEMPLATE, batteryUnderLoad,
+        state.battery.sag, state.battery.samples);
+      Serial.println(bfr);
+    }
+    difference = helpers::getSleepDifference( state, getTime() );
+    if (helpers::scheduleTrack(
+      state, getTime(), batteryPolicy.extras() ? TRACK_INTERVAL : 0)
+    ) {
+      difference = state.expected_wakeup - getTime();
+    }
+    rtc_sleep = helpers::getRtcSleep(state, getTime(), clockSynced);
+  }
+  // the sleep is accounted after the timer wake up
+  xSemaphoreTake(mutex_energy, portMAX_DELAY);
+  energyMeter.update(getRunTimeMs());
+  energyMeter.startSleep(rtc_sleep);
+  state.energy = energyMeter.getTotals();
+  xSemaphoreGive(mutex_energy);
+  // Store data needed on wakeup, the Rockblock task is still running
+  xSemaphoreTake(mutex_rockblock, portMAX_DELAY);
+  state.signal_history = rockblock.getSignalHistory();
+  xSemaphoreGive(mutex_rockblock);
   storage.store( state );
   // Output a message before sleeping
   if ( xSemaphoreTake(mutex_i2c, 1000) == pdTRUE ) {
     // Clear display, since we don't want to show anything while sleeping
     display.off();
     // delete Rockblock task
-    vTaskDelete( rockblockTaskHandle );
+    deleteTask(rockblockTaskHandle, rockblock_serial);
     // Set port expander to known state, i.e. peripherals off, holding RB
     // enable pin HIGH.
     expander.init();
@@ -168,7 +549,6 @@ void goToSleep(bool error=false) {
       bfr, 128, ERROR_SLEEP_TEMPLATE, difference,
       scoutMessageTypeLabels[state.mode]);
   } else {
-    difference = helpers::getSleepDifference( state, getTime() );
     snprintf(
       bfr, 128, SLEEP_TEMPLATE, state.interval, difference, state.retries,
       scoutMessageTypeLabels[state.mode]);
@@ -177,7 +557,22 @@ void goToSleep(bool error=false) {
   Serial.print("Expected wakeup (UTC): ");
   strftime(bfr, 32, "%F %T", gmtime(&state.expected_wakeup));
   Serial.println(bfr);
-  esp_sleep_enable_timer_wakeup( difference * 1E6 );
+  snprintf(bfr, 128, RTC_SLEEP_TEMPLATE, (unsigned long) rtc_sleep,
+    state.rtc_drift.ppm, state.rtc_drift.samples);
+  Serial.println(bfr);
+  snprintf(bfr, 128, ENERGY_TEMPLATE,
+    energyPerDay(state.energy, ENERGY_LOADS), state.energy.seconds / 86400,
+    energyPerDay(state.energy, LOAD_CPU), energyPerDay(state.energy, LOAD_GPS),
+    energyPerDay(state.energy, LOAD_ROCKBLOCK),
+    energyPerDay(state.energy, LOAD_SBDIX),
+    energyPerDay(state.energy, LOAD_SLEEP));
+  Serial.println(bfr);
+  if (state.track_wakeup) {
+    snprintf(bfr, 128, TRACK_SLEEP_TEMPLATE,
+      (unsigned) state.track.size());
+    Serial.println(bfr);
+  }
+  esp_sleep_enable_timer_wakeup( rtc_sleep * 1E6 );
   try {
     esp_deep_sleep_start();
   } catch (...) {
@@ -245,13 +640,47 @@ void Task_rockblock(void *pvParameters) {
   // Give some time for the peripherials to stabilize.
   // It might hang up if we start too early
   vTaskDelay( pdMS_TO_TICKS( 200 ) );
+  rockblock.setTerse(ROCKBLOCK_TERSE);
+#if ROCKBLOCK_FLOW_CONTROL
+  rockblock.setFlowControl(PORT_EXPANDER_ROCKBLOCK_RTS_PIN);
+#endif
   if (xSemaphoreTake(mutex_i2c, 100) == pdTRUE) {
     rockblock.toggle(true);
     xSemaphoreGive(mutex_i2c);
   }
+  setEnergyLoad(LOAD_ROCKBLOCK, true);
   while (true) {
-    vTaskDelay( pdMS_TO_TICKS( 100 ) );
+    // responses are handled as soon as they arrived, command timeouts and
+    // the ring indicator are checked at least every 100ms
+    rockblock_serial.waitForData(100);
+    // the main task might be updating the message
+    if (xSemaphoreTake(mutex_rockblock, 100) != pdTRUE) { continue; }
+    // ring indicator and CTS are connected to the IO expander
+    int64_t start = esp_timer_get_time();
+    bool i2c = xSemaphoreTake(mutex_i2c, 10) == pdTRUE;
+    if (gpsOverlap) {
+      overlap.i2c_wait += esp_timer_get_time() - start;
+      overlap.i2c_missed += !i2c;
+    }
+    if (i2c) {
+      rockblock.ringIndicator(
+        expander.digitalRead(PORT_EXPANDER_ROCKBLOCK_RING_PIN));
+#if ROCKBLOCK_FLOW_CONTROL
+      rockblock.clearToSend(
+        expander.digitalRead(PORT_EXPANDER_ROCKBLOCK_CTS_PIN));
+#endif
+      xSemaphoreGive(mutex_i2c);
+    }
+    start = esp_timer_get_time();
+    holdLock(rockblockBoost, true);
     rockblock.loop();
+    holdLock(rockblockBoost, false);
+    if (gpsOverlap) { overlap.rockblock_cpu += esp_timer_get_time() - start; }
+    // the 9603 only sends responses, a ring alert also shows on the ring
+    // indicator. The 9704 sends unsolicited messages.
+    holdLock(rockblockListen, ROCKBLOCK_9704 || rockblock.commandPending());
+    setEnergyLoad(LOAD_SBDIX, rockblock.state == SENDING);
+    xSemaphoreGive(mutex_rockblock);
   }
 }
 
@@ -263,9 +692,16 @@ void Task_gps(void *pvParameters) {
     gps.enable();
     xSemaphoreGive(mutex_i2c);
   }
+  setEnergyLoad(LOAD_GPS, true);
   while(true) {
-    vTaskDelay( pdMS_TO_TICKS( 100 ) );
+    holdLock(gpsListen, gpsListening);
+    // wakes at the end of every NMEA burst
+    gps_serial.waitForData(1000);
+    int64_t start = esp_timer_get_time();
+    holdLock(gpsBoost, true);
     gps.loop();
+    holdLock(gpsBoost, false);
+    if (gpsOverlap) { overlap.gps_cpu += esp_timer_get_time() - start; }
   }
 }
 
@@ -290,11 +726,20 @@ void Task_time(void *pvParameters) {
 void Task_main_loop(void *pvParameters) {
   // setup
   mainFSM fsmState = AWAKE;
-  // use as needed
-  char bfr[255] = {0};
+  // use as needed, fits a full MO message. Static since a 9704 message does
+  // not fit the task stack.
+  static char bfr[RADIO_MESSAGE_SIZE + 1] = {0};
   // use for timed action or output in increaments of 100ms, e.g. while waiting
   // for state change
   uint16_t ctr = 0;
+  // listen for ring alerts after sending, see RING_LISTEN_TIME
+  uint16_t ringListenStart = 0;
+  uint16_t incomingCount = 0;
+  // learned in gpsPolicy, at most GPS_TIME_OUT
+  uint16_t gpsTimeout = GPS_TIME_OUT;
+  // energy accounting per phase
+  mainFSM lastState = fsmState;
+  int64_t phaseStart = 0;
 
   while (true) {
     // Check whether port expander is available by writing and reading to an
@@ -316,70 +761,156 @@ void Task_main_loop(void *pvParameters) {
     switch (fsmState) {
 
       case AWAKE: {
+        // report the low battery without GPS
+        if (batteryPolicy.skipGps()) {
+          Serial.println("GPS: skipped, battery low");
+          // the task may have turned the GPS on before it was suspended
+          stopGps();
+          fsmState = helpers::skipGps(state, getTime());
+          if (fsmState == WAIT_FOR_RB) {
+            vTaskResume(rockblockTaskHandle);
+            queueMessage(bfr);
+          }
+          break;
+        }
         vTaskResume( gpsTaskHandle );
+        gpsTimeout = batteryPolicy.gpsTimeout(gpsPolicy.timeout());
+        snprintf(bfr, 255, GPS_TIMEOUT_TEMPLATE, gpsTimeout,
+          gpsPolicy.successRate() * 100, gpsPolicy.acceptHdop() / 100.0);
+        Serial.println(bfr);
         fsmState = WAIT_FOR_GPS;
         break;
       }
 
       case WAIT_FOR_GPS: {
-        bool timeout_test = getRunTime() > GPS_TIME_OUT;
-        // update state
+        bool timeout_test = getRunTime() > gpsTimeout;
+        // update state, the best fix so far is kept until accepted
         fsmState = helpers::processGpsFix(
-          state, gps, getTime(), timeout_test);
+          state, gps, gpsPolicy, getTime(), timeout_test);
         // set read time clock and some output
         if (gps.updated) {
           setTime( gps.get_corrected_epoch() );
-          snprintf(bfr, 255, GPS_MESSAGE_TEMPLATE, state.lat, state.lng,
-            getRunTime());
+          // compare the wake up with the schedule once per wake up
+          if (!clockSynced) {
+            clockSynced = true;
+            if (helpers::updateRtcDrift(state, getTime() - getRunTime())) {
+              snprintf(bfr, 255, RTC_DRIFT_TEMPLATE,
+                (long) state.wakeup_error, state.rtc_drift.ppm,
+                state.rtc_drift.samples);
+              Serial.println(bfr);
+            }
+          }
+          snprintf(bfr, 255, GPS_MESSAGE_TEMPLATE, gps.lat, gps.lng,
+            gps.hdop / 100.0, gps.satellites, getRunTime());
           Serial.println(bfr);
         } else if (timeout_test) {
           Serial.println( "GPS: Timeout." );
         } else if (ctr % 50 == 0) { Serial.println("GPS: Waiting for fix."); }
+        if (fsmState == SLEEP_READY) {
+          snprintf(bfr, 255, TRACK_MESSAGE_TEMPLATE,
+            (unsigned) state.track.size());
+          Serial.println(bfr);
+        }
+        if (fsmState == WAIT_FOR_RB && state.ttff) {
+          const gpsHistory &history = state.gps_history;
+          unsigned long aided = gpsPolicy.averageTtff(true);
+          unsigned long unaided = gpsPolicy.averageTtff(false);
+          long refreshed = (getTime() - state.gps_refresh_time) / 3600;
+          snprintf(bfr, 255, TTFF_MESSAGE_TEMPLATE, (unsigned long) state.ttff,
+            state.gps_aided ? " (aided)" : "", aided, history.fixes[1],
+            unaided, history.fixes[0], refreshed);
+          Serial.println(bfr);
+        }
 
         // State transitions affecting hardware and queue message
         if (fsmState == WAIT_FOR_RB) {
-          // stop GPS
-          vTaskDelete(gpsTaskHandle);
+          // keep the GPS on while the Rockblock sends to refresh the orbital
+          // data or to average speed and course, otherwise stop it
+          if (
+            batteryPolicy.extras() && helpers::startGpsRefresh(state, getTime())
+          ) {
+            gpsRefreshStart = getRunTime();
+            snprintf(bfr, 255, REFRESH_MESSAGE_TEMPLATE,
+              state.gps_refresh_progress, GPS_REFRESH_DURATION,
+              (long) ((getTime() - state.gps_refresh_time) / 3600));
+            Serial.println(bfr);
+          }
+          if (
+            ((GPS_OVERLAP && batteryPolicy.extras()) ||
+              state.gps_refreshing) &&
+            scoutMessages::hasPosition(state)
+          ) {
+            startGpsOverlap();
+          } else if (!state.gps_refreshing) {
+            stopGps();
+          }
+          gpsListening = gpsOverlap;
           // start Rockblock
           vTaskResume(rockblockTaskHandle);
-          // turn off GPS hardware
-          if (xSemaphoreTake(mutex_i2c, 100) == pdTRUE) {
-            gps.disable();
-            xSemaphoreGive(mutex_i2c);
-          }
           // send message and update FSM
-          scoutMessages::createPK101(bfr, state);
-          rockblock.sendMessage(bfr);
+          queueMessage(bfr);
         }
         break;
       };
 
       case WAIT_FOR_RB: {
-        // check whether we are timing out
-        if (getRunTime() > SYSTEM_TIME_OUT) {
+        if (gpsOverlap) { updateGpsOverlap(bfr); }
+        if (rockblock.state == SENDING) { sampleBatteryLoad(); }
+        // check whether we are timing out, sooner with a weak battery
+        if (getRunTime() > batteryPolicy.systemTimeout(SYSTEM_TIME_OUT)) {
           Serial.println("\nRB: Timeout\n");
+          helpers::queueUnsentFix(state);
           state.retries--;
           state.retry = state.retries > 0;
           fsmState = SLEEP_READY;
         } else {
-          // Check for incoming messages
-          rockblock.getLastIncoming(bfr);
+          // Check for incoming messages, all queued messages are retrieved
+          // before sendSuccess is set
+          size_t count = rockblock.sendSuccess ? readIncoming() : 0;
           // Determine next state, systemState will be updated as a side effect
           // I considered passing a reference to the rockblock instance but
           // that makes testing harder, therefore passing only select values.
           fsmState = helpers::processRockblockMessage(
-            state, bfr, rockblock.sendSuccess,
+            state, incomingMessages, incomingLengths, count,
+            rockblock.sendSuccess,
             rockblock.state == SENDING || rockblock.state == INCOMING);
           if (fsmState == SLEEP_READY) {
             state.retries = 3;
             Serial.println("\nRB: Send success");
-            Serial.print("RB: Incoming message - ");
-            Serial.println(bfr); Serial.println();
+            // without incoming message an operator might still send one
+            if (
+              RING_LISTEN_TIME > 0 && count == 0 && batteryPolicy.extras()
+            ) {
+              Serial.println("RB: Listen for ring alerts");
+              ringListenStart = getRunTime();
+              incomingCount = rockblock.getIncomingCount();
+              fsmState = WAIT_FOR_RING;
+            }
           }
         }
         break;
       };
 
+      // Rockblock answers ring alerts by itself, a received message is
+      // processed as if it has been received with our message
+      case WAIT_FOR_RING: {
+        if (
+          getRunTime() > batteryPolicy.systemTimeout(SYSTEM_TIME_OUT) ||
+          getRunTime() - ringListenStart > RING_LISTEN_TIME
+        ) {
+          fsmState = SLEEP_READY;
+        } else if (
+          rockblock.getIncomingCount() != incomingCount &&
+          !rockblock.mailboxPending() && rockblock.state == IDLE
+        ) {
+          Serial.println("RB: Incoming messages after ring alert");
+          size_t count = readIncoming();
+          fsmState = helpers::processRockblockMessage(
+            state, incomingMessages, incomingLengths, count, true, false);
+        }
+        break;
+      };
+
       // normal sleep
       case SLEEP_READY: {
         goToSleep();
@@ -393,6 +924,30 @@ void Task_main_loop(void *pvParameters) {
       }
 
     }
+    // stop averaging once the message has been sent
+    if (gpsOverlap && (rockblock.sendSuccess || fsmState != WAIT_FOR_RB)) {
+      endGpsOverlap();
+      if (!state.gps_refreshing) { stopGps(); }
+    }
+    // stop the refresh once complete, otherwise at sleep
+    if (
+      state.gps_refreshing && state.gps_refresh_progress +
+      getRunTime() - gpsRefreshStart >= GPS_REFRESH_DURATION
+    ) {
+      endGpsRefresh();
+      if (!gpsOverlap) { stopGps(); }
+    }
+    if (fsmState != lastState) {
+      xSemaphoreTake(mutex_energy, portMAX_DELAY);
+      energyMeter.update(getRunTimeMs());
+      float phase = energyMeter.phase();
+      xSemaphoreGive(mutex_energy);
+      snprintf(bfr, 255, ENERGY_PHASE_TEMPLATE, mainFSMLabels[lastState],
+        (unsigned long) (getRunTimeMs() - phaseStart), phase);
+      Serial.println(bfr);
+      lastState = fsmState;
+      phaseStart = getRunTimeMs();
+    }
     ctr++;
     vTaskDelay( 100 );
   }
@@ -435,23 +990,65 @@ void Task_timeout(void *pvParameters) {
 void setup() {
   // --- Go slow for power consumption since a 32bit system with 240Mhz is
   // --- overkill for this system that is mostly waiting around
-  setCpuFrequencyMhz(10);
+#if POWER_MANAGEMENT
+  powerManaged = enablePowerManagement(POWER_MAX_FREQ, POWER_MIN_FREQ);
+#endif
+  if (powerManaged) {
+    gpsListen.begin();
+    gpsBoost.begin();
+    rockblockListen.begin();
+    rockblockBoost.begin();
+    i2cSetup.begin();
+  } else {
+    setCpuFrequencyMhz(10);
+  }
   // Task to monitor the system, will reset the system if we not finish in time
   xTaskCreate(&Task_timeout, "Task timeout", 4096, NULL, 10, NULL);
   // ---- Start Serial for debugging --------------
   Serial.begin(115200);
-  // ----- Init both HardwareSerial channels ---------------------
-  gps_serial.begin(9600, SERIAL_8N1, GPS_SERIAL_RX_PIN, GPS_SERIAL_TX_PIN);
+  // ----- Init both serial channels ---------------------
+  gps_serial.begin(GPS_SERIAL_SPEED, SERIAL_8N1,
+    GPS_SERIAL_RX_PIN, GPS_SERIAL_TX_PIN);
+  gps.setConfig(UbxSettings{GPS_UBX, GPS_SERIAL_SPEED_RAISED, GPS_GNSS,
+    GPS_POWER_SAVE});
   rockblock_serial.begin(ROCKBLOCK_SERIAL_SPEED, SERIAL_8N1,
     ROCKBLOCK_SERIAL_RX_PIN, ROCKBLOCK_SERIAL_TX_PIN);
   // ---- Start I2C bus for peripherials ----------
+  // at the highest APB frequency, it runs slower below
+  i2cSetup.hold(true);
   Wire.begin();
+  i2cSetup.hold(false);
   // ---- set state defaults
   // Reporting times need to be changed via downlink message and will only be
   // persisted until next power off
   state.interval = DEFAULT_INTERVAL;
   // ---- Restore state
   storage.restore(state);
+  // send threshold is learned across wake ups
+  rockblock.setSignalHistory(state.signal_history);
+  gpsPolicy.setHistory(state.gps_history);
+  // account the sleep and the time awake since boot, no other task uses the
+  // meter yet
+  energyMeter.setTotals(state.energy);
+  energyMeter.wake(esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER);
+  energyMeter.set(LOAD_CPU, true, 0);
+  // the CPU was busy until now, then it sleeps between locks
+  energyMeter.setPowerManaged(powerManaged, getRunTimeMs());
+  // the RTC drifts through deep sleep, correct the time by the estimate
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) {
+    setTime(helpers::correctRtcTime(state, getTime()));
+  } else {
+    state.rtc_drift.sleep_start = 0;
+  }
+  // start the GPS from the last fix
+  uint32_t position_accuracy = 0;
+  uint16_t time_accuracy = 0;
+  if (GPS_AIDING && helpers::estimateAiding(
+    state, getTime(), &position_accuracy, &time_accuracy)
+  ) {
+    gps.setAiding(state.last_lat, state.last_lng, position_accuracy,
+      getTime(), time_accuracy);
+  }
   // ---- Init Display: if not used it should be turned be off properly, it
   // ---- might have random content on power on
   display.begin();
@@ -462,9 +1059,19 @@ void setup() {
   Serial.println("falk.schuetzenmeister@tnc.org");
   Serial.println("\n© The Nature Conservancy 2025\n");
   Serial.print("reporting interval: "); Serial.println(state.interval);
+  Serial.print("light sleep while awake: ");
+  Serial.println(powerManaged ? "on" : "off");
   // ---- Read battery voltage --------------------
   state.bat = readBatteryVoltage();
-  Serial.print("battery: "); Serial.println(state.bat);
+  // the battery decides about interval, timeouts and extras
+  batteryPolicy.setHealth(state.battery);
+  batteryPolicy.update(state.bat);
+  state.battery = batteryPolicy.getHealth();
+  char batteryBfr[128] = {0};
+  snprintf(batteryBfr, 128, BATTERY_TEMPLATE, state.bat,
+    batteryLevelLabels[state.battery.level], state.battery.sag,
+    state.battery.samples);
+  Serial.println(batteryBfr);
 
 #if DEBUG
   preferences.begin("debug", false);
@@ -506,6 +1113,14 @@ void setup() {
    * Mutex protecting state
    */
   mutex_state = xSemaphoreCreateMutex();
+  /*
+   * Mutex protecting the Rockblock object, see queueMessage
+   */
+  mutex_rockblock = xSemaphoreCreateMutex();
+  /*
+   * Mutex protecting the energy meter, see setEnergyLoad
+   */
+  mutex_energy = xSemaphoreCreateMutex();
   /*
    * Create and start simple tasks.
    */
@@ -5,11 +5,67 @@
 #define PORT_EXPANDER_I2C_ADDRESS 0x24
 #define PORT_EXPANDER_GPS_ENABLE_PIN 0
 #define PORT_EXPANDER_ROCKBLOCK_ENABLE_PIN 13
+#define PORT_EXPANDER_ROCKBLOCK_RING_PIN 14
+#define PORT_EXPANDER_ROCKBLOCK_CTS_PIN 16
+#define PORT_EXPANDER_ROCKBLOCK_RTS_PIN 17
+// RTS/CTS via the port expander, 0 disables
+#ifndef ROCKBLOCK_FLOW_CONTROL
+#define ROCKBLOCK_FLOW_CONTROL 0
+#endif
+// Terse AT dialect (ATE0, ATV0), 0 keeps echo and verbose result codes
+#ifndef ROCKBLOCK_TERSE
+#define ROCKBLOCK_TERSE 0
+#endif
+// RockBLOCK 9704 (JSPR/IMT) instead of the 9603 (AT/SBD)
+#ifndef ROCKBLOCK_9704
+#define ROCKBLOCK_9704 0
+#endif
+// UBX NAV-PVT instead of NMEA, needs a u-blox M8 or later
+#ifndef GPS_UBX
+#define GPS_UBX 0
+#endif
+// GPS receiver settings after power on: UART rate (0 keeps 9600),
+// constellations (UBX_GNSS_*, 0 keeps the receiver default), power save mode
+#ifndef GPS_SERIAL_SPEED_RAISED
+#define GPS_SERIAL_SPEED_RAISED 0
+#endif
+#ifndef GPS_GNSS
+#define GPS_GNSS 0
+#endif
+#ifndef GPS_POWER_SAVE
+#define GPS_POWER_SAVE 0
+#endif
+// send time and last position to the GPS after wake up, u-blox M8 or later
+#ifndef GPS_AIDING
+#define GPS_AIDING 1
+#endif
+// keep the GPS on while the Rockblock sends and update the queued message
+// with speed and course averaged over the fixes every GPS_OVERLAP_INTERVAL s,
+// costs the GPS current for the time it takes to send
+#ifndef GPS_OVERLAP
+#define GPS_OVERLAP 0
+#endif
+#ifndef GPS_OVERLAP_INTERVAL
+#define GPS_OVERLAP_INTERVAL 10
+#endif
+// GPS only wake ups every TRACK_INTERVAL s between reports, the fixes are
+// sent delta encoded with the next report, 0 disables. See
+// helpers::scheduleTrack.
+#ifndef TRACK_INTERVAL
+#define TRACK_INTERVAL 0
+#endif
 #define GPS_SERIAL_RX_PIN 35
 #define GPS_SERIAL_TX_PIN 12
 #define ROCKBLOCK_SERIAL_RX_PIN 34
 #define ROCKBLOCK_SERIAL_TX_PIN 25
+#if ROCKBLOCK_9704
+#define ROCKBLOCK_SERIAL_SPEED 230400
+#else
 #define ROCKBLOCK_SERIAL_SPEED 19200
+#endif
+// UART RX buffer, has to fit a burst of NMEA sentences. See hal.h for the
+// Rockblock.
+#define GPS_SERIAL_RX_BUFFER 1024
 #define NUM_TIMERS 1
 
 /* Pin mapping
@@ -67,8 +123,14 @@ ird_rts     1     7    0
 #define RETRY_INTERVAL 600
 // time after which system is shutdown no matter what, 9 minutes
 #define SYSTEM_TIME_OUT 360
-// time before we decide that we won't get a GPS fix
+// longest time to wait for a GPS fix, the timeout is learned below that, see
+// gpsPolicy.h
 #define GPS_TIME_OUT 240
+// Keep the Rockblock on for ring alerts after the message has been sent, in
+// seconds, 0 disables. Limited by SYSTEM_TIME_OUT.
+#ifndef RING_LISTEN_TIME
+#define RING_LISTEN_TIME 0
+#endif
 // Maximum regular reporting time, 86400s = 1day
 #define MAXIMUM_INTERVAL 86400  // IMPLEMENT
 // Mininmum sleep time, 5s
@@ -77,5 +139,18 @@ ird_rts     1     7    0
 #define MAXIMUM_SLEEP 259200
 // Sleep time on system error
 #define ERROR_SLEEP_DIFFERENCE 600
+// Automatic light sleep while awake and tasks wait, the CPU between
+// POWER_MIN_FREQ and POWER_MAX_FREQ (MHz, boosted for parsing). Needs an
+// ESP-IDF built with power management and tickless idle, otherwise, and with
+// 0, the CPU runs at a fixed 10 MHz. See enablePowerManagement in hal.h.
+#ifndef POWER_MANAGEMENT
+#define POWER_MANAGEMENT 0
+#endif
+#ifndef POWER_MAX_FREQ
+#define POWER_MAX_FREQ 80
+#endif
+#ifndef POWER_MIN_FREQ
+#define POWER_MIN_FREQ 10
+#endif
 
 #endif /* __PINDEFS_H__ */
@@ -0,0 +1,29 @@
+/*
+ * Shared timing helpers for benchmarks. Cycles are read from the time stamp
+ * counter where available, otherwise nanoseconds are used.
+ */
+#ifndef __BENCH_H__
+#define __BENCH_H__
+#include <stdint.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_TICK_UNIT "cycles"
+static inline uint64_t benchTicks() { return __rdtsc(); }
+#else
+#define BENCH_TICK_UNIT "ns"
+static inline uint64_t benchTicks() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+static inline double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+#endif /* __BENCH_H__ */
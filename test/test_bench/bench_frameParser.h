@@ -0,0 +1,74 @@
+/*
+ * Compare the streaming frame parser with the former strdup/strtok based
+ * parser. The legacy parser also ran on every poll without new data, which
+ * is measured separately as an idle poll.
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <frameParser.h>
+#include "bench.h"
+#include "legacy.h"
+
+#define BENCH_PARSE_ROUNDS 20000
+
+static const char* parserFrames[] = {
+    "AT+CSQ\r\n+CSQ:4\r\n\r\nOK\r\n",
+    "AT+SBDWT\r\nREADY\r\n",
+    "AT+SBDIX\r\n+SBDIX: 0, 12, 1, 3, 15, 0\r\n\r\nOK\r\n",
+    "AT+SBDRT\r\n+SBDRT:\r\n+DATA:PK006,60;\r\n\r\nOK\r\n",
+};
+
+void benchFrameParserVsLegacy() {
+    char report[256] = {0};
+    LegacyFrameParser legacy;
+    FrameParser parser;
+    size_t checksum = 0;
+
+    uint64_t start = benchTicks();
+    for (size_t i = 0; i < BENCH_PARSE_ROUNDS; i++) {
+        legacy.parse(parserFrames[i % 4]);
+        checksum += legacy.values.size();
+    }
+    double legacyTicks = (double) (benchTicks() - start) / BENCH_PARSE_ROUNDS;
+
+    // legacy parsed an empty frame on every poll without new data
+    start = benchTicks();
+    for (size_t i = 0; i < BENCH_PARSE_ROUNDS; i++) {
+        legacy.parse("");
+        checksum += legacy.status;
+    }
+    double legacyIdleTicks = (
+        (double) (benchTicks() - start) / BENCH_PARSE_ROUNDS);
+
+    start = benchTicks();
+    for (size_t i = 0; i < BENCH_PARSE_ROUNDS; i++) {
+        const char* frame = parserFrames[i % 4];
+        parser.feed(frame, strlen(frame));
+        checksum += parser.values.size();
+    }
+    double streamTicks = (double) (benchTicks() - start) / BENCH_PARSE_ROUNDS;
+
+    snprintf(report, sizeof(report),
+        "legacy:    %.0f " BENCH_TICK_UNIT "/frame, %.0f " BENCH_TICK_UNIT
+        "/idle poll", legacyTicks, legacyIdleTicks);
+    TEST_MESSAGE(report);
+    snprintf(report, sizeof(report),
+        "streaming: %.0f " BENCH_TICK_UNIT "/frame, no work on idle polls "
+        "(checksum %zu)", streamTicks, checksum);
+    TEST_MESSAGE(report);
+
+    // both parsers have to agree
+    for (size_t i = 0; i < 4; i++) {
+        legacy.parse(parserFrames[i]);
+        parser.parse(parserFrames[i]);
+        TEST_ASSERT_EQUAL_STRING(legacy.command, parser.command);
+        TEST_ASSERT_EQUAL_STRING(legacy.response, parser.response);
+        TEST_ASSERT_EQUAL_STRING(legacy.payload, parser.payload);
+        TEST_ASSERT_EQUAL_INT(legacy.status, (int) parser.status);
+        // legacy kept values of the previous frame if there was no response
+        if (parser.response[0] != '\0') {
+            TEST_ASSERT_EQUAL_INT(legacy.values.size(), parser.values.size());
+        }
+    }
+    TEST_ASSERT_LESS_THAN(legacyTicks, streamTicks);
+}
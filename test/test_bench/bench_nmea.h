@@ -0,0 +1,281 @@
+/*
+ * Compare the NMEA parser with the TinyGPSPlus model in legacy.h on a log
+ * as a u-blox receiver outputs it at 1 Hz and 9600 baud: RMC, VTG, GGA, GSA,
+ * 3 GSV and GLL every second, first without time, then with time but without
+ * fix, then with a fix.
+ *
+ * Fix detection is timed on the simulated UART: bytes arrive at 960 B/s and
+ * are handed over when the RX FIFO threshold is reached or the burst ends,
+ * as EventSerial does. The former check accepted the RMC alone, NmeaParser
+ * waits for the GGA of the same second, i.e. up to one more chunk.
+ *
+ * Timings are from the host. Both run on integers, except for the final
+ * conversion of the TinyGPSPlus model to double, which the ESP32 computes
+ * in software.
+ *
+ * benchUbxVsNmea compares the same seconds as NAV-PVT, the only message left
+ * on the UART once Gps switched to UBX.
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <nmea.h>
+#include <ubx.h>
+#include "bench.h"
+#include "legacy.h"
+
+#define NMEA_ROUNDS 2000
+#define NMEA_BYTES_PER_SECOND 960
+// bytes handed over at once, see ESP32 UART FIFO threshold
+#define NMEA_CHUNK_SIZE 120
+#define NMEA_NO_TIME_SECONDS 5
+#define NMEA_NO_FIX_SECONDS 20
+#define NMEA_FIX_SECONDS 60
+
+static void appendSentence(std::string &log, const char *body) {
+    char bfr[100] = {0};
+    uint8_t checksum = 0;
+    for (const char *c = body; *c; c++) { checksum ^= *c; }
+    snprintf(bfr, sizeof(bfr), "$%s*%02X\r\n", body, checksum);
+    log += bfr;
+}
+
+/*
+ * NMEA log, bursts[i] is the offset of the burst of second i
+ */
+static std::string nmeaLog(std::vector<size_t> &bursts) {
+    std::string log;
+    char body[96] = {0};
+    int seconds = NMEA_NO_TIME_SECONDS + NMEA_NO_FIX_SECONDS + NMEA_FIX_SECONDS;
+    for (int i = 0; i < seconds; i++) {
+        bursts.push_back(log.size());
+        char time[16] = "";
+        if (i >= NMEA_NO_TIME_SECONDS) {
+            snprintf(time, sizeof(time), "1230%02d.00", i % 60);
+        }
+        const char *date = (i >= NMEA_NO_TIME_SECONDS) ? "160526" : "";
+        if (i < NMEA_NO_TIME_SECONDS + NMEA_NO_FIX_SECONDS) {
+            snprintf(body, sizeof(body), "GPRMC,%s,V,,,,,,,%s,,,N", time, date);
+            appendSentence(log, body);
+            appendSentence(log, "GPVTG,,,,,,,,,N");
+            snprintf(body, sizeof(body), "GPGGA,%s,,,,,0,03,25.51,,,,,,", time);
+            appendSentence(log, body);
+            appendSentence(log, "GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99");
+            appendSentence(log, "GPGSV,1,1,03,04,,,22,09,,,18,24,,,25");
+            snprintf(body, sizeof(body), "GPGLL,,,,,%s,V,N", time);
+            appendSentence(log, body);
+            continue;
+        }
+        // drifting north east
+        int step = i - NMEA_NO_TIME_SECONDS - NMEA_NO_FIX_SECONDS;
+        char lat[16] = {0};
+        char lng[16] = {0};
+        snprintf(lat, sizeof(lat), "3730.%05d", 1234 + step * 7);
+        snprintf(lng, sizeof(lng), "12215.%05d", 54321 - step * 3);
+        snprintf(body, sizeof(body), "GPRMC,%s,A,%s,N,%s,W,1.254,47.30,%s,,,A",
+            time, lat, lng, date);
+        appendSentence(log, body);
+        appendSentence(log, "GPVTG,47.30,T,,M,1.254,N,2.322,K,A");
+        snprintf(body, sizeof(body),
+            "GPGGA,%s,%s,N,%s,W,1,08,0.94,3.4,M,-32.1,M,,", time, lat, lng);
+        appendSentence(log, body);
+        appendSentence(log, "GPGSA,A,3,04,05,09,12,24,25,29,31,,,,,1.72,0.94,1.44");
+        appendSentence(log,
+            "GPGSV,3,1,11,04,41,289,40,05,17,034,31,09,62,102,44,12,22,217,35");
+        appendSentence(log,
+            "GPGSV,3,2,11,24,33,156,42,25,08,321,27,29,71,012,45,31,15,265,33");
+        appendSentence(log, "GPGSV,3,3,11,02,03,112,,18,05,191,,26,02,348,");
+        snprintf(body, sizeof(body), "GPGLL,%s,N,%s,W,%s,A,A", lat, lng, time);
+        appendSentence(log, body);
+    }
+    return log;
+}
+
+/*
+ * Feed the log as the UART hands it over, returns the time (ms since the log
+ * started) of the first chunk for which poll() returns true, -1 if none
+ */
+template <typename Poll>
+static int32_t detectFix(const std::string &log,
+    const std::vector<size_t> &bursts, Poll poll
+) {
+    for (size_t i = 0; i < bursts.size(); i++) {
+        size_t end = (i + 1 < bursts.size()) ? bursts[i + 1] : log.size();
+        for (size_t start = bursts[i]; start < end; start += NMEA_CHUNK_SIZE) {
+            size_t len = end - start;
+            len = (len < NMEA_CHUNK_SIZE) ? len : NMEA_CHUNK_SIZE;
+            if (poll(log.data() + start, len)) {
+                return i * 1000 + (start - bursts[i] + len) * 1000 /
+                    NMEA_BYTES_PER_SECOND;
+            }
+        }
+    }
+    return -1;
+}
+
+void benchNmeaVsTinyGps() {
+    char report[200] = {0};
+    std::vector<size_t> bursts;
+    std::string log = nmeaLog(bursts);
+    double seconds = bursts.size();
+    size_t fixes = 0;
+    double lat = 0;
+    double lng = 0;
+
+    uint64_t start = benchTicks();
+    for (int round = 0; round < NMEA_ROUNDS; round++) {
+        LegacyNmeaParser legacy;
+        for (size_t i = 0; i < bursts.size(); i++) {
+            size_t end = (i + 1 < bursts.size()) ? bursts[i + 1] : log.size();
+            fixes += legacyGpsPoll(legacy, log.data() + bursts[i],
+                end - bursts[i], &lat, &lng);
+        }
+    }
+    double legacyTicks = (benchTicks() - start) / (NMEA_ROUNDS * seconds);
+    size_t legacyFixes = fixes / NMEA_ROUNDS;
+
+    fixes = 0;
+    start = benchTicks();
+    for (int round = 0; round < NMEA_ROUNDS; round++) {
+        NmeaParser parser;
+        for (size_t i = 0; i < bursts.size(); i++) {
+            size_t end = (i + 1 < bursts.size()) ? bursts[i + 1] : log.size();
+            fixes += parser.feed(log.data() + bursts[i], end - bursts[i]);
+        }
+    }
+    double parserTicks = (benchTicks() - start) / (NMEA_ROUNDS * seconds);
+    size_t parserFixes = fixes / NMEA_ROUNDS;
+
+    // time to detect the first fix after it was output
+    LegacyNmeaParser legacy;
+    int32_t legacyDetect = detectFix(log, bursts,
+        [&](const char *bfr, size_t len) {
+            return legacyGpsPoll(legacy, bfr, len, &lat, &lng);
+        });
+    NmeaParser parser;
+    int32_t parserDetect = detectFix(log, bursts,
+        [&](const char *bfr, size_t len) { return parser.feed(bfr, len); });
+    int32_t firstFix = (NMEA_NO_TIME_SECONDS + NMEA_NO_FIX_SECONDS) * 1000;
+
+    snprintf(report, sizeof(report), "%zu bytes of NMEA per second",
+        log.size() / bursts.size());
+    TEST_MESSAGE(report);
+    snprintf(report, sizeof(report),
+        "TinyGPSPlus model: %.0f " BENCH_TICK_UNIT "/s of NMEA, %zu fixes, "
+        "first fix after %d ms", legacyTicks, legacyFixes,
+        (int) (legacyDetect - firstFix));
+    TEST_MESSAGE(report);
+    snprintf(report, sizeof(report),
+        "NMEA parser:       %.0f " BENCH_TICK_UNIT "/s of NMEA, %zu fixes, "
+        "first fix after %d ms", parserTicks, parserFixes,
+        (int) (parserDetect - firstFix));
+    TEST_MESSAGE(report);
+
+    // both see every second with a fix and agree on the position
+    TEST_ASSERT_EQUAL_INT(NMEA_FIX_SECONDS, legacyFixes);
+    TEST_ASSERT_EQUAL_INT(NMEA_FIX_SECONDS, parserFixes);
+    TEST_ASSERT_EQUAL_INT(8, parser.fix.satellites);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, lat, parser.fix.lat / 1e7);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, lng, parser.fix.lng / 1e7);
+    // the fix is detected at most one chunk after the RMC alone would be
+    TEST_ASSERT_GREATER_OR_EQUAL(firstFix, parserDetect);
+    TEST_ASSERT_LESS_OR_EQUAL(
+        legacyDetect + NMEA_CHUNK_SIZE * 1000 / NMEA_BYTES_PER_SECOND,
+        parserDetect);
+    TEST_ASSERT_LESS_THAN(legacyTicks, parserTicks);
+}
+
+/*
+ * NAV-PVT log of the same seconds as nmeaLog()
+ */
+static std::vector<uint8_t> ubxLog(std::vector<size_t> &bursts) {
+    std::vector<uint8_t> log;
+    uint8_t frame[UBX_NAV_PVT_LENGTH + UBX_OVERHEAD] = {0};
+    int seconds = NMEA_NO_TIME_SECONDS + NMEA_NO_FIX_SECONDS + NMEA_FIX_SECONDS;
+    for (int i = 0; i < seconds; i++) {
+        bursts.push_back(log.size());
+        uint8_t p[UBX_NAV_PVT_LENGTH] = {0};
+        int step = i - NMEA_NO_TIME_SECONDS - NMEA_NO_FIX_SECONDS;
+        if (i >= NMEA_NO_TIME_SECONDS) {
+            p[4] = 2026 & 0xff;
+            p[5] = 2026 >> 8;
+            p[6] = 5;
+            p[7] = 16;
+            p[8] = 12;
+            p[9] = 30;
+            p[10] = i % 60;
+            p[11] = 0x07;
+        }
+        if (step >= 0) {
+            int32_t lat = 375205700 + step * 1167;
+            int32_t lng = -1222590535 + step * 500;
+            p[20] = 3;
+            p[21] = 0x01;
+            p[23] = 8;
+            memcpy(p + 24, &lng, 4);
+            memcpy(p + 28, &lat, 4);
+        }
+        size_t len = ubxFrame(frame, sizeof(frame), UBX_CLASS_NAV,
+            UBX_NAV_PVT, p, sizeof(p));
+        log.insert(log.end(), frame, frame + len);
+    }
+    return log;
+}
+
+void benchUbxVsNmea() {
+    char report[200] = {0};
+    std::vector<size_t> nmeaBursts;
+    std::string nmea = nmeaLog(nmeaBursts);
+    std::vector<size_t> ubxBursts;
+    std::vector<uint8_t> ubx = ubxLog(ubxBursts);
+    double seconds = ubxBursts.size();
+    size_t fixes = 0;
+
+    uint64_t start = benchTicks();
+    for (int round = 0; round < NMEA_ROUNDS; round++) {
+        NmeaParser parser;
+        for (size_t i = 0; i < nmeaBursts.size(); i++) {
+            size_t end = (i + 1 < nmeaBursts.size()) ?
+                nmeaBursts[i + 1] : nmea.size();
+            fixes += parser.feed(nmea.data() + nmeaBursts[i],
+                end - nmeaBursts[i]);
+        }
+    }
+    double nmeaTicks = (benchTicks() - start) / (NMEA_ROUNDS * seconds);
+    size_t nmeaFixes = fixes / NMEA_ROUNDS;
+
+    // as Gps::loop() hands a burst to the parser
+    NmeaFix fix;
+    fixes = 0;
+    start = benchTicks();
+    for (int round = 0; round < NMEA_ROUNDS; round++) {
+        UbxParser parser;
+        for (size_t i = 0; i < ubxBursts.size(); i++) {
+            size_t end = (i + 1 < ubxBursts.size()) ?
+                ubxBursts[i + 1] : ubx.size();
+            size_t used = ubxBursts[i];
+            while (used < end) {
+                used += parser.feed(ubx.data() + used, end - used);
+                fixes += parser.navPvt(&fix);
+            }
+        }
+    }
+    double ubxTicks = (benchTicks() - start) / (NMEA_ROUNDS * seconds);
+    size_t ubxFixes = fixes / NMEA_ROUNDS;
+
+    snprintf(report, sizeof(report),
+        "NMEA:    %zu bytes/s, %.0f " BENCH_TICK_UNIT "/s, %zu fixes",
+        nmea.size() / nmeaBursts.size(), nmeaTicks, nmeaFixes);
+    TEST_MESSAGE(report);
+    snprintf(report, sizeof(report),
+        "NAV-PVT: %zu bytes/s, %.0f " BENCH_TICK_UNIT "/s, %zu fixes",
+        ubx.size() / ubxBursts.size(), ubxTicks, ubxFixes);
+    TEST_MESSAGE(report);
+
+    TEST_ASSERT_EQUAL_INT(NMEA_FIX_SECONDS, nmeaFixes);
+    TEST_ASSERT_EQUAL_INT(NMEA_FIX_SECONDS, ubxFixes);
+    TEST_ASSERT_LESS_THAN(nmea.size() / 4, ubx.size());
+    TEST_ASSERT_LESS_THAN(nmeaTicks, ubxTicks);
+}
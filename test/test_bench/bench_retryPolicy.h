@@ -0,0 +1,167 @@
+/*
+ * Compare the retry policy with the former fixed threshold on a simulated
+ * modem. Link quality follows a slow random walk, the reported signal
+ * strength is noisy and a session only succeeds with a probability depending
+ * on the actual link quality. Every +SBDIX attempt is counted, they are the
+ * high current part of a message. A message has the time left after the GPS
+ * until SYSTEM_TIME_OUT, a wake up that runs out of time is not delivered.
+ *
+ * A single run is noisy, the number of timeouts differs by a few percent
+ * between seeds. Signal readings are averaged by the policy, the legacy
+ * threshold acted on single readings.
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <retryPolicy.h>
+
+#define SIM_MESSAGES 2000
+// wake up time limit and GPS time in seconds, see SYSTEM_TIME_OUT and
+// GPS_TIME_OUT in pindefs.h
+#define SIM_SYSTEM_TIME_OUT 360
+#define SIM_GPS_TIME_MIN 20
+#define SIM_GPS_TIME_OUT 240
+// legacy threshold, CSQ is 0 to 5
+#define SIM_SEND_THRESHOLD 3
+// duration of a +SBDIX session in seconds
+#define SIM_SBDIX_TIME 20
+// legacy polled +CSQ back-to-back, a measurement takes about a second
+#define SIM_CSQ_TIME 1
+
+// actual success rate per link quality, lower than the original threshold
+// assumed
+static const float simSuccessRate[SIGNAL_LEVELS] = {
+    0, 0.02, 0.1, 0.3, 0.7, 0.9};
+
+class SimulatedModem {
+    private:
+        uint32_t seed;
+        uint8_t link = 3;
+    public:
+        uint32_t attempts = 0;
+        uint32_t successes = 0;
+        uint32_t polls = 0;
+        uint32_t timeouts = 0;
+        SimulatedModem(uint32_t seed) { this->seed = seed; }
+        float uniform() {
+            this->seed ^= this->seed << 13;
+            this->seed ^= this->seed >> 17;
+            this->seed ^= this->seed << 5;
+            return (this->seed % 100000) / 100000.0;
+        }
+        // a new location every message, link changes slowly within a session
+        void newSession() { this->link = this->uniform() * SIGNAL_LEVELS; }
+        void advance(uint32_t seconds) {
+            for (uint32_t i = 0; i < seconds; i++) {
+                float r = this->uniform();
+                if (r < 0.02 && this->link > 0) { this->link--; }
+                else if (r > 0.98 && this->link < SIGNAL_LEVELS - 1) {
+                    this->link++;
+                }
+            }
+        }
+        uint8_t csq() {
+            this->polls++;
+            float r = this->uniform();
+            if (r < 0.2 && this->link > 0) { return this->link - 1; }
+            if (r > 0.8 && this->link < SIGNAL_LEVELS - 1) {
+                return this->link + 1;
+            }
+            return this->link;
+        }
+        // MO status, 18 is connection lost
+        uint8_t sbdix() {
+            this->attempts++;
+            this->advance(SIM_SBDIX_TIME);
+            if (this->uniform() < simSuccessRate[this->link]) {
+                this->successes++;
+                return 0;
+            }
+            return 18;
+        }
+};
+
+/*
+ * Time left for the Rockblock in message i, the same for both runs. Mostly
+ * quick fixes, every 8th wake up waits for the GPS timeout.
+ */
+static uint32_t simSessionTime(size_t i) {
+    uint32_t hash = (i + 1) * 2654435761u;
+    uint32_t gps = (i % 8 == 7) ? SIM_GPS_TIME_OUT :
+        SIM_GPS_TIME_MIN + (hash >> 16) % 60;
+    return SIM_SYSTEM_TIME_OUT - gps;
+}
+
+// former behavior: fixed threshold, no backoff
+static void simulateLegacy(SimulatedModem &modem) {
+    for (size_t i = 0; i < SIM_MESSAGES; i++) {
+        modem.newSession();
+        uint32_t elapsed = 0;
+        bool sent = false;
+        // a session that started in time completes
+        while (!sent && elapsed < simSessionTime(i)) {
+            uint8_t signal = modem.csq();
+            modem.advance(SIM_CSQ_TIME);
+            elapsed += SIM_CSQ_TIME;
+            if (signal < SIM_SEND_THRESHOLD) { continue; }
+            sent = modem.sbdix() == 0;
+            elapsed += SIM_SBDIX_TIME;
+        }
+        if (!sent) { modem.timeouts++; }
+    }
+}
+
+// time in ms as the policy expects it, the policy persists across messages
+static void simulatePolicy(SimulatedModem &modem) {
+    RetryPolicy policy;
+    uint32_t now = 0;
+    for (size_t i = 0; i < SIM_MESSAGES; i++) {
+        modem.newSession();
+        uint32_t start = now;
+        bool sent = false;
+        policy.reset(now);
+        policy.setDeadline(start + simSessionTime(i) * 1000);
+        while (!sent && now - start < simSessionTime(i) * 1000) {
+            if (!policy.readyToPoll(now)) {
+                now += 1000;
+                modem.advance(1);
+                continue;
+            }
+            uint8_t signal = policy.addReading(modem.csq());
+            policy.polled(now);
+            if (!policy.shouldAttempt(signal, now)) { continue; }
+            uint8_t code = modem.sbdix();
+            now += SIM_SBDIX_TIME * 1000;
+            policy.onResult(signal, code, now);
+            sent = code == 0;
+        }
+        if (!sent) { modem.timeouts++; }
+        // sleep until the next message
+        now += 600000;
+    }
+}
+
+void benchRetryPolicyVsLegacy() {
+    char report[256] = {0};
+    SimulatedModem legacy(12345);
+    SimulatedModem adaptive(12345);
+    simulateLegacy(legacy);
+    simulatePolicy(adaptive);
+
+    double legacyRatio = (double) legacy.attempts / legacy.successes;
+    double adaptiveRatio = (double) adaptive.attempts / adaptive.successes;
+    snprintf(report, sizeof(report),
+        "legacy:   %.2f SBDIX/message, %lu signal polls, %lu of %d timed out",
+        legacyRatio, (unsigned long) legacy.polls,
+        (unsigned long) legacy.timeouts, SIM_MESSAGES);
+    TEST_MESSAGE(report);
+    snprintf(report, sizeof(report),
+        "adaptive: %.2f SBDIX/message, %lu signal polls, %lu of %d timed out",
+        adaptiveRatio, (unsigned long) adaptive.polls,
+        (unsigned long) adaptive.timeouts, SIM_MESSAGES);
+    TEST_MESSAGE(report);
+
+    TEST_ASSERT_LESS_THAN_DOUBLE(legacyRatio, adaptiveRatio);
+    TEST_ASSERT_LESS_THAN(legacy.polls, adaptive.polls);
+    // fewer sessions must not cost reports
+    TEST_ASSERT_LESS_OR_EQUAL(legacy.timeouts, adaptive.timeouts);
+}
@@ -0,0 +1,109 @@
+/*
+ * Compare the Rockblock serial stream handling before and after the ring
+ * buffer, each with the frame parser of its time, as Rockblock::run() uses
+ * them. Data is fed in chunks as it would arrive between two polls. Chunks
+ * end on a line boundary since the legacy code reads past the end of the
+ * stream if a status token arrives without its line ending.
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <ringBuffer.h>
+#include <frameParser.h>
+#include "bench.h"
+#include "legacy.h"
+
+#define BENCH_FRAMES 20000
+#define BENCH_CHUNK 64
+
+static const char* benchFrames[] = {
+    "AT+CSQ\r\n+CSQ:4\r\n\r\nOK\r\n",
+    "AT+SBDWT\r\nREADY\r\n",
+    "PK101;lat:3750.5119,NS:N,lon:12216.5280,EW:W,utc:194031,batt:3.7,"
+        "int:10,sl:0,st:0\r\n0\r\n\r\nOK\r\n",
+    "AT+SBDIX\r\n+SBDIX: 0, 12, 1, 3, 15, 0\r\n\r\nOK\r\n",
+    "AT+SBDRT\r\n+SBDRT:\r\n+DATA:PK006,60;\r\n\r\nOK\r\n",
+};
+
+// Build a long stream of frames once, so that both runs use the same input
+static size_t buildBenchStream(char* bfr, size_t size, size_t* frames) {
+    size_t len = 0;
+    *frames = 0;
+    for (size_t i = 0; i < BENCH_FRAMES; i++) {
+        const char* frame = benchFrames[i % 5];
+        size_t frame_len = strlen(frame);
+        if (len + frame_len >= size) { break; }
+        memcpy(bfr + len, frame, frame_len);
+        len += frame_len;
+        (*frames)++;
+    }
+    return len;
+}
+
+// Length of the next chunk starting at pos, extended to the next line end
+static size_t nextChunk(const char* bfr, size_t pos, size_t len) {
+    size_t end = (pos + BENCH_CHUNK < len) ? pos + BENCH_CHUNK : len;
+    while (end < len && bfr[end - 1] != '\n') { end++; }
+    return end - pos;
+}
+
+void benchRingBufferVsLegacy() {
+    static char input[BENCH_FRAMES * 96];
+    static char legacyStream[1024];
+    char frame[512] = {0};
+    char report[256] = {0};
+    size_t frames = 0;
+    size_t len = buildBenchStream(input, sizeof(input), &frames);
+
+    // legacy path
+    LegacyFrameParser legacy;
+    size_t legacyFrames = 0;
+    legacy_copied = 0;
+    legacyStream[0] = '\0';
+    auto start = std::chrono::steady_clock::now();
+    for (size_t pos = 0, chunk = 0; pos < len; pos += chunk) {
+        chunk = nextChunk(input, pos, len);
+        legacyAppend(legacyStream, sizeof(legacyStream), input + pos, chunk);
+        while (true) {
+            legacyExtractFrame(frame, legacyStream);
+            if (frame[0] == '\0') { break; }
+            legacy.parse(frame);
+            legacyFrames++;
+        }
+    }
+    double legacySeconds = secondsSince(start);
+
+    // ring buffer path, the parser reads views and frames are never copied
+    RingBuffer stream;
+    FrameParser parser;
+    size_t ringFrames = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t pos = 0, chunk = 0; pos < len; pos += chunk) {
+        chunk = nextChunk(input, pos, len);
+        stream.write(input + pos, chunk);
+        while (stream.size() > 0) {
+            stream.consume(parser.feed(stream.view(0, stream.size())));
+            if (!parser.complete) { break; }
+            parser.reset();
+            ringFrames++;
+        }
+    }
+    double ringSeconds = secondsSince(start);
+    // the only copy is from the serial into the buffer
+    size_t ringCopied = len;
+
+    snprintf(report, sizeof(report),
+        "legacy: %.0f bytes/s, %.1f bytes copied/frame, %zu frames",
+        len / legacySeconds, (double) legacy_copied / legacyFrames,
+        legacyFrames);
+    TEST_MESSAGE(report);
+    snprintf(report, sizeof(report),
+        "ring:   %.0f bytes/s, %.1f bytes copied/frame, %zu frames, "
+        "%u bytes dropped",
+        len / ringSeconds, (double) ringCopied / ringFrames, ringFrames,
+        stream.dropped_bytes);
+    TEST_MESSAGE(report);
+
+    TEST_ASSERT_EQUAL_INT(frames, ringFrames);
+    TEST_ASSERT_EQUAL_INT(0, stream.dropped_bytes);
+    TEST_ASSERT_LESS_THAN(legacy_copied, ringCopied);
+}
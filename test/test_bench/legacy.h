@@ -0,0 +1,393 @@
+/*
+ * Reference copies of the serial stream handling and frame parsing Rockblock
+ * used before the ring buffer and the streaming parser, and of the NMEA
+ * decoding Gps used before NmeaParser. Only used to compare against in
+ * benchmarks. Byte copies are counted in legacy_copied.
+ */
+#ifndef __LEGACY_H__
+#define __LEGACY_H__
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ctype.h>
+
+static size_t legacy_copied = 0;
+
+/*
+ * Former Rockblock::readAndAppendResponse(), reading from a buffer instead
+ * of the serial.
+ */
+void legacyAppend(char* stream, size_t stream_size, const char* data,
+    size_t len
+) {
+    char bfr[255] = {0};
+    size_t idx = 0;
+    size_t remainingSpace = stream_size - strlen(stream) - 1;
+    for (size_t i = 0; i < len; i++) {
+        bfr[idx] = data[i];
+        if (idx > 253) { break; }
+        else idx++;
+    }
+    legacy_copied += idx;
+    legacy_copied += (idx < remainingSpace) ? idx : remainingSpace;
+    strncat(stream, bfr, remainingSpace);
+}
+
+/*
+ * Former extractFrame() in rockblock.cpp
+ */
+void legacyExtractFrame(char* bfr, char* serialBuffer) {
+    const char* stringConstants[] = {"OK", "ERROR", "READY"};
+    const char* pos = nullptr;
+    size_t len = 0;
+    size_t idx = 0;
+    for (idx = 0; idx < 3; idx++) {
+        pos = strstr(serialBuffer, stringConstants[idx]);
+        if (pos != nullptr) { break; }
+    }
+    if (pos == nullptr) {
+        bfr[0] = '\0';
+        return;
+    }
+    len = pos + strlen(stringConstants[idx]) + 2 - serialBuffer;
+    memcpy(bfr, serialBuffer, len);
+    bfr[len] = '\0';
+    legacy_copied += len;
+    legacy_copied += strlen(pos + strlen(stringConstants[idx]) + 2) + 1;
+    strcpy(serialBuffer, pos + strlen(stringConstants[idx]) + 2);
+}
+
+/*
+ * Former FrameParser from rockblock.cpp
+ */
+char* legacyStrsepMulti(char** stringp, const char* delim) {
+    if (*stringp == NULL) { return NULL; }
+    char* start = *stringp;
+    char* end = strstr(start, delim);
+    if (end) {
+        *end = '\0';
+        *stringp = end + strlen(delim);
+    } else {
+        *stringp = NULL;
+    }
+    return start;
+}
+
+class LegacyFrameParser {
+    private:
+        void parseResponse(const char* line) {
+            char* rest_ptr = nullptr;
+            char copy_of_line[512] = {0};
+            strncpy(copy_of_line, line, 511);
+            char* token = strtok_r(copy_of_line, ":", &rest_ptr);
+            token = strtok_r(nullptr, ",", &rest_ptr);
+            this->values.clear();
+            while (token != nullptr) {
+                this->values.push_back(std::stoi(token));
+                token = strtok_r(nullptr, ",", &rest_ptr);
+            }
+        }
+    public:
+        char command[256] = {0};
+        char response[128] = {0};
+        int status = 0;
+        std::vector<int16_t> values;
+        char payload[340] = {0};
+        void parse(const char* frame) {
+            char* rest = strdup(frame);
+            char* token = nullptr;
+            size_t pld_idx = 0;
+            size_t idx = 0;
+            memset(this->command, 0, 256);
+            memset(this->response, 0, 128);
+            memset(this->payload, 0, 340);
+            char pld[340] = {0};
+            this->status = 0;
+            while ( (token = legacyStrsepMulti(&rest, "\r\n")) != NULL ) {
+                if (idx==0) { strncpy(this->command, token, 255); }
+                if (idx==1) {
+                    if (token[0] == '+') {
+                        memset(this->response, 0, 128);
+                        strncpy(this->response, token, 127);
+                        this->parseResponse(token);
+                    } else {
+                        this->response[0] = '\0';
+                    }
+                }
+                if (idx > 0) {
+                    if (strstr(token, "OK") != nullptr) {
+                        this->status = 1; continue;
+                    } else if (strstr(token, "ERROR") != nullptr) {
+                        this->status = 3; continue;
+                    } else if (strstr(token, "READY") != nullptr) {
+                        this->status = 2; continue;
+                    }
+                }
+                if ( (idx == 2 && token[0] != '\0') || (idx > 2 && pld_idx > 0) ) {
+                    if (pld_idx > 0) {
+                        memcpy(pld + pld_idx, "\r\n", 2);
+                        pld_idx += 2;
+                    }
+                    strncpy(pld + pld_idx, token, 340 - pld_idx);
+                    pld_idx += strlen(token);
+                }
+                if (token[0] != 0) { idx++; }
+            }
+            if (pld_idx > 2) { strncpy(this->payload, pld, pld_idx-2); }
+            free(rest);
+        }
+};
+
+/*
+ * Model of how TinyGPSPlus (1.0.3) decodes NMEA, which Gps used before the
+ * in-tree parser: terms are copied into a buffer, the sentence type is found
+ * with strcmp, numbers are parsed with atol and kept per field with an
+ * updated flag, values are committed once the checksum matches. Only the
+ * fields Gps used are modelled, altitude is kept since TinyGPSPlus parses it
+ * too. Accessors return doubles and clear the updated flag.
+ */
+struct LegacyGpsField {
+    bool valid = false;
+    bool updated = false;
+    long value = 0;
+    long staged = 0;
+    void commit() { this->value = this->staged; this->valid = true;
+        this->updated = true; }
+};
+
+class LegacyNmeaParser {
+    private:
+        enum { GPS_RMC, GPS_GGA, GPS_OTHER } type = GPS_OTHER;
+        char term[15] = {0};
+        uint8_t term_offset = 0;
+        uint8_t term_number = 0;
+        uint8_t parity = 0;
+        bool checksum_term = false;
+        bool has_fix = false;
+        long lat_deg = 0, lat_billionths = 0, lng_deg = 0, lng_billionths = 0;
+        bool lat_negative = false, lng_negative = false;
+        long staged_lat_deg = 0, staged_lat_billionths = 0;
+        long staged_lng_deg = 0, staged_lng_billionths = 0;
+        bool staged_lat_negative = false, staged_lng_negative = false;
+
+        static int fromHex(char a) {
+            if (a >= 'A' && a <= 'F') { return a - 'A' + 10; }
+            else if (a >= 'a' && a <= 'f') { return a - 'a' + 10; }
+            return a - '0';
+        }
+
+        // hundredths, e.g. "12.34" is 1234
+        static long parseDecimal(const char *term) {
+            bool negative = *term == '-';
+            if (negative) { ++term; }
+            long ret = 100 * atol(term);
+            while (isdigit(*term)) { ++term; }
+            if (*term == '.' && isdigit(term[1])) {
+                ret += 10 * (term[1] - '0');
+                if (isdigit(term[2])) { ret += term[2] - '0'; }
+            }
+            return negative ? -ret : ret;
+        }
+
+        static void parseDegrees(const char *term, long *deg,
+            long *billionths
+        ) {
+            uint32_t left = atol(term);
+            uint16_t minutes = (uint16_t) (left % 100UL);
+            uint32_t multiplier = 10000000UL;
+            uint32_t tenMillionths = minutes * multiplier;
+            *deg = (int16_t) (left / 100);
+            while (isdigit(*term)) { ++term; }
+            if (*term == '.') {
+                while (isdigit(*++term)) {
+                    multiplier /= 10;
+                    tenMillionths += (*term - '0') * multiplier;
+                }
+            }
+            *billionths = (5 * tenMillionths + 1) / 3;
+        }
+
+        bool endOfTerm() {
+            if (this->checksum_term) {
+                uint8_t checksum = 16 * fromHex(this->term[0]) +
+                    fromHex(this->term[1]);
+                if (checksum != this->parity) { return false; }
+                if (this->type == GPS_RMC) {
+                    this->date.commit();
+                    this->time.commit();
+                    if (this->has_fix) {
+                        this->commitLocation();
+                        this->speed.commit();
+                        this->course.commit();
+                    }
+                } else if (this->type == GPS_GGA) {
+                    this->time.commit();
+                    if (this->has_fix) {
+                        this->commitLocation();
+                        this->altitude.commit();
+                    }
+                    this->satellites.commit();
+                    this->hdop.commit();
+                }
+                return true;
+            }
+            if (this->term_number == 0) {
+                if (
+                    !strcmp(this->term, "GPRMC") || !strcmp(this->term, "GNRMC")
+                ) {
+                    this->type = GPS_RMC;
+                } else if (
+                    !strcmp(this->term, "GPGGA") || !strcmp(this->term, "GNGGA")
+                ) {
+                    this->type = GPS_GGA;
+                } else {
+                    this->type = GPS_OTHER;
+                }
+                return false;
+            }
+            if (this->type == GPS_OTHER || !this->term[0]) { return false; }
+            bool rmc = this->type == GPS_RMC;
+            switch (this->term_number) {
+                case 1: this->time.staged = parseDecimal(this->term); break;
+                case 2:
+                    if (rmc) { this->has_fix = this->term[0] == 'A'; }
+                    else {
+                        parseDegrees(this->term, &this->staged_lat_deg,
+                            &this->staged_lat_billionths);
+                    }
+                    break;
+                case 3:
+                    if (rmc) {
+                        parseDegrees(this->term, &this->staged_lat_deg,
+                            &this->staged_lat_billionths);
+                    } else {
+                        this->staged_lat_negative = this->term[0] == 'S';
+                    }
+                    break;
+                case 4:
+                    if (rmc) {
+                        this->staged_lat_negative = this->term[0] == 'S';
+                    } else {
+                        parseDegrees(this->term, &this->staged_lng_deg,
+                            &this->staged_lng_billionths);
+                    }
+                    break;
+                case 5:
+                    if (rmc) {
+                        parseDegrees(this->term, &this->staged_lng_deg,
+                            &this->staged_lng_billionths);
+                    } else {
+                        this->staged_lng_negative = this->term[0] == 'W';
+                    }
+                    break;
+                case 6:
+                    if (rmc) {
+                        this->staged_lng_negative = this->term[0] == 'W';
+                    } else {
+                        this->has_fix = this->term[0] > '0';
+                    }
+                    break;
+                case 7:
+                    if (rmc) { this->speed.staged = parseDecimal(this->term); }
+                    else { this->satellites.staged = atol(this->term); }
+                    break;
+                case 8:
+                    if (rmc) { this->course.staged = parseDecimal(this->term); }
+                    else { this->hdop.staged = parseDecimal(this->term); }
+                    break;
+                case 9:
+                    if (rmc) { this->date.staged = atol(this->term); }
+                    else { this->altitude.staged = parseDecimal(this->term); }
+                    break;
+                default: break;
+            }
+            return false;
+        }
+
+        void commitLocation() {
+            this->lat_deg = this->staged_lat_deg;
+            this->lat_billionths = this->staged_lat_billionths;
+            this->lat_negative = this->staged_lat_negative;
+            this->lng_deg = this->staged_lng_deg;
+            this->lng_billionths = this->staged_lng_billionths;
+            this->lng_negative = this->staged_lng_negative;
+            this->location.valid = true;
+            this->location.updated = true;
+        }
+
+    public:
+        LegacyGpsField time, date, location, speed, course, altitude;
+        LegacyGpsField satellites, hdop;
+
+        bool encode(char c) {
+            bool valid_sentence = false;
+            switch (c) {
+                case ',':
+                    this->parity ^= (uint8_t) c;
+                    // fall through
+                case '\r':
+                case '\n':
+                case '*':
+                    if (this->term_offset < sizeof(this->term)) {
+                        this->term[this->term_offset] = 0;
+                        valid_sentence = this->endOfTerm();
+                    }
+                    ++this->term_number;
+                    this->term_offset = 0;
+                    this->checksum_term = c == '*';
+                    return valid_sentence;
+                case '$':
+                    this->term_number = this->term_offset = 0;
+                    this->parity = 0;
+                    this->type = GPS_OTHER;
+                    this->checksum_term = false;
+                    this->has_fix = false;
+                    return false;
+                default:
+                    if (this->term_offset < sizeof(this->term) - 1) {
+                        this->term[this->term_offset++] = c;
+                    }
+                    if (!this->checksum_term) { this->parity ^= c; }
+                    return false;
+            }
+        }
+
+        double lat() {
+            this->location.updated = false;
+            double ret = this->lat_deg + this->lat_billionths / 1000000000.0;
+            return this->lat_negative ? -ret : ret;
+        }
+
+        double lng() {
+            this->location.updated = false;
+            double ret = this->lng_deg + this->lng_billionths / 1000000000.0;
+            return this->lng_negative ? -ret : ret;
+        }
+};
+
+/*
+ * Former acceptance check of Gps::loop() after each poll: time, date and
+ * location valid and updated since the last fix
+ */
+bool legacyGpsPoll(LegacyNmeaParser &parser, const char *bfr, size_t len,
+    double *lat, double *lng
+) {
+    for (size_t i = 0; i < len; i++) { parser.encode(bfr[i]); }
+    if (
+        parser.time.valid && parser.time.updated &&
+        parser.date.valid && parser.date.updated &&
+        parser.location.valid && parser.location.updated
+    ) {
+        *lat = parser.lat();
+        *lng = parser.lng();
+        parser.time.updated = false;
+        parser.date.updated = false;
+        return true;
+    }
+    return false;
+}
+
+#endif /* __LEGACY_H__ */
@@ -0,0 +1,24 @@
+#include <unity.h>
+#include "bench_ringBuffer.h"
+#include "bench_frameParser.h"
+#include "bench_retryPolicy.h"
+#include "bench_nmea.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+/*
+ * Benchmarks running on the development machine (native environment). They
+ * print their results and check only for plausibility, timings depend on the
+ * host.
+ */
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(benchRingBufferVsLegacy);
+    RUN_TEST(benchFrameParserVsLegacy);
+    RUN_TEST(benchRetryPolicyVsLegacy);
+    RUN_TEST(benchNmeaVsTinyGps);
+    RUN_TEST(benchUbxVsNmea);
+    return UNITY_END();
+}
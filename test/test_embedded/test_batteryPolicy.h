@@ -0,0 +1,76 @@
+#include <unity.h>
+#include <batteryPolicy.h>
+
+
+void testBatteryPolicyLevels() {
+    BatteryPolicy policy;
+    TEST_ASSERT_EQUAL_INT(BATTERY_NORMAL, policy.update(4.0));
+    TEST_ASSERT_EQUAL_INT(BATTERY_LOW, policy.update(3.45));
+    // back to normal only above the hysteresis
+    TEST_ASSERT_EQUAL_INT(BATTERY_LOW, policy.update(3.52));
+    TEST_ASSERT_EQUAL_INT(BATTERY_NORMAL, policy.update(3.6));
+    // a falling battery can skip levels
+    TEST_ASSERT_EQUAL_INT(BATTERY_SAFE, policy.update(3.25));
+    TEST_ASSERT_EQUAL_INT(BATTERY_SAFE, policy.update(3.33));
+    TEST_ASSERT_EQUAL_INT(BATTERY_CRITICAL, policy.update(3.38));
+    // no battery, USB power
+    TEST_ASSERT_EQUAL_INT(BATTERY_CRITICAL, policy.update(0.1));
+    TEST_ASSERT_EQUAL_INT(BATTERY_CRITICAL, policy.level());
+    TEST_ASSERT_EQUAL_INT(BATTERY_NORMAL, policy.update(4.1));
+}
+
+void testBatteryPolicySag() {
+    BatteryPolicy policy;
+    policy.onLoad(4.0, 3.8);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.2, policy.getHealth().sag);
+    policy.onLoad(4.0, 3.6);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.3, policy.getHealth().sag);
+    TEST_ASSERT_EQUAL_INT(2, policy.getHealth().samples);
+    // readings without battery are ignored
+    policy.onLoad(4.0, 0.5);
+    TEST_ASSERT_EQUAL_INT(2, policy.getHealth().samples);
+    // fine at rest, low under load
+    TEST_ASSERT_EQUAL_INT(BATTERY_LOW, policy.update(3.75));
+    // the sag is kept with the state
+    BatteryPolicy restored;
+    restored.setHealth(policy.getHealth());
+    TEST_ASSERT_EQUAL_INT(BATTERY_LOW, restored.level());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.3, restored.getHealth().sag);
+    // later sessions are followed exponentially
+    for (uint8_t i = 0; i < 20; i++) { restored.onLoad(4.0, 3.9); }
+    TEST_ASSERT_EQUAL_INT(BATTERY_SAG_SAMPLES, restored.getHealth().samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0.1, restored.getHealth().sag);
+}
+
+void testBatteryPolicyLimits() {
+    BatteryPolicy policy;
+    batteryHealth health;
+    TEST_ASSERT_EQUAL_UINT32(600, policy.interval(600));
+    TEST_ASSERT_EQUAL_UINT16(300, policy.gpsTimeout(300));
+    TEST_ASSERT_TRUE(policy.retry());
+    TEST_ASSERT_TRUE(policy.extras());
+    health.level = BATTERY_LOW;
+    policy.setHealth(health);
+    TEST_ASSERT_EQUAL_UINT32(1200, policy.interval(600));
+    TEST_ASSERT_EQUAL_UINT16(
+        BATTERY_LOW_GPS_TIME_OUT, policy.gpsTimeout(300));
+    TEST_ASSERT_EQUAL_UINT16(90, policy.gpsTimeout(90));
+    TEST_ASSERT_EQUAL_UINT16(300, policy.systemTimeout(300));
+    TEST_ASSERT_TRUE(policy.retry());
+    TEST_ASSERT_FALSE(policy.extras());
+    health.level = BATTERY_CRITICAL;
+    policy.setHealth(health);
+    TEST_ASSERT_EQUAL_UINT32(BATTERY_CRITICAL_INTERVAL, policy.interval(600));
+    // longer intervals are kept
+    TEST_ASSERT_EQUAL_UINT32(86400, policy.interval(86400));
+    TEST_ASSERT_EQUAL_UINT16(
+        BATTERY_CRITICAL_GPS_TIME_OUT, policy.gpsTimeout(300));
+    TEST_ASSERT_EQUAL_UINT16(
+        BATTERY_CRITICAL_SYSTEM_TIME_OUT, policy.systemTimeout(300));
+    TEST_ASSERT_FALSE(policy.retry());
+    TEST_ASSERT_FALSE(policy.skipGps());
+    health.level = BATTERY_SAFE;
+    policy.setHealth(health);
+    TEST_ASSERT_EQUAL_UINT32(BATTERY_SAFE_INTERVAL, policy.interval(600));
+    TEST_ASSERT_TRUE(policy.skipGps());
+}
@@ -0,0 +1,125 @@
+#include <unity.h>
+#include <string.h>
+#include <commandQueue.h>
+
+
+// Records what the queue sends
+class RecordingSerial: public AbstractSerial {
+    public:
+        char sent[128] = {0};
+        size_t sent_len = 0;
+        void begin(uint32_t serialSpeed, int serial8N1,
+            uint8_t rxPin, uint8_t txPin) override {};
+        void print(const char *bfr) override {
+            this->write((const uint8_t*) bfr, strlen(bfr));
+        }
+        size_t write(const uint8_t *bfr, size_t len) override {
+            memcpy(this->sent, bfr, len);
+            this->sent_len = len;
+            this->sent[len] = '\0';
+            return len;
+        }
+        char read() override { return 0; }
+        bool available() override { return false; }
+};
+
+void testCommandQueueOrder() {
+    RecordingSerial serial;
+    CommandQueue queue;
+    int order[3] = {0};
+    int calls = 0;
+    TEST_ASSERT_TRUE(queue.idle());
+    queue.push("+SBDD2", [&](CommandResult r) { order[calls++] = 1; });
+    queue.push("+CSQ", [&](CommandResult r) { order[calls++] = 2; });
+    queue.push("+SBDMTA=1", [&](CommandResult r) { order[calls++] = 3; },
+        OK_STATUS, DEFAULT_COMMAND_TIMEOUT, PRIORITY_HIGH);
+    // higher priority first, then in order
+    FrameParser parser;
+    const char* frames[] = {
+        "AT+SBDMTA=1\r\nOK\r\n", "AT+SBDD2\r\n0\r\n\r\nOK\r\n",
+        "AT+CSQ\r\n+CSQ:4\r\n\r\nOK\r\n"};
+    const char* expected[] = {"AT+SBDMTA=1\r\n", "AT+SBDD2\r\n", "AT+CSQ\r\n"};
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_NOT_NULL(queue.start(&serial, 0));
+        TEST_ASSERT_EQUAL_STRING(expected[i], serial.sent);
+        // one command in flight
+        TEST_ASSERT_NULL(queue.start(&serial, 0));
+        parser.parse(frames[i]);
+        TEST_ASSERT_TRUE(queue.complete(parser));
+    }
+    TEST_ASSERT_TRUE(queue.idle());
+    TEST_ASSERT_EQUAL_INT(3, order[0]);
+    TEST_ASSERT_EQUAL_INT(1, order[1]);
+    TEST_ASSERT_EQUAL_INT(2, order[2]);
+}
+
+void testCommandQueueResults() {
+    RecordingSerial serial;
+    CommandQueue queue;
+    FrameParser parser;
+    CommandResult result = COMMAND_OK;
+    queue.push("+SBDWT", [&](CommandResult r) { result = r; }, READY_STATUS);
+    queue.start(&serial, 0);
+    // the echo does not match, e.g. a late response
+    parser.parse("AT+CSQ\r\n+CSQ:4\r\n\r\nOK\r\n");
+    TEST_ASSERT_FALSE(queue.complete(parser));
+    TEST_ASSERT_TRUE(queue.busy());
+    // OK instead of READY
+    parser.parse("AT+SBDWT\r\nOK\r\n");
+    TEST_ASSERT_TRUE(queue.complete(parser));
+    TEST_ASSERT_EQUAL_INT(COMMAND_ERROR, result);
+    // raw data has no echo
+    const uint8_t data[] = {'h', 'i', '\r'};
+    queue.pushRaw(data, 3, [&](CommandResult r) { result = r; });
+    queue.start(&serial, 0);
+    TEST_ASSERT_EQUAL_STRING("hi\r", serial.sent);
+    parser.parse("\r\n0\r\n\r\nOK\r\n");
+    TEST_ASSERT_TRUE(queue.complete(parser));
+    TEST_ASSERT_EQUAL_INT(COMMAND_OK, result);
+}
+
+void testCommandQueueTimeout() {
+    RecordingSerial serial;
+    CommandQueue queue;
+    CommandResult result = COMMAND_OK;
+    bool next = false;
+    queue.push("+SBDIX", [&](CommandResult r) {
+        result = r;
+        // the callback may queue the next command
+        queue.push("+CSQ", [&](CommandResult r) { next = true; });
+    }, OK_STATUS, 60000);
+    queue.start(&serial, 1000);
+    TEST_ASSERT_FALSE(queue.checkTimeout(60999));
+    TEST_ASSERT_TRUE(queue.checkTimeout(61000));
+    TEST_ASSERT_EQUAL_INT(COMMAND_TIMEOUT, result);
+    TEST_ASSERT_FALSE(queue.busy());
+    TEST_ASSERT_NOT_NULL(queue.start(&serial, 61000));
+    TEST_ASSERT_EQUAL_STRING("AT+CSQ\r\n", serial.sent);
+    // dropped without callback
+    queue.clear();
+    TEST_ASSERT_TRUE(queue.idle());
+    TEST_ASSERT_FALSE(next);
+}
+
+void testCommandQueueWithoutEcho() {
+    RecordingSerial serial;
+    CommandQueue queue;
+    FrameParser parser;
+    CommandResult result = COMMAND_ERROR;
+    parser.setTerse(true);
+    queue.push("+SBDIXA", [&](CommandResult r) { result = r; });
+    queue.start(&serial, 0);
+    // a late response to another command
+    parser.parse("+CSQ:4\r\n0\r");
+    TEST_ASSERT_FALSE(queue.complete(parser));
+    // +SBDIXA answers with +SBDIX:
+    parser.parse("+SBDIX: 0, 1, 0, 0, 0, 0\r\n0\r");
+    TEST_ASSERT_TRUE(queue.complete(parser));
+    TEST_ASSERT_EQUAL_INT(COMMAND_OK, result);
+    // result code only
+    queue.push("+SBDMTA=1", [&](CommandResult r) { result = r; });
+    queue.start(&serial, 0);
+    parser.parse("4\r");
+    TEST_ASSERT_TRUE(queue.complete(parser));
+    TEST_ASSERT_EQUAL_INT(COMMAND_ERROR, result);
+}
@@ -0,0 +1,42 @@
+#include <unity.h>
+#include <courseAverage.h>
+
+
+void testCourseAverage() {
+    CourseAverage average;
+    TEST_ASSERT_EQUAL_UINT16(0, average.samples());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0, average.speed());
+    TEST_ASSERT_TRUE(average.add(1000, 2, 90));
+    TEST_ASSERT_TRUE(average.add(1001, 1, 90));
+    // the same fix again
+    TEST_ASSERT_FALSE(average.add(1001, 1, 90));
+    TEST_ASSERT_EQUAL_UINT16(2, average.samples());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.5, average.speed());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 90, average.course());
+    average.reset();
+    TEST_ASSERT_EQUAL_UINT16(0, average.samples());
+}
+
+void testCourseAverageAroundNorth() {
+    CourseAverage average;
+    // 350 and 10 degrees average to north, not to south
+    average.add(1000, 1, 350);
+    average.add(1001, 1, 10);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0.985, average.speed());
+    float course = average.course();
+    TEST_ASSERT_TRUE(course < 0.01 || course > 359.99);
+    average.add(1002, 1, 290);
+    average.add(1003, 1, 290);
+    TEST_ASSERT_TRUE(average.course() > 300 && average.course() < 330);
+}
+
+void testCourseAverageSwinging() {
+    CourseAverage average;
+    // waves swing the buoy back and forth, it drifts east at 0.5 knots
+    for (int i = 0; i < 10; i++) {
+        average.add(1000 + 2 * i, 2.5, 90);
+        average.add(1001 + 2 * i, 1.5, 270);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0.5, average.speed());
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 90, average.course());
+}
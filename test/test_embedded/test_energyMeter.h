@@ -0,0 +1,91 @@
+#include <unity.h>
+#include <energyMeter.h>
+
+
+void testEnergyMeter() {
+    EnergyMeter meter;
+    meter.set(LOAD_CPU, true, 0);
+    // 30 s GPS, then 60 s Rockblock with a 10 s session
+    meter.set(LOAD_GPS, true, 1000);
+    meter.set(LOAD_GPS, false, 31000);
+    meter.set(LOAD_ROCKBLOCK, true, 31000);
+    meter.set(LOAD_SBDIX, true, 40000);
+    // switching on again keeps the start
+    meter.set(LOAD_SBDIX, true, 45000);
+    meter.set(LOAD_SBDIX, false, 50000);
+    TEST_ASSERT_TRUE(meter.isOn(LOAD_ROCKBLOCK));
+    TEST_ASSERT_FALSE(meter.isOn(LOAD_SBDIX));
+    meter.update(91000);
+    energyTotals totals = meter.getTotals();
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 91 * ENERGY_CPU_MA, totals.charge[LOAD_CPU]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 30 * ENERGY_GPS_MA, totals.charge[LOAD_GPS]);
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.01, 60 * ENERGY_ROCKBLOCK_MA, totals.charge[LOAD_ROCKBLOCK]);
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.01, 10 * ENERGY_SBDIX_MA, totals.charge[LOAD_SBDIX]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 91, totals.seconds);
+    // update does not count twice
+    meter.update(91000);
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.01, 91 * ENERGY_CPU_MA, meter.getTotals().charge[LOAD_CPU]);
+    // a day at this rate
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.01, 30 * ENERGY_GPS_MA * 24.0 / 91, energyPerDay(totals, LOAD_GPS));
+    float total = (91 * ENERGY_CPU_MA + 30 * ENERGY_GPS_MA +
+        60 * ENERGY_ROCKBLOCK_MA + 10 * ENERGY_SBDIX_MA) / 3600.0;
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.01, total * 86400 / 91, energyPerDay(totals, ENERGY_LOADS));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, total, meter.phase());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0, meter.phase());
+}
+
+void testEnergySleep() {
+    EnergyMeter meter;
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0, energyPerDay(meter.getTotals(), 0));
+    meter.set(LOAD_CPU, true, 0);
+    meter.update(100000);
+    meter.startSleep(500);
+    // restored after the timer wake up
+    EnergyMeter woken;
+    woken.setTotals(meter.getTotals());
+    woken.wake(true);
+    energyTotals totals = woken.getTotals();
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.001, 500 * ENERGY_SLEEP_MA, totals.charge[LOAD_SLEEP]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 600, totals.seconds);
+    TEST_ASSERT_EQUAL_UINT32(0, totals.sleep);
+    // the sleep is not part of the phase awake
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0, woken.phase());
+    // reset during the sleep
+    EnergyMeter reset;
+    reset.setTotals(meter.getTotals());
+    reset.wake(false);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0, reset.getTotals().charge[LOAD_SLEEP]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 100, reset.getTotals().seconds);
+}
+
+void testEnergyLightSleep() {
+    EnergyMeter meter;
+    meter.set(LOAD_CPU, true, 0);
+    // busy for 10 s until power management is on
+    meter.setPowerManaged(true, 10000);
+    // 20 s with a lock held, two locks overlap
+    meter.lock(true, 30000);
+    meter.lock(true, 35000);
+    meter.lock(false, 40000);
+    meter.lock(false, 50000);
+    // 40 s in light sleep between locks
+    meter.update(90000);
+    energyTotals totals = meter.getTotals();
+    TEST_ASSERT_FLOAT_WITHIN(0.01,
+        30 * ENERGY_CPU_MA + 60 * ENERGY_LIGHT_SLEEP_MA,
+        totals.charge[LOAD_CPU]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 90, totals.seconds);
+    // without power management the CPU is always busy
+    EnergyMeter busy;
+    busy.set(LOAD_CPU, true, 0);
+    busy.setPowerManaged(false, 10000);
+    busy.update(90000);
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.01, 90 * ENERGY_CPU_MA, busy.getTotals().charge[LOAD_CPU]);
+}
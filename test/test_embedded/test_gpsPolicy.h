@@ -0,0 +1,107 @@
+#include <unity.h>
+#include <gpsPolicy.h>
+
+
+void testGpsPolicyDefaultTimeout() {
+    GpsPolicy policy;
+    TEST_ASSERT_EQUAL_UINT16(GPS_TIME_OUT, policy.timeout());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1, policy.successRate());
+    TEST_ASSERT_EQUAL_UINT16(GPS_ACCEPT_HDOP, policy.acceptHdop());
+}
+
+void testGpsPolicyLearnsTimeout() {
+    GpsPolicy policy;
+    // quick fixes shorten the timeout once they outweigh the prior
+    for (int i = 0; i < 10; i++) { policy.onFix(25000, 90, 9, false); }
+    TEST_ASSERT_EQUAL_UINT16(GPS_TIME_OUT, policy.timeout());
+    for (int i = 0; i < 10; i++) { policy.onFix(25000, 90, 9, false); }
+    TEST_ASSERT_EQUAL_UINT16(GPS_MIN_TIME_OUT, policy.timeout());
+    // some slower ones, 90% within 45 s
+    for (int i = 0; i < 8; i++) { policy.onFix(40000, 90, 9, false); }
+    TEST_ASSERT_EQUAL_UINT16(90, policy.timeout());
+    // history survives deep sleep
+    gpsHistory history = policy.getHistory();
+    TEST_ASSERT_EQUAL_UINT8(20, history.ttff[2]);
+    TEST_ASSERT_EQUAL_UINT8(8, history.ttff[3]);
+    GpsPolicy restored;
+    restored.setHistory(history);
+    TEST_ASSERT_EQUAL_UINT16(90, restored.timeout());
+    // never above GPS_TIME_OUT
+    for (int i = 0; i < 20; i++) { restored.onFix(300000, 90, 9, false); }
+    TEST_ASSERT_EQUAL_UINT16(GPS_TIME_OUT, restored.timeout());
+}
+
+void testGpsPolicyMisses() {
+    GpsPolicy policy;
+    for (int i = 0; i < 20; i++) { policy.onFix(15000, 90, 9, false); }
+    TEST_ASSERT_EQUAL_UINT16(GPS_MIN_TIME_OUT, policy.timeout());
+    // the next wake up tries as long as possible
+    policy.onTimeout();
+    TEST_ASSERT_EQUAL_UINT16(GPS_TIME_OUT, policy.timeout());
+    // then give up early, but try long every GPS_FULL_ATTEMPT_EVERY times
+    policy.onTimeout();
+    TEST_ASSERT_EQUAL_UINT16(GPS_MISS_TIME_OUT, policy.timeout());
+    policy.onTimeout();
+    TEST_ASSERT_EQUAL_UINT16(GPS_MISS_TIME_OUT, policy.timeout());
+    policy.onTimeout();
+    TEST_ASSERT_EQUAL_UINT16(GPS_TIME_OUT, policy.timeout());
+    policy.onTimeout();
+    TEST_ASSERT_EQUAL_UINT16(GPS_MISS_TIME_OUT, policy.timeout());
+    // a fix ends the series
+    policy.onFix(15000, 90, 9, false);
+    TEST_ASSERT_EQUAL_UINT16(GPS_MIN_TIME_OUT, policy.timeout());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 23.0 / 28, policy.successRate());
+}
+
+void testGpsPolicyLowSuccessRate() {
+    GpsPolicy policy;
+    for (int i = 0; i < 4; i++) { policy.onFix(15000, 90, 9, false); }
+    for (int i = 0; i < 8; i++) { policy.onTimeout(); }
+    policy.onFix(15000, 90, 9, false);
+    // the few fixes don't tell how long to wait
+    TEST_ASSERT_LESS_THAN_FLOAT(GPS_MIN_SUCCESS_RATE, policy.successRate());
+    TEST_ASSERT_EQUAL_UINT16(GPS_TIME_OUT, policy.timeout());
+}
+
+void testGpsPolicyAcceptance() {
+    GpsPolicy policy;
+    TEST_ASSERT_TRUE(policy.acceptable(150, 6));
+    TEST_ASSERT_FALSE(policy.acceptable(150, 4));
+    TEST_ASSERT_FALSE(policy.acceptable(250, 8));
+    // unknown HDOP
+    TEST_ASSERT_TRUE(policy.acceptable(0, 5));
+    // an antenna that never does better than 3.0
+    for (int i = 0; i < 20; i++) { policy.onFix(15000, 300, 6, false); }
+    TEST_ASSERT_EQUAL_UINT16(375, policy.acceptHdop());
+    TEST_ASSERT_TRUE(policy.acceptable(350, 6));
+    TEST_ASSERT_FALSE(policy.acceptable(400, 6));
+    TEST_ASSERT_EQUAL_UINT8(6, policy.getHistory().satellites);
+}
+
+void testGpsPolicyHistoryLimit() {
+    GpsPolicy policy;
+    for (int i = 0; i < GPS_HISTORY_LIMIT; i++) {
+        policy.onFix(5000, 90, 9, false);
+    }
+    policy.onTimeout();
+    gpsHistory history = policy.getHistory();
+    TEST_ASSERT_EQUAL_UINT8(GPS_HISTORY_LIMIT / 2, history.ttff[0]);
+    TEST_ASSERT_EQUAL_UINT8(1, history.timeouts);
+    // the averages are kept
+    TEST_ASSERT_EQUAL_UINT16(GPS_HISTORY_LIMIT / 2, history.fixes[0]);
+    TEST_ASSERT_EQUAL_UINT32(5000, policy.averageTtff(false));
+}
+
+void testGpsPolicyAverageTtff() {
+    GpsPolicy policy;
+    TEST_ASSERT_EQUAL_UINT32(0, policy.averageTtff(true));
+    policy.onFix(30000, 90, 9, false);
+    policy.onFix(50000, 90, 9, false);
+    policy.onFix(8000, 90, 9, true);
+    policy.onTimeout();
+    TEST_ASSERT_EQUAL_UINT32(40000, policy.averageTtff(false));
+    TEST_ASSERT_EQUAL_UINT32(8000, policy.averageTtff(true));
+    gpsHistory history = policy.getHistory();
+    TEST_ASSERT_EQUAL_UINT16(2, history.fixes[0]);
+    TEST_ASSERT_EQUAL_UINT16(1, history.fixes[1]);
+}
@@ -171,4 +171,286 @@ void testUpdateStatefromRbMessage() {
         processRockblockMessage(test_state, bfr, true, false));
     TEST_ASSERT_EQUAL_INT((int) ERROR, test_state.mode);
     TEST_ASSERT_EQUAL_INT(1200, test_state.interval);
-}
\ No newline at end of file
+}
+void testFixQueue() {
+    fixQueue queue;
+    queuedFix fix;
+    for (uint16_t i = 0; i < FIX_QUEUE_SIZE + 2; i++) {
+        fix.seq = i;
+        queue.push(fix);
+    }
+    // oldest fixes are dropped when full
+    TEST_ASSERT_EQUAL_INT(FIX_QUEUE_SIZE, queue.size());
+    TEST_ASSERT_EQUAL_UINT16(2, queue[0].seq);
+    TEST_ASSERT_EQUAL_UINT16(FIX_QUEUE_SIZE + 1, queue[FIX_QUEUE_SIZE - 1].seq);
+    queue.pop(3);
+    TEST_ASSERT_EQUAL_INT(FIX_QUEUE_SIZE - 3, queue.size());
+    TEST_ASSERT_EQUAL_UINT16(5, queue[0].seq);
+    queue.pop(100);
+    TEST_ASSERT_EQUAL_INT(0, queue.size());
+}
+
+void testQueueUnsentFix() {
+    char bfr[255] = {0};
+    systemState test_state;
+    test_state.gps_done = true;
+    // fixes from two failed sends
+    for (uint16_t i = 1; i < 3; i++) {
+        test_state.sequence = i;
+        test_state.lat = 35 + i;
+        test_state.lng = -122;
+        test_state.gps_read_time = 1726686649 + i * 600;
+        queueUnsentFix(test_state);
+    }
+    // no fix, nothing to queue
+    test_state.lat = 999;
+    test_state.lng = 999;
+    queueUnsentFix(test_state);
+    TEST_ASSERT_EQUAL_INT(2, test_state.queue.size());
+    TEST_ASSERT_EQUAL_UINT16(1, test_state.queue[0].seq);
+    TEST_ASSERT_EQUAL_FLOAT(37, test_state.queue[1].lat);
+    TEST_ASSERT_EQUAL_UINT32(1726687849, test_state.queue[1].time);
+    // the oldest has been packed into the next message and is removed after
+    // success
+    test_state.queue_sent = 1;
+    TEST_ASSERT_EQUAL_INT((int) SLEEP_READY,
+        processRockblockMessage(test_state, bfr, true, false));
+    TEST_ASSERT_EQUAL_INT(1, test_state.queue.size());
+    TEST_ASSERT_EQUAL_UINT16(2, test_state.queue[0].seq);
+    TEST_ASSERT_EQUAL_INT(0, test_state.queue_sent);
+}
+
+void testUpdateStateFromRbInbox() {
+    char first[32] = "+DATA:PK007,86400;";
+    char second[32] = "+DATA:PK006,60;";
+    char* messages[] = {first, second};
+    size_t lengths[] = {strlen(first), strlen(second)};
+    systemState test_state;
+    test_state.interval = 900;
+    // still retrieving queued messages
+    TEST_ASSERT_EQUAL_INT((int) WAIT_FOR_RB,
+        processRockblockMessage(
+            test_state, messages, lengths, 2, false, false));
+    TEST_ASSERT_EQUAL_INT((int) SLEEP_READY,
+        processRockblockMessage(
+            test_state, messages, lengths, 2, true, false));
+    TEST_ASSERT_EQUAL_INT((int) CONFIG, test_state.mode);
+    TEST_ASSERT_EQUAL_UINT32(600, test_state.interval);
+    TEST_ASSERT_EQUAL_UINT32(3600, test_state.new_interval);
+    TEST_ASSERT_EQUAL_UINT32(86400, test_state.new_sleep);
+    TEST_ASSERT_TRUE(test_state.config_change_requested);
+}
+
+void testEstimateAiding() {
+    systemState state;
+    uint32_t position = 0;
+    uint16_t time = 0;
+    time_t now = 1E9;
+    // no fix yet
+    TEST_ASSERT_FALSE(estimateAiding(state, now, &position, &time));
+    state.last_lat = 37.5;
+    state.last_lng = -122.25;
+    state.last_fix_time = now - 600;
+    // drifting slower than AIDING_MIN_DRIFT, 10 min ago
+    state.last_speed = 0.2;
+    TEST_ASSERT_TRUE(estimateAiding(state, now, &position, &time));
+    TEST_ASSERT_EQUAL_UINT32(400, position);
+    TEST_ASSERT_EQUAL_UINT16(13, time);
+    // 2 knots for 3 hours
+    state.last_speed = 2;
+    state.last_fix_time = now - 10800;
+    TEST_ASSERT_TRUE(estimateAiding(state, now, &position, &time));
+    TEST_ASSERT_UINT32_WITHIN(2, 11211, position);
+    TEST_ASSERT_EQUAL_UINT16(217, time);
+    // learned drift, the sign does not matter
+    state.rtc_drift.ppm = -5000;
+    TEST_ASSERT_TRUE(estimateAiding(state, now, &position, &time));
+    TEST_ASSERT_EQUAL_UINT16(217, time);
+    state.rtc_drift.samples = 1;
+    TEST_ASSERT_TRUE(estimateAiding(state, now, &position, &time));
+    TEST_ASSERT_EQUAL_UINT16(55, time);
+    // too far off to help, RTC behind the last fix
+    state.last_fix_time = now - 30 * 86400;
+    TEST_ASSERT_FALSE(estimateAiding(state, now, &position, &time));
+    state.last_fix_time = now + 10;
+    TEST_ASSERT_FALSE(estimateAiding(state, now, &position, &time));
+}
+
+void testGpsRefresh() {
+    systemState state;
+    time_t now = 1E9;
+    state.bat = 4.0;
+    // never refreshed, but no fix this time
+    TEST_ASSERT_FALSE(startGpsRefresh(state, now));
+    state.ttff = 25000;
+    TEST_ASSERT_TRUE(startGpsRefresh(state, now));
+    TEST_ASSERT_TRUE(state.gps_refreshing);
+    TEST_ASSERT_EQUAL_UINT32(25000, state.gps_refresh_ttff);
+    // the Rockblock took 300 s, continued on the next wake up
+    TEST_ASSERT_FALSE(endGpsRefresh(state, now, 300));
+    TEST_ASSERT_FALSE(state.gps_refreshing);
+    TEST_ASSERT_EQUAL_UINT16(300, state.gps_refresh_progress);
+    TEST_ASSERT_FALSE(endGpsRefresh(state, now, 300));
+    now += 600;
+    state.ttff = 8000;
+    TEST_ASSERT_TRUE(startGpsRefresh(state, now));
+    TEST_ASSERT_EQUAL_UINT32(25000, state.gps_refresh_ttff);
+    TEST_ASSERT_TRUE(endGpsRefresh(state, now, 500));
+    TEST_ASSERT_EQUAL_INT(now, state.gps_refresh_time);
+    TEST_ASSERT_EQUAL_UINT16(0, state.gps_refresh_progress);
+    // fresh data and a quick fix
+    now += 600;
+    TEST_ASSERT_FALSE(startGpsRefresh(state, now));
+    // slow fix
+    state.ttff = GPS_REFRESH_TTFF + 1;
+    TEST_ASSERT_TRUE(startGpsRefresh(state, now));
+    TEST_ASSERT_EQUAL_UINT32(GPS_REFRESH_TTFF + 1, state.gps_refresh_ttff);
+    endGpsRefresh(state, now, 10);
+    // old data, but low battery
+    state.gps_refresh_progress = 0;
+    state.ttff = 8000;
+    now += GPS_REFRESH_INTERVAL;
+    TEST_ASSERT_TRUE(startGpsRefresh(state, now));
+    state.bat = 3.5;
+    TEST_ASSERT_FALSE(startGpsRefresh(state, now));
+    TEST_ASSERT_FALSE(state.gps_refreshing);
+    TEST_ASSERT_FALSE(endGpsRefresh(state, now, 100));
+}
+
+void testRtcDrift() {
+    systemState state;
+    // no estimate yet, sleep as scheduled
+    state.expected_wakeup = 1E9 + 600;
+    TEST_ASSERT_EQUAL_UINT32(600, getRtcSleep(state, 1E9, true));
+    TEST_ASSERT_EQUAL_INT(1E9, state.rtc_drift.sleep_start);
+    // the RTC runs 1% slow, 600 of its seconds took 606 s
+    TEST_ASSERT_TRUE(updateRtcDrift(state, 1E9 + 606));
+    TEST_ASSERT_EQUAL_INT32(6, state.wakeup_error);
+    TEST_ASSERT_FLOAT_WITHIN(1, -9901, state.rtc_drift.ppm);
+    TEST_ASSERT_EQUAL_UINT8(1, state.rtc_drift.samples);
+    // measured once
+    TEST_ASSERT_FALSE(updateRtcDrift(state, 1E9 + 606));
+    // the next sleep is shorter to wake up in time
+    state.expected_wakeup = 1E9 + 1200;
+    TEST_ASSERT_EQUAL_UINT32(584, getRtcSleep(state, 1E9 + 610, true));
+    // the RTC counted its seconds and 2 s of boot time
+    TEST_ASSERT_EQUAL_INT(1E9 + 1202, correctRtcTime(state, 1E9 + 1196));
+    TEST_ASSERT_TRUE(updateRtcDrift(state, 1E9 + 1200));
+    TEST_ASSERT_EQUAL_INT32(0, state.wakeup_error);
+    // rounding to seconds, 584 of 590 s
+    TEST_ASSERT_FLOAT_WITHIN(1, -10035, state.rtc_drift.ppm);
+    // clock not set by the GPS, nothing to measure or correct
+    state.expected_wakeup = 1E9 + 1800;
+    TEST_ASSERT_EQUAL_UINT32(594, getRtcSleep(state, 1E9 + 1200, false));
+    TEST_ASSERT_EQUAL_INT(1E9 + 1796, correctRtcTime(state, 1E9 + 1796));
+    TEST_ASSERT_FALSE(updateRtcDrift(state, 1E9 + 1800));
+}
+
+void testRtcDriftRejects() {
+    systemState state;
+    // too short to tell
+    state.expected_wakeup = 1E9 + 100;
+    getRtcSleep(state, 1E9, true);
+    TEST_ASSERT_FALSE(updateRtcDrift(state, 1E9 + 102));
+    TEST_ASSERT_EQUAL_INT32(2, state.wakeup_error);
+    // e.g. a reset while sleeping
+    state.expected_wakeup = 1E9 + 600;
+    getRtcSleep(state, 1E9, true);
+    TEST_ASSERT_FALSE(updateRtcDrift(state, 1E9 + 900));
+    TEST_ASSERT_EQUAL_UINT8(0, state.rtc_drift.samples);
+    // the average of the first measurements, exponential after
+    for (int i = 0; i < RTC_DRIFT_SAMPLES; i++) {
+        state.rtc_drift.sleep_start = 1E9;
+        state.rtc_drift.sleep_rtc = 1000;
+        updateRtcDrift(state, 1E9 + ((i % 2) ? 1000 : 1010));
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1, -4950, state.rtc_drift.ppm);
+    state.rtc_drift.sleep_start = 1E9;
+    updateRtcDrift(state, 1E9 + 1000);
+    TEST_ASSERT_FLOAT_WITHIN(1, -4950 * 7 / 8.0, state.rtc_drift.ppm);
+}
+
+void testScheduleTrack() {
+    char bfr[255] = {0};
+    // 2024-09-18 01:00:30, report at 02:00:00
+    time_t day = 1726617600;
+    systemState test_state;
+    test_state.expected_wakeup = day + 7200;
+    TEST_ASSERT_FALSE(scheduleTrack(test_state, day + 3630, 0));
+    TEST_ASSERT_EQUAL_INT(day + 7200, test_state.expected_wakeup);
+    // track wake ups pegged to the interval like reports
+    TEST_ASSERT_TRUE(scheduleTrack(test_state, day + 3630, 900));
+    TEST_ASSERT_EQUAL_INT(day + 4500, test_state.expected_wakeup);
+    TEST_ASSERT_TRUE(test_state.track_wakeup);
+    // too close to wake up in time
+    test_state.expected_wakeup = day + 7200;
+    TEST_ASSERT_TRUE(scheduleTrack(test_state, day + 4495, 900));
+    TEST_ASSERT_EQUAL_INT(day + 5400, test_state.expected_wakeup);
+    // too close to the report, no time for the GPS
+    test_state.expected_wakeup = day + 7200;
+    TEST_ASSERT_FALSE(scheduleTrack(test_state, day + 6900, 900));
+    TEST_ASSERT_EQUAL_INT(day + 7200, test_state.expected_wakeup);
+    TEST_ASSERT_FALSE(test_state.track_wakeup);
+    // the feedback of a config change is sent right away
+    test_state.config_change_requested = true;
+    TEST_ASSERT_FALSE(scheduleTrack(test_state, day + 3630, 900));
+    // fixes packed into the message are removed after success
+    trackFix fix;
+    for (uint32_t i = 0; i < TRACK_SIZE + 2; i++) {
+        fix.time = day + i * 900;
+        test_state.track.push(fix);
+    }
+    TEST_ASSERT_EQUAL_INT(TRACK_SIZE, test_state.track.size());
+    TEST_ASSERT_EQUAL_UINT32(day + 1800, test_state.track[0].time);
+    test_state.track_sent = 5;
+    TEST_ASSERT_EQUAL_INT((int) SLEEP_READY,
+        processRockblockMessage(test_state, bfr, true, false));
+    TEST_ASSERT_EQUAL_INT(TRACK_SIZE - 5, test_state.track.size());
+    TEST_ASSERT_EQUAL_INT(0, test_state.track_sent);
+}
+
+void testEnergyReportDue() {
+    char bfr[255] = {0};
+    systemState test_state;
+    // nothing accounted before the first fix
+    TEST_ASSERT_FALSE(energyReportDue(test_state, 1726686049));
+    test_state.start_time = 1726600000;
+    test_state.energy.seconds = 86049;
+    TEST_ASSERT_FALSE(energyReportDue(test_state, 1726600000 + 86399));
+    TEST_ASSERT_TRUE(energyReportDue(test_state, 1726686649));
+    // the next one a day after the record was sent
+    test_state.energy_sent = true;
+    test_state.gps_read_time = 1726686649;
+    processRockblockMessage(test_state, bfr, true, false);
+    TEST_ASSERT_FALSE(test_state.energy_sent);
+    TEST_ASSERT_EQUAL_INT(1726686649, test_state.energy_report_time);
+    TEST_ASSERT_FALSE(energyReportDue(test_state, 1726686649 + 600));
+    TEST_ASSERT_TRUE(energyReportDue(test_state, 1726686649 + 86400));
+}
+
+void testBatteryHelpers() {
+    systemState test_state;
+    time_t now = 1E9 + 40;
+    test_state.gps_read_time = 1E9 + 20;
+    test_state.mode = NORMAL;
+    test_state.retry = true;
+    // no retries, next 6 hour slot at 06:00
+    test_state.battery.level = BATTERY_CRITICAL;
+    TEST_ASSERT_EQUAL_INT(15160, getSleepDifference(test_state, now));
+    // report without GPS
+    test_state.battery.level = BATTERY_SAFE;
+    TEST_ASSERT_EQUAL_INT(WAIT_FOR_RB, skipGps(test_state, now));
+    TEST_ASSERT_EQUAL_INT(LOW_BATTERY, test_state.mode);
+    TEST_ASSERT_EQUAL_INT(1, test_state.sequence);
+    TEST_ASSERT_EQUAL_FLOAT(999, test_state.lat);
+    TEST_ASSERT_EQUAL_INT(now, test_state.gps_read_time);
+    TEST_ASSERT_TRUE(test_state.gps_done);
+    // a config confirmation is not replaced
+    test_state.mode = CONFIG;
+    skipGps(test_state, now);
+    TEST_ASSERT_EQUAL_INT(CONFIG, test_state.mode);
+    // a track wake up sleeps again
+    test_state.track_wakeup = true;
+    TEST_ASSERT_EQUAL_INT(SLEEP_READY, skipGps(test_state, now));
+    TEST_ASSERT_EQUAL_INT(2, test_state.sequence);
+}
@@ -0,0 +1,117 @@
+#include <unity.h>
+#include <string.h>
+#include <jspr.h>
+
+
+void testBase64Vectors() {
+    // RFC 4648 test vectors
+    const char* plain[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    const char* encoded[] = {
+        "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+    char bfr[16] = {0};
+    uint8_t decoded[16] = {0};
+    size_t len = 0;
+    for (int i = 0; i < 7; i++) {
+        size_t plain_len = strlen(plain[i]);
+        TEST_ASSERT_EQUAL_INT(strlen(encoded[i]), base64Encode(
+            (const uint8_t*) plain[i], plain_len, bfr, sizeof(bfr)));
+        TEST_ASSERT_EQUAL_STRING(encoded[i], bfr);
+        TEST_ASSERT_TRUE(base64Decode(
+            encoded[i], strlen(encoded[i]), decoded, sizeof(decoded), &len));
+        TEST_ASSERT_EQUAL_INT(plain_len, len);
+        TEST_ASSERT_EQUAL_MEMORY(plain[i], decoded, plain_len);
+    }
+    // binary data and padding left out
+    const uint8_t binary[] = {0x00, 0xff, 0x10, 0x80};
+    TEST_ASSERT_EQUAL_INT(8, base64Encode(binary, 4, bfr, sizeof(bfr)));
+    TEST_ASSERT_EQUAL_STRING("AP8QgA==", bfr);
+    TEST_ASSERT_TRUE(base64Decode("AP8QgA", 6, decoded, 4, &len));
+    TEST_ASSERT_EQUAL_MEMORY(binary, decoded, 4);
+}
+
+void testBase64Limits() {
+    char bfr[8] = {0};
+    uint8_t decoded[2] = {0};
+    size_t len = 0;
+    // needs 8 characters and \0
+    TEST_ASSERT_EQUAL_INT(0, base64Encode(
+        (const uint8_t*) "foob", 4, bfr, sizeof(bfr)));
+    TEST_ASSERT_FALSE(base64Decode("Zm9v", 4, decoded, sizeof(decoded), &len));
+    TEST_ASSERT_FALSE(base64Decode("Zm9", 3, decoded, 1, &len));
+    TEST_ASSERT_FALSE(base64Decode("Z", 1, decoded, sizeof(decoded), &len));
+    TEST_ASSERT_FALSE(base64Decode("Zm\"v", 4, decoded, 3, &len));
+}
+
+void testJsprRequest() {
+    char bfr[64] = {0};
+    TEST_ASSERT_EQUAL_INT(26, jsprRequest(
+        bfr, sizeof(bfr), "GET", "constellationState", nullptr));
+    TEST_ASSERT_EQUAL_STRING("GET constellationState {}\r", bfr);
+    jsprRequest(bfr, sizeof(bfr), "PUT", "operationalState",
+        "{\"state\":\"active\"}");
+    TEST_ASSERT_EQUAL_STRING(
+        "PUT operationalState {\"state\":\"active\"}\r", bfr);
+    // does not fit
+    TEST_ASSERT_EQUAL_INT(0, jsprRequest(
+        bfr, 16, "GET", "constellationState", "{}"));
+}
+
+void testJsprParseResponse() {
+    JsprParser parser;
+    char bfr[32] = {0};
+    int32_t value = 0;
+    bool flag = false;
+    parser.parse("200 constellationState {\"constellation_visible\":true,"
+        "\"signal_bars\":3,\"signal_level\":-105}");
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_INT(200, parser.code);
+    TEST_ASSERT_EQUAL_STRING("", parser.method);
+    TEST_ASSERT_EQUAL_STRING("constellationState", parser.target);
+    TEST_ASSERT_TRUE(parser.getInt("signal_bars", &value));
+    TEST_ASSERT_EQUAL_INT(3, value);
+    TEST_ASSERT_TRUE(parser.getInt("signal_level", &value));
+    TEST_ASSERT_EQUAL_INT(-105, value);
+    TEST_ASSERT_TRUE(parser.getBool("constellation_visible", &flag));
+    TEST_ASSERT_TRUE(flag);
+    TEST_ASSERT_FALSE(parser.getInt("signal", &value));
+    // keys only, not values with the same text
+    parser.parse("299 messageOriginateStatus {\"note\":\"message_id\","
+        "\"message_id\":7,\"final_mo_status\":\"mo_ack_received\"}");
+    TEST_ASSERT_EQUAL_INT(JSPR_UNSOLICITED, parser.code);
+    TEST_ASSERT_TRUE(parser.getInt("message_id", &value));
+    TEST_ASSERT_EQUAL_INT(7, value);
+    TEST_ASSERT_TRUE(parser.getString("final_mo_status", bfr, sizeof(bfr)));
+    TEST_ASSERT_EQUAL_STRING("mo_ack_received", bfr);
+    TEST_ASSERT_FALSE(parser.getString("final_mo_status", bfr, 8));
+    // requests
+    parser.parse("PUT apiVersion {}\r");
+    TEST_ASSERT_EQUAL_INT(0, parser.code);
+    TEST_ASSERT_EQUAL_STRING("PUT", parser.method);
+    TEST_ASSERT_EQUAL_STRING("apiVersion", parser.target);
+    TEST_ASSERT_EQUAL_STRING("{}", parser.body());
+}
+
+void testJsprParseStream() {
+    JsprParser parser;
+    const char stream[] = "200 simConfig {}\r\n299 messageTerminate "
+        "{\"message_id\":2}\r";
+    size_t len = sizeof(stream) - 1;
+    int32_t value = 0;
+    size_t used = parser.feed(stream, len);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_STRING("simConfig", parser.target);
+    // the \n is skipped
+    used += parser.feed(stream + used, len - used);
+    TEST_ASSERT_EQUAL_INT(len, used);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_STRING("messageTerminate", parser.target);
+    TEST_ASSERT_TRUE(parser.getInt("message_id", &value));
+    TEST_ASSERT_EQUAL_INT(2, value);
+    // lines that do not fit are dropped, the next one is parsed
+    for (int i = 0; i < JSPR_MAX_LINE_SIZE; i++) { parser.feed('x'); }
+    TEST_ASSERT_FALSE(parser.feed('\r'));
+    TEST_ASSERT_EQUAL_UINT32(1, parser.dropped);
+    parser.feed("200 apiVersion {}\r", 18);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_INT(200, parser.code);
+}
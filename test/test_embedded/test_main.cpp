@@ -1,5 +1,15 @@
 #include <unity.h>
 #include "test_rockblock.h"
+#include "test_ringBuffer.h"
+#include "test_retryPolicy.h"
+#include "test_gpsPolicy.h"
+#include "test_courseAverage.h"
+#include "test_energyMeter.h"
+#include "test_batteryPolicy.h"
+#include "test_commandQueue.h"
+#include "test_jspr.h"
+#include "test_nmea.h"
+#include "test_ubx.h"
 #include "test_helpers.h"
 #include "test_scoutMessages.h"
 #define UNITY_DOUBLE_PRECISION 1e-12
@@ -14,7 +24,13 @@ int runUnityTests() {
     RUN_TEST(testStrSepMulti);
     RUN_TEST(testfloat2NmeaNumber);
     RUN_TEST(testGetSbdixWithLocation);
-    RUN_TEST(testExtractFrame);
+    RUN_TEST(testParseSbdixLocation);
+    RUN_TEST(testLocationInHeaderRoundTrip);
+    RUN_TEST(testStreamFrames);
+    RUN_TEST(testStreamFrameByteByByte);
+    RUN_TEST(testStreamFrameStatusInPayload);
+    RUN_TEST(testStreamFrameRingAlert);
+    RUN_TEST(testStreamFrameFromView);
     RUN_TEST(testParseFrame);
     RUN_TEST(testParseFrameWeirdFrame);
     RUN_TEST(testParseEmptyFrame);
@@ -23,10 +39,83 @@ int runUnityTests() {
     RUN_TEST(testPayloadParsing);
     RUN_TEST(testPayloadParsingMultipleLines);
     RUN_TEST(testPayloadParsingMultipleEmpty);
+    RUN_TEST(testSbdChecksum);
+    RUN_TEST(testParseBinaryFrame);
+    RUN_TEST(testParseTerseFrames);
+    RUN_TEST(testParseTerseInfo);
+    RUN_TEST(testParseTerseBinaryFrame);
+    // test command queue
+    RUN_TEST(testCommandQueueOrder);
+    RUN_TEST(testCommandQueueResults);
+    RUN_TEST(testCommandQueueTimeout);
+    RUN_TEST(testCommandQueueWithoutEcho);
+    // test JSPR
+    RUN_TEST(testBase64Vectors);
+    RUN_TEST(testBase64Limits);
+    RUN_TEST(testJsprRequest);
+    RUN_TEST(testJsprParseResponse);
+    RUN_TEST(testJsprParseStream);
+    // test NMEA
+    RUN_TEST(testNmeaFix);
+    RUN_TEST(testNmeaSouthWest);
+    RUN_TEST(testNmeaRejects);
+    RUN_TEST(testNmeaByteByByte);
+    RUN_TEST(testUbxFrame);
+    RUN_TEST(testUbxNavPvt);
+    RUN_TEST(testUbxChecksum);
+    RUN_TEST(testUbxStream);
+    RUN_TEST(testUbxConfig);
+    RUN_TEST(testUbxConfigRejected);
+    RUN_TEST(testUbxConfigProbe);
+    RUN_TEST(testUbxAiding);
+    // test retry policy
+    RUN_TEST(testRetryPolicyDefaultThreshold);
+    RUN_TEST(testRetryPolicyLearnsThreshold);
+    RUN_TEST(testRetryPolicyRelaxThreshold);
+    RUN_TEST(testRetryPolicyBackoff);
+    RUN_TEST(testRetryPolicyPollInterval);
+    RUN_TEST(testRetryPolicySignalAverage);
+    RUN_TEST(testRetryPolicyHistoryLimit);
+    RUN_TEST(testRetryPolicyDeadline);
+    RUN_TEST(testRetryPolicySeed);
+    // test GPS policy
+    RUN_TEST(testGpsPolicyDefaultTimeout);
+    RUN_TEST(testGpsPolicyLearnsTimeout);
+    RUN_TEST(testGpsPolicyMisses);
+    RUN_TEST(testGpsPolicyLowSuccessRate);
+    RUN_TEST(testGpsPolicyAcceptance);
+    RUN_TEST(testGpsPolicyHistoryLimit);
+    RUN_TEST(testGpsPolicyAverageTtff);
+    // test course average
+    RUN_TEST(testCourseAverage);
+    RUN_TEST(testCourseAverageAroundNorth);
+    RUN_TEST(testCourseAverageSwinging);
+    // test energy meter
+    RUN_TEST(testEnergyMeter);
+    RUN_TEST(testEnergySleep);
+    RUN_TEST(testEnergyLightSleep);
+    // test battery policy
+    RUN_TEST(testBatteryPolicyLevels);
+    RUN_TEST(testBatteryPolicySag);
+    RUN_TEST(testBatteryPolicyLimits);
+    // test ring buffer
+    RUN_TEST(testRingBufferWriteAndConsume);
+    RUN_TEST(testRingBufferWrapAround);
+    RUN_TEST(testRingBufferOverflow);
     // test helpers
     RUN_TEST(testGetNextWakeupTime);
     RUN_TEST(testGetSleepDifference);
     RUN_TEST(testUpdateStatefromRbMessage);
+    RUN_TEST(testFixQueue);
+    RUN_TEST(testQueueUnsentFix);
+    RUN_TEST(testUpdateStateFromRbInbox);
+    RUN_TEST(testEstimateAiding);
+    RUN_TEST(testGpsRefresh);
+    RUN_TEST(testRtcDrift);
+    RUN_TEST(testRtcDriftRejects);
+    RUN_TEST(testScheduleTrack);
+    RUN_TEST(testEnergyReportDue);
+    RUN_TEST(testBatteryHelpers);
     // test Scout messages
     RUN_TEST(test_float2Nmea);
     RUN_TEST(test_epoch2utc);
@@ -34,9 +123,21 @@ int runUnityTests() {
     RUN_TEST(test_createPK001_extended);
     // RUN_TEST(test_createPK101);
     RUN_TEST(test_createPK101_change);
+    RUN_TEST(test_createPK102);
     RUN_TEST(test_parsePK006);
     RUN_TEST(test_parseIncoming_incomplete);
     RUN_TEST(test_parseIncoming_invalid);
+    RUN_TEST(test_parsePK008);
+    RUN_TEST(test_parseIncomingMultiple);
+    RUN_TEST(test_createBinaryPosition);
+    RUN_TEST(test_createBinaryReport);
+    RUN_TEST(test_parseIncomingBinary);
+    RUN_TEST(test_appendBacklog);
+    RUN_TEST(test_createBinaryBacklog);
+    RUN_TEST(test_appendTrack);
+    RUN_TEST(test_createBinaryTrack);
+    RUN_TEST(test_trackTimeStepsBack);
+    RUN_TEST(test_createEnergy);
     return UNITY_END();
 }
 
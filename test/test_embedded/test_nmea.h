@@ -0,0 +1,91 @@
+#include <unity.h>
+#include <string.h>
+#include <nmea.h>
+
+#define NMEA_RMC_FIX "$GPRMC,123519.00,A,4807.03812,N,01131.00012,E,0.022,"\
+    "84.40,230326,,,A*5F\r\n"
+#define NMEA_GGA_FIX "$GPGGA,123519.00,4807.03812,N,01131.00012,E,1,08,"\
+    "0.94,545.4,M,46.9,M,,*5D\r\n"
+#define NMEA_GSA_FIX "$GPGSA,A,3,04,05,09,12,24,25,29,31,,,,,1.72,0.94,"\
+    "1.44*09\r\n"
+
+
+void testNmeaFix() {
+    NmeaParser parser;
+    TEST_ASSERT_FALSE(parser.feed(NMEA_GSA_FIX, strlen(NMEA_GSA_FIX)));
+    TEST_ASSERT_FALSE(parser.feed(NMEA_RMC_FIX, strlen(NMEA_RMC_FIX)));
+    // fix once GGA of the same second confirms it
+    TEST_ASSERT_TRUE(parser.feed(NMEA_GGA_FIX, strlen(NMEA_GGA_FIX)));
+    TEST_ASSERT_EQUAL_UINT32(3, parser.sentences);
+    TEST_ASSERT_EQUAL_INT(2026, parser.fix.year);
+    TEST_ASSERT_EQUAL_INT(3, parser.fix.month);
+    TEST_ASSERT_EQUAL_INT(23, parser.fix.day);
+    TEST_ASSERT_EQUAL_INT(12, parser.fix.hour);
+    TEST_ASSERT_EQUAL_INT(35, parser.fix.minute);
+    TEST_ASSERT_EQUAL_INT(19, parser.fix.second);
+    // 48 deg 7.03812 min, 11 deg 31.00012 min
+    TEST_ASSERT_EQUAL_INT32(481173020, parser.fix.lat);
+    TEST_ASSERT_EQUAL_INT32(115166687, parser.fix.lng);
+    TEST_ASSERT_EQUAL_UINT32(2, parser.fix.speed);
+    TEST_ASSERT_EQUAL_UINT32(8440, parser.fix.course);
+    TEST_ASSERT_EQUAL_INT(1, parser.fix.quality);
+    TEST_ASSERT_EQUAL_INT(8, parser.fix.satellites);
+    TEST_ASSERT_EQUAL_INT(94, parser.fix.hdop);
+    TEST_ASSERT_EQUAL_INT(172, parser.fix.pdop);
+    TEST_ASSERT_EQUAL_INT(144, parser.fix.vdop);
+    // a pair is only used once, also GGA before RMC works
+    TEST_ASSERT_FALSE(parser.feed(NMEA_GGA_FIX, strlen(NMEA_GGA_FIX)));
+    TEST_ASSERT_TRUE(parser.feed(NMEA_RMC_FIX, strlen(NMEA_RMC_FIX)));
+}
+
+void testNmeaSouthWest() {
+    NmeaParser parser;
+    const char *rmc = "$GNRMC,001122,A,3730.0000,S,12215.0000,W,,,010126,,,"
+        "*26\r\n";
+    const char *gga = "$GNGGA,001122,3730.0000,S,12215.0000,W,2,05,1.5,,,,,,"
+        "*63\r\n";
+    parser.feed(rmc, strlen(rmc));
+    TEST_ASSERT_TRUE(parser.feed(gga, strlen(gga)));
+    TEST_ASSERT_EQUAL_INT32(-375000000, parser.fix.lat);
+    TEST_ASSERT_EQUAL_INT32(-1222500000, parser.fix.lng);
+    TEST_ASSERT_EQUAL_INT(2026, parser.fix.year);
+    TEST_ASSERT_EQUAL_INT(2, parser.fix.quality);
+    TEST_ASSERT_EQUAL_INT(150, parser.fix.hdop);
+}
+
+void testNmeaRejects() {
+    NmeaParser parser;
+    // wrong checksum
+    char rmc[128] = NMEA_RMC_FIX;
+    rmc[strlen(rmc) - 3] = '1';
+    parser.feed(rmc, strlen(rmc));
+    TEST_ASSERT_FALSE(parser.feed(NMEA_GGA_FIX, strlen(NMEA_GGA_FIX)));
+    TEST_ASSERT_EQUAL_UINT32(1, parser.checksum_errors);
+    // no fix yet, time and date only
+    const char *no_fix = "$GPRMC,123520.00,V,,,,,,,230326,,,N*7C\r\n";
+    const char *no_fix_gga = "$GPGGA,123520.00,,,,,0,03,25.51,,,,,,*61\r\n";
+    TEST_ASSERT_FALSE(parser.feed(no_fix, strlen(no_fix)));
+    TEST_ASSERT_FALSE(parser.feed(no_fix_gga, strlen(no_fix_gga)));
+    // RMC and GGA of different seconds
+    parser.reset();
+    const char *gga = "$GPGGA,123521.00,4807.03812,N,01131.00012,E,1,08,"
+        "0.94,545.4,M,46.9,M,,*56\r\n";
+    parser.feed(NMEA_RMC_FIX, strlen(NMEA_RMC_FIX));
+    TEST_ASSERT_FALSE(parser.feed(gga, strlen(gga)));
+    // an interrupted sentence is dropped, the next one counts
+    const char *cut = "$GPGGA,123519.00,4807.03";
+    TEST_ASSERT_FALSE(parser.feed(cut, strlen(cut)));
+    TEST_ASSERT_TRUE(parser.feed(NMEA_GGA_FIX, strlen(NMEA_GGA_FIX)));
+}
+
+void testNmeaByteByByte() {
+    NmeaParser parser;
+    const char *stream = "$GPVTG,84.4,T,,M,0.022,N,0.041,K,A*30\r\n"
+        NMEA_RMC_FIX "$GPGSV,1,1,01,04,41,289,40*4E\r\n" NMEA_GGA_FIX;
+    size_t fixes = 0;
+    for (size_t i = 0; i < strlen(stream); i++) {
+        fixes += parser.feed(stream[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(1, fixes);
+    TEST_ASSERT_EQUAL_INT32(481173020, parser.fix.lat);
+}
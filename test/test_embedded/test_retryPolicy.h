@@ -0,0 +1,147 @@
+#include <unity.h>
+#include <retryPolicy.h>
+
+
+void testRetryPolicyDefaultThreshold() {
+    RetryPolicy policy;
+    policy.reset(1000);
+    TEST_ASSERT_EQUAL_UINT8(3, policy.threshold(1000));
+    TEST_ASSERT_FALSE(policy.shouldAttempt(2, 1000));
+    TEST_ASSERT_TRUE(policy.shouldAttempt(3, 1000));
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.6, policy.successRate(3));
+}
+
+void testRetryPolicyLearnsThreshold() {
+    RetryPolicy policy;
+    policy.reset(0);
+    // sessions keep failing at 3 bars
+    for (int i = 0; i < 12; i++) { policy.onResult(3, 18, 0); }
+    TEST_ASSERT_EQUAL_UINT8(4, policy.threshold(0));
+    TEST_ASSERT_EQUAL_UINT8(12, policy.consecutiveFailures());
+    // but succeed at 2 bars
+    for (int i = 0; i < 8; i++) { policy.onResult(2, 0, 0); }
+    TEST_ASSERT_EQUAL_UINT8(2, policy.threshold(0));
+    TEST_ASSERT_EQUAL_UINT8(0, policy.consecutiveFailures());
+    // history survives a new message and can be restored
+    policy.reset(0);
+    signalHistory history = policy.getHistory();
+    TEST_ASSERT_EQUAL_UINT8(12, history.attempts[3]);
+    TEST_ASSERT_EQUAL_UINT8(8, history.successes[2]);
+    RetryPolicy restored;
+    restored.setHistory(history);
+    TEST_ASSERT_EQUAL_UINT8(2, restored.threshold(0));
+}
+
+void testRetryPolicyRelaxThreshold() {
+    RetryPolicy policy;
+    policy.reset(0);
+    TEST_ASSERT_EQUAL_UINT8(3, policy.threshold(THRESHOLD_RELAX_AFTER - 1));
+    // 2 bars have a prior success rate of 0.15
+    TEST_ASSERT_EQUAL_UINT8(2, policy.threshold(THRESHOLD_RELAX_AFTER));
+}
+
+void testRetryPolicyBackoff() {
+    RetryPolicy policy;
+    policy.reset(0);
+    uint32_t now = 0;
+    uint32_t last = 0;
+    // increasing delays with +-25% jitter
+    for (int i = 0; i < 8; i++) {
+        uint32_t backoff = policy.onResult(4, 10, now);
+        TEST_ASSERT_GREATER_OR_EQUAL(3750, backoff);
+        TEST_ASSERT_LESS_OR_EQUAL(375000, backoff);
+        if (i < 6) { TEST_ASSERT_GREATER_THAN(last, backoff); }
+        // no polling or sending while backing off
+        TEST_ASSERT_FALSE(policy.readyToPoll(now + backoff - 1));
+        TEST_ASSERT_FALSE(policy.shouldAttempt(5, now + backoff - 1));
+        TEST_ASSERT_TRUE(policy.readyToPoll(now + backoff));
+        last = backoff;
+        now += backoff;
+    }
+    // fixed delays, not counted as attempts
+    signalHistory before = policy.getHistory();
+    TEST_ASSERT_EQUAL_UINT32(REGISTRATION_BACKOFF, policy.onResult(4, 36, 0));
+    TEST_ASSERT_EQUAL_UINT32(NO_SERVICE_BACKOFF, policy.onResult(4, 32, 0));
+    TEST_ASSERT_EQUAL_UINT32(GATEWAY_BACKOFF, policy.onResult(4, 38, 0));
+    TEST_ASSERT_EQUAL_UINT8(before.attempts[4], policy.getHistory().attempts[4]);
+}
+
+void testRetryPolicyPollInterval() {
+    RetryPolicy policy;
+    policy.reset(5000);
+    TEST_ASSERT_TRUE(policy.readyToPoll(5000));
+    policy.polled(5000);
+    TEST_ASSERT_FALSE(policy.readyToPoll(5000 + CSQ_POLL_INTERVAL - 1));
+    TEST_ASSERT_TRUE(policy.readyToPoll(5000 + CSQ_POLL_INTERVAL));
+}
+
+void testRetryPolicySignalAverage() {
+    RetryPolicy policy;
+    policy.reset(0);
+    TEST_ASSERT_EQUAL_UINT8(3, policy.addReading(3));
+    // rounded down
+    TEST_ASSERT_EQUAL_UINT8(2, policy.addReading(2));
+    TEST_ASSERT_EQUAL_UINT8(2, policy.addReading(2));
+    TEST_ASSERT_EQUAL_UINT8(2, policy.addReading(4));
+    // the oldest of SIGNAL_AVERAGE readings drops out
+    TEST_ASSERT_EQUAL_UINT8(3, policy.addReading(4));
+    TEST_ASSERT_EQUAL_UINT8(3, policy.addReading(5));
+    // readings from before a session don't count
+    policy.onResult(3, 18, 0);
+    TEST_ASSERT_EQUAL_UINT8(1, policy.addReading(1));
+    policy.addReading(5);
+    policy.reset(0);
+    TEST_ASSERT_EQUAL_UINT8(0, policy.addReading(0));
+}
+
+void testRetryPolicyHistoryLimit() {
+    RetryPolicy policy;
+    policy.reset(0);
+    for (int i = 0; i < HISTORY_LIMIT; i++) { policy.onResult(5, 0, 0); }
+    policy.onResult(5, 18, 0);
+    signalHistory history = policy.getHistory();
+    TEST_ASSERT_EQUAL_UINT8(HISTORY_LIMIT / 2 + 1, history.attempts[5]);
+    TEST_ASSERT_EQUAL_UINT8(HISTORY_LIMIT / 2, history.successes[5]);
+}
+
+void testRetryPolicyDeadline() {
+    RetryPolicy policy;
+    policy.reset(0);
+    uint32_t deadline = 600000;
+    policy.setDeadline(deadline);
+    // far from the deadline nothing changes
+    TEST_ASSERT_EQUAL_UINT8(3, policy.threshold(0));
+    uint32_t backoff = policy.onResult(3, 18, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(3750, backoff);
+    TEST_ASSERT_LESS_OR_EQUAL(6250, backoff);
+    // any signal that still succeeds sometimes close to the deadline
+    TEST_ASSERT_EQUAL_UINT8(1, policy.threshold(deadline - DEADLINE_MARGIN));
+    TEST_ASSERT_EQUAL_UINT8(1, policy.threshold(deadline));
+    // the backoff leaves time for another session
+    uint32_t now = deadline - LAST_ATTEMPT_MARGIN - 6000;
+    backoff = policy.onResult(4, 36, now);
+    TEST_ASSERT_EQUAL_UINT32(6000 / BACKOFF_SHARE, backoff);
+    TEST_ASSERT_EQUAL_UINT32(0, policy.onResult(4, 36, deadline));
+}
+
+void testRetryPolicySeed() {
+    RetryPolicy first;
+    RetryPolicy second;
+    first.setSeed(0x12345678);
+    second.setSeed(0x87654321);
+    first.reset(0);
+    second.reset(0);
+    // devices woken at the same time do not retry in lockstep
+    bool differ = false;
+    for (int i = 0; i < 4; i++) {
+        if (first.onResult(4, 18, 0) != second.onResult(4, 18, 0)) {
+            differ = true;
+        }
+    }
+    TEST_ASSERT_TRUE(differ);
+    // same seed, same jitter
+    first.setSeed(42);
+    second.setSeed(42);
+    uint32_t backoff = first.onResult(4, 18, 0);
+    TEST_ASSERT_EQUAL_UINT32(backoff, second.onResult(4, 18, 0));
+}
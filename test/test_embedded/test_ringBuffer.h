@@ -0,0 +1,58 @@
+#include <unity.h>
+#include <ringBuffer.h>
+
+
+void testRingBufferWriteAndConsume() {
+    RingBuffer stream;
+    TEST_ASSERT_EQUAL_INT(5, stream.write("Hello", 5));
+    TEST_ASSERT_EQUAL_INT(5, stream.size());
+    TEST_ASSERT_EQUAL_CHAR('H', stream.at(0));
+    stream.consume(2);
+    TEST_ASSERT_EQUAL_INT(3, stream.size());
+    TEST_ASSERT_EQUAL_CHAR('l', stream.at(0));
+    TEST_ASSERT_EQUAL_CHAR('o', stream.view(0, 3).at(2));
+    stream.clear();
+    TEST_ASSERT_EQUAL_INT(0, stream.size());
+}
+
+void testRingBufferWrapAround() {
+    char filler[RING_BUFFER_SIZE - 4] = {0};
+    RingBuffer stream;
+    stream.write(filler, sizeof(filler));
+    stream.consume(sizeof(filler));
+    // this will wrap around the end of the buffer
+    stream.write("wrapped", 7);
+    FrameView view = stream.view(0, 7);
+    TEST_ASSERT_EQUAL_INT(4, view.first_len);
+    TEST_ASSERT_EQUAL_INT(3, view.second_len);
+    TEST_ASSERT_EQUAL_CHAR('w', view.at(0));
+    TEST_ASSERT_EQUAL_CHAR('p', view.at(4));
+    TEST_ASSERT_EQUAL_CHAR('d', stream.at(6));
+    // consuming across the end
+    stream.consume(5);
+    TEST_ASSERT_EQUAL_CHAR('e', stream.at(0));
+    TEST_ASSERT_EQUAL_INT(2, stream.view(0, 2).first_len);
+}
+
+void testRingBufferOverflow() {
+    char filler[RING_BUFFER_SIZE - 2] = {0};
+    RingBuffer stream;
+    stream.write(filler, sizeof(filler));
+    TEST_ASSERT_EQUAL_INT(0, stream.overflows);
+    TEST_ASSERT_EQUAL_INT(2, stream.write("abcd", 4));
+    TEST_ASSERT_EQUAL_INT(1, stream.overflows);
+    TEST_ASSERT_EQUAL_INT(2, stream.dropped_bytes);
+    // still the same overflow
+    TEST_ASSERT_FALSE(stream.push('e'));
+    TEST_ASSERT_EQUAL_INT(3, stream.dropped_bytes);
+    TEST_ASSERT_EQUAL_INT(1, stream.overflows);
+    TEST_ASSERT_EQUAL_INT(0, stream.space());
+    // data in the buffer is not overwritten
+    TEST_ASSERT_EQUAL_CHAR('b', stream.at(RING_BUFFER_SIZE - 1));
+    // a new one once data was accepted in between
+    stream.consume(1);
+    TEST_ASSERT_TRUE(stream.push('f'));
+    TEST_ASSERT_FALSE(stream.push('g'));
+    TEST_ASSERT_EQUAL_INT(2, stream.overflows);
+    TEST_ASSERT_EQUAL_INT(4, stream.dropped_bytes);
+}
@@ -1,6 +1,8 @@
 #include <unity.h>
+#include <vector>
 #include <rockblock.h>
 #include <rockblock.cpp>
+#include <scoutMessages.h>
 
 
 void testStrSepMulti() {
@@ -32,6 +34,9 @@ void testfloat2NmeaNumber() {
     TEST_ASSERT_EQUAL_STRING("+0700.000", bfr);
     float2NmeaNumber(bfr, -3.5, 2);
     TEST_ASSERT_EQUAL_STRING("-0330.000", bfr);
+    // minutes round up to the next degree instead of 60.000
+    float2NmeaNumber(bfr, 7.9999995, 2);
+    TEST_ASSERT_EQUAL_STRING("+0800.000", bfr);
 }
 
 void testGetSbdixWithLocation() {
@@ -42,13 +47,127 @@ void testGetSbdixWithLocation() {
     TEST_ASSERT_EQUAL_STRING("+SBDIX=+0330.000,-00139.000", bfr);
 }
 
-void testExtractFrame() {
-    TEST_ASSERT_EQUAL_INT(1, 1);
+void testParseSbdixLocation() {
+    float lat = 0;
+    float lon = 0;
+    TEST_ASSERT_TRUE(parseSbdixLocation("AT+SBDIX=-3630.000,+12239.000\r",
+        &lat, &lon));
+    TEST_ASSERT_FLOAT_WITHIN(1E-5, -36.5, lat);
+    TEST_ASSERT_FLOAT_WITHIN(1E-5, 122.65, lon);
+    TEST_ASSERT_FALSE(parseSbdixLocation("AT+SBDIX", &lat, &lon));
+    TEST_ASSERT_FALSE(parseSbdixLocation("+SBDIX=+3630.000", &lat, &lon));
+    TEST_ASSERT_FALSE(parseSbdixLocation("+SBDIX=+3670.000,+12239.000",
+        &lat, &lon));
+}
+
+// Location sent in the session header, payload without coordinates
+void testLocationInHeaderRoundTrip() {
+    const float positions[][2] = {
+        {35.5, -122}, {-33.856784, 151.215297}, {0.000001, -0.000001},
+        {89.999999, 179.999999}, {-7.9999995, 12.3456789}
+    };
+    char sbdix[SBDIX_COMMAND_SIZE] = {0};
+    char pk101[255] = {0};
+    char pk102[255] = {0};
+    systemState state;
+    state.gps_read_time = 1726686649;
+    state.bat = 4.2;
+    for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+        float lat = 0;
+        float lon = 0;
+        state.lat = positions[i][0];
+        state.lng = positions[i][1];
+        getSbdixWithLocation(sbdix, state.lat, state.lng);
+        TEST_ASSERT_TRUE(parseSbdixLocation(sbdix, &lat, &lon));
+        // 0.001 minutes
+        TEST_ASSERT_FLOAT_WITHIN(0.00002, state.lat, lat);
+        TEST_ASSERT_FLOAT_WITHIN(0.00002, state.lng, lon);
+        size_t full = scoutMessages::createPK101(pk101, state);
+        size_t header = scoutMessages::createPK102(pk102, state);
+        TEST_ASSERT_NULL(strstr(pk102, "lat:"));
+        // about 40 bytes, depending on the number of digits
+        TEST_ASSERT_GREATER_OR_EQUAL(36, full - header);
+    }
+}
+
+void testStreamFrames() {
     char testData[] = "AT\r\nOK\r\nAT+NEXT\r\nOK\r\n";
-    char frame[100] = {0};
-    extractFrame(frame, testData);
-    TEST_ASSERT_EQUAL_STRING("AT\r\nOK\r\n", frame);
-    TEST_ASSERT_EQUAL_STRING("AT+NEXT\r\nOK\r\n", testData);
+    FrameParser parser = FrameParser();
+    size_t used = parser.feed(testData, strlen(testData));
+    TEST_ASSERT_EQUAL_INT(8, used);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_STRING("AT", parser.command);
+    used += parser.feed(testData + used, strlen(testData) - used);
+    TEST_ASSERT_EQUAL_INT(strlen(testData), used);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_STRING("AT+NEXT", parser.command);
+    TEST_ASSERT_EQUAL_INT16(OK_STATUS, parser.status);
+}
+
+void testStreamFrameByteByByte() {
+    char testData[] = "AT+SBDIX\r\n+SBDIX: 0, 12, 1, 3, 15, 0\r\n\r\nOK\r\n";
+    FrameParser parser = FrameParser();
+    for (size_t i = 0; i < strlen(testData) - 1; i++) {
+        TEST_ASSERT_FALSE(parser.feed(testData[i]));
+    }
+    TEST_ASSERT_TRUE(parser.feed(testData[strlen(testData) - 1]));
+    TEST_ASSERT_EQUAL_STRING("AT+SBDIX", parser.command);
+    TEST_ASSERT_EQUAL_INT(6, parser.values.size());
+    TEST_ASSERT_EQUAL_INT16(12, parser.values[1]);
+    TEST_ASSERT_EQUAL_INT16(3, parser.values[3]);
+}
+
+void testStreamFrameStatusInPayload() {
+    // status token within a line or without line end does not end the frame
+    char testData[] = "AT+SBDRT\r\n+SBDRT:\r\nNOT OK\r\nOK";
+    FrameParser parser = FrameParser();
+    parser.feed(testData, strlen(testData));
+    TEST_ASSERT_FALSE(parser.complete);
+    parser.feed("\r\n", 2);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_STRING("NOT OK", parser.payload);
+}
+
+void testStreamFrameRingAlert() {
+    // unsolicited ring alert before a frame
+    char testData[] = "SBDRING\r\nAT+CSQ\r\n+CSQ:4\r\n\r\nOK\r\n";
+    FrameParser parser = FrameParser();
+    parser.feed(testData, strlen(testData));
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_TRUE(parser.ring);
+    TEST_ASSERT_EQUAL_STRING("AT+CSQ", parser.command);
+    TEST_ASSERT_EQUAL_INT16(4, parser.values[0]);
+    // within a frame, ring is kept until cleared
+    char payload[] = (
+        "AT+SBDRT\r\n+SBDRT:\r\nSBDRING\r\n+DATA:PK006,60;\r\nSBDRING\r\n"
+        "\r\nOK\r\n");
+    parser.feed(payload, strlen(payload));
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_TRUE(parser.ring);
+    TEST_ASSERT_EQUAL_STRING("+SBDRT:", parser.response);
+    // same as without ring alerts
+    TEST_ASSERT_EQUAL_STRING("+DATA:PK006,60;\r\n", parser.payload);
+    // only a complete line is a ring alert
+    parser.ring = false;
+    parser.parse("AT+SBDRT\r\n+SBDRT:\r\nSBDRINGS\r\nOK\r\n");
+    TEST_ASSERT_FALSE(parser.ring);
+    TEST_ASSERT_EQUAL_STRING("SBDRINGS", parser.payload);
+}
+
+void testStreamFrameFromView() {
+    char filler[RING_BUFFER_SIZE - 5] = {0};
+    char testData[] = "AT+CSQ\r\n+CSQ:5\r\nOK\r\n";
+    RingBuffer stream;
+    FrameParser parser = FrameParser();
+    stream.write(filler, sizeof(filler));
+    stream.consume(sizeof(filler));
+    // wraps around the end of the ring buffer
+    stream.write(testData, strlen(testData));
+    stream.consume(parser.feed(stream.view(0, stream.size())));
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_INT(0, stream.size());
+    TEST_ASSERT_EQUAL_STRING("+CSQ:5", parser.response);
+    TEST_ASSERT_EQUAL_INT16(5, parser.values[0]);
 }
 
 void testParseFrame() {
@@ -130,3 +249,99 @@ void testPayloadParsingMultipleEmpty() {
     parser.parse(testData);
     TEST_ASSERT_EQUAL_STRING("first\r\n\r\nsecond\r\n", parser.payload);
 }
+
+void testSbdChecksum() {
+    // example from the Iridium AT command reference
+    const uint8_t message[] = {'h', 'e', 'l', 'l', 'o'};
+    TEST_ASSERT_EQUAL_UINT16(0x0214, sbdChecksum(message, 5));
+}
+
+void testParseBinaryFrame() {
+    // echo, length, message containing \r\n and OK, checksum, status
+    const char testData[] = {
+        'A', 'T', '+', 'S', 'B', 'D', 'R', 'B', '\r', '\n', 0, 6,
+        0x18, 1, '\r', '\n', 'O', 'K', 0x00, (char) 0xca,
+        '\r', '\n', 'O', 'K', '\r', '\n'};
+    FrameParser parser = FrameParser();
+    parser.expectBinary();
+    TEST_ASSERT_EQUAL_INT(sizeof(testData), parser.feed(testData, sizeof(testData)));
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_TRUE(parser.binary_valid);
+    TEST_ASSERT_EQUAL_INT16(OK_STATUS, parser.status);
+    TEST_ASSERT_EQUAL_STRING("AT+SBDRB", parser.command);
+    TEST_ASSERT_EQUAL_INT(6, parser.payloadLength());
+    TEST_ASSERT_EQUAL_MEMORY(testData + 12, parser.payload, 6);
+    // echo without line feed, wrong checksum
+    const char corrupted[] = {
+        'A', 'T', '+', 'S', 'B', 'D', 'R', 'B', '\r', 0, 1, 0x18, 0, 0x19,
+        '\r', '\n', 'O', 'K', '\r', '\n'};
+    parser.expectBinary();
+    parser.feed(corrupted, sizeof(corrupted));
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_FALSE(parser.binary_valid);
+}
+
+void testParseTerseFrames() {
+    // no echo, numeric result codes end with \r only
+    char testData[] = "+CSQ:4\r\n0\r0\r4\r";
+    FrameParser parser = FrameParser();
+    parser.setTerse(true);
+    size_t used = parser.feed(testData, strlen(testData));
+    TEST_ASSERT_EQUAL_INT(10, used);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_INT16(OK_STATUS, parser.status);
+    TEST_ASSERT_EQUAL_STRING("", parser.command);
+    TEST_ASSERT_EQUAL_STRING("+CSQ:4", parser.response);
+    TEST_ASSERT_EQUAL_INT16(4, parser.values[0]);
+    used += parser.feed(testData + used, strlen(testData) - used);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_INT16(OK_STATUS, parser.status);
+    parser.feed(testData + used, strlen(testData) - used);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_INT16(ERROR_STATUS, parser.status);
+    // status words in a line are content, ring alerts are removed
+    parser.parse("126\r+SBDIX: 0, 1, 0, 0, 0, 0\r\nOK\r\n0\r");
+    TEST_ASSERT_TRUE(parser.ring);
+    TEST_ASSERT_EQUAL_INT16(OK_STATUS, parser.status);
+    TEST_ASSERT_EQUAL_INT(6, parser.values.size());
+    TEST_ASSERT_EQUAL_STRING("OK", parser.payload);
+    // verbose frames are still understood, e.g. the response to ATE0
+    parser.parse("ATE0\r\nOK\r\n");
+    TEST_ASSERT_EQUAL_INT16(OK_STATUS, parser.status);
+    TEST_ASSERT_EQUAL_STRING("ATE0", parser.command);
+    parser.parse("READY\r\n");
+    TEST_ASSERT_EQUAL_INT16(READY_STATUS, parser.status);
+}
+
+void testParseTerseInfo() {
+    // +SBDWB answers with 0 (written) followed by result code 0
+    FrameParser parser = FrameParser();
+    parser.setTerse(true);
+    parser.expectInfo();
+    parser.feed("2\r", 2);
+    TEST_ASSERT_FALSE(parser.complete);
+    parser.feed("\n0\r", 3);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_STRING("2", parser.command);
+    TEST_ASSERT_EQUAL_INT16(OK_STATUS, parser.status);
+    // without expectInfo() the first number is the result code
+    parser.reset();
+    parser.feed("2\r", 2);
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_EQUAL_INT16(ERROR_STATUS, parser.status);
+}
+
+void testParseTerseBinaryFrame() {
+    // length right away, message containing a result code, checksum, status
+    const char testData[] = {
+        0, 3, '0', '\r', 'x', 0, (char) 0xb5, '0', '\r'};
+    FrameParser parser = FrameParser();
+    parser.setTerse(true);
+    parser.expectBinary();
+    TEST_ASSERT_EQUAL_INT(sizeof(testData), parser.feed(testData, sizeof(testData)));
+    TEST_ASSERT_TRUE(parser.complete);
+    TEST_ASSERT_TRUE(parser.binary_valid);
+    TEST_ASSERT_EQUAL_INT16(OK_STATUS, parser.status);
+    TEST_ASSERT_EQUAL_INT(3, parser.payloadLength());
+    TEST_ASSERT_EQUAL_MEMORY("0\rx", parser.payload, 3);
+}
@@ -86,6 +86,25 @@ void test_createPK101_change() {
     "batt:4.2,int:20,sl:0,st:3", bfr);
 }
 
+void test_createPK102() {
+  char bfr[255] = {0};
+  systemState state;
+  state.lat = 35.5;
+  state.lng = -122;
+  state.gps_read_time = 1726686649;
+  state.bat = 4.2;
+  state.interval = 600;
+  state.new_interval = 1200;
+  state.sleep = 0;
+  state.mode = CONFIG;
+  createPK102(bfr, state);
+  TEST_ASSERT_EQUAL_STRING("PK102;utc:191049,batt:4.2,int:20,sl:0,st:3", bfr);
+  TEST_ASSERT_TRUE(hasPosition(state));
+  state.lat = 999;
+  state.lng = 999;
+  TEST_ASSERT_FALSE(hasPosition(state));
+}
+
 void test_parsePK006() {
   char bfr[32] = {0};
   systemState state;
@@ -167,3 +186,330 @@ void test_parsePK007() {
   TEST_ASSERT_EQUAL_UINT32(259201, state.new_sleep);
   TEST_ASSERT_EQUAL_UINT32(600, state.new_interval);
 }
+
+void test_parsePK008() {
+  char bfr[32] = {0};
+  systemState state;
+  strcpy(bfr, "+DATA:PK008,1;");
+  TEST_ASSERT_TRUE(parseIncoming(state, bfr));
+  TEST_ASSERT_EQUAL_INT(BINARY_FORMAT, state.message_format);
+  strcpy(bfr, "+DATA:PK008,0;");
+  TEST_ASSERT_TRUE(parseIncoming(state, bfr));
+  TEST_ASSERT_EQUAL_INT(TEXT_FORMAT, state.message_format);
+  // out of bounds
+  strcpy(bfr, "+DATA:PK008,2;");
+  TEST_ASSERT_FALSE(parseIncoming(state, bfr));
+  TEST_ASSERT_EQUAL_INT(TEXT_FORMAT, state.message_format);
+}
+
+void test_parseIncomingMultiple() {
+  char first[32] = "+DATA:PK006,60;";
+  char second[32] = "+DATA:PK008,1;";
+  char third[32] = "+DATA:PK006,30;";
+  char invalid[32] = "+DATA:PK006,-1;";
+  size_t lengths[] = {15, 14};
+  systemState state;
+  // the format change does not reset the interval
+  char* messages[] = {first, second};
+  TEST_ASSERT_TRUE(parseIncoming(state, messages, lengths, 2));
+  TEST_ASSERT_EQUAL_UINT32(3600, state.new_interval);
+  TEST_ASSERT_EQUAL_INT(BINARY_FORMAT, state.message_format);
+  // last writer wins
+  char* updates[] = {first, third};
+  lengths[1] = 15;
+  TEST_ASSERT_TRUE(parseIncoming(state, updates, lengths, 2));
+  TEST_ASSERT_EQUAL_UINT32(1800, state.new_interval);
+  TEST_ASSERT_EQUAL_UINT32(0, state.new_sleep);
+  // valid messages are still applied
+  char* mixed[] = {third, invalid};
+  TEST_ASSERT_FALSE(parseIncoming(state, mixed, lengths, 2));
+  TEST_ASSERT_EQUAL_UINT32(1800, state.new_interval);
+  // nothing received
+  TEST_ASSERT_TRUE(parseIncoming(state, messages, lengths, 0));
+  TEST_ASSERT_EQUAL_UINT32(0, state.new_interval);
+}
+
+void test_createBinaryPosition() {
+  uint8_t bfr[64] = {0};
+  systemState state;
+  state.lat = 35.5;
+  state.lng = -122;
+  state.gps_read_time = 1726686649;
+  state.bat = 4.2;
+  state.interval = 600;
+  state.mode = WAKE_UP;
+  state.speed = 1.25;
+  state.heading = 271;
+  // version 1, position, utc
+  const uint8_t expected[] = {0x11, 0x66, 0xeb, 0x25, 0xb9};
+  TEST_ASSERT_EQUAL_INT(BINARY_POSITION_SIZE, createBinaryPosition(bfr, state));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, bfr, 5);
+  // 35.5 * 1E6 = 0x021dafe0
+  TEST_ASSERT_EQUAL_HEX8(0x02, bfr[5]);
+  TEST_ASSERT_EQUAL_HEX8(0x1d, bfr[6]);
+  TEST_ASSERT_EQUAL_HEX8(0xaf, bfr[7]);
+  TEST_ASSERT_EQUAL_HEX8(0xe0, bfr[8]);
+  // -122 * 1E6 = 0xf8ba6d80
+  TEST_ASSERT_EQUAL_HEX8(0xf8, bfr[9]);
+  TEST_ASSERT_EQUAL_HEX8(0xba, bfr[10]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, bfr[12]);
+  TEST_ASSERT_EQUAL_UINT8(210, bfr[13]); // 4.2V in 20mV
+  TEST_ASSERT_EQUAL_UINT8(10, bfr[15]); // interval in minutes
+  TEST_ASSERT_EQUAL_UINT8(0, bfr[17]); // sleep
+  TEST_ASSERT_EQUAL_UINT8(WAKE_UP, bfr[18]);
+  TEST_ASSERT_EQUAL_UINT8(13, bfr[19]); // 0.1 knots, rounded
+  TEST_ASSERT_EQUAL_UINT8(136, bfr[20]); // 2 degree steps
+}
+
+void test_createBinaryReport() {
+  uint8_t bfr[64] = {0};
+  systemState state;
+  // without fix status replaces position
+  state.gps_read_time = 1726686649;
+  state.bat = 3.7;
+  state.signal = 4;
+  TEST_ASSERT_EQUAL_INT(BINARY_STATUS_SIZE, createBinaryReport(bfr, state));
+  TEST_ASSERT_EQUAL_HEX8(0x12, bfr[0]);
+  TEST_ASSERT_EQUAL_UINT8(185, bfr[5]);
+  TEST_ASSERT_EQUAL_UINT8(4, bfr[6]);
+  // config acknowledgement is appended, report fits into a single credit
+  state.lat = 35.5;
+  state.lng = -122;
+  state.mode = CONFIG;
+  state.new_interval = 1200;
+  size_t len = createBinaryReport(bfr, state);
+  TEST_ASSERT_EQUAL_INT(BINARY_POSITION_SIZE + BINARY_CONFIG_ACK_SIZE, len);
+  TEST_ASSERT_LESS_OR_EQUAL(50, len);
+  TEST_ASSERT_EQUAL_HEX8(0x13, bfr[BINARY_POSITION_SIZE]);
+  TEST_ASSERT_EQUAL_UINT8(1, bfr[BINARY_POSITION_SIZE + 1]);
+  TEST_ASSERT_EQUAL_UINT8(20, bfr[BINARY_POSITION_SIZE + 3]);
+  // location in the session header drops the coordinates
+  state.speed = 5;
+  len = createBinaryReport(bfr, state, true);
+  TEST_ASSERT_EQUAL_INT(
+    BINARY_HEADER_POSITION_SIZE + BINARY_CONFIG_ACK_SIZE, len);
+  TEST_ASSERT_EQUAL_HEX8(0x14, bfr[0]);
+  TEST_ASSERT_EQUAL_HEX32(0x66eb25b9,
+    bfr[1] << 24 | bfr[2] << 16 | bfr[3] << 8 | bfr[4]);
+  TEST_ASSERT_EQUAL_UINT8(185, bfr[5]);
+  TEST_ASSERT_EQUAL_UINT8(CONFIG, bfr[10]);
+  TEST_ASSERT_EQUAL_UINT8(50, bfr[11]);
+  TEST_ASSERT_EQUAL_HEX8(0x13, bfr[BINARY_HEADER_POSITION_SIZE]);
+  // without fix the flag has no effect
+  state.lat = 999;
+  state.lng = 999;
+  createBinaryReport(bfr, state, true);
+  TEST_ASSERT_EQUAL_HEX8(0x12, bfr[0]);
+}
+
+void test_parseIncomingBinary() {
+  systemState state;
+  // interval, 30 minutes
+  uint8_t interval[] = {0x18, CONFIG_INTERVAL, 0, 0, 0, 30};
+  TEST_ASSERT_TRUE(parseIncomingBinary(state, interval, 6));
+  TEST_ASSERT_EQUAL_UINT32(1800, state.new_interval);
+  // sleep, 7200 seconds
+  uint8_t sleep[] = {0x18, CONFIG_SLEEP, 0, 0, 0x1c, 0x20};
+  TEST_ASSERT_TRUE(parseIncomingBinary(state, sleep, 6));
+  TEST_ASSERT_EQUAL_UINT32(7200, state.new_sleep);
+  TEST_ASSERT_EQUAL_UINT32(600, state.new_interval);
+  // format, dispatched from parseIncoming
+  char format[] = {0x18, CONFIG_FORMAT, 0, 0, 0, 1};
+  TEST_ASSERT_TRUE(parseIncoming(state, format, sizeof(format)));
+  TEST_ASSERT_EQUAL_INT(BINARY_FORMAT, state.message_format);
+  // truncated, not read past the end
+  state.message_format = TEXT_FORMAT;
+  TEST_ASSERT_FALSE(parseIncoming(state, format, 4));
+  TEST_ASSERT_FALSE(parseIncoming(state, format));
+  TEST_ASSERT_EQUAL_INT(TEXT_FORMAT, state.message_format);
+  // out of bounds, unknown setting, short or wrong version
+  uint8_t bounds[] = {0x18, CONFIG_INTERVAL, 0, 0, 0x05, 0xa1};
+  TEST_ASSERT_FALSE(parseIncomingBinary(state, bounds, 6));
+  TEST_ASSERT_EQUAL_UINT32(0, state.new_interval);
+  uint8_t unknown[] = {0x18, 9, 0, 0, 0, 1};
+  TEST_ASSERT_FALSE(parseIncomingBinary(state, unknown, 6));
+  TEST_ASSERT_FALSE(parseIncomingBinary(state, interval, 5));
+  uint8_t version[] = {0x28, CONFIG_INTERVAL, 0, 0, 0, 30};
+  TEST_ASSERT_FALSE(parseIncomingBinary(state, version, 6));
+}
+
+void test_appendBacklog() {
+  char bfr[340] = {0};
+  uint8_t sent = 0;
+  systemState state;
+  state.sequence = 12;
+  queuedFix fix;
+  fix.seq = 10;
+  fix.time = 1726686049;
+  fix.lat = 35.5;
+  fix.lng = -122;
+  state.queue.push(fix);
+  fix.seq = 11;
+  state.queue.push(fix);
+  size_t len = appendBacklog(bfr, sizeof(bfr), state, &sent);
+  TEST_ASSERT_EQUAL_STRING(";seq:12;Q:10,1726686049,35.50000,-122.00000"
+    ";Q:11,1726686049,35.50000,-122.00000", bfr);
+  TEST_ASSERT_EQUAL_INT(strlen(bfr), len);
+  TEST_ASSERT_EQUAL_UINT8(2, sent);
+  // only the oldest fits
+  len = appendBacklog(bfr, 60, state, &sent);
+  TEST_ASSERT_EQUAL_STRING(";seq:12;Q:10,1726686049,35.50000,-122.00000", bfr);
+  TEST_ASSERT_EQUAL_UINT8(1, sent);
+  // not even the sequence number fits
+  TEST_ASSERT_EQUAL_INT(0, appendBacklog(bfr, 4, state, &sent));
+  TEST_ASSERT_EQUAL_UINT8(0, sent);
+}
+
+void test_createBinaryBacklog() {
+  uint8_t bfr[340] = {0};
+  uint8_t sent = 0;
+  systemState state;
+  state.sequence = 0x0102;
+  TEST_ASSERT_EQUAL_INT(
+    BINARY_BACKLOG_SIZE, createBinaryBacklog(bfr, sizeof(bfr), state, &sent));
+  TEST_ASSERT_EQUAL_HEX8(0x15, bfr[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, bfr[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x02, bfr[2]);
+  TEST_ASSERT_EQUAL_UINT8(0, bfr[3]);
+  queuedFix fix;
+  fix.time = 1726686649;
+  fix.lat = 35.5;
+  fix.lng = -122;
+  for (uint16_t i = 0; i < FIX_QUEUE_SIZE; i++) {
+    fix.seq = i;
+    state.queue.push(fix);
+  }
+  // a full queue fits behind a report with config acknowledgement
+  size_t space = 340 - BINARY_POSITION_SIZE - BINARY_CONFIG_ACK_SIZE;
+  size_t len = createBinaryBacklog(bfr, space, state, &sent);
+  TEST_ASSERT_EQUAL_UINT8(FIX_QUEUE_SIZE, sent);
+  TEST_ASSERT_EQUAL_INT(
+    BINARY_BACKLOG_SIZE + FIX_QUEUE_SIZE * BINARY_BACKLOG_FIX_SIZE, len);
+  // second fix
+  uint8_t* entry = bfr + BINARY_BACKLOG_SIZE + BINARY_BACKLOG_FIX_SIZE;
+  TEST_ASSERT_EQUAL_HEX8(0x01, entry[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x66, entry[2]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, entry[13]);
+  // limited space
+  len = createBinaryBacklog(bfr, 4 + 2 * 14 + 13, state, &sent);
+  TEST_ASSERT_EQUAL_UINT8(2, sent);
+  TEST_ASSERT_EQUAL_UINT8(2, bfr[3]);
+  TEST_ASSERT_EQUAL_INT(4 + 2 * 14, len);
+}
+
+// three fixes ten minutes apart drifting slowly
+static void fillTrack(systemState &state) {
+  trackFix fix;
+  fix.time = 1726686049;
+  fix.lat = 3550000;
+  fix.lng = -12200000;
+  state.track.push(fix);
+  fix.time += 600;
+  fix.lat += 12;
+  fix.lng -= 40;
+  state.track.push(fix);
+  fix.time += 600;
+  fix.lat -= 300;
+  fix.lng += 1;
+  state.track.push(fix);
+}
+
+void test_appendTrack() {
+  char bfr[340] = {0};
+  uint8_t sent = 0;
+  systemState state;
+  TEST_ASSERT_EQUAL_INT(0, appendTrack(bfr, sizeof(bfr), state, &sent));
+  TEST_ASSERT_EQUAL_UINT8(0, sent);
+  fillTrack(state);
+  size_t len = appendTrack(bfr, sizeof(bfr), state, &sent);
+  TEST_ASSERT_EQUAL_STRING(
+    ";T:1726686049,3550000,-12200000,600,12,-40,600,-300,1", bfr);
+  TEST_ASSERT_EQUAL_INT(strlen(bfr), len);
+  TEST_ASSERT_EQUAL_UINT8(3, sent);
+  // the last fix does not fit
+  len = appendTrack(bfr, 45, state, &sent);
+  TEST_ASSERT_EQUAL_STRING(";T:1726686049,3550000,-12200000,600,12,-40", bfr);
+  TEST_ASSERT_EQUAL_UINT8(2, sent);
+}
+
+void test_createBinaryTrack() {
+  uint8_t bfr[340] = {0};
+  uint8_t sent = 0;
+  systemState state;
+  // no record without fixes
+  TEST_ASSERT_EQUAL_INT(0, createBinaryTrack(bfr, sizeof(bfr), state, &sent));
+  fillTrack(state);
+  size_t len = createBinaryTrack(bfr, sizeof(bfr), state, &sent);
+  uint8_t expected[] = {
+    0x16, 3, 0x66, 0xeb, 0x23, 0x61, 0x00, 0x36, 0x2b, 0x30,
+    0xff, 0x45, 0xd7, 0xc0,
+    // 600 s, 12, -40 zigzag encoded
+    0xd8, 0x04, 0x18, 0x4f,
+    // 600 s, -300, 1
+    0xd8, 0x04, 0xd7, 0x04, 0x02};
+  TEST_ASSERT_EQUAL_INT(sizeof(expected), len);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, bfr, sizeof(expected));
+  TEST_ASSERT_EQUAL_UINT8(3, sent);
+  // three fixes take less than two in the backlog
+  TEST_ASSERT_LESS_THAN(2 * BINARY_BACKLOG_FIX_SIZE, len);
+  // only the first fix fits
+  len = createBinaryTrack(bfr, BINARY_TRACK_SIZE + 3, state, &sent);
+  TEST_ASSERT_EQUAL_INT(BINARY_TRACK_SIZE, len);
+  TEST_ASSERT_EQUAL_UINT8(1, sent);
+  TEST_ASSERT_EQUAL_UINT8(1, bfr[1]);
+}
+
+void test_trackTimeStepsBack() {
+  char text[340] = {0};
+  uint8_t bfr[340] = {0};
+  uint8_t sent = 0;
+  systemState state;
+  trackFix fix;
+  fix.time = 1726686049;
+  fix.lat = 3550000;
+  fix.lng = -12200000;
+  state.track.push(fix);
+  fix.time += 600;
+  fix.lat += 12;
+  fix.lng -= 40;
+  state.track.push(fix);
+  // the RTC was set back
+  fix.time -= 60;
+  fix.lat -= 300;
+  fix.lng += 1;
+  state.track.push(fix);
+  appendTrack(text, sizeof(text), state, &sent);
+  TEST_ASSERT_EQUAL_STRING(";T:1726686049,3550000,-12200000,600,12,-40", text);
+  TEST_ASSERT_EQUAL_UINT8(2, sent);
+  size_t len = createBinaryTrack(bfr, sizeof(bfr), state, &sent);
+  TEST_ASSERT_EQUAL_INT(BINARY_TRACK_SIZE + 4, len);
+  TEST_ASSERT_EQUAL_UINT8(2, sent);
+  TEST_ASSERT_EQUAL_UINT8(2, bfr[1]);
+  // the next message starts from the fix absolute
+  state.track.pop(sent);
+  appendTrack(text, sizeof(text), state, &sent);
+  TEST_ASSERT_EQUAL_STRING(";T:1726686589,3549712,-12200039", text);
+  TEST_ASSERT_EQUAL_UINT8(1, sent);
+}
+
+void test_createEnergy() {
+  char text[80] = {0};
+  uint8_t bfr[20] = {0};
+  systemState state;
+  // two days at 10 mAh/day CPU, 5 GPS and 4.8 deep sleep
+  state.energy.seconds = 2 * 86400;
+  state.energy.charge[LOAD_CPU] = 2 * 10 * 3600;
+  state.energy.charge[LOAD_GPS] = 2 * 5 * 3600;
+  state.energy.charge[LOAD_SLEEP] = 2 * 4.8 * 3600;
+  size_t len = appendEnergy(text, sizeof(text), state);
+  TEST_ASSERT_EQUAL_STRING(";E:48,19.8,10.0,5.0,0.0,0.0,4.8", text);
+  TEST_ASSERT_EQUAL_INT(strlen(text), len);
+  TEST_ASSERT_EQUAL_INT(0, appendEnergy(text, 10, state));
+  uint8_t expected[] = {
+    0x17, 0x00, 0x30, 0x00, 0x64, 0x00, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x30};
+  TEST_ASSERT_EQUAL_INT(
+    BINARY_ENERGY_SIZE, createBinaryEnergy(bfr, sizeof(bfr), state));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, bfr, sizeof(expected));
+  TEST_ASSERT_EQUAL_INT(0, createBinaryEnergy(bfr, 12, state));
+}
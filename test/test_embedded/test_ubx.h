@@ -0,0 +1,283 @@
+#include <unity.h>
+#include <string.h>
+#include <ubx.h>
+
+static void putLe32(uint8_t *bfr, uint32_t value) {
+    for (int i = 0; i < 4; i++) { bfr[i] = value >> (8 * i); }
+}
+
+/*
+ * NAV-PVT of 2026-03-23 12:35:19, 3D fix at 48.117302 N, 11.5166687 E,
+ * 2 m/s, 84.4 degrees
+ */
+static size_t navPvtFrame(uint8_t *bfr, size_t len, uint8_t fix_type) {
+    uint8_t payload[UBX_NAV_PVT_LENGTH] = {0};
+    payload[4] = 2026 & 0xff;
+    payload[5] = 2026 >> 8;
+    payload[6] = 3;
+    payload[7] = 23;
+    payload[8] = 12;
+    payload[9] = 35;
+    payload[10] = 19;
+    payload[11] = 0x07;
+    payload[20] = fix_type;
+    payload[21] = fix_type ? 0x01 : 0x00;
+    payload[23] = 11;
+    putLe32(payload + 24, 115166687);
+    putLe32(payload + 28, 481173020);
+    putLe32(payload + 40, 2500);
+    putLe32(payload + 60, 2000);
+    putLe32(payload + 64, 8440000);
+    payload[76] = 135;
+    return ubxFrame(bfr, len, UBX_CLASS_NAV, UBX_NAV_PVT, payload,
+        sizeof(payload));
+}
+
+void testUbxFrame() {
+    uint8_t bfr[32] = {0};
+    // CFG-MSG NAV-PVT once per navigation solution
+    const uint8_t expected[] = {
+        0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x07, 0x01, 0x13, 0x51};
+    size_t len = ubxSetRate(bfr, sizeof(bfr), UBX_CLASS_NAV, UBX_NAV_PVT, 1);
+    TEST_ASSERT_EQUAL_INT(sizeof(expected), len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, bfr, len);
+    // CFG-PRT, 20 bytes of payload, UBX output only
+    len = ubxSetPort(bfr, sizeof(bfr), 9600, UBX_PROTOCOL_UBX);
+    TEST_ASSERT_EQUAL_INT(28, len);
+    TEST_ASSERT_EQUAL_UINT8(0x80, bfr[14]);
+    TEST_ASSERT_EQUAL_UINT8(0x25, bfr[15]);
+    TEST_ASSERT_EQUAL_UINT8(UBX_PROTOCOL_UBX, bfr[20]);
+    // does not fit
+    TEST_ASSERT_EQUAL_INT(0, ubxSetPort(bfr, 27, 9600, UBX_PROTOCOL_UBX));
+}
+
+void testUbxNavPvt() {
+    uint8_t bfr[128] = {0};
+    UbxParser parser;
+    NmeaFix fix;
+    size_t len = navPvtFrame(bfr, sizeof(bfr), 3);
+    TEST_ASSERT_EQUAL_INT(100, len);
+    TEST_ASSERT_EQUAL_INT(len, parser.feed(bfr, len));
+    TEST_ASSERT_TRUE(parser.is(UBX_CLASS_NAV, UBX_NAV_PVT));
+    TEST_ASSERT_TRUE(parser.navPvt(&fix));
+    TEST_ASSERT_EQUAL_INT(2026, fix.year);
+    TEST_ASSERT_EQUAL_INT(3, fix.month);
+    TEST_ASSERT_EQUAL_INT(23, fix.day);
+    TEST_ASSERT_EQUAL_INT(12, fix.hour);
+    TEST_ASSERT_EQUAL_INT(35, fix.minute);
+    TEST_ASSERT_EQUAL_INT(19, fix.second);
+    TEST_ASSERT_EQUAL_INT32(481173020, fix.lat);
+    TEST_ASSERT_EQUAL_INT32(115166687, fix.lng);
+    // 2 m/s = 3.888 kn
+    TEST_ASSERT_EQUAL_UINT32(389, fix.speed);
+    TEST_ASSERT_EQUAL_UINT32(8440, fix.course);
+    TEST_ASSERT_EQUAL_INT(11, fix.satellites);
+    TEST_ASSERT_EQUAL_INT(135, fix.pdop);
+    TEST_ASSERT_EQUAL_UINT32(2500, fix.h_acc);
+    // no fix yet
+    len = navPvtFrame(bfr, sizeof(bfr), 0);
+    TEST_ASSERT_EQUAL_INT(len, parser.feed(bfr, len));
+    TEST_ASSERT_TRUE(parser.is(UBX_CLASS_NAV, UBX_NAV_PVT));
+    TEST_ASSERT_FALSE(parser.navPvt(&fix));
+}
+
+void testUbxChecksum() {
+    uint8_t bfr[128] = {0};
+    UbxParser parser;
+    size_t len = navPvtFrame(bfr, sizeof(bfr), 3);
+    bfr[30] ^= 0x01;
+    parser.feed(bfr, len);
+    TEST_ASSERT_FALSE(parser.complete);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.checksum_errors);
+    TEST_ASSERT_EQUAL_UINT32(0, parser.messages);
+}
+
+void testUbxStream() {
+    uint8_t stream[256] = {0};
+    const char *nmea = "$GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99*30\r\n";
+    size_t len = strlen(nmea);
+    memcpy(stream, nmea, len);
+    len += navPvtFrame(stream + len, sizeof(stream) - len, 3);
+    memcpy(stream + len, nmea, strlen(nmea));
+    len += strlen(nmea);
+    len += ubxSetRate(stream + len, sizeof(stream) - len, UBX_CLASS_NAV,
+        UBX_NAV_PVT, 1);
+    // handed over in pieces that split the frames
+    UbxParser parser;
+    NmeaFix fix;
+    size_t fixes = 0;
+    size_t others = 0;
+    for (size_t start = 0; start < len; start += 37) {
+        size_t end = (start + 37 < len) ? start + 37 : len;
+        size_t used = start;
+        while (used < end) {
+            used += parser.feed(stream + used, end - used);
+            if (parser.is(UBX_CLASS_NAV, UBX_NAV_PVT)) {
+                fixes += parser.navPvt(&fix);
+            } else if (parser.complete) {
+                others++;
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(1, fixes);
+    TEST_ASSERT_EQUAL_INT(1, others);
+    TEST_ASSERT_EQUAL_UINT32(0, parser.checksum_errors);
+    TEST_ASSERT_EQUAL_INT32(481173020, fix.lat);
+}
+
+/*
+ * Answer a configuration message with ACK-ACK or ACK-NAK
+ */
+static void ubxReply(UbxConfig &config, const uint8_t *frame, bool ack) {
+    uint8_t bfr[16] = {0};
+    UbxParser parser;
+    size_t len = ubxFrame(bfr, sizeof(bfr), UBX_CLASS_ACK,
+        ack ? UBX_ACK_ACK : UBX_ACK_NAK, frame + 2, 2);
+    parser.feed(bfr, len);
+    config.onMessage(parser);
+}
+
+void testUbxConfig() {
+    uint8_t frame[64] = {0};
+    UbxConfig config;
+    UbxSettings settings = {true, 38400, UBX_GNSS_GPS | UBX_GNSS_GALILEO,
+        true};
+    config.begin(settings, 9600);
+    // class and id of every message, one at a time
+    const uint8_t expected[][2] = {
+        {UBX_CLASS_CFG, UBX_CFG_MSG}, {UBX_CLASS_CFG, UBX_CFG_MSG},
+        {UBX_CLASS_CFG, UBX_CFG_MSG}, {UBX_CLASS_CFG, UBX_CFG_GNSS},
+        {UBX_CLASS_CFG, UBX_CFG_RXM}, {UBX_CLASS_CFG, UBX_CFG_MSG},
+        {UBX_CLASS_CFG, UBX_CFG_PRT}};
+    int64_t now = 0;
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        size_t len = config.poll(now, frame, sizeof(frame));
+        TEST_ASSERT_GREATER_THAN(0, len);
+        TEST_ASSERT_EQUAL_UINT8(expected[i][0], frame[2]);
+        TEST_ASSERT_EQUAL_UINT8(expected[i][1], frame[3]);
+        // nothing else until the reply
+        TEST_ASSERT_EQUAL_INT(0, config.poll(now + 10, frame + 32, 32));
+        // the local UART follows the new rate right away
+        TEST_ASSERT_EQUAL_UINT32(
+            (i + 1 < sizeof(expected) / sizeof(expected[0])) ? 9600 : 38400,
+            config.baud);
+        // a reply to another message is ignored
+        ubxReply(config, frame + 1, true);
+        TEST_ASSERT_FALSE(config.done());
+        ubxReply(config, frame, true);
+        now += 50;
+    }
+    TEST_ASSERT_TRUE(config.done());
+    TEST_ASSERT_EQUAL_INT(0, config.poll(now, frame, sizeof(frame)));
+    TEST_ASSERT_TRUE(config.isAcked(UBX_STEP_NAV_PVT));
+    TEST_ASSERT_EQUAL_UINT16(0, config.rejected);
+    // NMEA off sends the port configuration again, at the same rate
+    config.setOutput(UBX_PROTOCOL_UBX);
+    TEST_ASSERT_FALSE(config.done());
+    TEST_ASSERT_EQUAL_INT(28, config.poll(now, frame, sizeof(frame)));
+    TEST_ASSERT_EQUAL_UINT8(UBX_PROTOCOL_UBX, frame[6 + 14]);
+    TEST_ASSERT_EQUAL_UINT8(38400 & 0xff, frame[6 + 8]);
+    ubxReply(config, frame, true);
+    TEST_ASSERT_TRUE(config.done());
+    config.setOutput(UBX_PROTOCOL_UBX);
+    TEST_ASSERT_TRUE(config.done());
+    // the same messages after the next power on
+    uint8_t first[64] = {0};
+    size_t first_len = ubxSetRate(first, sizeof(first), UBX_CLASS_NMEA,
+        UBX_NMEA_GSV, 0);
+    config.begin(settings, 9600);
+    TEST_ASSERT_EQUAL_INT(first_len, config.poll(now, frame, sizeof(frame)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(first, frame, first_len);
+    TEST_ASSERT_EQUAL_UINT16(0, config.acked);
+}
+
+void testUbxConfigRejected() {
+    uint8_t frame[64] = {0};
+    UbxConfig config;
+    UbxSettings settings = {false, 38400, 0, false};
+    config.begin(settings, 9600);
+    int64_t now = 0;
+    // NAK skips the message, the rest is still sent
+    config.poll(now, frame, sizeof(frame));
+    ubxReply(config, frame, false);
+    TEST_ASSERT_EQUAL_UINT16(1 << UBX_STEP_GSV, config.rejected);
+    // no reply: repeated after the timeout, then skipped
+    config.poll(now, frame, sizeof(frame));
+    TEST_ASSERT_EQUAL_INT(0, config.poll(now + UBX_ACK_TIMEOUT - 1, frame,
+        sizeof(frame)));
+    for (int i = 1; i < UBX_CONFIG_ATTEMPTS; i++) {
+        now += UBX_ACK_TIMEOUT;
+        TEST_ASSERT_EQUAL_INT(11, config.poll(now, frame, sizeof(frame)));
+        TEST_ASSERT_EQUAL_UINT8(UBX_NMEA_GLL, frame[7]);
+    }
+    now += UBX_ACK_TIMEOUT;
+    config.poll(now, frame, sizeof(frame));
+    TEST_ASSERT_EQUAL_UINT8(UBX_NMEA_VTG, frame[7]);
+    TEST_ASSERT_TRUE(config.rejected & (1 << UBX_STEP_GLL));
+    ubxReply(config, frame, true);
+    config.poll(now, frame, sizeof(frame));
+    ubxReply(config, frame, true);
+    // the receiver does not answer at the new rate, back to the old one
+    for (int i = 0; i < UBX_CONFIG_ATTEMPTS; i++) {
+        TEST_ASSERT_EQUAL_INT(28, config.poll(now, frame, sizeof(frame)));
+        TEST_ASSERT_EQUAL_UINT32(38400, config.baud);
+        now += UBX_ACK_TIMEOUT;
+    }
+    config.poll(now, frame, sizeof(frame));
+    TEST_ASSERT_TRUE(config.done());
+    TEST_ASSERT_EQUAL_UINT32(9600, config.baud);
+    TEST_ASSERT_TRUE(config.rejected & (1 << UBX_STEP_PORT));
+}
+
+void testUbxConfigProbe() {
+    uint8_t frame[64] = {0};
+    UbxConfig config;
+    UbxSettings settings = {false, 38400, 0, false};
+    config.begin(settings, 9600);
+    int64_t now = 0;
+    // no reply at all, the receiver may still run at 38400
+    for (int i = 0; i < UBX_CONFIG_ATTEMPTS; i++) {
+        config.poll(now, frame, sizeof(frame));
+        now += UBX_ACK_TIMEOUT;
+    }
+    config.poll(now, frame, sizeof(frame));
+    TEST_ASSERT_EQUAL_UINT32(38400, config.baud);
+    TEST_ASSERT_EQUAL_UINT8(UBX_NMEA_GSV, frame[7]);
+    TEST_ASSERT_EQUAL_UINT16(0, config.rejected);
+    while (!config.done()) {
+        ubxReply(config, frame, true);
+        config.poll(now, frame, sizeof(frame));
+    }
+    TEST_ASSERT_EQUAL_UINT32(38400, config.baud);
+    TEST_ASSERT_TRUE(config.isAcked(UBX_STEP_PORT));
+}
+
+void testUbxAiding() {
+    uint8_t bfr[40] = {0};
+    UbxParser parser;
+    // 2026-03-23 12:35:19 +/- 30 s
+    size_t len = ubxAidTime(bfr, sizeof(bfr), 1774269319, 30);
+    TEST_ASSERT_EQUAL_INT(32, len);
+    TEST_ASSERT_EQUAL_INT(len, parser.feed(bfr, len));
+    TEST_ASSERT_TRUE(parser.is(UBX_CLASS_MGA, UBX_MGA_INI));
+    TEST_ASSERT_EQUAL_UINT8(0x10, parser.payload[0]);
+    TEST_ASSERT_EQUAL_UINT8(2026 & 0xff, parser.payload[4]);
+    TEST_ASSERT_EQUAL_UINT8(2026 >> 8, parser.payload[5]);
+    TEST_ASSERT_EQUAL_UINT8(3, parser.payload[6]);
+    TEST_ASSERT_EQUAL_UINT8(23, parser.payload[7]);
+    TEST_ASSERT_EQUAL_UINT8(12, parser.payload[8]);
+    TEST_ASSERT_EQUAL_UINT8(35, parser.payload[9]);
+    TEST_ASSERT_EQUAL_UINT8(19, parser.payload[10]);
+    TEST_ASSERT_EQUAL_UINT8(30, parser.payload[16]);
+    // 37.5 S, 122.25 W +/- 5 km
+    len = ubxAidPosition(bfr, sizeof(bfr), -375000000, -1222500000, 500000);
+    TEST_ASSERT_EQUAL_INT(28, len);
+    TEST_ASSERT_EQUAL_INT(len, parser.feed(bfr, len));
+    TEST_ASSERT_TRUE(parser.is(UBX_CLASS_MGA, UBX_MGA_INI));
+    TEST_ASSERT_EQUAL_UINT8(0x01, parser.payload[0]);
+    int32_t lat = parser.payload[4] | (parser.payload[5] << 8) |
+        (parser.payload[6] << 16) | (parser.payload[7] << 24);
+    TEST_ASSERT_EQUAL_INT32(-375000000, lat);
+    TEST_ASSERT_EQUAL_UINT8(500000 & 0xff, parser.payload[16]);
+    TEST_ASSERT_EQUAL_UINT8((500000 >> 16) & 0xff, parser.payload[18]);
+}
@@ -0,0 +1,94 @@
+/*
+ * Time-to-send and +SBDIX attempts of Rockblock against the emulated modem.
+ * Each message is a wake up: a new Rockblock instance with the signal history
+ * of the last one, the trace starts over and sending stops at
+ * SYSTEM_TIME_OUT.
+ *
+ * The traces are shaped after field logs (signal strength over time in ms);
+ * replace them with recorded +CSQ logs to compare against actual conditions.
+ */
+#include <unity.h>
+#include <stdio.h>
+#include <rockblock.h>
+#include "rockblockEmulator.h"
+
+#define BENCH_MESSAGES 50
+// see helpers.h
+#define BENCH_TIME_OUT 360000
+#define BENCH_INTERVAL 600000
+
+// clear view of the sky
+static const SignalSample openSkyTrace[] = {
+    {0, 4}, {20000, 5}, {90000, 4}, {150000, 5}};
+// buoy rolling in swell, the antenna is shadowed by waves every few seconds
+static const SignalSample swellTrace[] = {
+    {0, 2}, {4000, 4}, {9000, 1}, {13000, 3}, {20000, 4}, {26000, 2},
+    {31000, 1}, {36000, 3}, {45000, 5}, {52000, 2}, {58000, 4}, {70000, 1},
+    {76000, 3}, {90000, 4}, {104000, 2}, {110000, 4}, {130000, 3},
+    {150000, 1}, {170000, 4}, {200000, 2}, {230000, 4}, {260000, 3}};
+// satellites low on the horizon
+static const SignalSample poorTrace[] = {
+    {0, 1}, {30000, 2}, {60000, 1}, {100000, 3}, {115000, 2}, {160000, 1},
+    {220000, 2}, {250000, 3}, {265000, 1}};
+
+struct BenchResult {
+    uint32_t sent = 0;
+    uint64_t time_to_send = 0;
+    uint32_t sessions = 0;
+    uint32_t polls = 0;
+};
+
+static BenchResult benchTrace(const SignalSample *trace, size_t len) {
+    BenchResult result;
+    char bfr[64] = {0};
+    signalHistory history;
+    RockblockEmulator modem(4242);
+    EmulatorExpander expander(modem);
+    for (size_t i = 0; i < BENCH_MESSAGES; i++) {
+        Rockblock rb(expander, modem, 1);
+        rb.setSignalHistory(history);
+        modem.setSignalTrace(trace, len);
+        snprintf(bfr, sizeof(bfr), "PK101;bench:%d", (int) i);
+        rb.toggle(true);
+        rb.sendMessage(bfr);
+        uint32_t elapsed = runRockblock(
+            rb, modem, [&]() { return rb.sendSuccess; }, BENCH_TIME_OUT);
+        if (rb.sendSuccess) {
+            result.sent++;
+            result.time_to_send += elapsed;
+        }
+        rb.toggle(false);
+        history = rb.getSignalHistory();
+        advanceNativeTime((int64_t) (BENCH_INTERVAL - elapsed) * 1000);
+    }
+    result.sessions = modem.sessions;
+    result.polls = modem.polls;
+    return result;
+}
+
+static void reportTrace(const char *name, const BenchResult &result) {
+    char report[256] = {0};
+    snprintf(report, sizeof(report),
+        "%-9s %2lu of %d sent, %.0f s to send, %.2f SBDIX/message, "
+        "%lu signal polls", name, (unsigned long) result.sent, BENCH_MESSAGES,
+        result.sent ? result.time_to_send / 1000.0 / result.sent : 0,
+        result.sent ? (double) result.sessions / result.sent : 0,
+        (unsigned long) result.polls);
+    TEST_MESSAGE(report);
+}
+
+void benchRockblockTraces() {
+    BenchResult openSky = benchTrace(
+        openSkyTrace, sizeof(openSkyTrace) / sizeof(SignalSample));
+    BenchResult swell = benchTrace(
+        swellTrace, sizeof(swellTrace) / sizeof(SignalSample));
+    BenchResult poor = benchTrace(
+        poorTrace, sizeof(poorTrace) / sizeof(SignalSample));
+    reportTrace("open sky:", openSky);
+    reportTrace("swell:", swell);
+    reportTrace("poor:", poor);
+
+    TEST_ASSERT_EQUAL_UINT32(BENCH_MESSAGES, openSky.sent);
+    TEST_ASSERT_GREATER_OR_EQUAL(openSky.sent, openSky.sessions);
+    TEST_ASSERT_GREATER_OR_EQUAL(poor.sent, openSky.sent);
+}
@@ -0,0 +1,259 @@
+/*
+ * Scriptable RockBLOCK 9704 stand-in for the development machine.
+ *
+ * Implements AbstractSerial and answers the JSPR requests used by
+ * Rockblock9704: apiVersion, simConfig, operationalState, constellationState,
+ * messageOriginate and messageOriginateSegment. Messages are requested in
+ * segments of segment_size bytes, the final status follows after the session
+ * latency. Responses are delayed on the simulated clock of hal.h.
+ *
+ * Results of sessions can be scripted, MT messages queued at the "gateway"
+ * are pushed after the next successful session or right away with
+ * deliver().
+ */
+#ifndef __JSPR_EMULATOR_H__
+#define __JSPR_EMULATOR_H__
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <hal.h>
+#include <jspr.h>
+
+class JsprEmulator: public AbstractSerial {
+    private:
+        // responses become readable at the given time
+        std::deque<std::pair<int64_t, std::string>> pending;
+        std::string readable;
+        JsprParser parser;
+        bool active = false;
+        // message being received from the host
+        std::string mo;
+        int32_t mo_id = -1;
+        size_t mo_length = 0;
+        int32_t next_id = 1;
+
+        int64_t now() { return esp_timer_get_time() / 1000; }
+
+        void respond(const std::string &line, uint32_t latency) {
+            int64_t at = this->now() + latency;
+            // keep the order of messages
+            if (!this->pending.empty() && this->pending.back().first > at) {
+                at = this->pending.back().first;
+            }
+            this->pending.push_back({at, line + "\r"});
+        }
+
+        void respond(int code, const char *target, const std::string &json,
+            uint32_t latency
+        ) {
+            char bfr[48] = {0};
+            snprintf(bfr, sizeof(bfr), "%d %s ", code, target);
+            this->respond(bfr + json, latency);
+        }
+
+        void requestSegment(uint32_t latency) {
+            size_t start = this->mo.size();
+            size_t len = this->mo_length - start;
+            len = (len < this->segment_size) ? len : this->segment_size;
+            char bfr[128] = {0};
+            snprintf(bfr, sizeof(bfr), "{\"topic_id\":244,\"message_id\":%d,"
+                "\"segment_length\":%d,\"segment_start\":%d}",
+                (int) this->mo_id, (int) len, (int) start);
+            this->respond(JSPR_UNSOLICITED, "messageOriginateSegment", bfr,
+                latency);
+        }
+
+        /*
+         * The whole message arrived, report its final status after the
+         * session latency
+         */
+        void finishMessage() {
+            bool success = this->signal > 0;
+            if (!this->results.empty()) {
+                success = this->results.front();
+                this->results.pop_front();
+            }
+            this->sessions++;
+            char bfr[128] = {0};
+            snprintf(bfr, sizeof(bfr), "{\"topic_id\":244,\"message_id\":%d,"
+                "\"final_mo_status\":\"%s\"}", (int) this->mo_id,
+                success ? "mo_ack_received" : "mo_timeout");
+            this->respond(JSPR_UNSOLICITED, "messageOriginateStatus", bfr,
+                this->session_latency);
+            if (success) {
+                this->delivered.push_back(this->mo);
+                if (!this->mt_queue.empty()) { this->deliver(); }
+            }
+            this->mo.clear();
+            this->mo_id = -1;
+        }
+
+        void handle() {
+            const char *target = this->parser.target;
+            std::string echo = this->parser.body();
+            this->requests++;
+            if (strcmp(target, "apiVersion") == 0) {
+                this->respond(200, target, echo, this->latency);
+            } else if (strcmp(target, "simConfig") == 0) {
+                this->respond(200, target, echo, this->latency);
+            } else if (strcmp(target, "operationalState") == 0) {
+                this->active = true;
+                this->respond(200, target, echo, this->latency);
+            } else if (!this->active) {
+                this->respond(409, target, "{}", this->latency);
+            } else if (strcmp(target, "constellationState") == 0) {
+                char bfr[96] = {0};
+                snprintf(bfr, sizeof(bfr), "{\"constellation_visible\":%s,"
+                    "\"signal_bars\":%d,\"signal_level\":%d}",
+                    this->signal ? "true" : "false", this->signal,
+                    -120 + 5 * this->signal);
+                this->respond(200, target, bfr, this->latency);
+            } else if (strcmp(target, "messageOriginate") == 0) {
+                int32_t length = 0;
+                this->parser.getInt("message_length", &length);
+                if (this->mo_id >= 0 || length <= 0) {
+                    this->respond(409, target, "{}", this->latency);
+                    return;
+                }
+                this->mo_id = this->next_id++;
+                this->mo_length = length;
+                this->mo.clear();
+                char bfr[160] = {0};
+                snprintf(bfr, sizeof(bfr), "{\"topic_id\":244,"
+                    "\"message_length\":%d,\"message_id\":%d,"
+                    "\"message_response\":\"message_accepted\"}",
+                    (int) length, (int) this->mo_id);
+                this->respond(200, target, bfr, this->latency);
+                this->requestSegment(this->latency);
+            } else if (strcmp(target, "messageOriginateSegment") == 0) {
+                int32_t id = -1;
+                int32_t start = -1;
+                size_t data_len = 0;
+                size_t decoded = 0;
+                uint8_t data[JSPR_MAX_LINE_SIZE];
+                this->parser.getInt("message_id", &id);
+                this->parser.getInt("segment_start", &start);
+                const char *raw = this->parser.getRaw("data", &data_len);
+                if (
+                    id != this->mo_id || (size_t) start != this->mo.size() ||
+                    !raw || !base64Decode(raw, data_len, data, sizeof(data),
+                        &decoded)
+                ) {
+                    this->respond(400, target, "{}", this->latency);
+                    return;
+                }
+                this->segments++;
+                this->mo.append((const char*) data, decoded);
+                this->respond(200, target,
+                    "{\"status\":\"segment_accepted\"}", this->latency);
+                if (this->mo.size() < this->mo_length) {
+                    this->requestSegment(this->latency);
+                } else {
+                    this->finishMessage();
+                }
+            } else {
+                this->respond(400, target, "{}", this->latency);
+            }
+        }
+
+    public:
+        uint32_t latency = 20;
+        uint32_t session_latency = 15000;
+        size_t segment_size = 1024;
+        int signal = 5;
+        // success of the next sessions, without script depends on signal
+        std::deque<bool> results;
+        // messages delivered to the gateway
+        std::vector<std::string> delivered;
+        // MT messages waiting at the gateway
+        std::deque<std::string> mt_queue;
+        uint32_t sessions = 0;
+        uint32_t segments = 0;
+        uint32_t requests = 0;
+
+        // AbstractSerial
+        void begin(uint32_t serialSpeed, int serial8N1,
+            uint8_t rxPin, uint8_t txPin) override {};
+
+        void print(const char *bfr) override {
+            this->write((const uint8_t*) bfr, strlen(bfr));
+        }
+
+        size_t write(const uint8_t *bfr, size_t len) override {
+            for (size_t i = 0; i < len; i++) {
+                if (this->parser.feed((char) bfr[i])) { this->handle(); }
+            }
+            return len;
+        }
+
+        bool available() override {
+            while (
+                !this->pending.empty() &&
+                this->pending.front().first <= this->now()
+            ) {
+                this->readable += this->pending.front().second;
+                this->pending.pop_front();
+            }
+            return this->readable.size() > 0;
+        }
+
+        char read() override {
+            if (!this->available()) { return 0; }
+            char c = this->readable[0];
+            this->readable.erase(0, 1);
+            return c;
+        }
+
+        /*
+         * Push the oldest MT message in segments of segment_size bytes
+         */
+        void deliver() {
+            if (this->mt_queue.empty() || !this->active) { return; }
+            std::string message = this->mt_queue.front();
+            this->mt_queue.pop_front();
+            int id = this->next_id++;
+            char bfr[JSPR_MAX_LINE_SIZE] = {0};
+            snprintf(bfr, sizeof(bfr), "{\"topic_id\":244,\"message_id\":%d,"
+                "\"message_length_max\":%d}", id, (int) message.size());
+            this->respond(JSPR_UNSOLICITED, "messageTerminate", bfr,
+                this->latency);
+            for (size_t start = 0; start < message.size();
+                start += this->segment_size
+            ) {
+                size_t len = message.size() - start;
+                len = (len < this->segment_size) ? len : this->segment_size;
+                int offset = snprintf(bfr, sizeof(bfr), "{\"topic_id\":244,"
+                    "\"message_id\":%d,\"segment_length\":%d,"
+                    "\"segment_start\":%d,\"data\":\"", id, (int) len,
+                    (int) start);
+                size_t encoded = base64Encode(
+                    (const uint8_t*) message.data() + start, len,
+                    bfr + offset, sizeof(bfr) - offset);
+                snprintf(bfr + offset + encoded,
+                    sizeof(bfr) - offset - encoded, "\"}");
+                this->respond(JSPR_UNSOLICITED, "messageTerminateSegment", bfr,
+                    this->latency);
+            }
+            snprintf(bfr, sizeof(bfr), "{\"topic_id\":244,\"message_id\":%d,"
+                "\"final_mt_status\":\"complete\"}", id);
+            this->respond(JSPR_UNSOLICITED, "messageTerminateStatus", bfr,
+                this->latency);
+        }
+
+        // no ring indicator, MT messages are pushed
+        bool ringIndicatorLevel() { return true; }
+
+        // the modem forgets its state when powered off
+        void powerCycle() {
+            this->pending.clear();
+            this->readable.clear();
+            this->parser.reset();
+            this->active = false;
+            this->mo.clear();
+            this->mo_id = -1;
+        }
+};
+
+#endif
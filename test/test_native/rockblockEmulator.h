@@ -0,0 +1,420 @@
+/*
+ * Scriptable RockBLOCK 9603 emulator for the development machine.
+ *
+ * Implements AbstractSerial and answers the SBD commands used by Rockblock:
+ * +SBDD0/2, +SBDMTA, +SBDWT, +SBDWB, +CSQ, +CSQF, +SBDIX(A), +SBDRT, +SBDRB,
+ * and E0/V0 for the terse dialect (no echo, numeric result codes).
+ * Responses are delayed by configurable latencies on the simulated clock of
+ * hal.h, i.e. time only passes when the caller advances it.
+ *
+ * Session results depend on a signal trace and a success rate per signal
+ * strength. Results can also be scripted, e.g. to replay failure codes.
+ * MT messages are queued at the "gateway" and delivered one per session.
+ */
+#ifndef __ROCKBLOCK_EMULATOR_H__
+#define __ROCKBLOCK_EMULATOR_H__
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <hal.h>
+#include <tca95xx.h>
+#include <frameParser.h>
+
+// signal strength from the given time on, in ms since the trace started
+struct SignalSample {
+    uint32_t time;
+    uint8_t signal;
+};
+
+class RockblockEmulator: public AbstractSerial {
+    private:
+        enum InputMode { COMMAND_INPUT, TEXT_INPUT, BINARY_INPUT };
+        InputMode mode = COMMAND_INPUT;
+        // command line or message being received
+        std::string input;
+        size_t binary_len = 0;
+        bool line_end = false;
+        // responses become readable at the given time
+        std::deque<std::pair<int64_t, std::string>> pending;
+        std::string readable;
+        // the modem handles one command at a time
+        int64_t busy_until = 0;
+        std::string mo_buffer;
+        std::string mt_buffer;
+        uint16_t momsn = 0;
+        uint16_t mtmsn = 0;
+        bool ring_alerts = false;
+        // E1 and V1 after power on
+        bool echo = true;
+        bool verbose = true;
+        std::vector<SignalSample> trace;
+        int64_t trace_start = 0;
+        uint32_t seed = 1;
+
+        int64_t now() { return esp_timer_get_time() / 1000; }
+
+        float uniform() {
+            this->seed ^= this->seed << 13;
+            this->seed ^= this->seed >> 17;
+            this->seed ^= this->seed << 5;
+            return (this->seed % 100000) / 100000.0;
+        }
+
+        /*
+         * Pick the response for the current dialect
+         */
+        std::string reply(const std::string &verbose, const std::string &terse) {
+            return this->verbose ? verbose : terse;
+        }
+
+        /*
+         * Queue a response after the command latency, the echo is immediate
+         */
+        void respond(const std::string &echo, const std::string &response,
+            uint32_t latency
+        ) {
+            int64_t start = (this->busy_until > this->now()) ?
+                this->busy_until : this->now();
+            if (this->drop_responses > 0) {
+                this->drop_responses--;
+                return;
+            }
+            if (echo.size() > 0) { this->pending.push_back({start, echo}); }
+            this->busy_until = start + latency;
+            this->pending.push_back({this->busy_until, response});
+        }
+
+        /*
+         * +SBDIX and +SBDIXA, one MT message is retrieved per session
+         */
+        void session(const std::string &echo) {
+            char bfr[64] = {0};
+            this->sessions++;
+            uint8_t signal = this->signalAt(this->now());
+            uint8_t mo_status = 18;
+            if (!this->results.empty()) {
+                mo_status = this->results.front();
+                this->results.pop_front();
+            } else if (signal == 0) {
+                mo_status = 32;
+            } else if (this->uniform() < this->success_rate[signal]) {
+                mo_status = 0;
+            }
+            uint8_t mt_status = 2;
+            if (mo_status < 5) {
+                this->successes++;
+                if (this->mo_buffer.size() > 0) {
+                    this->momsn++;
+                    this->delivered.push_back(this->mo_buffer);
+                }
+                mt_status = 0;
+                if (!this->mt_queue.empty()) {
+                    this->mt_buffer = this->mt_queue.front();
+                    this->mt_queue.pop_front();
+                    this->mtmsn++;
+                    mt_status = 1;
+                }
+            }
+            snprintf(bfr, sizeof(bfr), "+SBDIX: %d, %d, %d, %d, %d, %d\r\n",
+                mo_status, this->momsn, mt_status, this->mtmsn,
+                (mt_status == 1) ? (int) this->mt_buffer.size() : 0,
+                (int) this->mt_queue.size());
+            this->respond(echo, std::string(bfr) + this->reply("\r\nOK\r\n", "0\r"),
+                (mo_status < 32) ? this->session_latency : this->command_latency);
+        }
+
+        /*
+         * Execute a command line without the trailing \r
+         */
+        void command(const std::string &line) {
+            char bfr[32] = {0};
+            std::string echo = this->echo ? line + "\r\n" : "";
+            std::string error = this->reply("ERROR\r\n", "4\r");
+            if (line.compare(0, 2, "AT") != 0) {
+                this->respond(echo, error, this->command_latency);
+                return;
+            }
+            std::string cmd = line.substr(2);
+            if (cmd == "E0" || cmd == "V0") {
+                // the echo of E0 is still sent, V0 is answered numerically
+                if (cmd == "E0") { this->echo = false; }
+                if (cmd == "V0") { this->verbose = false; }
+                this->respond(echo, this->reply("OK\r\n", "0\r"),
+                    this->command_latency);
+            } else if (cmd == "+SBDD0" || cmd == "+SBDD2") {
+                this->mo_buffer.clear();
+                if (cmd == "+SBDD2") { this->mt_buffer.clear(); }
+                this->respond(echo, this->reply("0\r\n\r\nOK\r\n", "0\r\n0\r"),
+                    this->command_latency);
+            } else if (cmd == "+SBDMTA=1" || cmd == "+SBDMTA=0") {
+                this->ring_alerts = cmd == "+SBDMTA=1";
+                this->respond(echo, this->reply("OK\r\n", "0\r"),
+                    this->command_latency);
+            } else if (cmd == "+SBDWT") {
+                this->mode = TEXT_INPUT;
+                this->respond(echo, "READY\r\n", this->command_latency);
+            } else if (cmd.compare(0, 7, "+SBDWB=") == 0) {
+                this->binary_len = atoi(cmd.c_str() + 7);
+                if (this->binary_len < 1 || this->binary_len > MAX_MESSAGE_SIZE) {
+                    this->respond(echo, this->reply("3\r\n\r\nOK\r\n", "3\r\n0\r"),
+                        this->command_latency);
+                    return;
+                }
+                this->mode = BINARY_INPUT;
+                this->respond(echo, "READY\r\n", this->command_latency);
+            } else if (cmd == "+CSQ" || cmd == "+CSQF") {
+                // +CSQ waits for a new measurement, +CSQF returns the last
+                // one the modem made by itself
+                bool fresh = cmd == "+CSQ";
+                this->polls++;
+                uint8_t signal = this->signalAt(
+                    this->now() + (fresh ? this->csq_latency : 0));
+                snprintf(bfr, sizeof(bfr), "%s:%d\r\n%s",
+                    cmd.c_str(), signal, this->reply("\r\nOK\r\n", "0\r").c_str());
+                this->respond(echo, bfr,
+                    fresh ? this->csq_latency : this->command_latency);
+            } else if (cmd.compare(0, 6, "+SBDIX") == 0) {
+                size_t eq = cmd.find('=');
+                if (eq != std::string::npos) {
+                    this->location = cmd.substr(eq + 1);
+                }
+                if (cmd.compare(0, 7, "+SBDIXA") == 0) {
+                    this->ring_indicator = false;
+                }
+                this->session(echo);
+            } else if (cmd == "+SBDRT") {
+                this->respond(echo, "+SBDRT:\r\n" + this->mt_buffer +
+                    this->reply("\r\nOK\r\n", "\r\n0\r"), this->command_latency);
+            } else if (cmd == "+SBDRB") {
+                uint16_t len = this->mt_buffer.size();
+                uint16_t checksum = sbdChecksum(
+                    (const uint8_t*) this->mt_buffer.data(), len);
+                std::string response;
+                response += (char) (len >> 8);
+                response += (char) (len & 0xff);
+                response += this->mt_buffer;
+                response += (char) (checksum >> 8);
+                response += (char) (checksum & 0xff);
+                response += this->reply("\r\nOK\r\n", "0\r");
+                this->respond(echo, response, this->command_latency);
+            } else {
+                this->respond(echo, error, this->command_latency);
+            }
+        }
+
+        /*
+         * Handle bytes from Rockblock depending on the input mode
+         */
+        void receive(char c) {
+            // line feed after a command, the input mode might have changed
+            if (this->line_end && c == '\n') {
+                this->line_end = false;
+                return;
+            }
+            this->line_end = false;
+            this->input += c;
+            switch (this->mode) {
+                case COMMAND_INPUT:
+                    if (c == '\r') {
+                        this->input.pop_back();
+                        this->line_end = true;
+                        this->command(this->input);
+                        this->input.clear();
+                    }
+                    break;
+                case TEXT_INPUT:
+                    if (c != '\r') { break; }
+                    // the trailing \r is part of the message in the MO buffer
+                    this->mo_buffer = this->input;
+                    this->input.clear();
+                    this->mode = COMMAND_INPUT;
+                    this->respond("", this->reply("\r\n0\r\n\r\nOK\r\n", "0\r\n0\r"),
+                        this->command_latency);
+                    break;
+                case BINARY_INPUT: {
+                    if (this->input.size() < this->binary_len + 2) { break; }
+                    const uint8_t *data = (const uint8_t*) this->input.data();
+                    uint16_t checksum = data[this->binary_len] << 8 |
+                        data[this->binary_len + 1];
+                    bool valid = checksum == sbdChecksum(data, this->binary_len);
+                    uint8_t code = valid ? 0 : 2;
+                    if (!this->write_results.empty()) {
+                        code = this->write_results.front();
+                        this->write_results.pop_front();
+                    }
+                    if (code == 0) {
+                        this->mo_buffer = this->input.substr(0, this->binary_len);
+                    }
+                    this->writes++;
+                    this->input.clear();
+                    this->mode = COMMAND_INPUT;
+                    std::string result(1, '0' + code);
+                    this->respond("", this->reply(result + "\r\n\r\nOK\r\n",
+                        result + "\r\n0\r"), this->command_latency);
+                    break;
+                }
+            }
+        }
+
+    public:
+        // latencies in ms
+        uint32_t command_latency = 50;
+        uint32_t csq_latency = 1000;
+        uint32_t session_latency = 20000;
+        // probability of a successful session per signal strength
+        float success_rate[SIGNAL_LEVELS] = {0, 0.1, 0.3, 0.6, 0.8, 0.9};
+        // MO status of the next sessions, overrides success_rate
+        std::deque<uint8_t> results;
+        // +SBDWB result of the next binary writes, overrides the checksum
+        std::deque<uint8_t> write_results;
+        // queued at the gateway
+        std::deque<std::string> mt_queue;
+        // the modem does not answer the next commands
+        uint32_t drop_responses = 0;
+        // statistics
+        std::vector<std::string> delivered;
+        std::string location;
+        uint32_t sessions = 0;
+        uint32_t successes = 0;
+        uint32_t polls = 0;
+        uint32_t writes = 0;
+        bool ring_indicator = false;
+        // UART traffic in bytes, from and to the host
+        uint32_t bytes_received = 0;
+        uint32_t bytes_sent = 0;
+
+        RockblockEmulator(uint32_t seed=1) {
+            this->seed = seed ? seed : 1;
+            this->setSignal(5);
+        }
+
+        // AbstractSerial
+        void begin(uint32_t serialSpeed, int serial8N1,
+            uint8_t rxPin, uint8_t txPin) override {};
+
+        void print(const char *bfr) override {
+            this->write((const uint8_t*) bfr, strlen(bfr));
+        }
+
+        size_t write(const uint8_t *bfr, size_t len) override {
+            for (size_t i = 0; i < len; i++) { this->receive(bfr[i]); }
+            this->bytes_received += len;
+            return len;
+        }
+
+        bool available() override {
+            while (
+                !this->pending.empty() &&
+                this->pending.front().first <= this->now()
+            ) {
+                this->readable += this->pending.front().second;
+                this->pending.pop_front();
+            }
+            return this->readable.size() > 0;
+        }
+
+        char read() override {
+            if (this->readable.size() == 0) { return 0; }
+            char c = this->readable[0];
+            this->readable.erase(0, 1);
+            this->bytes_sent++;
+            return c;
+        }
+
+        /*
+         * Signal strength follows the trace, the last value is kept
+         */
+        void setSignalTrace(const SignalSample *samples, size_t len) {
+            this->trace.assign(samples, samples + len);
+            this->trace_start = this->now();
+        }
+
+        void setSignal(uint8_t signal) {
+            SignalSample sample = {0, signal};
+            this->setSignalTrace(&sample, 1);
+        }
+
+        uint8_t signalAt(int64_t time) {
+            uint8_t signal = 0;
+            for (const SignalSample &sample : this->trace) {
+                if (time - this->trace_start < sample.time) { break; }
+                signal = sample.signal;
+            }
+            return signal;
+        }
+
+        /*
+         * A new MT message at the gateway, ring alerts are only sent if
+         * enabled with +SBDMTA=1
+         */
+        void ringAlert() {
+            if (!this->ring_alerts) { return; }
+            this->ring_indicator = true;
+            this->pending.push_back(
+                {this->now(), this->reply("SBDRING\r\n", "126\r")});
+        }
+
+        // level of the ring indicator output, active low
+        bool ringIndicatorLevel() { return !this->ring_indicator; }
+
+        // the modem loses its buffers and settings when powered off
+        void powerCycle() {
+            this->mode = COMMAND_INPUT;
+            this->input.clear();
+            this->line_end = false;
+            this->pending.clear();
+            this->readable.clear();
+            this->mo_buffer.clear();
+            this->mt_buffer.clear();
+            this->ring_alerts = false;
+            this->ring_indicator = false;
+            this->echo = true;
+            this->verbose = true;
+            this->busy_until = this->now();
+        }
+};
+
+/*
+ * Rockblock switches the modem with the IO expander, Modem provides
+ * powerCycle() and ringIndicatorLevel()
+ */
+template <typename Modem>
+class EmulatorExpander: public AbstractExpander {
+    private:
+        Modem *modem;
+        uint8_t enable_pin;
+        bool level = true;
+    public:
+        // level of the other pins written, e.g. RTS
+        bool pins[20] = {0};
+        EmulatorExpander(Modem &modem, uint8_t enable_pin=1) {
+            this->modem = &modem;
+            this->enable_pin = enable_pin;
+        };
+        void init() override {};
+        void pinMode(uint8_t pin, bool mode) override {};
+        void pinMode(uint8_t port, uint8_t bit, bool mode) override {};
+        // the enable pin is active low
+        void digitalWrite(uint8_t pin, bool value) override {
+            if (pin != this->enable_pin) {
+                if (pin < 20) { this->pins[pin] = value; }
+                return;
+            }
+            if (value && !this->level) { this->modem->powerCycle(); }
+            this->level = value;
+        };
+        void digitalWrite(uint8_t port, uint8_t bit, bool value) override {
+            this->digitalWrite(port * 10 + bit, value);
+        };
+        bool digitalRead(uint8_t pin) override {
+            return this->modem->ringIndicatorLevel();
+        };
+        bool digitalRead(uint8_t port, uint8_t bit) override {
+            return this->modem->ringIndicatorLevel();
+        };
+};
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Native serial used by tests
+ */
+#include <unity.h>
+#include <string.h>
+// project
+#include <hal.h>
+
+void testLoopbackSerialBulkRead() {
+    LoopbackSerial serial;
+    char bfr[16] = {0};
+    TEST_ASSERT_FALSE(serial.available());
+    TEST_ASSERT_EQUAL_INT(0, serial.readBytes(bfr, sizeof(bfr)));
+    serial.inject("OK\r\nREADY\r\n", 11);
+    // no more than asked for
+    TEST_ASSERT_EQUAL_INT(4, serial.readBytes(bfr, 4));
+    TEST_ASSERT_EQUAL_MEMORY("OK\r\n", bfr, 4);
+    // injected while data is pending
+    serial.inject("0\r\n", 3);
+    TEST_ASSERT_EQUAL_INT(10, serial.readBytes(bfr, sizeof(bfr)));
+    TEST_ASSERT_EQUAL_MEMORY("READY\r\n0\r\n", bfr, 10);
+    TEST_ASSERT_FALSE(serial.waitForData(100));
+    serial.inject("x", 1);
+    TEST_ASSERT_TRUE(serial.waitForData(100));
+    TEST_ASSERT_EQUAL_CHAR('x', serial.read());
+    serial.print("AT\r\n");
+    TEST_ASSERT_EQUAL_INT(4, serial.tx_len);
+    TEST_ASSERT_EQUAL_MEMORY("AT\r\n", serial.tx, 4);
+}
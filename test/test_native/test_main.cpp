@@ -1,6 +1,8 @@
 #include <unity.h>
-#include "test_scoutMessages.h"
+#include "test_hal.h"
 #include "test_rockBlock.h"
+#include "bench_rockblock.h"
+#include "test_rockblock9704.h"
 
 void setUp() {}
 
@@ -13,11 +15,26 @@ void tearDown() {}
  */
 int main() {
     UNITY_BEGIN();
-    // test the state object
-    RUN_TEST(test_createPK001);
-    RUN_TEST(test_float2Nmea);
-    RUN_TEST(test_epoch2utc);
-    RUN_TEST(test_parsePK006);
-    RUN_TEST(test_test);
+    RUN_TEST(testLoopbackSerialBulkRead);
+    // Rockblock against the emulated modem
+    RUN_TEST(testEmulatorSendText);
+    RUN_TEST(testEmulatorSendBinaryWithLocation);
+    RUN_TEST(testEmulatorRetryAfterFailure);
+    RUN_TEST(testEmulatorWriteFailure);
+    RUN_TEST(testEmulatorUpdateMessage);
+    RUN_TEST(testEmulatorLowSignal);
+    RUN_TEST(testEmulatorDrainQueuedMessages);
+    RUN_TEST(testEmulatorRingAlert);
+    RUN_TEST(testEmulatorLostResponse);
+    RUN_TEST(testEmulatorFlowControl);
+    RUN_TEST(testEmulatorTerseDialect);
+    // Rockblock9704 against the JSPR stand-in
+    RUN_TEST(testJsprSendText);
+    RUN_TEST(testJsprSendLargeBinary);
+    RUN_TEST(testJsprRetryAfterFailure);
+    RUN_TEST(testJsprUpdateMessage);
+    RUN_TEST(testJsprLowSignal);
+    RUN_TEST(testJsprReceive);
+    RUN_TEST(benchRockblockTraces);
     return UNITY_END();
 }
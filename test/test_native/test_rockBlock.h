@@ -1,59 +1,285 @@
-/* 
- * We currently not using native tests due to many time-consuming 
- * implementation difficulties. But I leave this here as a touch point.
+/*
+ * Drive Rockblock against the emulated modem in simulated time
  */
 #include <unity.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
 // project
 #include <hal.h>
 #include <tca95xx.h>
 #include <rockblock.h>
+#include "rockblockEmulator.h"
 
+// loop periods of Task_rockblock in ms
+#define ROCKBLOCK_LOOP_PERIOD 100
+#define ROCKBLOCK_BUSY_LOOP_PERIOD 10
 
-class MockSerial: public AbstractSerial {
-    private:
-        char readBuffer[255] = {0};
-        char printBuffer[255] = {0};
-        bool avail = false;
-        size_t idx = -1;
-    public:
-        // Methods of the base class used by the tested code
-        char read() override {
-            idx ++;
-            if (idx > 254) return 0;
-            return readBuffer[idx];
-         }
-        void begin(uint16_t serialSpeed, int serial8N1,
-            uint8_t rxPin, uint8_t txPin) override {};
-        void print(const char *bfr) override { snprintf(printBuffer, 255, bfr); }
-        bool available() override { return true; }
-        // Methods specific to this mock
-        void setReadBuffer(char *bfr) { snprintf(readBuffer, 255, bfr); }
-        void getPrintBuffer(char *bfr) { snprintf(bfr, 255, printBuffer); }
-        void setAvailable(bool on) { avail = on; }
-};
-
-
-class MockExpander: public AbstractExpander {
-    public:
-        MockExpander() {};
-        void begin(uint8_t i2c_address) override {};
-        void init() override {};
-        void pinMode(uint8_t pin, bool mode) override {};
-        void pinMode(uint8_t port, uint8_t bit, bool mode) override {};
-        void digitalWrite(uint8_t pin, bool value) override {};
-        void digitalWrite(uint8_t port, uint8_t bit, bool value) override {};
-        bool digitalRead(uint8_t pin) override { return true; };
-        bool digitalRead(uint8_t port, uint8_t bit) override { return true; };
-};
-
-
-void test_test() {
-    char bfr[20] = {0};
-    MockSerial serial;
-    MockExpander expander;
-    Rockblock rb(expander, serial);
-    rb.toggle(true);
-    serial.setReadBuffer("Hello World!");
-    TEST_ASSERT_EQUAL_CHAR(serial.read(), 'H');
-};
\ No newline at end of file
+/*
+ * Run the Rockblock loop as Task_rockblock does until done() returns true or
+ * the limit (ms) is reached. Returns the elapsed simulated time in ms.
+ * Works for both drivers and their emulators.
+ */
+template <typename Radio, typename Modem, typename Done>
+uint32_t runRockblock(Radio &rb, Modem &modem, Done done,
+    uint32_t limit
+) {
+    uint32_t elapsed = 0;
+    while (!done() && elapsed < limit) {
+        uint32_t period = rb.commandPending() ?
+            ROCKBLOCK_BUSY_LOOP_PERIOD : ROCKBLOCK_LOOP_PERIOD;
+        advanceNativeTime(period * 1000);
+        elapsed += period;
+        rb.ringIndicator(modem.ringIndicatorLevel());
+        rb.loop();
+    }
+    return elapsed;
+}
+
+void testEmulatorSendText() {
+    char bfr[32] = "PK101;test";
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    uint32_t elapsed = runRockblock(
+        rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    TEST_ASSERT_EQUAL_STRING("PK101;test\r", modem.delivered[0].c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, modem.sessions);
+    // +CSQ and +SBDIX dominate, the other commands run back to back
+    TEST_ASSERT_GREATER_OR_EQUAL(
+        modem.csq_latency + modem.session_latency, elapsed);
+    TEST_ASSERT_LESS_THAN(
+        modem.csq_latency + modem.session_latency + 500, elapsed);
+}
+
+void testEmulatorSendBinaryWithLocation() {
+    const uint8_t message[] = {0x14, 0x00, '\r', '\n', 0xff};
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    rb.toggle(true);
+    rb.sendMessage(message, sizeof(message), 37.5, -122.25);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    TEST_ASSERT_EQUAL_INT(sizeof(message), modem.delivered[0].size());
+    TEST_ASSERT_EQUAL_MEMORY(message, modem.delivered[0].data(), sizeof(message));
+    TEST_ASSERT_EQUAL_STRING("+3730.000,-12215.000", modem.location.c_str());
+}
+
+void testEmulatorRetryAfterFailure() {
+    char bfr[32] = "PK101;retry";
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    modem.results = {18, 0};
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 120000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_UINT32(2, modem.sessions);
+    // the MO buffer is written once
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+}
+
+void testEmulatorWriteFailure() {
+    uint8_t message[] = {0x14, 0x00, 0x01};
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    // checksum error, then written
+    modem.write_results = {2};
+    rb.toggle(true);
+    rb.sendMessage(message, sizeof(message));
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_UINT32(2, modem.writes);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    // the modem keeps rejecting the message, it is dropped
+    modem.write_results = {1, 2, 1, 0};
+    message[2] = 0x02;
+    rb.sendMessage(message, sizeof(message));
+    runRockblock(rb, modem, [&]() { return false; }, 60000);
+    TEST_ASSERT_FALSE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_UINT32(2 + WRITE_ATTEMPTS, modem.writes);
+    TEST_ASSERT_EQUAL_UINT32(1, modem.sessions);
+    // a message of the wrong size is not written again
+    modem.write_results = {3, 0};
+    message[2] = 0x03;
+    rb.sendMessage(message, sizeof(message));
+    runRockblock(rb, modem, [&]() { return false; }, 60000);
+    TEST_ASSERT_FALSE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_UINT32(3 + WRITE_ATTEMPTS, modem.writes);
+}
+
+void testEmulatorUpdateMessage() {
+    char bfr[32] = "PK101;sog 0.2";
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    modem.setSignal(1);
+    rb.toggle(true);
+    rb.sendMessage(bfr, 37.5, -122.25);
+    // written, waiting for signal
+    runRockblock(rb, modem, [&]() { return modem.polls > 0; }, 30000);
+    TEST_ASSERT_EQUAL_INT(COM_CHECK, rb.state);
+    strcpy(bfr, "PK101;sog 0.5");
+    TEST_ASSERT_TRUE(rb.updateMessage(bfr));
+    modem.setSignal(5);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_UINT32(1, modem.sessions);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    TEST_ASSERT_EQUAL_STRING("PK101;sog 0.5\r", modem.delivered[0].c_str());
+    // the location of the session header is kept
+    TEST_ASSERT_EQUAL_STRING("+3730.000,-12215.000", modem.location.c_str());
+    // too late
+    TEST_ASSERT_FALSE(rb.updateMessage(bfr));
+}
+
+void testEmulatorLowSignal() {
+    char bfr[32] = "PK101;low";
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    modem.setSignal(1);
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 30000);
+    TEST_ASSERT_FALSE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_UINT32(0, modem.sessions);
+    TEST_ASSERT_GREATER_THAN(1, modem.polls);
+}
+
+void testEmulatorDrainQueuedMessages() {
+    char bfr[32] = "PK101;drain";
+    char incoming[MAX_MESSAGE_SIZE] = {0};
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    modem.mt_queue = {"+DATA:PK006,60;", "+DATA:PK008,1;", "+DATA:PK006,30;"};
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 180000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_UINT32(3, modem.sessions);
+    TEST_ASSERT_EQUAL_INT(3, rb.getIncomingSize());
+    rb.getIncoming(2, incoming);
+    TEST_ASSERT_EQUAL_STRING("+DATA:PK006,30;", incoming);
+    // mailbox checks do not send our message again
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+}
+
+void testEmulatorRingAlert() {
+    char bfr[32] = "PK101;ring";
+    char incoming[MAX_MESSAGE_SIZE] = {0};
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    modem.mt_queue.push_back("+DATA:PK007,86400;");
+    modem.ringAlert();
+    runRockblock(
+        rb, modem, [&]() { return rb.getIncomingCount() > 0; }, 60000);
+    TEST_ASSERT_EQUAL_UINT16(1, rb.getIncomingCount());
+    rb.getLastIncoming(incoming);
+    TEST_ASSERT_EQUAL_STRING("+DATA:PK007,86400;", incoming);
+    TEST_ASSERT_FALSE(modem.ring_indicator);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+}
+
+void testEmulatorLostResponse() {
+    char bfr[32] = "PK101;lost";
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    // +SBDD2 and the following +SBDMTA are not answered
+    modem.drop_responses = 2;
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    uint32_t elapsed = runRockblock(
+        rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_GREATER_OR_EQUAL(2 * DEFAULT_COMMAND_TIMEOUT, elapsed);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+}
+
+void testEmulatorFlowControl() {
+    char bfr[32] = "PK101;cts";
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    rb.setFlowControl(17);
+    rb.toggle(true);
+    // RTS asserted (low) while on
+    TEST_ASSERT_EQUAL_INT(0, expander.pins[17]);
+    rb.sendMessage(bfr);
+    // CTS not asserted, nothing is sent
+    rb.clearToSend(1);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 10000);
+    TEST_ASSERT_FALSE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(0, modem.delivered.size());
+    rb.clearToSend(0);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    rb.toggle(false);
+    TEST_ASSERT_EQUAL_INT(1, expander.pins[17]);
+}
+
+/*
+ * Send a message and receive the MT messages queued at the gateway, returns
+ * the UART traffic in bytes
+ */
+uint32_t exchangeMessages(bool terse, std::vector<std::string> &received) {
+    char bfr[32] = "PK101;terse";
+    char incoming[MAX_MESSAGE_SIZE] = {0};
+    RockblockEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock rb(expander, modem, 1);
+    rb.setTerse(terse);
+    modem.mt_queue = {"+DATA:PK006,60;", "0\r\nOK\r\n"};
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 120000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    TEST_ASSERT_EQUAL_STRING("PK101;terse\r", modem.delivered[0].c_str());
+    for (size_t i = 0; i < rb.getIncomingSize(); i++) {
+        size_t len = rb.getIncoming(i, incoming);
+        received.push_back(std::string(incoming, len));
+    }
+    // a ring alert after the dialect has been switched
+    modem.mt_queue.push_back("+DATA:PK007,86400;");
+    modem.ringAlert();
+    runRockblock(
+        rb, modem, [&]() { return rb.getIncomingCount() > 2; }, 60000);
+    rb.getLastIncoming(incoming);
+    received.push_back(incoming);
+    return modem.bytes_received + modem.bytes_sent;
+}
+
+void testEmulatorTerseDialect() {
+    std::vector<std::string> verbose;
+    std::vector<std::string> terse;
+    uint32_t verbose_traffic = exchangeMessages(false, verbose);
+    uint32_t terse_traffic = exchangeMessages(true, terse);
+    // same messages, status words in a message do not matter anymore
+    TEST_ASSERT_EQUAL_INT(3, terse.size());
+    TEST_ASSERT_EQUAL_STRING("+DATA:PK006,60;", terse[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("0\r\nOK\r\n", terse[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("+DATA:PK007,86400;", terse[2].c_str());
+    TEST_ASSERT_EQUAL_STRING(verbose[0].c_str(), terse[0].c_str());
+    TEST_ASSERT_EQUAL_STRING(verbose[2].c_str(), terse[2].c_str());
+    printf("UART traffic verbose: %u bytes, terse: %u bytes\n",
+        verbose_traffic, terse_traffic);
+    TEST_ASSERT_LESS_THAN(verbose_traffic * 2 / 3, terse_traffic);
+}
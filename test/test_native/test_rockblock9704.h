@@ -0,0 +1,125 @@
+/*
+ * Drive Rockblock9704 against the JSPR stand-in in simulated time, see
+ * runRockblock() in test_rockBlock.h
+ */
+#include <unity.h>
+#include <stdint.h>
+#include <string>
+// project
+#include <hal.h>
+#include <rockblock9704.h>
+#include "jsprEmulator.h"
+
+void testJsprSendText() {
+    char bfr[32] = "PK101;imt";
+    JsprEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock9704 rb(expander, modem, 1);
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    uint32_t elapsed = runRockblock(
+        rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(IDLE, rb.state);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    TEST_ASSERT_EQUAL_STRING("PK101;imt", modem.delivered[0].c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, modem.segments);
+    TEST_ASSERT_GREATER_OR_EQUAL(modem.session_latency, elapsed);
+    TEST_ASSERT_LESS_THAN(modem.session_latency + 1000, elapsed);
+}
+
+void testJsprSendLargeBinary() {
+    uint8_t message[1500];
+    for (size_t i = 0; i < sizeof(message); i++) { message[i] = i * 7; }
+    JsprEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock9704 rb(expander, modem, 1);
+    rb.toggle(true);
+    // the location is not sent, it has to be part of the payload
+    rb.sendMessage(message, sizeof(message), 37.5, -122.25);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    TEST_ASSERT_EQUAL_INT(sizeof(message), modem.delivered[0].size());
+    TEST_ASSERT_EQUAL_MEMORY(
+        message, modem.delivered[0].data(), sizeof(message));
+    // larger than a 9603 message, sent in two segments
+    TEST_ASSERT_EQUAL_UINT32(2, modem.segments);
+}
+
+void testJsprRetryAfterFailure() {
+    char bfr[32] = "PK101;retry";
+    JsprEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock9704 rb(expander, modem, 1);
+    modem.results = {false, true};
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 180000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_UINT32(2, modem.sessions);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+}
+
+void testJsprUpdateMessage() {
+    char bfr[32] = "PK101;sog 0.2";
+    JsprEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock9704 rb(expander, modem, 1);
+    modem.signal = 0;
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(rb, modem, [&]() { return false; }, 5000);
+    TEST_ASSERT_EQUAL_INT(COM_CHECK, rb.state);
+    strcpy(bfr, "PK101;sog 0.5");
+    TEST_ASSERT_TRUE(rb.updateMessage(bfr));
+    modem.signal = 5;
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(1, modem.delivered.size());
+    TEST_ASSERT_EQUAL_STRING("PK101;sog 0.5", modem.delivered[0].c_str());
+    TEST_ASSERT_FALSE(rb.updateMessage(bfr));
+}
+
+void testJsprLowSignal() {
+    char bfr[32] = "PK101;low";
+    JsprEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock9704 rb(expander, modem, 1);
+    modem.signal = 0;
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(rb, modem, [&]() { return rb.sendSuccess; }, 30000);
+    TEST_ASSERT_FALSE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(COM_CHECK, rb.state);
+    TEST_ASSERT_EQUAL_UINT32(0, modem.sessions);
+}
+
+void testJsprReceive() {
+    char bfr[32] = "PK101;mt";
+    char incoming[MAX_MESSAGE_SIZE] = {0};
+    std::string config = "+DATA:PK006,60;";
+    JsprEmulator modem;
+    EmulatorExpander expander(modem);
+    Rockblock9704 rb(expander, modem, 1);
+    // split into segments
+    modem.segment_size = 8;
+    modem.mt_queue = {config};
+    rb.toggle(true);
+    rb.sendMessage(bfr);
+    runRockblock(
+        rb, modem, [&]() { return rb.getIncomingCount() > 0; }, 60000);
+    TEST_ASSERT_TRUE(rb.sendSuccess);
+    TEST_ASSERT_EQUAL_INT(1, rb.getIncomingSize());
+    rb.getLastIncoming(incoming);
+    TEST_ASSERT_EQUAL_STRING(config.c_str(), incoming);
+    // pushed while idle
+    modem.mt_queue = {"+DATA:PK007,86400;"};
+    modem.deliver();
+    runRockblock(
+        rb, modem, [&]() { return rb.getIncomingCount() > 1; }, 10000);
+    TEST_ASSERT_EQUAL_INT(2, rb.getIncomingSize());
+    rb.getLastIncoming(incoming);
+    TEST_ASSERT_EQUAL_STRING("+DATA:PK007,86400;", incoming);
+    TEST_ASSERT_EQUAL_INT(IDLE, rb.state);
+}